@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+# Sarus
+#
+# Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+#
+# Please, refer to the LICENSE file in the root directory.
+# SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Measures the cold-cache startup time of a containerized application with and
+without laying out the squashfs image according to an access profile.
+
+The same image archive is loaded twice into the local repository, once with
+'sarus load --access-profile' and once without. Then the application is run
+alternately from the two images: before each run, the page cache of the
+squashfs files is dropped, so that the files of the image are read again from
+the filesystem hosting the repository (ideally a network filesystem, where the
+layout of the image matters most).
+
+Example:
+
+    $ docker save python:3.11 -o python.tar
+    $ ./benchmark_access_profile.py --archive python.tar --profile python-profile.txt \\
+          --repetitions 10 -- python3 -c "import json, decimal, asyncio"
+"""
+
+import argparse
+import json
+import os
+import pwd
+import statistics
+import subprocess
+import sys
+import time
+
+
+IMAGE_NAMES = {"default": "benchmark/access-profile:default",
+               "profile": "benchmark/access-profile:profile"}
+
+
+def get_local_repository_path(sarus_json_filename):
+    with open(sarus_json_filename) as sarus_json:
+        repo_base = json.load(sarus_json)["localRepositoryBaseDir"]
+    return os.path.join(repo_base, pwd.getpwuid(os.geteuid()).pw_name, ".sarus")
+
+
+def get_squashfs_file(repository, image_name):
+    name, tag = image_name.split(":")
+    return os.path.join(repository, "images", "load", name, tag + ".squashfs")
+
+
+def load_images(archive, profile, temp_dir):
+    for variant, image_name in IMAGE_NAMES.items():
+        command = ["sarus", "load"]
+        if temp_dir:
+            command += ["--temp-dir", temp_dir]
+        if variant == "profile":
+            command += ["--access-profile", profile]
+        command += [archive, image_name]
+        print("Loading {}: {}".format(variant, " ".join(command)))
+        subprocess.check_call(command, stdout=subprocess.DEVNULL)
+
+
+def drop_page_cache(path, drop_all):
+    if drop_all:
+        # requires root privileges: also drops the caches of the filesystem metadata
+        subprocess.check_call(["sync"])
+        with open("/proc/sys/vm/drop_caches", "w") as f:
+            f.write("3\n")
+        return
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        os.fsync(fd)
+        os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+    finally:
+        os.close(fd)
+
+
+def run_application(image_name, command):
+    start = time.monotonic()
+    subprocess.check_call(["sarus", "run", image_name] + command,
+                          stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return time.monotonic() - start
+
+
+def print_summary(results):
+    print()
+    print("{:<10} {:>10} {:>10} {:>10} {:>10}".format("variant", "min [s]", "median [s]", "mean [s]", "stdev [s]"))
+    for variant, durations in results.items():
+        stdev = statistics.stdev(durations) if len(durations) > 1 else 0.0
+        print("{:<10} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}".format(
+            variant, min(durations), statistics.median(durations), statistics.mean(durations), stdev))
+    speedup = statistics.median(results["default"]) / statistics.median(results["profile"])
+    print()
+    print("Median speedup with access profile: {:.2f}x".format(speedup))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--archive", help="Docker archive of the image (e.g. from 'docker save')")
+    parser.add_argument("--profile", help="Access profile of the application")
+    parser.add_argument("--repetitions", type=int, default=5, help="Number of cold-cache runs of each variant")
+    parser.add_argument("--temp-dir", help="Temporary directory used by 'sarus load'")
+    parser.add_argument("--sarus-json",
+                        default=os.path.join(os.environ.get("CMAKE_INSTALL_PREFIX", "/opt/sarus/default"), "etc/sarus.json"),
+                        help="Configuration file of Sarus, used to find the local repository")
+    parser.add_argument("--skip-load", action="store_true", help="Reuse the images loaded by a previous invocation")
+    parser.add_argument("--drop-all-caches", action="store_true",
+                        help="Drop all the page, dentry and inode caches of the node before each run (requires root)")
+    parser.add_argument("command", nargs=argparse.REMAINDER, help="Command measured in the container")
+    args = parser.parse_args()
+
+    command = args.command[1:] if args.command[:1] == ["--"] else args.command
+    if not command:
+        parser.error("missing command to run in the container")
+    if not args.skip_load and not (args.archive and args.profile):
+        parser.error("--archive and --profile are required to load the images")
+
+    repository = get_local_repository_path(args.sarus_json)
+    if not args.skip_load:
+        load_images(args.archive, args.profile, args.temp_dir)
+
+    squashfs_files = {variant: get_squashfs_file(repository, image_name)
+                      for variant, image_name in IMAGE_NAMES.items()}
+    for variant, squashfs_file in squashfs_files.items():
+        print("{} image: {} ({} bytes)".format(variant, squashfs_file, os.path.getsize(squashfs_file)))
+
+    results = {variant: [] for variant in IMAGE_NAMES}
+    for repetition in range(args.repetitions):
+        # alternate the variants to spread the effects of the load of the filesystem
+        variants = list(IMAGE_NAMES) if repetition % 2 == 0 else list(reversed(list(IMAGE_NAMES)))
+        for variant in variants:
+            drop_page_cache(squashfs_files[variant], args.drop_all_caches)
+            duration = run_application(IMAGE_NAMES[variant], command)
+            results[variant].append(duration)
+            print("run {:>3} {:<10} {:.3f} s".format(repetition, variant, duration))
+
+    print_summary(results)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+# Sarus
+#
+# Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+#
+# Please, refer to the LICENSE file in the root directory.
+# SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Compares the squashfs and EROFS image formats side by side.
+
+The same unpacked root filesystem is converted into a squashfs image with
+mksquashfs and into an EROFS image with mkfs.erofs, using the options that
+would be set in the Sarus configuration ('mksquashfsOptions', and
+'erofsCompression'/'erofsChunkSizeKB'). For each format the script reports the
+conversion time, the image size and the latency of opening and reading a
+sample of files of the image:
+
+  * cold: the image is loop mounted again and its page cache is dropped before
+    each repetition, so that the data is read from the filesystem hosting the
+    image and decompressed;
+  * warm: the files are read again from the same mount.
+
+Mounting the images requires root privileges.
+
+Example:
+
+    $ umoci raw unpack --image python:3.11 rootfs
+    $ sudo ./benchmark_image_formats.py --rootfs rootfs --work-dir /scratch/benchmark \\
+          --erofs-options="-zlz4" --repetitions 10 \\
+          --files /usr/bin/python3.11 /usr/lib/python3.11/json/__init__.py
+"""
+
+import argparse
+import os
+import random
+import shlex
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def build_images(rootfs, work_dir, mksquashfs_options, erofs_options):
+    images = {}
+    commands = {
+        "squashfs": lambda image: ["mksquashfs", rootfs, image, "-noappend"] + shlex.split(mksquashfs_options),
+        "erofs": lambda image: ["mkfs.erofs"] + shlex.split(erofs_options) + [image, rootfs],
+    }
+    for image_format, command in commands.items():
+        image = os.path.join(work_dir, "image." + image_format)
+        if os.path.exists(image):
+            os.remove(image)
+        print("Building {} image: {}".format(image_format, " ".join(command(image))))
+        start = time.monotonic()
+        subprocess.check_call(command(image), stdout=subprocess.DEVNULL)
+        images[image_format] = {"file": image,
+                                "conversion": time.monotonic() - start,
+                                "size": os.path.getsize(image)}
+    return images
+
+
+def sample_files(rootfs, count, seed):
+    files = []
+    for directory, _, filenames in os.walk(rootfs):
+        for filename in filenames:
+            path = os.path.join(directory, filename)
+            if os.path.isfile(path) and not os.path.islink(path):
+                files.append("/" + os.path.relpath(path, rootfs))
+    files.sort()
+    random.Random(seed).shuffle(files)
+    return files[:count]
+
+
+def mount_image(image, image_format, mount_point):
+    subprocess.check_call(["mount", "-n", "-o", "loop,nosuid,nodev,ro", "-t", image_format, image, mount_point])
+
+
+def umount_image(mount_point):
+    subprocess.check_call(["umount", mount_point])
+
+
+def drop_page_cache(path):
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+    finally:
+        os.close(fd)
+
+
+def read_files(mount_point, files):
+    start = time.monotonic()
+    for path in files:
+        with open(os.path.join(mount_point, path.lstrip("/")), "rb") as f:
+            while f.read(1 << 20):
+                pass
+    return time.monotonic() - start
+
+
+def measure_latency(image, image_format, files, repetitions):
+    results = {"cold": [], "warm": []}
+    with tempfile.TemporaryDirectory(prefix="sarus-benchmark-mount") as mount_point:
+        for _ in range(repetitions):
+            drop_page_cache(image)
+            mount_image(image, image_format, mount_point)
+            try:
+                results["cold"].append(read_files(mount_point, files))
+                results["warm"].append(read_files(mount_point, files))
+            finally:
+                umount_image(mount_point)
+    return results
+
+
+def print_summary(images):
+    print()
+    print("{:<10} {:>14} {:>14} {:>14} {:>14}".format(
+        "format", "convert [s]", "size [MiB]", "cold [ms]", "warm [ms]"))
+    for image_format, image in images.items():
+        print("{:<10} {:>14.2f} {:>14.1f} {:>14.1f} {:>14.1f}".format(
+            image_format, image["conversion"], image["size"] / 2**20,
+            statistics.median(image["latency"]["cold"]) * 1000,
+            statistics.median(image["latency"]["warm"]) * 1000))
+    print()
+    print("Latencies are medians of the time to open and read the sampled files.")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--rootfs", required=True, help="Unpacked root filesystem of the image")
+    parser.add_argument("--work-dir", default=".", help="Directory where the images are built")
+    parser.add_argument("--mksquashfs-options", default="-comp gzip -Xcompression-level 6",
+                        help="Options of mksquashfs, as in the 'mksquashfsOptions' parameter")
+    parser.add_argument("--erofs-options", default="",
+                        help="Options of mkfs.erofs, e.g. '-zlz4' or '--chunksize=65536'")
+    parser.add_argument("--files", nargs="+", help="Files of the image to open and read (default: a random sample)")
+    parser.add_argument("--sample-size", type=int, default=200, help="Number of files of the random sample")
+    parser.add_argument("--seed", type=int, default=0, help="Seed of the random sample")
+    parser.add_argument("--repetitions", type=int, default=5, help="Number of measurements of each format")
+    args = parser.parse_args()
+
+    if os.geteuid() != 0:
+        parser.error("root privileges are required to loop mount the images")
+
+    files = args.files or sample_files(args.rootfs, args.sample_size, args.seed)
+    print("Reading {} files of the image".format(len(files)))
+
+    images = build_images(args.rootfs, args.work_dir, args.mksquashfs_options, args.erofs_options)
+    for image_format, image in images.items():
+        print("{} image: {} ({} bytes, built in {:.2f} s)".format(
+            image_format, image["file"], image["size"], image["conversion"]))
+        image["latency"] = measure_latency(image["file"], image_format, files, args.repetitions)
+
+    print_summary(images)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -79,6 +79,21 @@ class TestCommandRun(unittest.TestCase):
         self.assertEqual(processes[0], {"pid": 1, "comm": "init"})
         self.assertEqual(processes[1]["comm"], "ps")
 
+    def test_read_only_rootfs(self):
+        util.pull_image_if_necessary(is_centralized_repository=False, image=self.DEFAULT_IMAGE)
+
+        # the image is not writable
+        command = ["sarus", "run", "--read-only", self.DEFAULT_IMAGE, "touch", "/file-in-read-only-rootfs"]
+        output = util.get_sarus_error_output(command)
+        assert "Read-only file system" in output
+        # /etc, /tmp and /run are
+        for path in ["/etc/file-of-test", "/tmp/file-of-test", "/run/file-of-test"]:
+            out = util.run_command_in_container(is_centralized_repository=False,
+                                                image=self.DEFAULT_IMAGE,
+                                                command=["sh", "-c", f"echo test > {path} && cat {path}"],
+                                                options_of_run_command=["--read-only"])
+            self.assertEqual(out, ["test"])
+
     def test_cleanup_image_without_backing_file(self):
         util.pull_image_if_necessary(is_centralized_repository=False, image=self.DEFAULT_IMAGE)
         util.remove_image_backing_file(self.DEFAULT_IMAGE)
@@ -0,0 +1,160 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef cli_CommandExec_hpp
+#define cli_CommandExec_hpp
+
+#include "cli/Command.hpp"
+#include "cli/HelpMessage.hpp"
+#include "cli/Utility.hpp"
+
+#include <libsarus/Utility.hpp>
+#include <runtime/PersistentContainer.hpp>
+#include <runtime/Utility.hpp>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+namespace sarus {
+namespace cli {
+
+class CommandExec : public Command {
+public:
+  CommandExec() {
+    initializeOptionsDescription();
+  }
+
+  CommandExec(const libsarus::CLIArguments &args, std::shared_ptr<common::Config> conf)
+      : conf{std::move(conf)} {
+    initializeOptionsDescription();
+    parseCommandArguments(args);
+  }
+
+  void execute() override {
+    libsarus::logMessage(boost::format("exec in container: %s") % containerName, libsarus::LogLevel::INFO);
+
+    auto container = runtime::PersistentContainer{conf->userIdentity, containerName};
+    if (!container.exists()) {
+      auto message = boost::format("No container named %s is running in the background.\n"
+                                   "Hint: start one with 'sarus run --detach --name %s'") % containerName % containerName;
+      cli::utility::printLog(message, libsarus::LogLevel::GENERAL, std::cerr);
+      SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+    }
+
+    auto runcPath = conf->json["runcPath"].GetString();
+    auto args = libsarus::CLIArguments{runcPath,
+                                       "--root", "/run/runc/" + std::to_string(conf->userIdentity.uid),
+                                       "exec"};
+    if (allocatePseudoTTY) {
+      args.push_back("--tty");
+    }
+    if (!workdir.empty()) {
+      args.push_back("--cwd");
+      args.push_back(workdir);
+    }
+    for (const auto& variable : env) {
+      args.push_back("--env");
+      args.push_back(variable);
+    }
+    args.push_back(containerName);
+    args += execArgs;
+
+    // the container is not idle while the process is attached
+    auto activityLock = container.lockActivity();
+    container.recordActivity();
+
+    // execute runc
+    auto status = libsarus::process::forkExecWait(args, {}, std::function<void(pid_t)>{runtime::utility::setupSignalProxying});
+
+    container.recordActivity();
+
+    if (status != 0) {
+      auto message = boost::format("%s exited with code %d") % args % status;
+      libsarus::logMessage(message, libsarus::LogLevel::INFO);
+      exit(status);
+    }
+  };
+
+  bool requiresRootPrivileges() const override { return true; };
+  std::string getBriefDescription() const override { return "Run a command in a container started with 'sarus run --detach'"; };
+  void printHelpMessage() const override {
+    auto printer = cli::HelpMessage()
+                       .setUsage("sarus exec [OPTIONS] NAME COMMAND [ARG...]\n")
+                       .setDescription(getBriefDescription())
+                       .setOptionsDescription(optionsDescription);
+    std::cout << printer;
+  };
+
+private:
+  void initializeOptionsDescription() {
+    optionsDescription.add_options()
+        ("env,e",
+            boost::program_options::value<std::vector<std::string>>(&env),
+            "Set environment variables for the command")
+        ("tty,t", "Allocate a pseudo-TTY for the command")
+        ("workdir,w",
+            boost::program_options::value<std::string>(&workdir),
+            "Set working directory of the command inside the container");
+  }
+
+  void parseCommandArguments(const libsarus::CLIArguments &args) {
+    cli::utility::printLog("parsing CLI arguments of exec command", libsarus::LogLevel::DEBUG);
+
+    libsarus::CLIArguments nameAndOptionArgs, positionalArgs;
+    std::tie(nameAndOptionArgs, positionalArgs) = cli::utility::groupOptionsAndPositionalArguments(args, optionsDescription);
+
+    // the exec command expects at least two positional arguments (the container name and the command)
+    cli::utility::validateNumberOfPositionalArguments(positionalArgs, 2, INT_MAX, "exec");
+
+    try {
+      boost::program_options::variables_map values;
+      boost::program_options::parsed_options parsed =
+          boost::program_options::command_line_parser(nameAndOptionArgs.argc(), nameAndOptionArgs.argv())
+                  .options(optionsDescription)
+                  .style(boost::program_options::command_line_style::unix_style)
+                  .run();
+      boost::program_options::store(parsed, values);
+      boost::program_options::notify(values);
+
+      containerName = positionalArgs.argv()[0];
+      runtime::PersistentContainer::validateName(containerName);
+      execArgs = libsarus::CLIArguments(positionalArgs.begin()+1, positionalArgs.end());
+
+      allocatePseudoTTY = values.count("tty");
+
+      for (const auto& variable : env) {
+        libsarus::environment::parseVariable(variable);
+      }
+
+      if (!workdir.empty() && !boost::filesystem::path{workdir}.is_absolute()) {
+        auto message = boost::format("The working directory '%s' is invalid, it"
+                                     " needs to be an absolute path.") % workdir;
+        SARUS_THROW_ERROR(message.str());
+      }
+    } catch (std::exception &e) {
+      auto message = boost::format("%s\nSee 'sarus help exec'") % e.what();
+      cli::utility::printLog(message, libsarus::LogLevel::GENERAL, std::cerr);
+      SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+    }
+  }
+
+  boost::program_options::options_description optionsDescription{"Options"};
+  std::string containerName;
+  libsarus::CLIArguments execArgs;
+  std::vector<std::string> env;
+  std::string workdir;
+  bool allocatePseudoTTY = false;
+  std::shared_ptr<common::Config> conf;
+};
+
+} // namespace cli
+} // namespace sarus
+
+#endif
@@ -69,7 +69,14 @@ private:
         visibleOptionsDescription.add_options()
             ("temp-dir",   boost::program_options::value<std::string>(&conf->directories.tempFromCLI),
                 "Temporary directory where the image is unpacked")
-            ("centralized-repository", "Use centralized repository instead of the local one");
+            ("centralized-repository", "Use centralized repository instead of the local one")
+            ("timing-report",
+                boost::program_options::value<std::string>(&timingReport),
+                "Write a JSON report with the duration of each load phase to the given file")
+            ("access-profile",
+                boost::program_options::value<std::string>(&accessProfile),
+                "File listing the paths accessed by the application in order of access, "
+                "used to lay out the files in the squashfs image");
         hiddenOptionsDescription.add_options()
             ("source-format", boost::program_options::value<std::string>(&sourceFormat)->default_value("docker-archive"),
                 "Format of the source archive");
@@ -105,6 +112,13 @@ private:
                 SARUS_THROW_ERROR("Destination image reference must not contain a digest when loading the image from a file");
             }
 
+            if(values.count("timing-report")) {
+                conf->timingReportFile = boost::filesystem::absolute(timingReport);
+            }
+            if(values.count("access-profile")) {
+                conf->accessProfileFile = boost::filesystem::absolute(accessProfile);
+            }
+
             conf->useCentralizedRepository = values.count("centralized-repository");
             conf->directories.initialize(conf->useCentralizedRepository, *conf);
         }
@@ -132,6 +146,8 @@ private:
     boost::program_options::options_description hiddenOptionsDescription{};
     std::shared_ptr<common::Config> conf;
     std::string sourceFormat;
+    std::string timingReport;
+    std::string accessProfile;
 };
 
 }
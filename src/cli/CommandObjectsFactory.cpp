@@ -11,16 +11,20 @@
 #include "CommandObjectsFactory.hpp"
 
 #include "cli/Utility.hpp"
+#include "cli/CommandExec.hpp"
 #include "cli/CommandHelp.hpp"
 #include "cli/CommandHelpOfCommand.hpp"
 #include "cli/CommandHooks.hpp"
 #include "cli/CommandImages.hpp"
+#include "cli/CommandPrune.hpp"
 #include "cli/CommandPs.hpp"
 #include "cli/CommandLoad.hpp"
 #include "cli/CommandPull.hpp"
+#include "cli/CommandResolve.hpp"
 #include "cli/CommandRmi.hpp"
 #include "cli/CommandRun.hpp"
 #include "cli/CommandSshKeygen.hpp"
+#include "cli/CommandStage.hpp"
 #include "cli/CommandKill.hpp"
 #include "cli/CommandVersion.hpp"
 
@@ -29,15 +33,19 @@ namespace sarus {
 namespace cli {
 
 CommandObjectsFactory::CommandObjectsFactory() {
+    addCommand<cli::CommandExec>("exec");
     addCommand<cli::CommandHelp>("help");
     addCommand<cli::CommandHooks>("hooks");
     addCommand<cli::CommandImages>("images");
     addCommand<cli::CommandLoad>("load");
+    addCommand<cli::CommandPrune>("prune");
     addCommand<cli::CommandPs>("ps");
     addCommand<cli::CommandPull>("pull");
+    addCommand<cli::CommandResolve>("resolve");
     addCommand<cli::CommandRmi>("rmi");
     addCommand<cli::CommandRun>("run");
     addCommand<cli::CommandSshKeygen>("ssh-keygen");
+    addCommand<cli::CommandStage>("stage");
     addCommand<cli::CommandKill>("kill");
     addCommand<cli::CommandVersion>("version");
 }
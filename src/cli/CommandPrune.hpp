@@ -0,0 +1,149 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef cli_CommandPrune_hpp
+#define cli_CommandPrune_hpp
+
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include "cli/Utility.hpp"
+#include "common/Config.hpp"
+#include "common/SarusImage.hpp"
+#include "cli/Command.hpp"
+#include "libsarus/CLIArguments.hpp"
+#include "cli/HelpMessage.hpp"
+#include "image_manager/RepositoryPruner.hpp"
+
+
+namespace sarus {
+namespace cli {
+
+class CommandPrune : public Command {
+public:
+    CommandPrune() {
+        initializeOptionsDescription();
+    }
+
+    CommandPrune(const libsarus::CLIArguments& args, std::shared_ptr<common::Config> conf)
+        : conf{std::move(conf)}
+    {
+        initializeOptionsDescription();
+        parseCommandArguments(args);
+    }
+
+    void execute() override {
+        const auto& prune = conf->commandPrune;
+        auto pruner = image_manager::RepositoryPruner{conf};
+
+        auto quota = pruner.getConfiguredQuota();
+        if(prune.quotaMB) {
+            quota = *prune.quotaMB * 1024 * 1024;
+        }
+
+        auto report = pruner.prune(prune.isDryRun, quota);
+
+        for(const auto& item : report.items) {
+            auto message = boost::format("%s %s: %s (%s)")
+                           % (prune.isDryRun ? "Would remove" : "Removed")
+                           % item.reason
+                           % item.path.string()
+                           % common::SarusImage::createSizeString(item.size);
+            cli::utility::printLog(message, libsarus::LogLevel::GENERAL);
+        }
+
+        auto imagesSize = boost::format("Size of images: %s") % common::SarusImage::createSizeString(report.imagesSizeAfter);
+        if(quota) {
+            imagesSize = boost::format("%s (quota: %s)") % imagesSize.str() % common::SarusImage::createSizeString(*quota);
+        }
+        cli::utility::printLog(imagesSize, libsarus::LogLevel::GENERAL);
+        cli::utility::printLog(boost::format("%s: %s")
+                                    % (prune.isDryRun ? "Reclaimable space" : "Reclaimed space")
+                                    % common::SarusImage::createSizeString(report.getReclaimableSize()),
+                               libsarus::LogLevel::GENERAL);
+    }
+
+    bool requiresRootPrivileges() const override {
+        return false;
+    }
+
+    std::string getBriefDescription() const override {
+        return "Reclaim space in the image repository";
+    }
+
+    void printHelpMessage() const override {
+        auto printer = cli::HelpMessage()
+            .setUsage("sarus prune [OPTIONS]\n"
+                "\n"
+                "Removes the files of the repository which do not belong to any image,\n"
+                "the temporary files abandoned by interrupted pulls and loads and, if a\n"
+                "quota is set, the least recently used images exceeding the quota.")
+            .setDescription(getBriefDescription())
+            .setOptionsDescription(optionsDescription);
+        std::cout << printer;
+    }
+
+private:
+    void initializeOptionsDescription() {
+        optionsDescription.add_options()
+            ("centralized-repository", "Use centralized repository instead of the local one")
+            ("dry-run", "Report the reclaimable space without removing anything")
+            ("quota",
+                boost::program_options::value<size_t>(),
+                "Maximum size of the images in megabytes (default: repositoryQuotaMB of the configuration)");
+    }
+
+    void parseCommandArguments(const libsarus::CLIArguments& args) {
+        cli::utility::printLog(boost::format("parsing CLI arguments of prune command"), libsarus::LogLevel::DEBUG);
+
+        libsarus::CLIArguments nameAndOptionArgs, positionalArgs;
+        std::tie(nameAndOptionArgs, positionalArgs) = cli::utility::groupOptionsAndPositionalArguments(args, optionsDescription);
+
+        // the prune command doesn't expect any positional argument
+        cli::utility::validateNumberOfPositionalArguments(positionalArgs, 0, 0, "prune");
+
+        try {
+            boost::program_options::variables_map values;
+            boost::program_options::store(
+                boost::program_options::command_line_parser(nameAndOptionArgs.argc(), nameAndOptionArgs.argv())
+                        .options(optionsDescription)
+                        .style(boost::program_options::command_line_style::unix_style)
+                        .run(), values);
+            boost::program_options::notify(values);
+
+            conf->useCentralizedRepository = values.count("centralized-repository");
+            conf->directories.initialize(conf->useCentralizedRepository, *conf);
+
+            conf->commandPrune.isDryRun = values.count("dry-run");
+            if(values.count("quota")) {
+                conf->commandPrune.quotaMB = values["quota"].as<size_t>();
+            }
+        }
+        catch (std::exception& e) {
+            auto message = boost::format("%s\nSee 'sarus help prune'") % e.what();
+            cli::utility::printLog(message, libsarus::LogLevel::GENERAL, std::cerr);
+            SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+        }
+
+        cli::utility::printLog(boost::format("successfully parsed CLI arguments"), libsarus::LogLevel::DEBUG);
+    }
+
+private:
+    boost::program_options::options_description optionsDescription{"Options"};
+    std::shared_ptr<common::Config> conf;
+};
+
+}
+}
+
+#endif
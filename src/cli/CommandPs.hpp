@@ -15,6 +15,9 @@
 #include "cli/HelpMessage.hpp"
 #include "cli/Utility.hpp"
 
+#include <ctime>
+
+#include <runtime/PersistentContainer.hpp>
 #include <runtime/Runtime.hpp>
 #include <runtime/Utility.hpp>
 
@@ -47,10 +50,11 @@ public:
       exit(status);
     }
 
+    printPersistentContainers();
   };
 
   bool requiresRootPrivileges() const override { return true; };
-  std::string getBriefDescription() const override { return "List running containers"; }
+  std::string getBriefDescription() const override { return "List running containers, including those started with 'sarus run --detach'"; }
 
   void printHelpMessage() const override {
     auto printer = cli::HelpMessage()
@@ -60,6 +64,26 @@ public:
   };
 
   private:
+  // containers started with "sarus run --detach"
+  void printPersistentContainers() const {
+    auto containers = runtime::PersistentContainer::list(conf->userIdentity);
+    if (containers.empty()) {
+      return;
+    }
+
+    auto format = boost::format("%-24.24s %-40.40s %-20s %-12s %s\n");
+    std::cout << "\nContainers started with 'sarus run --detach':\n";
+    std::cout << format % "NAME" % "IMAGE" % "CREATED" % "IDLE TIMEOUT" % "SLURM JOB";
+    for (const auto& container : containers) {
+      char created[32];
+      std::strftime(created, sizeof(created), "%Y-%m-%dT%H:%M:%S", std::localtime(&container.creationTime));
+      auto timeout = container.idleTimeout.count() > 0
+        ? std::to_string(container.idleTimeout.count()) + "s" : std::string{"none"};
+      auto job = container.slurmJobID.empty() ? std::string{"-"} : container.slurmJobID;
+      std::cout << format % container.name % container.image % created % timeout % job;
+    }
+  }
+
   std::shared_ptr<common::Config> conf;
 };
 
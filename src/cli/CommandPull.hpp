@@ -77,7 +77,16 @@ private:
             ("username,u",
                 boost::program_options::value<std::string>(&username),
                 "Username for private repository")
-            ("centralized-repository", "Use centralized repository instead of the local one");
+            ("centralized-repository", "Use centralized repository instead of the local one")
+            ("timing-report",
+                boost::program_options::value<std::string>(&timingReport),
+                "Write a JSON report with the duration of each pull phase to the given file")
+            ("access-profile",
+                boost::program_options::value<std::string>(&accessProfile),
+                "File listing the paths accessed by the application in order of access, "
+                "used to lay out the files in the squashfs image")
+            ("lazy", "Store only the index of the eStargz layers of the image and fetch its "
+                     "file data in the background. The image is converted at its first run");
         hiddenOptionsDescription.add_options()
             ("containers-storage", "Pull from a local containers/storage image store");
         allOptionsDescription.add(visibleOptionsDescription).add(hiddenOptionsDescription);
@@ -128,6 +137,20 @@ private:
             }
 
             conf->imageReference = cli::utility::parseImageReference(positionalArgs.argv()[0]);
+            if(values.count("timing-report")) {
+                conf->timingReportFile = boost::filesystem::absolute(timingReport);
+            }
+            if(values.count("access-profile")) {
+                conf->accessProfileFile = boost::filesystem::absolute(accessProfile);
+            }
+            conf->lazyPull = values.count("lazy");
+            if(conf->lazyPull && transport != "docker") {
+                SARUS_THROW_ERROR("The option '--lazy' can only be used to pull from a registry");
+            }
+            if(conf->lazyPull && !conf->accessProfileFile.empty()) {
+                SARUS_THROW_ERROR("The options '--lazy' and '--access-profile' cannot be used together");
+            }
+
             conf->useCentralizedRepository = values.count("centralized-repository");
             conf->directories.initialize(conf->useCentralizedRepository, *conf);
         }
@@ -192,6 +215,8 @@ private:
     std::shared_ptr<common::Config> conf;
     std::string username;
     std::string transport;
+    std::string timingReport;
+    std::string accessProfile;
 };
 
 }
@@ -0,0 +1,142 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef cli_CommandResolve_hpp
+#define cli_CommandResolve_hpp
+
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include "cli/Utility.hpp"
+#include "common/Config.hpp"
+#include "cli/Command.hpp"
+#include "libsarus/CLIArguments.hpp"
+#include "cli/HelpMessage.hpp"
+#include "image_manager/ImageManager.hpp"
+#include "image_manager/ImageResolutionToken.hpp"
+#include "image_manager/ImageStore.hpp"
+#include "image_manager/LazyImage.hpp"
+
+
+namespace sarus {
+namespace cli {
+
+class CommandResolve : public Command {
+public:
+    CommandResolve() {
+        initializeOptionsDescription();
+    }
+
+    CommandResolve(const libsarus::CLIArguments& args, std::shared_ptr<common::Config> conf)
+        : conf{std::move(conf)}
+    {
+        initializeOptionsDescription();
+        parseCommandArguments(args);
+    }
+
+    void execute() override {
+        auto requestedReference = conf->imageReference;
+        auto imageStore = image_manager::ImageStore{conf};
+        auto image = imageStore.findImage(requestedReference);
+        if(!image && requestedReference.server == common::ImageReference::DEFAULT_SERVER) {
+            auto legacyReference = requestedReference;
+            legacyReference.server = common::ImageReference::LEGACY_DEFAULT_SERVER;
+            image = imageStore.findImage(legacyReference);
+        }
+        if(!image) {
+            auto message = boost::format("Image %s is not available") % requestedReference;
+            cli::utility::printLog(message.str(), libsarus::LogLevel::GENERAL, std::cerr);
+            SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+        }
+        // materialize lazily pulled images once, instead of at the first run of the job
+        if(image->format == image_manager::LazyImage::format) {
+            cli::utility::printLog(boost::format("Materializing lazily pulled image %s") % image->reference,
+                                   libsarus::LogLevel::GENERAL, std::cerr);
+            image = image_manager::ImageManager{conf}.materializeLazyImage(*image);
+        }
+        // the runs using the token don't access the repository metadata
+        imageStore.markImageAsUsed(image->reference);
+
+        auto token = image_manager::ImageResolutionToken{conf}.create(requestedReference, *image);
+        std::cout << token << std::endl;
+    }
+
+    bool requiresRootPrivileges() const override {
+        return false;
+    }
+
+    std::string getBriefDescription() const override {
+        return "Resolve an image once for all the runs of a job";
+    }
+
+    void printHelpMessage() const override {
+        auto printer = cli::HelpMessage()
+            .setUsage("sarus resolve [OPTIONS] REPOSITORY[:TAG]\n"
+                "\n"
+                "Note: REPOSITORY[:TAG] has to be specified as\n"
+                "      displayed by the \"sarus images\" command.\n"
+                "      The command prints a token which lets \"sarus run\" skip the\n"
+                "      lookup of the image in the repository, when exported in the\n"
+                "      SARUS_IMAGE_TOKEN environment variable, e.g. in a batch script:\n"
+                "      export SARUS_IMAGE_TOKEN=$(sarus resolve IMAGE)")
+            .setDescription(getBriefDescription())
+            .setOptionsDescription(optionsDescription);
+        std::cout << printer;
+    }
+
+private:
+    void initializeOptionsDescription() {
+        optionsDescription.add_options()
+            ("centralized-repository", "Use centralized repository instead of the local one");
+    }
+
+    void parseCommandArguments(const libsarus::CLIArguments& args) {
+        cli::utility::printLog(boost::format("parsing CLI arguments of resolve command"), libsarus::LogLevel::DEBUG);
+
+        libsarus::CLIArguments nameAndOptionArgs, positionalArgs;
+        std::tie(nameAndOptionArgs, positionalArgs) = cli::utility::groupOptionsAndPositionalArguments(args, optionsDescription);
+
+        // the resolve command expects exactly one positional argument
+        cli::utility::validateNumberOfPositionalArguments(positionalArgs, 1, 1, "resolve");
+
+        try {
+            boost::program_options::variables_map values;
+            boost::program_options::store(
+                boost::program_options::command_line_parser(nameAndOptionArgs.argc(), nameAndOptionArgs.argv())
+                        .options(optionsDescription)
+                        .style(boost::program_options::command_line_style::unix_style)
+                        .run(), values);
+            boost::program_options::notify(values);
+
+            conf->imageReference = cli::utility::parseImageReference(positionalArgs.argv()[0]).normalize();
+            conf->useCentralizedRepository = values.count("centralized-repository");
+            conf->directories.initialize(conf->useCentralizedRepository, *conf);
+        }
+        catch (std::exception& e) {
+            auto message = boost::format("%s\nSee 'sarus help resolve'") % e.what();
+            cli::utility::printLog(message, libsarus::LogLevel::GENERAL, std::cerr);
+            SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+        }
+
+        cli::utility::printLog(boost::format("successfully parsed CLI arguments"), libsarus::LogLevel::DEBUG);
+    }
+
+private:
+    boost::program_options::options_description optionsDescription{"Options"};
+    std::shared_ptr<common::Config> conf;
+};
+
+}
+}
+
+#endif
@@ -11,13 +11,17 @@
 #ifndef cli_CommandRun_hpp
 #define cli_CommandRun_hpp
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <stdexcept>
 #include <chrono>
+#include <cstdint>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 #include <boost/program_options.hpp>
+#include <rapidjson/pointer.h>
 
 #include "common/Config.hpp"
 #include "libsarus/CLIArguments.hpp"
@@ -27,7 +31,12 @@
 #include "cli/Utility.hpp"
 #include "cli/Command.hpp"
 #include "cli/HelpMessage.hpp"
+#include "image_manager/ImageManager.hpp"
+#include "image_manager/ImageResolutionToken.hpp"
 #include "image_manager/ImageStore.hpp"
+#include "image_manager/StagedImageRegistry.hpp"
+#include "image_manager/ImageCache.hpp"
+#include "runtime/Hugepages.hpp"
 #include "runtime/Runtime.hpp"
 #include "libsarus/DeviceMount.hpp"
 
@@ -73,7 +82,12 @@ public:
         message = boost::format("Successfully set up container in %.6f seconds") % setupTime.count();
         cli::utility::printLog(message, libsarus::LogLevel::INFO);
 
-        runtime.executeContainer();
+        if(conf->commandRun.detach) {
+            runtime.executeContainerInBackground();
+        }
+        else {
+            runtime.executeContainer();
+        }
 
         cli::utility::printLog("Successfully executed run command", libsarus::LogLevel::INFO);
     }
@@ -104,6 +118,8 @@ private:
                 boost::program_options::value<std::vector<std::string>>(&annotations),
                 "Add an OCI annotation to the container")
             ("centralized-repository", "Use centralized repository instead of the local one")
+            ("detach,d", "Run the container in the background and print its name. Further processes can be "
+                         "attached to the container with 'sarus exec'")
             ("device",
                 boost::program_options::value<std::vector<std::string>>(&deviceMounts),
                 "Mount custom devices into the container")
@@ -114,6 +130,15 @@ private:
                 boost::program_options::value<std::vector<std::string>>(&env),
                 "Set environment variables in the container")
             ("glibc", "Enable replacement of the container's GNU C libraries")
+            ("hugepages",
+                boost::program_options::value<std::vector<std::string>>(&hugepages),
+                "Mount a hugetlbfs of the given page size into the container, at /dev/hugepages-<SIZE>, "
+                "optionally limiting the container to a number of pages. Format: SIZE[:PAGES], e.g. '2MB:512'")
+            ("idle-timeout",
+                boost::program_options::value<std::int64_t>(&idleTimeout),
+                "Stop a container started with '--detach' when no process was attached to it with "
+                "'sarus exec' for this number of seconds. 0 disables the timeout. "
+                "Default: set by the administrator")
             ("init", "Run an init process inside the container that forwards signals and reaps processes. "
                      "Mostly useful in conjunction with '--pid=private'")
             ("mount",
@@ -133,7 +158,22 @@ private:
                 boost::program_options::value<std::string>(&pid),
                 "Set the PID namespace mode for the container. Supported values: 'host', 'private'. "
                 "Default: use the host’s PID namespace for the container")
+            ("read-only", "Run the container with a read-only root filesystem, mounting the image without a writable "
+                          "overlay. Only /tmp, /run and /etc remain writable")
+            ("record-prefetch-profile", "Record the parts of the image read during the startup of the container, "
+                                        "which are prefetched at the startup of the following containers of the image")
             ("ssh", "Enable SSH in the container. Implies '--pid=private'")
+            ("task-list",
+                boost::program_options::value<std::string>(&taskList),
+                "Execute the tasks of a file (one shell command line per line) in the container, in parallel "
+                "on the CPUs of the container, instead of the command of the container")
+            ("task-results",
+                boost::program_options::value<std::string>(&taskResults),
+                "Write the exit code and the wall time of each task of '--task-list' to a JSON file. "
+                "Default: the task list file with the '.results.json' suffix")
+            ("task-retries",
+                boost::program_options::value<std::int64_t>(&taskRetries),
+                "Retry a failed task of '--task-list' up to this number of times. Default: 0")
             ("tty,t", "Allocate a pseudo-TTY in the container")
             ("workdir,w",
                 boost::program_options::value<std::string>(&workdir),
@@ -228,6 +268,40 @@ private:
                 conf->commandRun.createNewPIDNamespace = false;
             }
 
+            conf->commandRun.recordPrefetchProfile = values.count("record-prefetch-profile");
+
+            if(values.count("read-only")) {
+                conf->commandRun.readOnlyRootfs = true;
+                if(values.count("glibc") || values.count("mpi") || values.count("mpi-type") || values.count("ssh")) {
+                    auto message = boost::format("The use of '--read-only' is incompatible with '--glibc', '--mpi', "
+                                                 "'--mpi-type' and '--ssh'. The hooks of these features add files "
+                                                 "to the root filesystem of the container");
+                    SARUS_THROW_ERROR(message.str());
+                }
+            }
+            else {
+                conf->commandRun.readOnlyRootfs = false;
+            }
+
+            if(values.count("detach")) {
+                conf->commandRun.detach = true;
+                if(values.count("tty") || values.count("record-prefetch-profile")) {
+                    auto message = boost::format("The use of '--detach' is incompatible with '--tty' and "
+                                                 "'--record-prefetch-profile'");
+                    SARUS_THROW_ERROR(message.str());
+                }
+                conf->commandRun.idleTimeout = getIdleTimeout(values.count("idle-timeout") > 0);
+                if(values.count("name")) {
+                    runtime::PersistentContainer::validateName(containerName);
+                }
+            }
+            else {
+                conf->commandRun.detach = false;
+                if(values.count("idle-timeout")) {
+                    SARUS_THROW_ERROR("The '--idle-timeout' option requires '--detach'");
+                }
+            }
+
             if(values.count("ssh")) {
                 conf->commandRun.enableSSH = true;
                 conf->commandRun.createNewPIDNamespace = true;
@@ -241,6 +315,29 @@ private:
                 conf->commandRun.enableSSH = false;
             }
 
+            if(values.count("task-list")) {
+                if(conf->commandRun.detach || !conf->commandRun.execArgs.empty() || values.count("entrypoint")) {
+                    auto message = boost::format("The use of '--task-list' is incompatible with '--detach', "
+                                                 "'--entrypoint' and a command after the image: the task runner "
+                                                 "replaces the command of the container");
+                    SARUS_THROW_ERROR(message.str());
+                }
+                conf->commandRun.taskListFile = boost::filesystem::absolute(taskList);
+                conf->commandRun.taskResultsFile = values.count("task-results")
+                    ? boost::filesystem::absolute(taskResults)
+                    : boost::filesystem::path{conf->commandRun.taskListFile->string() + ".results.json"};
+                if(taskRetries < 0) {
+                    auto message = boost::format("Invalid value provided for --task-retries option: %d") % taskRetries;
+                    SARUS_THROW_ERROR(message.str());
+                }
+                conf->commandRun.taskRetries = taskRetries;
+            }
+            else if(values.count("task-results") || values.count("task-retries")) {
+                SARUS_THROW_ERROR("The '--task-results' and '--task-retries' options require '--task-list'");
+            }
+
+            makeHugepagesRequests();
+
             if(values.count("tty")) {
                 conf->commandRun.allocatePseudoTTY = true;
             }
@@ -273,6 +370,62 @@ private:
         cli::utility::printLog("successfully parsed CLI arguments", libsarus::LogLevel::DEBUG);
     }
 
+    /**
+     * The default and the maximum idle timeouts of detached containers are set by the
+     * "persistentContainers" parameter of the configuration.
+     */
+    std::chrono::seconds getIdleTimeout(bool isRequestedFromCLI) const {
+        auto timeout = std::chrono::seconds{1800};
+        auto maxTimeout = boost::optional<std::chrono::seconds>{};
+        if(const auto* value = rapidjson::Pointer("/persistentContainers/defaultIdleTimeout").Get(conf->json)) {
+            timeout = std::chrono::seconds{value->GetInt64()};
+        }
+        if(const auto* value = rapidjson::Pointer("/persistentContainers/maxIdleTimeout").Get(conf->json)) {
+            maxTimeout = std::chrono::seconds{value->GetInt64()};
+        }
+        if(isRequestedFromCLI) {
+            if(idleTimeout < 0) {
+                auto message = boost::format("Invalid value provided for --idle-timeout option: %d") % idleTimeout;
+                SARUS_THROW_ERROR(message.str());
+            }
+            timeout = std::chrono::seconds{idleTimeout};
+        }
+        if(maxTimeout && (timeout.count() == 0 || timeout > *maxTimeout)) {
+            auto message = boost::format("The idle timeout of detached containers can't exceed %d seconds")
+                % maxTimeout->count();
+            SARUS_THROW_ERROR(message.str());
+        }
+        return timeout;
+    }
+
+    /**
+     * Only the syntax of the requests is checked here: the availability of the page sizes on the host
+     * and the limits set by the administrator are validated by the runtime (see Runtime::setHugepages).
+     */
+    void makeHugepagesRequests() {
+        for(const auto& request : hugepages) {
+            auto separator = request.find(':');
+            auto sizeKB = runtime::Hugepages::parseSize(request.substr(0, separator));
+            auto pages = size_t{0};
+            if(separator != std::string::npos) {
+                auto pagesString = request.substr(separator + 1);
+                if(pagesString.empty()
+                   || !std::all_of(pagesString.cbegin(), pagesString.cend(), [](char c) { return std::isdigit(c); })
+                   || (pages = std::stoul(pagesString)) == 0) {
+                    auto message = boost::format("Invalid value provided for --hugepages option: '%s'. "
+                                                 "The number of pages must be a positive integer") % request;
+                    SARUS_THROW_ERROR(message.str());
+                }
+            }
+            if(conf->commandRun.hugepages.count(sizeKB)) {
+                auto message = boost::format("Hugepages of size %s requested more than once")
+                    % runtime::Hugepages::formatSize(sizeKB);
+                SARUS_THROW_ERROR(message.str());
+            }
+            conf->commandRun.hugepages[sizeKB] = pages;
+        }
+    }
+
     void makeAnnotations() {
         for(const auto& annotation : annotations) {
             auto message = boost::format("Parsing annotation from CLI '%s'") % annotation;
@@ -520,22 +673,39 @@ private:
         //   - we can access images on root_squashed filesystems
         //   - we do not create/update local repo files (e.g. repo metadata and lockfiles) with root ownership
         auto rootIdentity = libsarus::UserIdentity{};
+        auto imageCache = image_manager::ImageCache{conf};
+        if(imageCache.isEnabled()) {
+            imageCache.initialize();
+        }
         libsarus::process::switchIdentity(conf->userIdentity);
 
         try {
-            auto imageStore = image_manager::ImageStore(conf);
-            auto image = imageStore.findImage(conf->imageReference);
-            if(!image && conf->imageReference.server == common::ImageReference::DEFAULT_SERVER) {
-                auto message = boost::format("Image %s is not available. Attempting to look for equivalent image in %s server repositories")
-                                             % conf->imageReference % common::ImageReference::LEGACY_DEFAULT_SERVER;
-                cli::utility::printLog(message.str(), libsarus::LogLevel::GENERAL, std::cerr);
-                conf->imageReference.server = common::ImageReference::LEGACY_DEFAULT_SERVER;
-                image = imageStore.findImage(conf->imageReference);
-            }
-            if(!image) {
-                auto message = boost::format("Image %s is not available") % conf->imageReference;
-                cli::utility::printLog(message.str(), libsarus::LogLevel::GENERAL, std::cerr);
-                exit(EXIT_FAILURE);
+            // a token created by "sarus resolve" spares the lookup in the repository metadata
+            auto image = image_manager::ImageResolutionToken{conf}.findImage(conf->imageReference);
+            if(image) {
+                conf->imageReference = image->reference;
+            }
+            else {
+                image = findImageInRepository();
+            }
+            // entries reusing a file of the image pool are not stored under the path of Config::getImageFile()
+            conf->commandRun.imageFile = image->imageFile;
+            if(!image->format.empty()) {
+                conf->commandRun.imageFormat = image->format;
+            }
+
+            // prefer the node-local copy created by "sarus stage", if still up to date
+            auto stagedImageFile = image_manager::StagedImageRegistry{conf}.findStagedImage(*image);
+            if(stagedImageFile) {
+                cli::utility::printLog(boost::format("Using staged image %s") % *stagedImageFile,
+                                       libsarus::LogLevel::INFO);
+                conf->commandRun.nodeLocalImageFile = *stagedImageFile;
+            }
+            // otherwise transparently copy the image to the node-local cache, if configured
+            else if(auto cachedImageFile = imageCache.getCachedImage(*image)) {
+                cli::utility::printLog(boost::format("Using cached image %s") % *cachedImageFile,
+                                       libsarus::LogLevel::INFO);
+                conf->commandRun.nodeLocalImageFile = *cachedImageFile;
             }
         }
         catch(const std::exception& e) {
@@ -548,17 +718,47 @@ private:
                                libsarus::LogLevel::INFO);
     }
 
+    boost::optional<common::SarusImage> findImageInRepository() const {
+        auto imageStore = image_manager::ImageStore(conf);
+        auto image = imageStore.findImage(conf->imageReference);
+        if(!image && conf->imageReference.server == common::ImageReference::DEFAULT_SERVER) {
+            auto message = boost::format("Image %s is not available. Attempting to look for equivalent image in %s server repositories")
+                                         % conf->imageReference % common::ImageReference::LEGACY_DEFAULT_SERVER;
+            cli::utility::printLog(message.str(), libsarus::LogLevel::GENERAL, std::cerr);
+            conf->imageReference.server = common::ImageReference::LEGACY_DEFAULT_SERVER;
+            image = imageStore.findImage(conf->imageReference);
+        }
+        if(!image) {
+            auto message = boost::format("Image %s is not available") % conf->imageReference;
+            cli::utility::printLog(message.str(), libsarus::LogLevel::GENERAL, std::cerr);
+            exit(EXIT_FAILURE);
+        }
+        // lazily pulled images are materialized at their first run
+        if(image->format == image_manager::LazyImage::format) {
+            cli::utility::printLog(boost::format("Materializing lazily pulled image %s") % image->reference,
+                                   libsarus::LogLevel::GENERAL);
+            image = image_manager::ImageManager{conf}.materializeLazyImage(*image);
+        }
+        imageStore.markImageAsUsed(image->reference);
+        return image;
+    }
+
 private:
     boost::program_options::options_description optionsDescription{"Options"};
     std::shared_ptr<common::Config> conf;
     std::vector<std::string> annotations;
     std::vector<std::string> deviceMounts;
     std::vector<std::string> env;
+    std::vector<std::string> hugepages;
     std::string entrypoint;
     std::string mpiType;
     std::string containerName;
     std::string pid;
     std::string workdir;
+    std::int64_t idleTimeout = 0;
+    std::string taskList;
+    std::string taskResults;
+    std::int64_t taskRetries = 0;
 };
 
 }
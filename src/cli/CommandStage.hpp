@@ -0,0 +1,257 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef cli_CommandStage_hpp
+#define cli_CommandStage_hpp
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include "libsarus/Utility.hpp"
+#include "cli/Utility.hpp"
+#include "common/Config.hpp"
+#include "cli/Command.hpp"
+#include "libsarus/CLIArguments.hpp"
+#include "cli/HelpMessage.hpp"
+#include "image_manager/ImageStore.hpp"
+#include "image_manager/ImageBroadcast.hpp"
+#include "image_manager/LazyImage.hpp"
+#include "image_manager/StagedImageRegistry.hpp"
+
+
+namespace sarus {
+namespace cli {
+
+class CommandStage : public Command {
+public:
+    CommandStage() {
+        initializeOptionsDescription();
+    }
+
+    CommandStage(const libsarus::CLIArguments& args, std::shared_ptr<common::Config> conf)
+        : conf{std::move(conf)}
+    {
+        initializeOptionsDescription();
+        parseCommandArguments(args);
+    }
+
+    void execute() override {
+        const auto& stage = conf->commandStage;
+        if(stage.isExtraTaskOnNode) {
+            cli::utility::printLog("Not the first task on the node: nothing to do", libsarus::LogLevel::INFO);
+            return;
+        }
+
+        // the per-user staging directory is created with root privileges,
+        // the rest of the operations are performed with the user identity
+        auto registry = image_manager::StagedImageRegistry{conf};
+        libsarus::filesystem::createFoldersIfNecessary(registry.getDirectory(), conf->userIdentity.uid, conf->userIdentity.gid);
+        libsarus::process::switchIdentity(conf->userIdentity);
+
+        auto image = image_manager::ImageStore{conf}.findImage(conf->imageReference);
+        if(!image) {
+            auto message = boost::format("Image %s is not available") % conf->imageReference;
+            cli::utility::printLog(message.str(), libsarus::LogLevel::GENERAL, std::cerr);
+            SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+        }
+        if(image->format == image_manager::LazyImage::format) {
+            auto message = boost::format("Image %s was pulled lazily and has not been materialized yet."
+                                         " Run it once before staging it") % conf->imageReference;
+            cli::utility::printLog(message.str(), libsarus::LogLevel::GENERAL, std::cerr);
+            SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+        }
+
+        auto topology = image_manager::ImageBroadcast::Topology{};
+        topology.rank = stage.nodeRank;
+        topology.fanout = stage.fanout;
+        for(const auto& node : stage.nodes) {
+            topology.peers.push_back(image_manager::ImageBroadcast::Peer{node, stage.port});
+        }
+
+        // only processes of the user staging the same image within the job know the key
+        auto key = registry.getTransferKey(*image, stage.jobID);
+        auto broadcast = image_manager::ImageBroadcast{topology, key, stage.timeout};
+        auto result = broadcast.run(image->imageFile, registry.getStagedImageFile(*image));
+        registry.registerImage(*image, result.digest);
+
+        if(stage.nodeRank == 0) {
+            auto message = boost::format("Staged image %s (sha256:%s) on %d of %d nodes")
+                           % conf->imageReference % result.digest % result.stagedNodes % stage.nodes.size();
+            cli::utility::printLog(message, libsarus::LogLevel::GENERAL);
+            if(result.stagedNodes < stage.nodes.size()) {
+                SARUS_THROW_ERROR("Failed to stage the image on all the nodes", libsarus::LogLevel::INFO);
+            }
+        }
+    }
+
+    bool requiresRootPrivileges() const override {
+        return true;
+    }
+
+    std::string getBriefDescription() const override {
+        return "Copy an image to the node-local storage of all the nodes of a job";
+    }
+
+    void printHelpMessage() const override {
+        auto printer = cli::HelpMessage()
+            .setUsage("sarus stage [OPTIONS] REPOSITORY[:TAG]\n"
+                "\n"
+                "Note: REPOSITORY[:TAG] has to be specified as\n"
+                "      displayed by the \"sarus images\" command.\n"
+                "      The command has to be launched once on every node,\n"
+                "      e.g. with \"srun --ntasks-per-node=1 sarus stage IMAGE\".")
+            .setDescription(getBriefDescription())
+            .setOptionsDescription(optionsDescription);
+        std::cout << printer;
+    }
+
+private:
+    void initializeOptionsDescription() {
+        optionsDescription.add_options()
+            ("centralized-repository", "Use centralized repository instead of the local one")
+            ("fanout",
+                boost::program_options::value<size_t>(&fanout)->default_value(image_manager::ImageBroadcast::defaultFanout),
+                "Number of nodes each node forwards the image to")
+            ("nodes",
+                boost::program_options::value<std::string>(&nodes),
+                "Hostlist of the nodes where the image is staged, e.g. nid[001-004]"
+                " (default: the nodes of the Slurm job step)")
+            ("node-rank",
+                boost::program_options::value<size_t>(&nodeRank),
+                "Index of the current node in the hostlist (default: the Slurm node ID)")
+            ("port",
+                boost::program_options::value<std::uint16_t>(&port),
+                "TCP port used for the transfers between nodes (default: a port derived from the"
+                " Slurm job ID, or 23600 outside of Slurm jobs)")
+            ("timeout",
+                boost::program_options::value<size_t>(&timeout)->default_value(300),
+                "Timeout in seconds for the connections between nodes");
+    }
+
+    void parseCommandArguments(const libsarus::CLIArguments& args) {
+        cli::utility::printLog(boost::format("parsing CLI arguments of stage command"), libsarus::LogLevel::DEBUG);
+
+        libsarus::CLIArguments nameAndOptionArgs, positionalArgs;
+        std::tie(nameAndOptionArgs, positionalArgs) = cli::utility::groupOptionsAndPositionalArguments(args, optionsDescription);
+
+        // the stage command expects exactly one positional argument
+        cli::utility::validateNumberOfPositionalArguments(positionalArgs, 1, 1, "stage");
+
+        try {
+            boost::program_options::variables_map values;
+            boost::program_options::store(
+                boost::program_options::command_line_parser(nameAndOptionArgs.argc(), nameAndOptionArgs.argv())
+                        .options(optionsDescription)
+                        .style(boost::program_options::command_line_style::unix_style)
+                        .run(), values);
+            boost::program_options::notify(values);
+
+            conf->imageReference = cli::utility::parseImageReference(positionalArgs.argv()[0]).normalize();
+            conf->useCentralizedRepository = values.count("centralized-repository");
+            conf->directories.initialize(conf->useCentralizedRepository, *conf);
+
+            parseTopology(values);
+        }
+        catch (std::exception& e) {
+            auto message = boost::format("%s\nSee 'sarus help stage'") % e.what();
+            cli::utility::printLog(message, libsarus::LogLevel::GENERAL, std::cerr);
+            SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+        }
+
+        cli::utility::printLog(boost::format("successfully parsed CLI arguments"), libsarus::LogLevel::DEBUG);
+    }
+
+    /**
+     * The topology defaults to the nodes of the Slurm job step, where the
+     * command is expected to run as one task per node.
+     */
+    void parseTopology(const boost::program_options::variables_map& values) {
+        auto& stage = conf->commandStage;
+        const auto& environment = conf->commandRun.hostEnvironment;
+
+        auto hostlist = nodes;
+        if(!values.count("nodes")) {
+            for(const auto* variable : {"SLURM_STEP_NODELIST", "SLURM_JOB_NODELIST"}) {
+                auto it = environment.find(variable);
+                if(it != environment.cend()) {
+                    hostlist = it->second;
+                    break;
+                }
+            }
+        }
+        if(hostlist.empty()) {
+            SARUS_THROW_ERROR("Failed to determine the nodes where to stage the image:"
+                              " please use the '--nodes' option or run the command within a Slurm job");
+        }
+        stage.nodes = image_manager::ImageBroadcast::expandHostlist(hostlist);
+
+        stage.nodeRank = nodeRank;
+        if(!values.count("node-rank")) {
+            auto it = environment.find("SLURM_NODEID");
+            if(it == environment.cend()) {
+                SARUS_THROW_ERROR("Failed to determine the rank of the current node:"
+                                  " please use the '--node-rank' option or run the command within a Slurm job");
+            }
+            stage.nodeRank = std::stoul(it->second);
+        }
+        if(stage.nodeRank >= stage.nodes.size()) {
+            auto message = boost::format("Invalid node rank %d: the hostlist contains %d nodes")
+                           % stage.nodeRank % stage.nodes.size();
+            SARUS_THROW_ERROR(message.str());
+        }
+
+        // concurrent job steps of the same job get different ports and keys
+        stage.jobID.clear();
+        auto jobID = environment.find("SLURM_JOB_ID");
+        if(jobID != environment.cend()) {
+            stage.jobID = jobID->second;
+            auto stepID = environment.find("SLURM_STEP_ID");
+            if(stepID != environment.cend()) {
+                stage.jobID += "." + stepID->second;
+            }
+        }
+
+        auto localID = environment.find("SLURM_LOCALID");
+        stage.isExtraTaskOnNode = localID != environment.cend() && localID->second != "0";
+
+        if(fanout == 0) {
+            SARUS_THROW_ERROR("Invalid fan-out: the value must be greater than zero");
+        }
+        stage.fanout = fanout;
+        if(values.count("port")) {
+            stage.port = port;
+        }
+        else if(!stage.jobID.empty()) {
+            stage.port = image_manager::ImageBroadcast::getJobPort(stage.jobID);
+        }
+        else {
+            stage.port = image_manager::ImageBroadcast::defaultPort;
+        }
+        stage.timeout = std::chrono::seconds{timeout};
+    }
+
+private:
+    boost::program_options::options_description optionsDescription{"Options"};
+    std::shared_ptr<common::Config> conf;
+    size_t fanout;
+    std::string nodes;
+    size_t nodeRank = 0;
+    std::uint16_t port = image_manager::ImageBroadcast::defaultPort;
+    size_t timeout;
+};
+
+}
+}
+
+#endif
@@ -21,17 +21,21 @@
 #include "libsarus/Mount.hpp"
 #include "cli/CommandObjectsFactory.hpp"
 #include "cli/CLI.hpp"
+#include "cli/CommandExec.hpp"
 #include "cli/CommandHelp.hpp"
 #include "cli/CommandHelpOfCommand.hpp"
 #include "cli/CommandHooks.hpp"
 #include "cli/CommandImages.hpp"
 #include "cli/CommandKill.hpp"
 #include "cli/CommandLoad.hpp"
+#include "cli/CommandPrune.hpp"
 #include "cli/CommandPs.hpp"
 #include "cli/CommandPull.hpp"
+#include "cli/CommandResolve.hpp"
 #include "cli/CommandRmi.hpp"
 #include "cli/CommandRun.hpp"
 #include "cli/CommandSshKeygen.hpp"
+#include "cli/CommandStage.hpp"
 #include "cli/CommandVersion.hpp"
 #include "test_utility/config.hpp"
 #include "test_utility/filesystem.hpp"
@@ -70,6 +74,9 @@ TEST(CLITestGroup, CommandTypes) {
     auto command = generateCommandFromCLIArguments({"sarus"});
     checkCommandDynamicType<cli::CommandHelp>(*command);
 
+    command = generateCommandFromCLIArguments({"sarus", "exec", "name", "command"});
+    checkCommandDynamicType<cli::CommandExec>(*command);
+
     command = generateCommandFromCLIArguments({"sarus", "help"});
     checkCommandDynamicType<cli::CommandHelp>(*command);
 
@@ -91,12 +98,18 @@ TEST(CLITestGroup, CommandTypes) {
     command = generateCommandFromCLIArguments({"sarus", "load", "archive.tar", "image"});
     checkCommandDynamicType<cli::CommandLoad>(*command);
 
+    command = generateCommandFromCLIArguments({"sarus", "prune"});
+    checkCommandDynamicType<cli::CommandPrune>(*command);
+
     command = generateCommandFromCLIArguments({"sarus", "ps"});
     checkCommandDynamicType<cli::CommandPs>(*command);
 
     command = generateCommandFromCLIArguments({"sarus", "pull", "image"});
     checkCommandDynamicType<cli::CommandPull>(*command);
 
+    command = generateCommandFromCLIArguments({"sarus", "resolve", "image"});
+    checkCommandDynamicType<cli::CommandResolve>(*command);
+
     command = generateCommandFromCLIArguments({"sarus", "rmi", "image"});
     checkCommandDynamicType<cli::CommandRmi>(*command);
 
@@ -106,6 +119,9 @@ TEST(CLITestGroup, CommandTypes) {
     command = generateCommandFromCLIArguments({"sarus", "ssh-keygen"});
     checkCommandDynamicType<cli::CommandSshKeygen>(*command);
 
+    command = generateCommandFromCLIArguments({"sarus", "stage", "--nodes=nid001", "--node-rank=0", "image"});
+    checkCommandDynamicType<cli::CommandStage>(*command);
+
     command = generateCommandFromCLIArguments({"sarus", "version"});
     checkCommandDynamicType<cli::CommandVersion>(*command);
 
@@ -156,6 +172,20 @@ TEST(CLITestGroup, generated_config_for_CommandLoad) {
         CHECK_EQUAL(conf->imageReference.image, std::string{"image"});
         CHECK_EQUAL(conf->imageReference.tag, std::string{"tag"});
     }
+    // timing report
+    {
+        auto conf = generateConfig(
+            {"load", "--timing-report", "report.json", "archive.tar", "library/image:tag"});
+        auto expectedReportPath = boost::filesystem::absolute("report.json");
+        CHECK_EQUAL(conf->timingReportFile.string(), expectedReportPath.string());
+    }
+    // access profile
+    {
+        auto conf = generateConfig(
+            {"load", "--access-profile", "profile.txt", "archive.tar", "library/image:tag"});
+        auto expectedProfilePath = boost::filesystem::absolute("profile.txt");
+        CHECK_EQUAL(conf->accessProfileFile.string(), expectedProfilePath.string());
+    }
 }
 
 TEST(CLITestGroup, generated_config_for_CommandPull) {
@@ -171,6 +201,8 @@ TEST(CLITestGroup, generated_config_for_CommandPull) {
         CHECK(conf->imageReference.repositoryNamespace == "library");
         CHECK(conf->imageReference.image == "ubuntu");
         CHECK(conf->imageReference.tag == "latest");
+        CHECK(conf->timingReportFile.empty());
+        CHECK(conf->accessProfileFile.empty());
     }
     // centralized repo
     {
@@ -213,6 +245,26 @@ TEST(CLITestGroup, generated_config_for_CommandPull) {
         CHECK(conf->authentication.isAuthenticationNeeded == true);
         CHECK(conf->authentication.username == "bob");
     }
+    // timing report
+    {
+        auto conf = generateConfig({"pull", "--timing-report=/tmp/report.json", "ubuntu"});
+        CHECK(conf->timingReportFile == "/tmp/report.json");
+    }
+    // access profile
+    {
+        auto conf = generateConfig({"pull", "--access-profile=/tmp/profile.txt", "ubuntu"});
+        CHECK(conf->accessProfileFile == "/tmp/profile.txt");
+    }
+    // lazy
+    {
+        auto conf = generateConfig({"pull", "ubuntu"});
+        CHECK(conf->lazyPull == false);
+
+        conf = generateConfig({"pull", "--lazy", "ubuntu"});
+        CHECK(conf->lazyPull == true);
+
+        CHECK_THROWS(libsarus::Error, generateConfig({"pull", "--lazy", "--access-profile=/tmp/profile.txt", "ubuntu"}));
+    }
 }
 
 TEST(CLITestGroup, generated_config_for_CommandRmi) {
@@ -236,6 +288,83 @@ TEST(CLITestGroup, generated_config_for_CommandRmi) {
     }
 }
 
+TEST(CLITestGroup, generated_config_for_CommandPrune) {
+    // defaults
+    {
+        auto conf = generateConfig({"prune"});
+        CHECK_FALSE(conf->useCentralizedRepository);
+        CHECK_FALSE(conf->commandPrune.isDryRun);
+        CHECK_FALSE(conf->commandPrune.quotaMB);
+    }
+    // options
+    {
+        auto conf = generateConfig({"prune", "--centralized-repository", "--dry-run", "--quota=2048"});
+        CHECK(conf->useCentralizedRepository);
+        CHECK(conf->commandPrune.isDryRun);
+        CHECK_EQUAL(*conf->commandPrune.quotaMB, 2048);
+    }
+    // invalid arguments
+    {
+        CHECK_THROWS(libsarus::Error, generateConfig({"prune", "ubuntu"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"prune", "--quota=large"}));
+    }
+}
+
+TEST(CLITestGroup, generated_config_for_CommandResolve) {
+    // local repository
+    {
+        auto conf = generateConfig({"resolve", "ubuntu"});
+        CHECK_EQUAL(conf->useCentralizedRepository, false);
+        CHECK_EQUAL(conf->imageReference.server, std::string{"docker.io"});
+        CHECK_EQUAL(conf->imageReference.repositoryNamespace, std::string{"library"});
+        CHECK_EQUAL(conf->imageReference.image, std::string{"ubuntu"});
+        CHECK_EQUAL(conf->imageReference.tag, std::string{"latest"});
+    }
+    // centralized repository
+    {
+        auto conf = generateConfig({"resolve", "--centralized-repository", "ubuntu"});
+        CHECK_EQUAL(conf->useCentralizedRepository, true);
+    }
+    // invalid arguments
+    {
+        CHECK_THROWS(libsarus::Error, generateConfig({"resolve"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"resolve", "ubuntu", "alpine"}));
+    }
+}
+
+TEST(CLITestGroup, generated_config_for_CommandStage) {
+    // explicit topology
+    {
+        auto conf = generateConfig({"stage", "--nodes=nid[001-004]", "--node-rank=2", "ubuntu"});
+        CHECK_EQUAL(conf->useCentralizedRepository, false);
+        CHECK_EQUAL(conf->imageReference.image, std::string{"ubuntu"});
+        CHECK_EQUAL(conf->imageReference.tag, std::string{"latest"});
+        CHECK(conf->commandStage.nodes == (std::vector<std::string>{"nid001", "nid002", "nid003", "nid004"}));
+        CHECK_EQUAL(conf->commandStage.nodeRank, 2);
+        CHECK_EQUAL(conf->commandStage.fanout, image_manager::ImageBroadcast::defaultFanout);
+        CHECK_EQUAL(conf->commandStage.port, image_manager::ImageBroadcast::defaultPort);
+        CHECK(conf->commandStage.timeout == std::chrono::seconds{300});
+        CHECK_FALSE(conf->commandStage.isExtraTaskOnNode);
+    }
+    // transfer options
+    {
+        auto conf = generateConfig({"stage", "--nodes=nid001,nid002", "--node-rank=1",
+                                    "--fanout=2", "--port=30000", "--timeout=10",
+                                    "--centralized-repository", "ubuntu"});
+        CHECK_EQUAL(conf->useCentralizedRepository, true);
+        CHECK_EQUAL(conf->commandStage.fanout, 2);
+        CHECK_EQUAL(conf->commandStage.port, 30000);
+        CHECK(conf->commandStage.timeout == std::chrono::seconds{10});
+    }
+    // invalid values
+    {
+        CHECK_THROWS(libsarus::Error, generateConfig({"stage", "--nodes=nid001", "--node-rank=1", "ubuntu"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"stage", "--nodes=nid001", "--node-rank=0", "--fanout=0", "ubuntu"}));
+        // no topology outside of a Slurm job
+        CHECK_THROWS(libsarus::Error, generateConfig({"stage", "ubuntu"}));
+    }
+}
+
 TEST(CLITestGroup, generated_config_for_CommandRun) {
     // empty values
     {
@@ -257,6 +386,8 @@ TEST(CLITestGroup, generated_config_for_CommandRun) {
         CHECK_FALSE(conf->commandRun.enableSSH);
         CHECK_FALSE(conf->commandRun.allocatePseudoTTY);
         CHECK_FALSE(conf->commandRun.mpiType);
+        CHECK_FALSE(conf->commandRun.recordPrefetchProfile);
+        CHECK_FALSE(conf->commandRun.readOnlyRootfs);
         CHECK(conf->commandRun.execArgs.argc() == 0);
     }
     //annotation
@@ -287,6 +418,24 @@ TEST(CLITestGroup, generated_config_for_CommandRun) {
         auto conf = generateConfig({"run", "--centralized-repository", "image"});
         CHECK_EQUAL(conf->useCentralizedRepository, true);
     }
+    // detach
+    {
+        auto conf = generateConfig({"run", "image"});
+        CHECK_FALSE(conf->commandRun.detach);
+
+        conf = generateConfig({"run", "--detach", "--name", "test", "image"});
+        CHECK(conf->commandRun.detach);
+        CHECK(conf->commandRun.idleTimeout == std::chrono::seconds{1800});
+
+        conf = generateConfig({"run", "-d", "--idle-timeout", "60", "image"});
+        CHECK(conf->commandRun.detach);
+        CHECK(conf->commandRun.idleTimeout == std::chrono::seconds{60});
+
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--idle-timeout", "60", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--detach", "--idle-timeout", "-1", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--detach", "--tty", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--detach", "--name", "../test", "image"}));
+    }
     // entrypoint
     {
         auto conf = generateConfig({"run", "--entrypoint", "myprogram", "image"});
@@ -324,6 +473,23 @@ TEST(CLITestGroup, generated_config_for_CommandRun) {
         conf = generateConfig({"run", "--env=INEXISTENT", "image"});
         CHECK_TRUE(conf->commandRun.userEnvironment.empty());
     }
+    // hugepages
+    {
+        auto conf = generateConfig({"run", "image"});
+        CHECK(conf->commandRun.hugepages.empty());
+
+        conf = generateConfig({"run", "--hugepages", "2MB", "image"});
+        CHECK(conf->commandRun.hugepages == (std::map<size_t, size_t>{{2048, 0}}));
+
+        conf = generateConfig({"run", "--hugepages=2MB:512", "--hugepages=1GB:4", "image"});
+        CHECK(conf->commandRun.hugepages == (std::map<size_t, size_t>{{2048, 512}, {1048576, 4}}));
+
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--hugepages=2TB", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--hugepages=2MB:", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--hugepages=2MB:0", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--hugepages=2MB:-1", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--hugepages=2MB", "--hugepages=2048kB:8", "image"}));
+    }
     // init
     {
         auto conf = generateConfig({"run", "--init", "image"});
@@ -376,12 +542,47 @@ TEST(CLITestGroup, generated_config_for_CommandRun) {
         conf = generateConfig({"run", "--pid", "private", "image"});
         CHECK_EQUAL(conf->commandRun.createNewPIDNamespace, true);
     }
+    // read-only
+    {
+        auto conf = generateConfig({"run", "--read-only", "image"});
+        CHECK(conf->commandRun.readOnlyRootfs);
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--read-only", "--mpi", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--read-only", "--glibc", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--read-only", "--ssh", "image"}));
+    }
+    // record-prefetch-profile
+    {
+        auto conf = generateConfig({"run", "--record-prefetch-profile", "image", "python3"});
+        CHECK(conf->commandRun.recordPrefetchProfile);
+        CHECK_EQUAL(conf->imageReference.image, std::string{"image"});
+        CHECK(conf->commandRun.execArgs.argc() == 1);
+    }
     // ssh
     {
         auto conf = generateConfig({"run", "--ssh", "image"});
         CHECK_EQUAL(conf->commandRun.enableSSH, true);
         CHECK_EQUAL(conf->commandRun.createNewPIDNamespace, true);
     }
+    // task-list
+    {
+        auto conf = generateConfig({"run", "image"});
+        CHECK_FALSE(conf->commandRun.taskListFile);
+
+        conf = generateConfig({"run", "--task-list", "/tasks.txt", "image"});
+        CHECK_EQUAL(conf->commandRun.taskListFile->string(), std::string{"/tasks.txt"});
+        CHECK_EQUAL(conf->commandRun.taskResultsFile.string(), std::string{"/tasks.txt.results.json"});
+        CHECK_EQUAL(conf->commandRun.taskRetries, 0);
+
+        conf = generateConfig({"run", "--task-list=/tasks.txt", "--task-results=/results.json", "--task-retries=2", "image"});
+        CHECK_EQUAL(conf->commandRun.taskResultsFile.string(), std::string{"/results.json"});
+        CHECK_EQUAL(conf->commandRun.taskRetries, 2);
+
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--task-list=/tasks.txt", "image", "command"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--task-list=/tasks.txt", "--entrypoint=sh", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--task-list=/tasks.txt", "--detach", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--task-list=/tasks.txt", "--task-retries=-1", "image"}));
+        CHECK_THROWS(libsarus::Error, generateConfig({"run", "--task-retries=2", "image"}));
+    }
     // tty
     {
         auto conf = generateConfig({"run", "--tty", "image"});
@@ -77,6 +77,12 @@ boost::filesystem::path Config::getMetadataFileOfImage() const {
     return file;
 }
 
+boost::filesystem::path Config::getPrefetchProfileFileOfImage() const {
+    auto key = imageReference.getUniqueKey();
+    auto file = boost::filesystem::path(directories.images.string() + "/" + key + ".prefetch");
+    return file;
+}
+
 bool Config::isCentralizedRepositoryEnabled() const {
     // centralized repository is enabled when a directory is specified
     return json.HasMember("centralizedRepositoryDir");
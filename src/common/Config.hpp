@@ -11,11 +11,13 @@
 #ifndef sarus_common_Config_hpp
 #define sarus_common_Config_hpp
 
+#include <map>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <chrono>
 #include <memory>
+#include <cstdint>
 
 #include <boost/optional.hpp>
 #include <boost/filesystem.hpp>
@@ -66,6 +68,9 @@ class Config {
             std::unordered_map<std::string, std::string> userEnvironment;
             std::unordered_map<std::string, std::string> ociAnnotations;
             std::vector<int> cpuAffinity;
+            std::vector<int> memoryNodes; // NUMA nodes of cpuset.mems, empty if not set
+            std::map<size_t, size_t> hugepages; // page size in kB -> requested number of pages, 0 if not specified
+            std::map<size_t, size_t> hugepageLimits; // page size in kB -> limit in bytes of the hugetlb cgroup
             std::vector<std::string> userMounts;
             std::vector<std::shared_ptr<libsarus::Mount>> mounts;
             std::vector<std::shared_ptr<libsarus::DeviceMount>> deviceMounts;
@@ -73,6 +78,12 @@ class Config {
             boost::optional<boost::filesystem::path> workdir;
             boost::optional<libsarus::CLIArguments> entrypoint;
             boost::optional<std::string> containerName;
+            boost::optional<boost::filesystem::path> imageFile; // repository image file, as recorded in the repository metadata
+            boost::optional<boost::filesystem::path> nodeLocalImageFile; // staged or cached copy of the repository image
+            boost::optional<boost::filesystem::path> taskListFile; // tasks executed by the task runner in the container
+            boost::filesystem::path taskResultsFile;
+            size_t taskRetries = 0;
+            std::string imageFormat = "squashfs"; // filesystem type of the image file
             libsarus::CLIArguments execArgs;
             bool createNewPIDNamespace = false;
             bool allocatePseudoTTY = false;
@@ -80,10 +91,30 @@ class Config {
             bool useMPI = false;
             bool enableGlibcReplacement = false;
             bool enableSSH = false;
+            bool recordPrefetchProfile = false;
+            bool readOnlyRootfs = false;
+            bool detach = false;
+            std::chrono::seconds idleTimeout{0}; // of detached containers, 0 means no timeout
+        };
+
+        struct CommandStage {
+            std::vector<std::string> nodes;
+            size_t nodeRank = 0;
+            size_t fanout = 0;
+            std::uint16_t port = 0;
+            std::chrono::seconds timeout{0};
+            std::string jobID; // Slurm job and step IDs, empty outside of Slurm jobs
+            bool isExtraTaskOnNode = false;
+        };
+
+        struct CommandPrune {
+            boost::optional<size_t> quotaMB;
+            bool isDryRun = false;
         };
 
         boost::filesystem::path getImageFile() const;
         boost::filesystem::path getMetadataFileOfImage() const;
+        boost::filesystem::path getPrefetchProfileFileOfImage() const;
         boost::filesystem::path getCentralizedRepositoryDirectory() const;
         boost::filesystem::path getLocalRepositoryDirectory() const;
         boost::filesystem::path getRootfsDirectory() const;
@@ -94,11 +125,17 @@ class Config {
         common::ImageReference imageReference;
         Directories directories;
         rapidjson::Document json{ rapidjson::kObjectType };
+        rapidjson::Document validatedHooks{ rapidjson::kNullType }; // OCI hooks validated by the node daemon, null if not available
         libsarus::UserIdentity userIdentity;
         Authentication authentication;
         CommandRun commandRun;
+        CommandStage commandStage;
+        CommandPrune commandPrune;
 
         boost::filesystem::path archivePath; // for CommandLoad
+        boost::filesystem::path timingReportFile; // for CommandPull and CommandLoad
+        boost::filesystem::path accessProfileFile; // for CommandPull and CommandLoad
+        bool lazyPull = false; // for CommandPull
 
         bool useCentralizedRepository = false;
 
@@ -39,6 +39,8 @@ struct SarusImage {
     boost::filesystem::path imageFile;
     boost::filesystem::path metadataFile;
 
+    std::string format;          // The filesystem format of the image file (e.g. "squashfs", "erofs")
+
     static std::string createTimeString(time_t time_in);
     static std::string createSizeString(size_t size);
 };
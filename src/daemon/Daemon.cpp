@@ -0,0 +1,454 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "Daemon.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+#include <boost/regex.hpp>
+#include <rapidjson/pointer.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/OCIHooksFactory.hpp"
+#include "runtime/SecurityChecks.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace daemon {
+
+namespace {
+
+// the security checks also cover paths whose changes don't show up in the fingerprint
+// of the configuration (e.g. the binaries referenced by sarus.json)
+const auto maxConfigurationAge = std::chrono::seconds{60};
+
+rj::Document makeErrorResponse(const std::string& message) {
+    auto response = rj::Document{rj::kObjectType};
+    auto& allocator = response.GetAllocator();
+    response.AddMember("status", rj::Value{"error"}, allocator);
+    response.AddMember("message", rj::Value{message.c_str(), allocator}, allocator);
+    return response;
+}
+
+std::string makeFileFingerprint(const boost::filesystem::path& file) {
+    struct stat st;
+    if(stat(file.c_str(), &st) != 0) {
+        return file.string() + ":missing;";
+    }
+    return (boost::format("%s:%d:%d:%d.%d:%d.%d;")
+        % file.string() % st.st_ino % st.st_size
+        % st.st_mtim.tv_sec % st.st_mtim.tv_nsec
+        % st.st_ctim.tv_sec % st.st_ctim.tv_nsec).str();
+}
+
+std::vector<boost::filesystem::path> getHookFiles(const boost::filesystem::path& hooksDir) {
+    auto files = std::vector<boost::filesystem::path>{};
+    if(!boost::filesystem::is_directory(hooksDir)) {
+        return files;
+    }
+    for(const auto& entry : boost::filesystem::directory_iterator{hooksDir}) {
+        if(entry.path().extension() == ".json") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+}
+
+Daemon::Daemon(const boost::filesystem::path& prefixDir, const boost::filesystem::path& socketPath)
+    : prefixDir{prefixDir}
+    , socketPath{socketPath}
+    , imagesDir{socketPath.parent_path() / "images"}
+{
+    loadConfigurationIfChanged();
+
+    // the directory is private to root: the image mounts are only reached
+    // through the bind mounts of the Sarus processes
+    auto runDir = socketPath.parent_path();
+    libsarus::filesystem::createFoldersIfNecessary(runDir);
+    boost::filesystem::permissions(runDir, boost::filesystem::owner_all);
+
+    // images left mounted by a previous instance of the daemon
+    if(boost::filesystem::is_directory(imagesDir)) {
+        for(const auto& entry : boost::filesystem::directory_iterator{imagesDir}) {
+            umount2(entry.path().c_str(), MNT_DETACH);
+        }
+        boost::filesystem::remove_all(imagesDir);
+    }
+    libsarus::filesystem::createFoldersIfNecessary(imagesDir);
+
+    socketFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(socketFd < 0) {
+        auto message = boost::format("Failed to create socket: %s") % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if(socketPath.string().size() >= sizeof(address.sun_path)) {
+        auto message = boost::format("Path of socket %s is too long") % socketPath;
+        SARUS_THROW_ERROR(message.str());
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    if(boost::filesystem::exists(socketPath)) {
+        if(::connect(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            auto message = boost::format("Another node daemon is already serving socket %s") % socketPath;
+            SARUS_THROW_ERROR(message.str());
+        }
+        boost::filesystem::remove(socketPath);
+    }
+    if(::bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+       || chmod(socketPath.c_str(), 0600) != 0
+       || ::listen(socketFd, SOMAXCONN) != 0) {
+        auto message = boost::format("Failed to listen on socket %s: %s") % socketPath % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    libsarus::logMessage(boost::format("Node daemon listening on %s") % socketPath, libsarus::LogLevel::INFO);
+}
+
+Daemon::~Daemon() {
+    // waits for the connections in progress
+    connections.clear();
+    if(socketFd >= 0) {
+        close(socketFd);
+        boost::system::error_code ec;
+        boost::filesystem::remove(socketPath, ec);
+    }
+    for(const auto& image : imageMounts) {
+        unmountImage(image.second);
+    }
+}
+
+void Daemon::run() {
+    while(!isStopRequested) {
+        auto pfd = pollfd{socketFd, POLLIN, 0};
+        auto ret = poll(&pfd, 1, 1000);
+        if(ret < 0 && errno != EINTR) {
+            auto message = boost::format("Failed to poll socket %s: %s") % socketPath % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(ret > 0) {
+            acceptConnection();
+        }
+        joinFinishedConnections();
+        unmountIdleImages();
+    }
+    connections.clear();
+    libsarus::logMessage("Node daemon stopped", libsarus::LogLevel::INFO);
+}
+
+void Daemon::acceptConnection() {
+    auto connectionFd = accept4(socketFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if(connectionFd < 0) {
+        return;
+    }
+
+    // e.g. many requests stuck on a hung filesystem: the clients fall back to serving themselves
+    if(connections.size() >= maxConcurrentConnections) {
+        libsarus::logMessage(boost::format("Rejecting connection: %d requests are in progress") % connections.size(),
+                             libsarus::LogLevel::WARN);
+        try {
+            protocol::sendMessage(connectionFd, makeErrorResponse("Too many requests in progress"));
+        }
+        catch(libsarus::Error&) {}
+        close(connectionFd);
+        return;
+    }
+
+    try {
+        connections.push_back(std::async(std::launch::async, [this, connectionFd]() {
+            serveConnection(connectionFd);
+            close(connectionFd);
+        }));
+    }
+    catch(const std::system_error& e) {
+        libsarus::logMessage(boost::format("Failed to start thread serving connection: %s") % e.what(),
+                             libsarus::LogLevel::WARN);
+        close(connectionFd);
+    }
+}
+
+void Daemon::joinFinishedConnections() {
+    for(auto connection = connections.begin(); connection != connections.end();) {
+        if(connection->wait_for(std::chrono::seconds{0}) == std::future_status::ready) {
+            connection = connections.erase(connection);
+        }
+        else {
+            ++connection;
+        }
+    }
+}
+
+void Daemon::serveConnection(int connectionFd) {
+    // a stuck client must not block the other ones
+    auto timeout = timeval{5, 0};
+    setsockopt(connectionFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(connectionFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    try {
+        auto peer = protocol::getPeerCredentials(connectionFd);
+        auto request = protocol::receiveMessage(connectionFd);
+        auto response = handleRequest(request, peer);
+        protocol::sendMessage(connectionFd, response);
+    }
+    catch(const std::exception& e) {
+        // the exceptions of the connection threads would otherwise go unnoticed
+        auto message = boost::format("Failed to serve connection: %s") % e.what();
+        libsarus::logMessage(message, libsarus::LogLevel::WARN);
+    }
+}
+
+rj::Document Daemon::handleRequest(const rj::Document& request, const struct ucred& peer) {
+    // SO_PEERCRED reports the effective UID of the peer, i.e. root for the SUID Sarus executable
+    if(peer.uid != 0) {
+        auto message = boost::format("Rejected request from non-root peer (pid %d, uid %d)") % peer.pid % peer.uid;
+        libsarus::logMessage(message, libsarus::LogLevel::WARN);
+        return makeErrorResponse("Only root peers are served");
+    }
+    if(!request.IsObject() || !request.HasMember("request") || !request["request"].IsString()) {
+        return makeErrorResponse("Invalid request");
+    }
+
+    auto name = std::string{request["request"].GetString()};
+    libsarus::logMessage(boost::format("Serving %s request of pid %d") % name % peer.pid, libsarus::LogLevel::DEBUG);
+    try {
+        if(name == "configuration") {
+            return makeConfigurationResponse(request);
+        }
+        else if(name == "mountImage") {
+            return makeImageMountResponse(request);
+        }
+        return makeErrorResponse("Unknown request '" + name + "'");
+    }
+    catch(libsarus::Error& e) {
+        auto message = boost::format("Failed to serve %s request: %s") % name % e.what();
+        libsarus::logMessage(message, libsarus::LogLevel::WARN);
+        return makeErrorResponse(message.str());
+    }
+}
+
+rj::Document Daemon::makeConfigurationResponse(const rj::Document& request) {
+    // the configuration is only valid for the installation of Sarus served by the daemon
+    auto version = common::Config::BuildTime{}.version;
+    if(!request.HasMember("prefixDir") || request["prefixDir"] != prefixDir.c_str()
+       || !request.HasMember("version") || request["version"] != version.c_str()) {
+        auto message = boost::format("The node daemon serves the installation of Sarus in %s (version %s)")
+            % prefixDir % version;
+        return makeErrorResponse(message.str());
+    }
+
+    std::lock_guard<std::mutex> lock{mutex};
+    loadConfigurationIfChanged();
+
+    auto response = rj::Document{rj::kObjectType};
+    auto& allocator = response.GetAllocator();
+    response.AddMember("status", rj::Value{"ok"}, allocator);
+    response.AddMember("configuration", rj::Value{config->json, allocator}, allocator);
+    if(!hooks.IsNull()) {
+        response.AddMember("hooks", rj::Value{hooks, allocator}, allocator);
+    }
+    return response;
+}
+
+/**
+ * The image file is opened once and mounted through its file descriptor, so that the key
+ * of the mount (device, inode, size and modification time) is the one of the file which
+ * is actually mounted, even if the file is replaced in the meantime.
+ * The file is opened and mounted without holding the lock of the daemon state, which may
+ * take long on the shared filesystem of a repository.
+ */
+rj::Document Daemon::makeImageMountResponse(const rj::Document& request) {
+    if(!request.HasMember("imageFile") || !request["imageFile"].IsString()
+       || !request.HasMember("format") || !request["format"].IsString()) {
+        return makeErrorResponse("Invalid mountImage request");
+    }
+    auto imageFile = boost::filesystem::path{request["imageFile"].GetString()};
+    auto format = std::string{request["format"].GetString()};
+    static const boost::regex formatRegex("^(squashfs|erofs)$");
+    if(!imageFile.is_absolute() || !boost::regex_match(format, formatRegex)) {
+        return makeErrorResponse("Invalid mountImage request");
+    }
+
+    auto imageFd = open(imageFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if(imageFd < 0) {
+        auto message = boost::format("Failed to open image %s: %s") % imageFile % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    struct stat st;
+    if(fstat(imageFd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(imageFd);
+        auto message = boost::format("Image %s is not a regular file") % imageFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto key = ImageKey{st.st_dev, st.st_ino, st.st_size, st.st_mtime, format};
+    std::unique_lock<std::mutex> lock{mutex};
+    pendingMountsChanged.wait(lock, [&]() { return pendingMounts.count(key) == 0; });
+    auto image = imageMounts.find(key);
+    if(image != imageMounts.end()) {
+        struct stat mountSt;
+        if(stat(image->second.mountPoint.c_str(), &mountSt) != 0 || mountSt.st_dev != image->second.device) {
+            libsarus::logMessage(boost::format("Mount of image %s on %s disappeared")
+                                 % imageFile % image->second.mountPoint,
+                                 libsarus::LogLevel::WARN);
+            unmountImage(image->second);
+            imageMounts.erase(image);
+            image = imageMounts.end();
+        }
+    }
+
+    if(image == imageMounts.end()) {
+        auto mountPoint = imagesDir / std::to_string(numberOfMounts++);
+        pendingMounts.insert(key);
+        lock.unlock();
+        try {
+            libsarus::filesystem::createFoldersIfNecessary(mountPoint);
+            auto fdPath = boost::format("/proc/%d/fd/%d") % getpid() % imageFd;
+            libsarus::mount::loopMountImage(fdPath.str(), mountPoint, format);
+        }
+        catch(libsarus::Error& e) {
+            close(imageFd);
+            boost::system::error_code ec;
+            boost::filesystem::remove(mountPoint, ec);
+            lock.lock();
+            pendingMounts.erase(key);
+            pendingMountsChanged.notify_all();
+            auto message = boost::format("Failed to mount image %s") % imageFile;
+            SARUS_RETHROW_ERROR(e, message.str());
+        }
+        struct stat mountSt;
+        stat(mountPoint.c_str(), &mountSt);
+        lock.lock();
+        image = imageMounts.emplace(key, ImageMount{mountPoint, mountSt.st_dev, {}}).first;
+        pendingMounts.erase(key);
+        pendingMountsChanged.notify_all();
+        libsarus::logMessage(boost::format("Mounted image %s on %s") % imageFile % mountPoint,
+                             libsarus::LogLevel::INFO);
+    }
+    close(imageFd);
+    image->second.lastUse = std::chrono::steady_clock::now();
+
+    auto response = rj::Document{rj::kObjectType};
+    auto& allocator = response.GetAllocator();
+    response.AddMember("status", rj::Value{"ok"}, allocator);
+    response.AddMember("mountPoint", rj::Value{image->second.mountPoint.c_str(), allocator}, allocator);
+    response.AddMember("device", rj::Value{static_cast<uint64_t>(image->second.device)}, allocator);
+    return response;
+}
+
+/**
+ * The configuration, the OCI hooks and the results of the security checks are reloaded
+ * when one of the files they are read from changes, and at least every minute.
+ */
+void Daemon::loadConfigurationIfChanged() {
+    auto now = std::chrono::steady_clock::now();
+    auto fingerprint = makeConfigurationFingerprint();
+    if(config && fingerprint == configurationFingerprint && now - configurationLoadTime < maxConfigurationAge) {
+        return;
+    }
+
+    libsarus::logMessage("Loading configuration", libsarus::LogLevel::INFO);
+    auto newConfig = std::make_shared<common::Config>(prefixDir);
+    runtime::SecurityChecks{newConfig}.runSecurityChecks(prefixDir);
+
+    auto newHooks = rj::Document{rj::kNullType};
+    if(newConfig->json.HasMember("hooksDir")) {
+        auto hooksDir = boost::filesystem::path{newConfig->json["hooksDir"].GetString()};
+        auto schemaFile = prefixDir / "etc/hook.schema.json";
+        newHooks.SetArray();
+        auto& allocator = newHooks.GetAllocator();
+        for(const auto& file : getHookFiles(hooksDir)) {
+            auto json = libsarus::json::readAndValidate(file, schemaFile);
+            runtime::OCIHooksFactory{}.createHook(file, json); // validates the content beyond the schema
+            auto hook = rj::Value{rj::kObjectType};
+            hook.AddMember("file", rj::Value{file.c_str(), allocator}, allocator);
+            hook.AddMember("json", rj::Value{json, allocator}, allocator);
+            newHooks.PushBack(hook, allocator);
+        }
+    }
+
+    auto newImageIdleTimeout = std::chrono::seconds{600};
+    if(const auto* value = rj::Pointer("/nodeDaemon/imageIdleTimeout").Get(newConfig->json)) {
+        newImageIdleTimeout = std::chrono::seconds{value->GetInt64()};
+    }
+
+    config = newConfig;
+    hooks.Swap(newHooks);
+    imageIdleTimeout = newImageIdleTimeout;
+    configurationFingerprint = fingerprint;
+    configurationLoadTime = now;
+    libsarus::logMessage("Successfully loaded configuration", libsarus::LogLevel::INFO);
+}
+
+std::string Daemon::makeConfigurationFingerprint() const {
+    auto fingerprint = makeFileFingerprint(prefixDir / "etc/sarus.json")
+                     + makeFileFingerprint(prefixDir / "etc/sarus.schema.json")
+                     + makeFileFingerprint(prefixDir / "etc/definitions.schema.json")
+                     + makeFileFingerprint(prefixDir / "etc/hook.schema.json");
+    if(config && config->json.HasMember("hooksDir")) {
+        auto hooksDir = boost::filesystem::path{config->json["hooksDir"].GetString()};
+        fingerprint += makeFileFingerprint(hooksDir);
+        for(const auto& file : getHookFiles(hooksDir)) {
+            fingerprint += makeFileFingerprint(file);
+        }
+    }
+    return fingerprint;
+}
+
+/**
+ * The mounts are detached lazily: the containers which bind mounted an image keep it
+ * until they exit.
+ */
+void Daemon::unmountIdleImages() {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto now = std::chrono::steady_clock::now();
+    for(auto image = imageMounts.begin(); image != imageMounts.end();) {
+        if(imageIdleTimeout.count() > 0 && now - image->second.lastUse > imageIdleTimeout) {
+            libsarus::logMessage(boost::format("Unmounting idle image from %s") % image->second.mountPoint,
+                                 libsarus::LogLevel::INFO);
+            unmountImage(image->second);
+            image = imageMounts.erase(image);
+        }
+        else {
+            ++image;
+        }
+    }
+}
+
+void Daemon::unmountImage(const ImageMount& image) const {
+    if(umount2(image.mountPoint.c_str(), MNT_DETACH) != 0 && errno != EINVAL) {
+        auto message = boost::format("Failed to unmount image from %s: %s") % image.mountPoint % strerror(errno);
+        libsarus::logMessage(message, libsarus::LogLevel::WARN);
+        return;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove(image.mountPoint, ec);
+}
+
+}
+}
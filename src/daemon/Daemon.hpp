@@ -0,0 +1,115 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_daemon_Daemon_hpp
+#define sarus_daemon_Daemon_hpp
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "common/Config.hpp"
+#include "daemon/DaemonProtocol.hpp"
+
+
+namespace sarus {
+namespace daemon {
+
+/**
+ * Node daemon (sarusd): a root process serving the Sarus processes of the node, to which
+ * it spares the work that is identical across launches:
+ *
+ * - The configuration is read, validated against its schema and checked with the security
+ *   checks once, together with the OCI hooks. They are reloaded when one of their files
+ *   changes.
+ * - The images are loop mounted once, under the directory of the socket, and stay mounted
+ *   until they are not requested for the configured idle timeout. A new version of an
+ *   image file (another inode, size or modification time) gets a new mount.
+ *
+ * Only root peers (i.e. the SUID Sarus executable) are served, as checked through the
+ * SO_PEERCRED socket option. Each connection is served by its own thread, so that opening
+ * or mounting an image on a slow (or hung) filesystem does not delay the other requests.
+ * Concurrent requests for the same image wait for a single mount.
+ */
+class Daemon {
+public:
+    Daemon(const boost::filesystem::path& prefixDir,
+           const boost::filesystem::path& socketPath = protocol::defaultSocketPath);
+    Daemon(const Daemon&) = delete;
+    Daemon& operator=(const Daemon&) = delete;
+    ~Daemon();
+
+    void run();
+    void stop() { isStopRequested = true; }
+
+private:
+    using ImageKey = std::tuple<dev_t, ino_t, off_t, time_t, std::string>;
+
+    struct ImageMount {
+        boost::filesystem::path mountPoint;
+        dev_t device;
+        std::chrono::steady_clock::time_point lastUse;
+    };
+
+private:
+    static const size_t maxConcurrentConnections = 64;
+
+private:
+    void acceptConnection();
+    void joinFinishedConnections();
+    void serveConnection(int connectionFd);
+    rapidjson::Document handleRequest(const rapidjson::Document& request, const struct ucred& peer);
+    rapidjson::Document makeConfigurationResponse(const rapidjson::Document& request);
+    rapidjson::Document makeImageMountResponse(const rapidjson::Document& request);
+    void loadConfigurationIfChanged();
+    std::string makeConfigurationFingerprint() const;
+    void unmountIdleImages();
+    void unmountImage(const ImageMount&) const;
+
+private:
+    boost::filesystem::path prefixDir;
+    boost::filesystem::path socketPath;
+    boost::filesystem::path imagesDir;
+    int socketFd = -1;
+    std::atomic<bool> isStopRequested{false};
+
+    std::shared_ptr<common::Config> config;
+    rapidjson::Document hooks{rapidjson::kNullType};
+    std::string configurationFingerprint;
+    std::chrono::steady_clock::time_point configurationLoadTime;
+    std::chrono::seconds imageIdleTimeout{600};
+
+    // the state above and below is shared by the threads serving the connections
+    std::mutex mutex;
+    std::condition_variable pendingMountsChanged;
+    std::map<ImageKey, ImageMount> imageMounts;
+    std::set<ImageKey> pendingMounts; // being mounted by a connection thread
+    size_t numberOfMounts = 0;
+
+    std::list<std::future<void>> connections;
+};
+
+}
+}
+
+#endif
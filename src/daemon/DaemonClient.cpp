@@ -0,0 +1,163 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "DaemonClient.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace daemon {
+
+DaemonClient::DaemonClient(const boost::filesystem::path& socketPath)
+    : socketPath{socketPath}
+{}
+
+/**
+ * Replaces the JSON of the configuration with the one validated by the daemon, together
+ * with the OCI hooks. The daemon also ran the security checks on the configuration.
+ */
+bool DaemonClient::loadConfiguration(common::Config& config, const boost::filesystem::path& prefixDir) const {
+    auto request = rj::Document{rj::kObjectType};
+    auto& allocator = request.GetAllocator();
+    request.AddMember("request", rj::Value{"configuration"}, allocator);
+    request.AddMember("prefixDir", rj::Value{prefixDir.c_str(), allocator}, allocator);
+    request.AddMember("version", rj::Value{config.buildTime.version.c_str(), allocator}, allocator);
+
+    auto response = rj::Document{};
+    if(!sendRequest(request, response)) {
+        return false;
+    }
+    if(!response.HasMember("configuration") || !response["configuration"].IsObject()) {
+        libsarus::logMessage("Ignoring response of node daemon without configuration", libsarus::LogLevel::WARN);
+        return false;
+    }
+
+    config.json.CopyFrom(response["configuration"], config.json.GetAllocator());
+    if(response.HasMember("hooks")) {
+        config.validatedHooks.CopyFrom(response["hooks"], config.validatedHooks.GetAllocator());
+    }
+    libsarus::logMessage("Loaded configuration from node daemon", libsarus::LogLevel::DEBUG);
+    return true;
+}
+
+/**
+ * Returns the directory where the daemon mounted the image. The daemon keeps the image
+ * mounted across containers, hence the caller only needs a bind mount of the directory.
+ */
+boost::optional<DaemonClient::ImageMount> DaemonClient::mountImage(const boost::filesystem::path& imageFile,
+                                                                   const std::string& format) const {
+    auto request = rj::Document{rj::kObjectType};
+    auto& allocator = request.GetAllocator();
+    request.AddMember("request", rj::Value{"mountImage"}, allocator);
+    request.AddMember("imageFile", rj::Value{imageFile.c_str(), allocator}, allocator);
+    request.AddMember("format", rj::Value{format.c_str(), allocator}, allocator);
+
+    auto response = rj::Document{};
+    if(!sendRequest(request, response)) {
+        return {};
+    }
+    if(!response.HasMember("mountPoint") || !response["mountPoint"].IsString()
+       || !response.HasMember("device") || !response["device"].IsUint64()) {
+        libsarus::logMessage("Ignoring response of node daemon without image mount", libsarus::LogLevel::WARN);
+        return {};
+    }
+
+    auto mount = ImageMount{response["mountPoint"].GetString(), static_cast<dev_t>(response["device"].GetUint64())};
+    libsarus::logMessage(boost::format("Node daemon mounted image %s on %s") % imageFile % mount.mountPoint,
+                         libsarus::LogLevel::DEBUG);
+    return mount;
+}
+
+bool DaemonClient::sendRequest(const rj::Value& request, rj::Document& response) const {
+    auto requestName = std::string{request["request"].GetString()};
+    if(!boost::filesystem::exists(socketPath)) {
+        libsarus::logMessage(boost::format("Node daemon not available: %s not found") % socketPath,
+                             libsarus::LogLevel::DEBUG);
+        return false;
+    }
+
+    auto socketFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(socketFd < 0) {
+        libsarus::logMessage(boost::format("Failed to create socket for node daemon: %s") % strerror(errno),
+                             libsarus::LogLevel::WARN);
+        return false;
+    }
+
+    try {
+        auto address = sockaddr_un{};
+        address.sun_family = AF_UNIX;
+        if(socketPath.string().size() >= sizeof(address.sun_path)) {
+            auto message = boost::format("Path of node daemon's socket %s is too long") % socketPath;
+            SARUS_THROW_ERROR(message.str());
+        }
+        std::strcpy(address.sun_path, socketPath.c_str());
+
+        // the mounts of images can take a while, e.g. on a slow filesystem
+        auto timeout = timeval{60, 0};
+        setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(socketFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        if(::connect(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            libsarus::logMessage(boost::format("Node daemon not available: failed to connect to %s: %s")
+                                 % socketPath % strerror(errno),
+                                 libsarus::LogLevel::DEBUG);
+            close(socketFd);
+            return false;
+        }
+
+        // the responses are trusted (e.g. the configuration is not validated again),
+        // hence the daemon must be root
+        auto peer = protocol::getPeerCredentials(socketFd);
+        if(peer.uid != 0) {
+            auto message = boost::format("Ignoring node daemon: the peer of socket %s is not root (uid %d)")
+                % socketPath % peer.uid;
+            libsarus::logMessage(message, libsarus::LogLevel::WARN);
+            close(socketFd);
+            return false;
+        }
+
+        protocol::sendMessage(socketFd, request);
+        response = protocol::receiveMessage(socketFd);
+        close(socketFd);
+    }
+    catch(libsarus::Error& e) {
+        close(socketFd);
+        auto message = boost::format("Failed to send %s request to node daemon, falling back to standalone mode: %s")
+            % requestName % e.what();
+        libsarus::logMessage(message, libsarus::LogLevel::WARN);
+        return false;
+    }
+
+    if(!response.IsObject() || !response.HasMember("status") || response["status"] != "ok") {
+        auto message = boost::format("Node daemon failed to serve %s request, falling back to standalone mode: %s")
+            % requestName
+            % (response.IsObject() && response.HasMember("message") && response["message"].IsString()
+               ? response["message"].GetString() : "invalid response");
+        libsarus::logMessage(message, libsarus::LogLevel::WARN);
+        return false;
+    }
+    return true;
+}
+
+}
+}
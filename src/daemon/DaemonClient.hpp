@@ -0,0 +1,60 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_daemon_DaemonClient_hpp
+#define sarus_daemon_DaemonClient_hpp
+
+#include <string>
+#include <sys/types.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <rapidjson/document.h>
+
+#include "common/Config.hpp"
+#include "daemon/DaemonProtocol.hpp"
+
+
+namespace sarus {
+namespace daemon {
+
+/**
+ * Client side of the node daemon (sarusd). The daemon is optional: when it is not running,
+ * or it can't serve a request, the methods return an empty result and Sarus falls back to
+ * doing the work itself.
+ *
+ * The daemon is only trusted if the peer of the socket is root, as checked through the
+ * SO_PEERCRED socket option.
+ */
+class DaemonClient {
+public:
+    struct ImageMount {
+        boost::filesystem::path mountPoint;
+        dev_t device;
+    };
+
+public:
+    DaemonClient(const boost::filesystem::path& socketPath = protocol::defaultSocketPath);
+
+    bool loadConfiguration(common::Config&, const boost::filesystem::path& prefixDir) const;
+    boost::optional<ImageMount> mountImage(const boost::filesystem::path& imageFile,
+                                           const std::string& format) const;
+
+private:
+    bool sendRequest(const rapidjson::Value& request, rapidjson::Document& response) const;
+
+private:
+    boost::filesystem::path socketPath;
+};
+
+}
+}
+
+#endif
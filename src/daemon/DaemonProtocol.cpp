@@ -0,0 +1,87 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "DaemonProtocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace daemon {
+namespace protocol {
+
+const boost::filesystem::path defaultSocketPath = "/run/sarus/sarusd.sock";
+
+void sendMessage(int socketFd, const rapidjson::Value& message) {
+    auto serialized = libsarus::json::serialize(message);
+    ssize_t n;
+    do {
+        n = ::send(socketFd, serialized.data(), serialized.size(), MSG_NOSIGNAL);
+    } while(n < 0 && errno == EINTR);
+    if(n != static_cast<ssize_t>(serialized.size())) {
+        auto message = boost::format("Failed to send message of %d bytes to the node daemon's socket: %s")
+            % serialized.size() % (n < 0 ? strerror(errno) : "short write");
+        SARUS_THROW_ERROR(message.str());
+    }
+}
+
+rapidjson::Document receiveMessage(int socketFd) {
+    // peek the size of the packet first, so that the buffer can be sized exactly
+    ssize_t size;
+    char byte;
+    do {
+        size = ::recv(socketFd, &byte, 1, MSG_PEEK | MSG_TRUNC);
+    } while(size < 0 && errno == EINTR);
+    if(size <= 0) {
+        auto message = boost::format("Failed to receive message from the node daemon's socket: %s")
+            % (size < 0 ? strerror(errno) : "connection closed");
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto buffer = std::vector<char>(size);
+    ssize_t n;
+    do {
+        n = ::recv(socketFd, buffer.data(), buffer.size(), 0);
+    } while(n < 0 && errno == EINTR);
+    if(n != size) {
+        auto message = boost::format("Failed to receive message of %d bytes from the node daemon's socket: %s")
+            % size % (n < 0 ? strerror(errno) : "short read");
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    try {
+        return libsarus::json::parse(std::string(buffer.cbegin(), buffer.cend()));
+    }
+    catch(libsarus::Error& e) {
+        SARUS_RETHROW_ERROR(e, "Failed to parse message from the node daemon's socket");
+    }
+}
+
+struct ucred getPeerCredentials(int socketFd) {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if(getsockopt(socketFd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+        auto message = boost::format("Failed to get credentials of the node daemon's socket peer: %s")
+            % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return credentials;
+}
+
+}
+}
+}
@@ -0,0 +1,46 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_daemon_DaemonProtocol_hpp
+#define sarus_daemon_DaemonProtocol_hpp
+
+#include <sys/socket.h>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+
+/**
+ * Messages exchanged between Sarus and the node daemon (sarusd). The messages are JSON
+ * documents sent over a UNIX socket of type SOCK_SEQPACKET, one document per packet, hence
+ * no framing is needed. Each connection carries one request and one response.
+ *
+ * Requests:
+ *   {"request": "configuration", "prefixDir": ..., "version": ...}
+ *   {"request": "mountImage", "imageFile": ..., "format": ...}
+ *
+ * Responses:
+ *   {"status": "ok", ...} or {"status": "error", "message": ...}
+ */
+namespace sarus {
+namespace daemon {
+namespace protocol {
+
+extern const boost::filesystem::path defaultSocketPath;
+
+void sendMessage(int socketFd, const rapidjson::Value& message);
+rapidjson::Document receiveMessage(int socketFd);
+struct ucred getPeerCredentials(int socketFd);
+
+}
+}
+}
+
+#endif
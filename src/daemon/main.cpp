@@ -0,0 +1,96 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <clocale>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Logger.hpp"
+#include "daemon/Daemon.hpp"
+
+
+using namespace sarus;
+
+static daemon::Daemon* nodeDaemon = nullptr;
+
+static void stopDaemon(int) {
+    if(nodeDaemon != nullptr) {
+        nodeDaemon->stop();
+    }
+}
+
+static void printUsage() {
+    std::cerr << "Usage: sarusd [--verbose|--debug]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::setlocale(LC_CTYPE, "C.UTF-8");
+    umask(022);
+
+    auto& logger = libsarus::Logger::getInstance();
+
+    static const option options[] = {
+        {"verbose", no_argument, nullptr, 'v'},
+        {"debug", no_argument, nullptr, 'd'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int opt;
+    while((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch(opt) {
+        case 'v':
+            logger.setLevel(libsarus::LogLevel::INFO);
+            break;
+        case 'd':
+            logger.setLevel(libsarus::LogLevel::DEBUG);
+            break;
+        default:
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    if(optind != argc) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if(geteuid() != 0) {
+            SARUS_THROW_ERROR("The node daemon must run as root");
+        }
+
+        // the daemon serves the installation of Sarus it belongs to
+        auto prefixDir = boost::filesystem::canonical("/proc/self/exe").parent_path().parent_path();
+        // the socket is not configurable: Sarus connects to the daemon before reading the configuration
+        daemon::Daemon server{prefixDir, daemon::protocol::defaultSocketPath};
+        nodeDaemon = &server;
+        std::signal(SIGTERM, stopDaemon);
+        std::signal(SIGINT, stopDaemon);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        server.run();
+        nodeDaemon = nullptr;
+    }
+    catch(const libsarus::Error& e) {
+        logger.logErrorTrace(e, "sarusd");
+        return EXIT_FAILURE;
+    }
+    catch(const std::exception& e) {
+        logger.log(e.what(), "sarusd", libsarus::LogLevel::ERROR);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test_utility/config.hpp"
+#include "libsarus/Utility.hpp"
+#include "daemon/Daemon.hpp"
+#include "daemon/DaemonClient.hpp"
+#include "runtime/OCIHooksFactory.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+using namespace sarus;
+
+TEST_GROUP(DaemonTestGroup) {
+};
+
+TEST(DaemonTestGroup, daemon_not_available) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = configRAII.config;
+    auto prefixDir = boost::filesystem::path{config->json["prefixDir"].GetString()};
+
+    auto client = daemon::DaemonClient{prefixDir / "run/sarusd.sock"};
+    auto loadedConfig = common::Config{};
+    CHECK_FALSE(client.loadConfiguration(loadedConfig, prefixDir));
+    CHECK(!client.mountImage(prefixDir / "image.squashfs", "squashfs"));
+}
+
+#ifdef ASROOT
+TEST(DaemonTestGroup, configuration) {
+#else
+IGNORE_TEST(DaemonTestGroup, configuration) {
+#endif
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = configRAII.config;
+    auto prefixDir = boost::filesystem::path{config->json["prefixDir"].GetString()};
+    libsarus::json::write(config->json, prefixDir / "etc/sarus.json");
+
+    auto socketPath = prefixDir / "run/sarusd.sock";
+    daemon::Daemon server{prefixDir, socketPath};
+    auto serverThread = std::thread{[&server]() { server.run(); }};
+    auto client = daemon::DaemonClient{socketPath};
+
+    // configuration and hooks validated by the daemon
+    {
+        auto loadedConfig = common::Config{};
+        CHECK(client.loadConfiguration(loadedConfig, prefixDir));
+        CHECK(loadedConfig.json == config->json);
+        CHECK(loadedConfig.validatedHooks.IsArray());
+        CHECK_EQUAL(loadedConfig.validatedHooks.Size(), 1u);
+        auto hooks = runtime::OCIHooksFactory{}.createHooks(loadedConfig.validatedHooks);
+        CHECK_EQUAL(hooks.size(), 1u);
+        CHECK_EQUAL(hooks[0].jsonFile.filename().string(), std::string{"test-hook.json"});
+    }
+    // another installation of Sarus
+    {
+        auto loadedConfig = common::Config{};
+        CHECK_FALSE(client.loadConfiguration(loadedConfig, prefixDir / "another"));
+    }
+    // reload after a change of the configuration
+    {
+        config->json["tempDir"].SetString("/var/tmp");
+        libsarus::json::write(config->json, prefixDir / "etc/sarus.json");
+        auto loadedConfig = common::Config{};
+        CHECK(client.loadConfiguration(loadedConfig, prefixDir));
+        CHECK_EQUAL(loadedConfig.json["tempDir"].GetString(), std::string{"/var/tmp"});
+    }
+
+    server.stop();
+    serverThread.join();
+}
+
+#ifdef ASROOT
+TEST(DaemonTestGroup, image_mounts) {
+#else
+IGNORE_TEST(DaemonTestGroup, image_mounts) {
+#endif
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = configRAII.config;
+    auto prefixDir = boost::filesystem::path{config->json["prefixDir"].GetString()};
+    libsarus::json::write(config->json, prefixDir / "etc/sarus.json");
+    auto image = prefixDir / "image.squashfs";
+    libsarus::filesystem::copyFile(boost::filesystem::path{__FILE__}.parent_path().parent_path().parent_path()
+                                   / "libsarus/test/test_image.squashfs",
+                                   image);
+
+    auto socketPath = prefixDir / "run/sarusd.sock";
+    auto mountPoint = boost::filesystem::path{};
+    {
+        daemon::Daemon server{prefixDir, socketPath};
+        auto serverThread = std::thread{[&server]() { server.run(); }};
+        auto client = daemon::DaemonClient{socketPath};
+
+        auto mount = client.mountImage(image, "squashfs");
+        CHECK(mount);
+        mountPoint = mount->mountPoint;
+        struct stat st;
+        CHECK(stat(mountPoint.c_str(), &st) == 0);
+        CHECK(st.st_dev == mount->device);
+        CHECK(boost::filesystem::exists(mountPoint / "etc"));
+
+        // the mount is reused
+        auto secondMount = client.mountImage(image, "squashfs");
+        CHECK(secondMount);
+        CHECK(secondMount->mountPoint == mountPoint);
+
+        // a new version of the image gets a new mount
+        boost::filesystem::remove(image);
+        libsarus::filesystem::copyFile(boost::filesystem::path{__FILE__}.parent_path().parent_path().parent_path()
+                                       / "libsarus/test/test_image.squashfs",
+                                       image);
+        auto thirdMount = client.mountImage(image, "squashfs");
+        CHECK(thirdMount);
+        CHECK(thirdMount->mountPoint != mountPoint);
+
+        // invalid requests
+        CHECK(!client.mountImage(prefixDir / "missing.squashfs", "squashfs"));
+        CHECK(!client.mountImage(image, "squashfs,exec"));
+        CHECK(!client.mountImage("image.squashfs", "squashfs"));
+
+        server.stop();
+        serverThread.join();
+    }
+    // the images are unmounted when the daemon exits
+    CHECK(!boost::filesystem::exists(mountPoint));
+}
+
+#ifdef ASROOT
+TEST(DaemonTestGroup, concurrent_requests) {
+#else
+IGNORE_TEST(DaemonTestGroup, concurrent_requests) {
+#endif
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = configRAII.config;
+    auto prefixDir = boost::filesystem::path{config->json["prefixDir"].GetString()};
+    libsarus::json::write(config->json, prefixDir / "etc/sarus.json");
+    auto image = prefixDir / "image.squashfs";
+    libsarus::filesystem::copyFile(boost::filesystem::path{__FILE__}.parent_path().parent_path().parent_path()
+                                   / "libsarus/test/test_image.squashfs",
+                                   image);
+    // opening a FIFO blocks until a writer shows up, like an image on a hung filesystem
+    auto stuckImage = prefixDir / "stuck.squashfs";
+    CHECK(mkfifo(stuckImage.c_str(), 0600) == 0);
+
+    auto socketPath = prefixDir / "run/sarusd.sock";
+    {
+        daemon::Daemon server{prefixDir, socketPath};
+        auto serverThread = std::thread{[&server]() { server.run(); }};
+
+        auto isStuckRequestServed = false;
+        auto stuckThread = std::thread{[&]() {
+            auto client = daemon::DaemonClient{socketPath};
+            isStuckRequestServed = static_cast<bool>(client.mountImage(stuckImage, "squashfs"));
+        }};
+
+        // the requests of other clients are served in the meantime
+        auto mountPoints = std::vector<boost::filesystem::path>(4);
+        auto threads = std::vector<std::thread>{};
+        for(size_t i=0; i<mountPoints.size(); ++i) {
+            threads.emplace_back([&, i]() {
+                auto mount = daemon::DaemonClient{socketPath}.mountImage(image, "squashfs");
+                if(mount) {
+                    mountPoints[i] = mount->mountPoint;
+                }
+            });
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        // concurrent requests of the same image share a single mount
+        CHECK(!mountPoints[0].empty());
+        for(const auto& mountPoint : mountPoints) {
+            CHECK(mountPoint == mountPoints[0]);
+        }
+
+        // unblock the stuck request, which fails because the FIFO is not a regular file
+        auto fifoFd = open(stuckImage.c_str(), O_WRONLY);
+        stuckThread.join();
+        close(fifoFd);
+        CHECK(!isStuckRequestServed);
+
+        server.stop();
+        serverThread.join();
+    }
+}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -20,6 +20,7 @@
 #include "libsarus/Error.hpp"
 #include "libsarus/Utility.hpp"
 #include "libsarus/MountParser.hpp"
+#include "libsarus/MountPlan.hpp"
 #include "libsarus/DeviceParser.hpp"
 
 namespace sarus {
@@ -174,9 +175,13 @@ void MountHook::performBindMounts() const {
     }
 
     log("Performing bind mounts", libsarus::LogLevel::INFO);
+    auto plan = libsarus::MountPlan{rootfsDir, userIdentity};
     for(const auto& mount : bindMounts) {
-        mount->performMount();
+        plan.add(*mount, "bind");
     }
+    plan.resolve();
+    log(plan.dump(), libsarus::LogLevel::DEBUG);
+    plan.execute();
     log("Successfully performed bind mounts", libsarus::LogLevel::INFO);
 }
 
@@ -188,8 +193,14 @@ void MountHook::performDeviceMounts() const {
 
     log("Performing device mounts", libsarus::LogLevel::INFO);
     auto devicesCgroupPath = libsarus::hook::findCgroupPath("devices", "/", containerState.pid());
+    auto plan = libsarus::MountPlan{rootfsDir, userIdentity};
+    for(const auto& mount : deviceMounts) {
+        plan.add(*mount, "device");
+    }
+    plan.resolve();
+    log(plan.dump(), libsarus::LogLevel::DEBUG);
+    plan.execute();
     for(const auto& mount : deviceMounts) {
-        mount->performMount();
         libsarus::hook::whitelistDeviceInCgroup(devicesCgroupPath, rootfsDir / mount->getDestination());
     }
     log("Successfully performed device mounts", libsarus::LogLevel::INFO);
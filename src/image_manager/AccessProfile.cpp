@@ -0,0 +1,117 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/AccessProfile.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <set>
+
+#include <boost/algorithm/string.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+AccessProfile::AccessProfile(const std::vector<boost::filesystem::path>& files) {
+    auto uniqueFiles = std::set<boost::filesystem::path>{};
+    for(const auto& file : files) {
+        if(uniqueFiles.insert(file).second) {
+            this->files.push_back(file);
+        }
+    }
+}
+
+AccessProfile AccessProfile::read(const boost::filesystem::path& file) {
+    auto is = std::ifstream{file.string()};
+    if(!is) {
+        auto message = boost::format("Failed to open access profile %s") % file;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto files = std::vector<boost::filesystem::path>{};
+    auto line = std::string{};
+    for(size_t lineNumber = 1; std::getline(is, line); ++lineNumber) {
+        boost::trim(line);
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        auto path = boost::filesystem::path{line};
+        if(!path.is_absolute()) {
+            auto message = boost::format("Invalid access profile %s: path %s at line %d is not absolute")
+                           % file % path % lineNumber;
+            SARUS_THROW_ERROR(message.str());
+        }
+        files.push_back(path);
+    }
+    return AccessProfile{files};
+}
+
+/**
+ * Writes the sort file for the unpacked image in rootfs. mksquashfs identifies the
+ * entries of the sort file by device and inode, so the paths of the profile are
+ * resolved within the rootfs and written as absolute host paths. Paths which do not
+ * resolve to a regular file of the image are skipped, as well as paths which cannot
+ * be represented in a sort file (i.e. containing whitespace).
+ *
+ * Returns the number of files written to the sort file.
+ */
+size_t AccessProfile::writeSortFile(const boost::filesystem::path& rootfs, const boost::filesystem::path& sortFile) const {
+    auto os = std::ofstream{sortFile.string()};
+    if(!os) {
+        auto message = boost::format("Failed to open mksquashfs sort file %s for writing") % sortFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto writtenFiles = std::set<boost::filesystem::path>{};
+    auto priority = maxPriority;
+    for(const auto& file : files) {
+        auto hostPath = rootfs / libsarus::filesystem::realpathWithinRootfs(rootfs, file);
+        if(!boost::filesystem::is_regular_file(boost::filesystem::symlink_status(hostPath))) {
+            printLog(boost::format("Skipping %s of access profile: not a regular file in the image") % file,
+                     libsarus::LogLevel::DEBUG);
+            continue;
+        }
+        auto hostPathString = hostPath.string();
+        if(std::any_of(hostPathString.cbegin(), hostPathString.cend(), ::isspace)) {
+            printLog(boost::format("Skipping %s of access profile: path contains whitespace") % file,
+                     libsarus::LogLevel::DEBUG);
+            continue;
+        }
+        if(!writtenFiles.insert(hostPath).second) {
+            continue;
+        }
+
+        os << hostPathString << " " << priority << "\n";
+        // files beyond the range of priorities are still placed before the other files of the image
+        priority = std::max(priority - 1, 1);
+    }
+
+    if(!os) {
+        auto message = boost::format("Failed to write mksquashfs sort file %s") % sortFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    printLog(boost::format("Wrote %d of %d files of access profile to sort file %s")
+                % writtenFiles.size() % files.size() % sortFile,
+             libsarus::LogLevel::INFO);
+    return writtenFiles.size();
+}
+
+void AccessProfile::printLog(const boost::format& message, libsarus::LogLevel level) const {
+    libsarus::Logger::getInstance().log(message, "AccessProfile", level);
+}
+
+}
+}
@@ -0,0 +1,60 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_AccessProfile_hpp
+#define sarus_image_manger_AccessProfile_hpp
+
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Ordered list of the files accessed by an application in a container (e.g. at startup),
+ * recorded from a previous run or supplied by the user.
+ *
+ * The profile is a text file with one absolute path within the container per line, in
+ * order of access. Empty lines and lines starting with '#' are ignored, as well as the
+ * repeated occurrences of a path.
+ *
+ * The profile is translated into a mksquashfs sort file, so that the files of the profile
+ * are stored contiguously and in order of access at the beginning of the squashfs image.
+ */
+class AccessProfile {
+public:
+    // range of the priorities of mksquashfs sort files: files without priority have priority 0
+    static const int maxPriority = 32767;
+
+public:
+    AccessProfile() = default;
+    AccessProfile(const std::vector<boost::filesystem::path>& files);
+    static AccessProfile read(const boost::filesystem::path& file);
+
+    const std::vector<boost::filesystem::path>& getFiles() const { return files; };
+    size_t writeSortFile(const boost::filesystem::path& rootfs, const boost::filesystem::path& sortFile) const;
+
+private:
+    void printLog(const boost::format& message, libsarus::LogLevel level) const;
+
+private:
+    std::vector<boost::filesystem::path> files;
+};
+
+}
+}
+
+#endif
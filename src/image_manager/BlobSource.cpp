@@ -0,0 +1,235 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/BlobSource.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <boost/regex.hpp>
+#include <rapidjson/pointer.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+boost::filesystem::path getRelativeBlobPath(const std::string& digest) {
+    auto separator = digest.find(":");
+    if(separator == std::string::npos
+       || digest.find("/") != std::string::npos
+       || digest.find("..") != std::string::npos) {
+        auto message = boost::format("Invalid blob digest '%s'") % digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return boost::filesystem::path{"blobs"} / digest.substr(0, separator) / digest.substr(separator+1);
+}
+
+}
+
+DirectoryBlobSource::DirectoryBlobSource(const boost::filesystem::path& directory)
+    : directory{directory}
+{}
+
+std::string DirectoryBlobSource::getDescription() const {
+    return directory.string();
+}
+
+std::string DirectoryBlobSource::readRange(const std::string& digest, std::uint64_t offset, std::uint64_t length) const {
+    auto file = getBlobFile(digest);
+    auto fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        auto message = boost::format("Failed to open blob %s: %s") % file % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto data = std::string(length, '\0');
+    auto done = std::uint64_t{0};
+    while(done < length) {
+        auto bytes = pread(fd, &data[done], length - done, offset + done);
+        if(bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if(bytes <= 0) {
+            auto error = bytes < 0 ? std::string{strerror(errno)} : std::string{"range exceeds the size of the blob"};
+            close(fd);
+            auto message = boost::format("Failed to read range %d-%d of blob %s: %s")
+                % offset % (offset + length) % file % error;
+            SARUS_THROW_ERROR(message.str());
+        }
+        done += bytes;
+    }
+    close(fd);
+    return data;
+}
+
+std::string DirectoryBlobSource::readBlob(const std::string& digest) const {
+    return libsarus::filesystem::readFile(getBlobFile(digest));
+}
+
+boost::filesystem::path DirectoryBlobSource::getBlobFile(const std::string& digest) const {
+    return directory / getRelativeBlobPath(digest);
+}
+
+RegistryBlobSource::RegistryBlobSource(std::shared_ptr<const common::Config> config,
+                                       const std::string& server,
+                                       const std::string& repository)
+    : config{std::move(config)}
+    , curlPath{"/usr/bin/curl"}
+    , host{getRegistryHost(server)}
+    , repository{repository}
+{
+    if(const auto* value = rapidjson::Pointer("/curlPath").Get(this->config->json)) {
+        curlPath = value->GetString();
+    }
+}
+
+std::string RegistryBlobSource::getDescription() const {
+    return host + "/" + repository;
+}
+
+std::string RegistryBlobSource::readRange(const std::string& digest, std::uint64_t offset, std::uint64_t length) const {
+    auto range = std::to_string(offset) + "-" + std::to_string(offset + length - 1);
+    auto args = libsarus::CLIArguments{"-f", "-r", range} + getAuthorizationArgs();
+    auto url = "https://" + host + "/v2/" + repository + "/blobs/" + digest;
+    auto data = fetch(url, args);
+
+    // registries not supporting range requests return the whole blob
+    if(data.size() > length && data.size() >= offset + length) {
+        data = data.substr(offset, length);
+    }
+    if(data.size() != length) {
+        auto message = boost::format("Failed to read range %s of blob %s from %s: received %d bytes instead of %d")
+            % range % digest % getDescription() % data.size() % length;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return data;
+}
+
+std::string RegistryBlobSource::readBlob(const std::string& digest) const {
+    auto args = libsarus::CLIArguments{"-f"} + getAuthorizationArgs();
+    return fetch("https://" + host + "/v2/" + repository + "/blobs/" + digest, args);
+}
+
+/**
+ * The images of Docker Hub are referenced by its index server, but served by its registry server
+ */
+std::string RegistryBlobSource::getRegistryHost(const std::string& server) {
+    if(server == "docker.io" || server == "index.docker.io") {
+        return "registry-1.docker.io";
+    }
+    return server;
+}
+
+/**
+ * Returns the URL to request a token with pull access to the repository, according to the
+ * bearer challenge in the WWW-Authenticate header of the response of the registry, e.g.:
+ *   www-authenticate: Bearer realm="https://auth.docker.io/token",service="registry.docker.io"
+ * Returns an empty string if the registry doesn't request a bearer token.
+ */
+std::string RegistryBlobSource::parseAuthenticateHeader(const std::string& headers, const std::string& repository) {
+    auto lines = std::vector<std::string>{};
+    boost::split(lines, headers, boost::is_any_of("\n"));
+    for(auto line : lines) {
+        boost::trim(line);
+        if(!boost::istarts_with(line, "www-authenticate:")) {
+            continue;
+        }
+        auto challenge = line.substr(std::string{"www-authenticate:"}.size());
+        boost::trim(challenge);
+        if(!boost::istarts_with(challenge, "bearer ")) {
+            continue;
+        }
+        auto parameters = std::unordered_map<std::string, std::string>{};
+        auto regex = boost::regex{"(\\w+)=\"([^\"]*)\""};
+        for(auto it = boost::sregex_iterator(challenge.begin(), challenge.end(), regex); it != boost::sregex_iterator(); ++it) {
+            parameters[(*it)[1]] = (*it)[2];
+        }
+        if(!parameters.count("realm")) {
+            continue;
+        }
+        auto url = parameters["realm"] + "?scope=repository:" + repository + ":pull";
+        if(parameters.count("service")) {
+            url += "&service=" + parameters["service"];
+        }
+        return url;
+    }
+    return {};
+}
+
+std::string RegistryBlobSource::fetch(const std::string& url, const libsarus::CLIArguments& extraArgs) const {
+    auto outputFile = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(
+        config->directories.temp / "sarus-blob-range")};
+    auto args = libsarus::CLIArguments{curlPath.string(), "-sSL", "--retry", "3"};
+    args += extraArgs;
+    args += libsarus::CLIArguments{"-o", outputFile.getPath().string(), url};
+    auto status = libsarus::process::forkExecWait(args);
+    if(status != 0) {
+        auto message = boost::format("Failed to fetch %s (curl exit status %d)") % url % status;
+        SARUS_THROW_ERROR(message.str());
+    }
+    if(!boost::filesystem::exists(outputFile.getPath())) {
+        return {};
+    }
+    return libsarus::filesystem::readFile(outputFile.getPath());
+}
+
+/**
+ * The token is passed to curl through a header file, to keep it out of the command lines
+ */
+libsarus::CLIArguments RegistryBlobSource::getAuthorizationArgs() const {
+    acquireTokenIfNeeded();
+    if(!authorizationHeaderFile) {
+        return {};
+    }
+    return {"-H", "@" + authorizationHeaderFile->getPath().string()};
+}
+
+void RegistryBlobSource::acquireTokenIfNeeded() const {
+    if(isTokenAcquired) {
+        return;
+    }
+    auto headersFile = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(
+        config->directories.temp / "sarus-registry-headers")};
+    fetch("https://" + host + "/v2/", {"-D", headersFile.getPath().string()});
+    auto tokenUrl = parseAuthenticateHeader(libsarus::filesystem::readFile(headersFile.getPath()), repository);
+    if(!tokenUrl.empty()) {
+        auto response = libsarus::json::parse(fetch(tokenUrl, {"-f"}));
+        auto token = std::string{};
+        if(response.IsObject() && response.HasMember("token") && response["token"].IsString()) {
+            token = response["token"].GetString();
+        }
+        else if(response.IsObject() && response.HasMember("access_token") && response["access_token"].IsString()) {
+            token = response["access_token"].GetString();
+        }
+        else {
+            auto message = boost::format("Failed to acquire an anonymous token to pull from %s") % getDescription();
+            SARUS_THROW_ERROR(message.str());
+        }
+        authorizationHeaderFile.reset(new libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(
+            config->directories.temp / "sarus-registry-authorization")});
+        libsarus::filesystem::createFileIfNecessary(authorizationHeaderFile->getPath());
+        boost::filesystem::permissions(authorizationHeaderFile->getPath(), boost::filesystem::perms(0600));
+        libsarus::filesystem::writeTextFile("Authorization: Bearer " + token + "\n", authorizationHeaderFile->getPath());
+    }
+    isTokenAcquired = true;
+}
+
+}} // namespace
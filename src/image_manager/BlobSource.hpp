@@ -0,0 +1,91 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_BlobSource_hpp
+#define sarus_image_manger_BlobSource_hpp
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "common/Config.hpp"
+#include "libsarus/CLIArguments.hpp"
+#include "libsarus/PathRAII.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Source of the blobs of an image (manifests, configurations and layers),
+ * which serves arbitrary byte ranges of a blob.
+ */
+class BlobSource {
+public:
+    virtual ~BlobSource() = default;
+    virtual std::string getDescription() const = 0;
+    virtual std::string readRange(const std::string& digest, std::uint64_t offset, std::uint64_t length) const = 0;
+    virtual std::string readBlob(const std::string& digest) const = 0;
+};
+
+/**
+ * Serves the blobs of an OCI image layout (blobs/<algorithm>/<hash>).
+ * Used as a stand-in for a registry, e.g. to test the lazy pulls.
+ */
+class DirectoryBlobSource : public BlobSource {
+public:
+    DirectoryBlobSource(const boost::filesystem::path& directory);
+    std::string getDescription() const override;
+    std::string readRange(const std::string& digest, std::uint64_t offset, std::uint64_t length) const override;
+    std::string readBlob(const std::string& digest) const override;
+    boost::filesystem::path getBlobFile(const std::string& digest) const;
+
+private:
+    boost::filesystem::path directory;
+};
+
+/**
+ * Fetches the blobs from the repository of a registry with HTTP range requests,
+ * through the binary at "curlPath" in the configuration (default: /usr/bin/curl).
+ * Only anonymous access is supported: if the registry requests it, a bearer
+ * token with pull access to the repository is acquired from its token service.
+ */
+class RegistryBlobSource : public BlobSource {
+public:
+    RegistryBlobSource(std::shared_ptr<const common::Config> config,
+                       const std::string& server,
+                       const std::string& repository);
+    std::string getDescription() const override;
+    std::string readRange(const std::string& digest, std::uint64_t offset, std::uint64_t length) const override;
+    std::string readBlob(const std::string& digest) const override;
+
+    static std::string getRegistryHost(const std::string& server);
+    static std::string parseAuthenticateHeader(const std::string& headers, const std::string& repository);
+
+private:
+    std::string fetch(const std::string& url, const libsarus::CLIArguments& extraArgs) const;
+    libsarus::CLIArguments getAuthorizationArgs() const;
+    void acquireTokenIfNeeded() const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    boost::filesystem::path curlPath;
+    std::string host;
+    std::string repository;
+    mutable bool isTokenAcquired = false;
+    mutable std::unique_ptr<libsarus::PathRAII> authorizationHeaderFile;
+};
+
+}
+}
+
+#endif
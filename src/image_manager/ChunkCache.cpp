@@ -0,0 +1,169 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/ChunkCache.hpp"
+
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+std::string getHash(const std::string& digest) {
+    if(!boost::starts_with(digest, "sha256:")
+       || digest.size() == std::string{"sha256:"}.size()
+       || digest.find_first_not_of("0123456789abcdef", std::string{"sha256:"}.size()) != std::string::npos) {
+        auto message = boost::format("Invalid digest '%s': expected sha256:<hex>") % digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return digest.substr(std::string{"sha256:"}.size());
+}
+
+}
+
+// upper bound of the size of a range request grouping adjacent gzip members
+const std::uint64_t ChunkCache::maxRangeSize = 16 * 1024 * 1024;
+
+ChunkCache::ChunkCache(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+boost::filesystem::path ChunkCache::getDirectory() const {
+    return config->directories.repository / "chunks";
+}
+
+std::string ChunkCache::getKey(const std::string& layerDigest, const EStargzIndex::Entry& chunk) {
+    if(chunk.chunkDigest.empty()) {
+        auto message = boost::format("Chunk of '%s' at offset %d in layer %s has no digest")
+            % chunk.name % chunk.offset % layerDigest;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return "sha256/" + getHash(chunk.chunkDigest);
+}
+
+boost::filesystem::path ChunkCache::getChunkFile(const std::string& layerDigest, const EStargzIndex::Entry& chunk) const {
+    return getDirectory() / getKey(layerDigest, chunk);
+}
+
+bool ChunkCache::contains(const std::string& layerDigest, const EStargzIndex::Entry& chunk) const {
+    return boost::filesystem::exists(getChunkFile(layerDigest, chunk));
+}
+
+std::string ChunkCache::getChunk(const BlobSource& source, const std::string& layerDigest, const EStargzIndex::Entry& chunk) const {
+    auto file = getChunkFile(layerDigest, chunk);
+    if(!boost::filesystem::exists(file)) {
+        fetchChunks(source, layerDigest, {&chunk});
+    }
+    auto data = libsarus::filesystem::readFile(file);
+    if(data.size() != chunk.chunkSize) {
+        auto message = boost::format("Cached chunk %s has size %d, expected %d") % file % data.size() % chunk.chunkSize;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return data;
+}
+
+/**
+ * Fetches the chunks missing from the cache, grouping the gzip members which are adjacent
+ * in the layer into range requests of up to maxRangeSize bytes. Returns the number of
+ * compressed bytes fetched.
+ */
+std::uint64_t ChunkCache::fetchChunks(const BlobSource& source,
+                                      const std::string& layerDigest,
+                                      std::vector<const EStargzIndex::Entry*> chunks) const {
+    chunks.erase(std::remove_if(chunks.begin(), chunks.end(), [&](const EStargzIndex::Entry* chunk) {
+        return contains(layerDigest, *chunk);
+    }), chunks.end());
+    std::sort(chunks.begin(), chunks.end(), [](const EStargzIndex::Entry* lhs, const EStargzIndex::Entry* rhs) {
+        return lhs->offset < rhs->offset;
+    });
+
+    auto fetchedSize = std::uint64_t{0};
+    auto groupBegin = chunks.cbegin();
+    while(groupBegin != chunks.cend()) {
+        auto rangeOffset = (*groupBegin)->offset;
+        auto rangeEnd = (*groupBegin)->compressedEnd;
+        auto groupEnd = std::next(groupBegin);
+        while(groupEnd != chunks.cend()
+              && (*groupEnd)->offset <= rangeEnd
+              && (*groupEnd)->compressedEnd - rangeOffset <= maxRangeSize) {
+            rangeEnd = std::max(rangeEnd, (*groupEnd)->compressedEnd);
+            ++groupEnd;
+        }
+
+        if(rangeEnd <= rangeOffset) {
+            auto message = boost::format("Invalid location of chunk of '%s' in layer %s")
+                % (*groupBegin)->name % layerDigest;
+            SARUS_THROW_ERROR(message.str());
+        }
+        auto range = source.readRange(layerDigest, rangeOffset, rangeEnd - rangeOffset);
+        fetchedSize += range.size();
+
+        for(auto it = groupBegin; it != groupEnd; ++it) {
+            const auto& chunk = **it;
+            auto member = EStargzIndex::decompressMember(range.substr(chunk.offset - rangeOffset, chunk.compressedEnd - chunk.offset),
+                                                         chunk.innerOffset + chunk.chunkSize);
+            if(member.size() != chunk.innerOffset + chunk.chunkSize) {
+                auto message = boost::format("Chunk of '%s' at offset %d in layer %s is truncated")
+                    % chunk.name % chunk.offset % layerDigest;
+                SARUS_THROW_ERROR(message.str());
+            }
+            auto data = member.substr(chunk.innerOffset, chunk.chunkSize);
+            auto file = getChunkFile(layerDigest, chunk); // rejects chunks without digest
+            auto sha256 = libsarus::Sha256{};
+            sha256.update(data);
+            auto digest = "sha256:" + sha256.finalizeHex();
+            if(digest != chunk.chunkDigest) {
+                auto message = boost::format("Digest mismatch of chunk of '%s' in layer %s: got %s, expected %s")
+                    % chunk.name % layerDigest % digest % chunk.chunkDigest;
+                SARUS_THROW_ERROR(message.str());
+            }
+            storeChunk(file, data);
+        }
+
+        printLog(boost::format("Fetched %d chunks (%d bytes) of layer %s from %s")
+            % std::distance(groupBegin, groupEnd) % range.size() % layerDigest % source.getDescription(),
+            libsarus::LogLevel::DEBUG);
+        groupBegin = groupEnd;
+    }
+    return fetchedSize;
+}
+
+/**
+ * Chunks are written to a temporary file and renamed, so that concurrent fetches
+ * of the same chunk (e.g. by the background fetch) never expose partial chunks.
+ */
+void ChunkCache::storeChunk(const boost::filesystem::path& file, const std::string& data) const {
+    libsarus::filesystem::createFoldersIfNecessary(file.parent_path());
+    auto tempFile = libsarus::filesystem::makeUniquePathWithRandomSuffix(file);
+    try {
+        libsarus::filesystem::writeTextFile(data, tempFile);
+        boost::filesystem::rename(tempFile, file);
+    }
+    catch(const std::exception& e) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(tempFile, ec);
+        auto message = boost::format("Failed to store chunk %s") % file;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+void ChunkCache::printLog(const boost::format& message, libsarus::LogLevel level) const {
+    libsarus::Logger::getInstance().log(message.str(), "ChunkCache", level);
+}
+
+}} // namespace
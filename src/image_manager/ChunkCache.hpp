@@ -0,0 +1,67 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ChunkCache_hpp
+#define sarus_image_manger_ChunkCache_hpp
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "common/Config.hpp"
+#include "image_manager/BlobSource.hpp"
+#include "image_manager/EStargzIndex.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Cache of the decompressed chunks of file data of lazily pulled images,
+ * in the "chunks" directory of the repository.
+ *
+ * Chunks are stored by the digest recorded in the TOC ("sha256/<hash>"), so that
+ * chunks shared by layers or images are fetched once, and are verified before
+ * being stored. Chunks without a digest are rejected: their data could not be
+ * verified. Chunks are fetched with range requests spanning the adjacent gzip
+ * members, and stored atomically.
+ */
+class ChunkCache {
+public:
+    static const std::uint64_t maxRangeSize;
+
+    ChunkCache(std::shared_ptr<const common::Config> config);
+    boost::filesystem::path getDirectory() const;
+    boost::filesystem::path getChunkFile(const std::string& layerDigest, const EStargzIndex::Entry& chunk) const;
+    bool contains(const std::string& layerDigest, const EStargzIndex::Entry& chunk) const;
+    std::string getChunk(const BlobSource& source, const std::string& layerDigest, const EStargzIndex::Entry& chunk) const;
+    std::uint64_t fetchChunks(const BlobSource& source,
+                              const std::string& layerDigest,
+                              std::vector<const EStargzIndex::Entry*> chunks) const;
+
+    static std::string getKey(const std::string& layerDigest, const EStargzIndex::Entry& chunk);
+
+private:
+    void storeChunk(const boost::filesystem::path& file, const std::string& data) const;
+    void printLog(const boost::format& message, libsarus::LogLevel level) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/EStargzIndex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <set>
+#include <vector>
+
+#include <zlib.h>
+#include <boost/format.hpp>
+
+#include "image_manager/Utility.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+const std::string footerMagic = "STARGZ";
+const std::string tocTarName = "stargz.index.json";
+const size_t tarBlockSize = 512;
+
+std::string getString(const rapidjson::Value& value, const char* key) {
+    auto itr = value.FindMember(key);
+    if(itr == value.MemberEnd()) {
+        return {};
+    }
+    if(!itr->value.IsString()) {
+        auto message = boost::format("Invalid eStargz TOC: property '%s' is not a string") % key;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return itr->value.GetString();
+}
+
+std::uint64_t getUint64(const rapidjson::Value& value, const char* key) {
+    auto itr = value.FindMember(key);
+    if(itr == value.MemberEnd()) {
+        return 0;
+    }
+    if(!itr->value.IsUint64()) {
+        auto message = boost::format("Invalid eStargz TOC: property '%s' is not an unsigned integer") % key;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return itr->value.GetUint64();
+}
+
+}
+
+// eStargz footer: empty gzip member whose extra field holds "%016xSTARGZ" (TOC offset)
+const std::uint64_t EStargzIndex::footerSize = 51;
+
+/**
+ * Returns the offset of the TOC stored in the footer of the blob, or boost::none if
+ * the footer is not an eStargz (or legacy stargz, 47 bytes long) footer.
+ */
+boost::optional<std::uint64_t> EStargzIndex::parseFooter(const std::string& footer) {
+    auto position = footer.rfind(footerMagic);
+    if(position == std::string::npos || position < 16) {
+        return boost::none;
+    }
+    auto hex = footer.substr(position - 16, 16);
+    if(hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+        return boost::none;
+    }
+    return static_cast<std::uint64_t>(std::stoull(hex, nullptr, 16));
+}
+
+EStargzIndex EStargzIndex::read(const BlobSource& source, const std::string& digest, std::uint64_t blobSize) {
+    if(blobSize < footerSize) {
+        auto message = boost::format("Layer %s is not in eStargz format: blob too small") % digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto tocOffset = parseFooter(source.readRange(digest, blobSize - footerSize, footerSize));
+    if(!tocOffset || *tocOffset >= blobSize - footerSize) {
+        auto message = boost::format("Layer %s is not in eStargz format: no eStargz footer found") % digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    // the TOC is a tar archive holding the JSON index, compressed in a gzip member of its own
+    auto tocTar = decompressMember(source.readRange(digest, *tocOffset, blobSize - *tocOffset),
+                                   std::numeric_limits<std::uint64_t>::max());
+    if(tocTar.size() < tarBlockSize
+       || std::string(tocTar.c_str(), strnlen(tocTar.c_str(), 100)) != tocTarName) {
+        auto message = boost::format("Layer %s is not in eStargz format: invalid TOC") % digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto tocSize = static_cast<size_t>(std::strtoull(std::string(tocTar.data() + 124, 12).c_str(), nullptr, 8));
+    if(tocTar.size() < tarBlockSize + tocSize) {
+        auto message = boost::format("Layer %s is not in eStargz format: truncated TOC") % digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    try {
+        auto tocJSON = tocTar.substr(tarBlockSize, tocSize);
+        auto index = EStargzIndex{libsarus::json::parse(tocJSON), *tocOffset};
+        auto sha256 = libsarus::Sha256{};
+        sha256.update(tocJSON);
+        index.tocDigest = "sha256:" + sha256.finalizeHex();
+        return index;
+    }
+    catch(const std::exception& e) {
+        auto message = boost::format("Failed to read the TOC of eStargz layer %s") % digest;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+/**
+ * Decompresses the first gzip member of the data, up to the given size
+ */
+std::string EStargzIndex::decompressMember(const std::string& compressed, std::uint64_t maxSize) {
+    auto stream = z_stream{};
+    if(inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        SARUS_THROW_ERROR("Failed to initialize zlib stream");
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    stream.avail_in = static_cast<uInt>(compressed.size());
+
+    auto output = std::string{};
+    auto buffer = std::vector<char>(64 * 1024);
+    auto ret = Z_OK;
+    while(ret != Z_STREAM_END && output.size() < maxSize) {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+        stream.avail_out = static_cast<uInt>(buffer.size());
+        ret = inflate(&stream, Z_NO_FLUSH);
+        if(ret != Z_OK && ret != Z_STREAM_END) {
+            inflateEnd(&stream);
+            auto message = boost::format("Failed to decompress gzip member: %s")
+                % (stream.msg ? stream.msg : "truncated data");
+            SARUS_THROW_ERROR(message.str());
+        }
+        output.append(buffer.data(), buffer.size() - stream.avail_out);
+    }
+    inflateEnd(&stream);
+
+    if(output.size() > maxSize) {
+        output.resize(maxSize);
+    }
+    return output;
+}
+
+/**
+ * Parses the RFC 3339 modification times of the TOC (e.g. "2023-05-01T12:00:00Z"), in UTC
+ */
+std::time_t EStargzIndex::parseModificationTime(const std::string& time) {
+    auto tm = std::tm{};
+    if(time.empty() || strptime(time.c_str(), "%Y-%m-%dT%H:%M:%S", &tm) == nullptr) {
+        return 0;
+    }
+    return timegm(&tm);
+}
+
+EStargzIndex::EStargzIndex(const rapidjson::Value& toc, std::uint64_t tocOffset)
+    : tocOffset{tocOffset}
+{
+    this->toc.CopyFrom(toc, this->toc.GetAllocator());
+
+    if(!toc.IsObject() || !toc.HasMember("entries") || !toc["entries"].IsArray()) {
+        SARUS_THROW_ERROR("Invalid eStargz TOC: missing array of entries");
+    }
+
+    static const std::set<std::string> types = {"dir", "reg", "symlink", "hardlink", "char", "block", "fifo", "chunk"};
+    auto offsets = std::set<std::uint64_t>{tocOffset};
+    for(const auto& value : toc["entries"].GetArray()) {
+        if(!value.IsObject()) {
+            SARUS_THROW_ERROR("Invalid eStargz TOC: entry is not an object");
+        }
+        auto entry = Entry{};
+        entry.name = getString(value, "name");
+        entry.type = getString(value, "type");
+        if(!types.count(entry.type)) {
+            auto message = boost::format("Invalid eStargz TOC: unsupported type '%s' of entry '%s'") % entry.type % entry.name;
+            SARUS_THROW_ERROR(message.str());
+        }
+        entry.linkName = getString(value, "linkName");
+        entry.size = getUint64(value, "size");
+        entry.mode = static_cast<std::uint32_t>(getUint64(value, "mode"));
+        entry.modificationTime = parseModificationTime(getString(value, "modtime"));
+        entry.devMajor = static_cast<std::uint32_t>(getUint64(value, "devMajor"));
+        entry.devMinor = static_cast<std::uint32_t>(getUint64(value, "devMinor"));
+        auto xattrs = value.FindMember("xattrs");
+        if(xattrs != value.MemberEnd() && xattrs->value.IsObject()) {
+            for(const auto& xattr : xattrs->value.GetObject()) {
+                if(!xattr.value.IsString()) {
+                    auto message = boost::format("Invalid eStargz TOC: extended attribute of '%s' is not a string") % entry.name;
+                    SARUS_THROW_ERROR(message.str());
+                }
+                entry.xattrs.emplace_back(xattr.name.GetString(), utility::base64Decode(xattr.value.GetString()));
+            }
+        }
+        entry.offset = getUint64(value, "offset");
+        entry.innerOffset = getUint64(value, "innerOffset");
+        entry.chunkOffset = getUint64(value, "chunkOffset");
+        entry.chunkSize = getUint64(value, "chunkSize");
+        entry.chunkDigest = getString(value, "chunkDigest");
+        if(entry.type == "reg" && entry.chunkSize == 0) {
+            entry.chunkSize = entry.size;
+        }
+        if(entry.offset > 0) {
+            offsets.insert(entry.offset);
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    // the gzip member of a chunk ends where the next member (or the TOC) begins
+    for(auto& entry : entries) {
+        if(entry.offset > 0) {
+            auto next = offsets.upper_bound(entry.offset);
+            entry.compressedEnd = next != offsets.cend() ? *next : tocOffset;
+        }
+    }
+}
+
+/**
+ * Returns the entries holding file data, in order of appearance in the layer
+ */
+std::vector<const EStargzIndex::Entry*> EStargzIndex::getChunks() const {
+    auto chunks = std::vector<const Entry*>{};
+    for(const auto& entry : entries) {
+        if((entry.type == "reg" || entry.type == "chunk") && entry.chunkSize > 0) {
+            chunks.push_back(&entry);
+        }
+    }
+    return chunks;
+}
+
+}} // namespace
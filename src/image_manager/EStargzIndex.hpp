@@ -0,0 +1,84 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_EStargzIndex_hpp
+#define sarus_image_manger_EStargzIndex_hpp
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <rapidjson/document.h>
+
+#include "image_manager/BlobSource.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Table of contents of an eStargz layer (https://github.com/containerd/stargz-snapshotter).
+ *
+ * An eStargz layer is a gzip-compressed tar archive made of independent gzip members,
+ * one for each chunk of file data, followed by a table of contents (TOC) listing the
+ * entries of the archive with the offsets of their chunks in the blob, and by a footer
+ * pointing to the TOC. Any chunk can then be decompressed on its own, after fetching
+ * the gzip member which holds it.
+ */
+class EStargzIndex {
+public:
+    struct Entry {
+        std::string name;
+        std::string type;       // dir, reg, symlink, hardlink, char, block, fifo or chunk
+        std::string linkName;
+        std::uint64_t size = 0;
+        std::uint32_t mode = 0;
+        std::time_t modificationTime = 0;
+        std::uint32_t devMajor = 0;
+        std::uint32_t devMinor = 0;
+        std::vector<std::pair<std::string, std::string>> xattrs;
+        // location of the data of a reg or chunk entry
+        std::uint64_t offset = 0;           // offset in the blob of the gzip member holding the chunk
+        std::uint64_t compressedEnd = 0;    // end of that gzip member in the blob
+        std::uint64_t innerOffset = 0;      // offset of the chunk in the decompressed gzip member
+        std::uint64_t chunkOffset = 0;      // offset of the chunk in the file
+        std::uint64_t chunkSize = 0;
+        std::string chunkDigest;
+    };
+
+    static const std::uint64_t footerSize;
+
+    static boost::optional<std::uint64_t> parseFooter(const std::string& footer);
+    static EStargzIndex read(const BlobSource& source, const std::string& digest, std::uint64_t blobSize);
+    static std::string decompressMember(const std::string& compressed, std::uint64_t maxSize);
+    static std::time_t parseModificationTime(const std::string& time);
+
+    EStargzIndex() = default;
+    EStargzIndex(const rapidjson::Value& toc, std::uint64_t tocOffset);
+    const std::vector<Entry>& getEntries() const { return entries; }
+    const rapidjson::Document& getTOC() const { return toc; }
+    std::uint64_t getTOCOffset() const { return tocOffset; }
+    const std::string& getTOCDigest() const { return tocDigest; }
+    std::vector<const Entry*> getChunks() const;
+
+private:
+    rapidjson::Document toc;
+    std::uint64_t tocOffset = 0;
+    std::string tocDigest;  // digest of the TOC JSON, known only when read from the layer
+    std::vector<Entry> entries;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "ErofsImage.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+#include <boost/format.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "libsarus/Logger.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/ImagePlacement.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+// The build time of the filesystem is set separately, through SOURCE_DATE_EPOCH
+const libsarus::CLIArguments ErofsImage::reproducibleArgs = {"-U", "00000000-0000-0000-0000-000000000000"};
+
+libsarus::CLIArguments ErofsImage::generateOptions(const common::Config& config, bool isReproducible) {
+    auto options = libsarus::CLIArguments{};
+
+    if (config.json.HasMember("erofsCompression")) {
+        auto compression = std::string{config.json["erofsCompression"].GetString()};
+        if (compression != "none") {
+            options.push_back("-z" + compression);
+        }
+    }
+
+    if (config.json.HasMember("erofsChunkSizeKB")) {
+        auto chunkSize = config.json["erofsChunkSizeKB"].GetUint64() * 1024;
+        // mkfs.erofs accepts power-of-two multiples of the block size
+        if (chunkSize < 4096 || (chunkSize & (chunkSize - 1)) != 0) {
+            auto message = boost::format("Invalid erofsChunkSizeKB %d in the configuration:"
+                                         " expected a power of two of at least 4")
+                           % config.json["erofsChunkSizeKB"].GetUint64();
+            SARUS_THROW_ERROR(message.str());
+        }
+        options.push_back("--chunksize=" + std::to_string(chunkSize));
+    }
+
+    if (isReproducible) {
+        options += reproducibleArgs;
+    }
+    return options;
+}
+
+libsarus::CLIArguments ErofsImage::generateMkfsErofsArgs(const common::Config& config,
+                                                       const boost::filesystem::path& sourcePath,
+                                                       const boost::filesystem::path& destinationPath,
+                                                       bool isReproducible) {
+    if (!config.json.HasMember("mkfsErofsPath")) {
+        SARUS_THROW_ERROR("The configuration parameter mkfsErofsPath is required to build EROFS images");
+    }
+    auto args = libsarus::CLIArguments{config.json["mkfsErofsPath"].GetString()};
+    args += generateOptions(config, isReproducible);
+    args += libsarus::CLIArguments{destinationPath.string(), sourcePath.string()};
+    return args;
+}
+
+std::string ErofsImage::getConversionSettings(const common::Config& config) {
+    return generateOptions(config, true).string();
+}
+
+/**
+ * Returns the newest modification time of the files of the unpacked image. Used as
+ * SOURCE_DATE_EPOCH, it makes the build time of the filesystem reproducible without
+ * clamping the modification time of any file (e.g. of the Python sources, whose
+ * compiled bytecode is validated against it).
+ */
+std::time_t ErofsImage::getNewestModificationTime(const boost::filesystem::path& unpackedImage) {
+    auto newest = std::time_t{0};
+    struct stat st;
+    if (lstat(unpackedImage.c_str(), &st) == 0) {
+        newest = st.st_mtime;
+    }
+    for (const auto& entry : boost::filesystem::recursive_directory_iterator{unpackedImage}) {
+        if (lstat(entry.path().c_str(), &st) == 0) {
+            newest = std::max(newest, st.st_mtime);
+        }
+    }
+    return newest;
+}
+
+ErofsImage::ErofsImage(const common::Config& config,
+                       const boost::filesystem::path& unpackedImage,
+                       const boost::filesystem::path& pathOfImage,
+                       bool isReproducible,
+                       const boost::optional<AccessProfile>& accessProfile)
+    : FilesystemImage{pathOfImage}
+{
+    auto pathTemp = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(pathOfImage)};
+    libsarus::filesystem::createFoldersIfNecessary(pathTemp.getPath().parent_path());
+
+    log(boost::format("> making EROFS image: %s") % pathOfImage, libsarus::LogLevel::GENERAL);
+    log(boost::format("creating EROFS image %s from unpacked image %s") % pathOfImage % unpackedImage,
+        libsarus::LogLevel::INFO);
+
+    if (accessProfile) {
+        log(boost::format("Ignoring access profile: mkfs.erofs doesn't support custom file layouts"),
+            libsarus::LogLevel::WARN);
+    }
+
+    auto start = std::chrono::system_clock::now();
+
+    auto command = generateMkfsErofsArgs(config, unpackedImage, pathTemp.getPath(), isReproducible).string();
+    if (isReproducible) {
+        command = "SOURCE_DATE_EPOCH=" + std::to_string(getNewestModificationTime(unpackedImage)) + " " + command;
+    }
+    auto mkfsErofsOutput = libsarus::process::executeCommand(command);
+    log(boost::format("mkfs.erofs output:\n%s") % mkfsErofsOutput, libsarus::LogLevel::DEBUG);
+
+    ImagePlacement{config}.apply(pathTemp.getPath());
+    boost::filesystem::rename(pathTemp.getPath(), pathOfImage); // atomically create/replace EROFS file
+    pathTemp.release();
+
+    auto end = std::chrono::system_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / double(1000);
+    log(boost::format("Elapsed time on mkfs.erofs: %s [s]") % elapsedTime, libsarus::LogLevel::INFO);
+
+    log(boost::format("successfully created EROFS file"), libsarus::LogLevel::INFO);
+}
+
+void ErofsImage::log(const boost::format &message, libsarus::LogLevel level) const {
+    libsarus::Logger::getInstance().log(message, "ErofsImage", level);
+}
+
+}} // namespace
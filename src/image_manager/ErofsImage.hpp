@@ -0,0 +1,62 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ErofsImage_hpp
+#define sarus_image_manger_ErofsImage_hpp
+
+#include <ctime>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "image_manager/AccessProfile.hpp"
+#include "image_manager/FilesystemImage.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * This class builds and represents an EROFS image with mkfs.erofs.
+ *
+ * EROFS images are stored uncompressed or compressed with lz4/lz4hc, which
+ * decompress faster than the algorithms of squashfs and in place. Uncompressed
+ * images can be built with chunk-based files, whose identical chunks are stored
+ * only once.
+ */
+class ErofsImage : public FilesystemImage {
+public:
+    // fixed UUID for byte-identical EROFS files from identical unpacked images
+    static const libsarus::CLIArguments reproducibleArgs;
+
+    static libsarus::CLIArguments generateMkfsErofsArgs(const common::Config& config,
+                                                      const boost::filesystem::path& sourcePath,
+                                                      const boost::filesystem::path& destinationPath,
+                                                      bool isReproducible=false);
+    static std::string getConversionSettings(const common::Config& config);
+    static std::time_t getNewestModificationTime(const boost::filesystem::path& unpackedImage);
+
+    ErofsImage(const common::Config& config,
+               const boost::filesystem::path& unpackedImage,
+               const boost::filesystem::path& pathOfImage,
+               bool isReproducible=false,
+               const boost::optional<AccessProfile>& accessProfile=boost::none);
+    std::string getFormat() const override { return erofsFormat; }
+
+private:
+    static libsarus::CLIArguments generateOptions(const common::Config& config, bool isReproducible);
+    void log(const boost::format &message, libsarus::LogLevel level) const;
+};
+
+}
+}
+
+#endif
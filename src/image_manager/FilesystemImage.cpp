@@ -0,0 +1,77 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "FilesystemImage.hpp"
+
+#include <boost/format.hpp>
+
+#include "libsarus/Error.hpp"
+#include "image_manager/SquashfsImage.hpp"
+#include "image_manager/ErofsImage.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+const std::string FilesystemImage::squashfsFormat = "squashfs";
+const std::string FilesystemImage::erofsFormat = "erofs";
+
+std::string FilesystemImage::getConfiguredFormat(const common::Config& config) {
+    if (config.json.HasMember("imageFormat")) {
+        return config.json["imageFormat"].GetString();
+    }
+    return squashfsFormat;
+}
+
+std::string FilesystemImage::getFileExtension(const std::string& format) {
+    return "." + format;
+}
+
+/**
+ * Returns the settings which determine the content of the images built with the
+ * configured format, used to tell apart the images of the pool built with different settings.
+ */
+std::string FilesystemImage::getConversionSettings(const common::Config& config) {
+    auto format = getConfiguredFormat(config);
+    if (format == erofsFormat) {
+        return format + " " + ErofsImage::getConversionSettings(config);
+    }
+    // the settings of squashfs images predate the other formats: keep them unchanged,
+    // so that the images already in the pool are still found
+    return SquashfsImage::getConversionSettings(config);
+}
+
+std::unique_ptr<FilesystemImage> FilesystemImage::create(const common::Config& config,
+                                                         const boost::filesystem::path& unpackedImage,
+                                                         const boost::filesystem::path& pathOfImage,
+                                                         bool isReproducible,
+                                                         const boost::optional<AccessProfile>& accessProfile) {
+    auto format = getConfiguredFormat(config);
+    if (format == squashfsFormat) {
+        return std::unique_ptr<FilesystemImage>{
+            new SquashfsImage{config, unpackedImage, pathOfImage, isReproducible, accessProfile}};
+    }
+    else if (format == erofsFormat) {
+        return std::unique_ptr<FilesystemImage>{
+            new ErofsImage{config, unpackedImage, pathOfImage, isReproducible, accessProfile}};
+    }
+    auto message = boost::format("Unsupported image format '%s'") % format;
+    SARUS_THROW_ERROR(message.str());
+}
+
+FilesystemImage::FilesystemImage(const boost::filesystem::path& pathOfImage)
+    : pathOfImage{pathOfImage}
+{}
+
+boost::filesystem::path FilesystemImage::getPathOfImage() const {
+    return pathOfImage;
+}
+
+}} // namespace
@@ -0,0 +1,64 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_FilesystemImage_hpp
+#define sarus_image_manger_FilesystemImage_hpp
+
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "image_manager/AccessProfile.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Read-only filesystem image built from an unpacked container image, which is
+ * loop mounted as the lower layer of the rootfs of the containers.
+ *
+ * The name of a format is also the filesystem type used to mount its images and
+ * the extension of the image files. The format used to build new images is chosen
+ * with the "imageFormat" parameter of the configuration, while the format of each
+ * image is recorded in the repository metadata.
+ */
+class FilesystemImage {
+public:
+    static const std::string squashfsFormat;
+    static const std::string erofsFormat;
+
+    static std::string getConfiguredFormat(const common::Config& config);
+    static std::string getFileExtension(const std::string& format);
+    static std::string getConversionSettings(const common::Config& config);
+    static std::unique_ptr<FilesystemImage> create(const common::Config& config,
+                                                   const boost::filesystem::path& unpackedImage,
+                                                   const boost::filesystem::path& pathOfImage,
+                                                   bool isReproducible=false,
+                                                   const boost::optional<AccessProfile>& accessProfile=boost::none);
+
+    virtual ~FilesystemImage() = default;
+    virtual std::string getFormat() const = 0;
+    boost::filesystem::path getPathOfImage() const;
+
+protected:
+    FilesystemImage(const boost::filesystem::path& pathOfImage);
+
+protected:
+    boost::filesystem::path pathOfImage;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,869 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/ImageBroadcast.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+const std::uint16_t ImageBroadcast::defaultPort;
+const std::uint16_t ImageBroadcast::jobPortRange;
+const size_t ImageBroadcast::defaultFanout;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char streamMagic[8] = {'S', 'A', 'R', 'U', 'S', 'B', 'C', '1'};
+const size_t chunkSize = 1 << 20;
+const size_t maxChunkSize = 16 << 20;
+const std::uint8_t ackSuccess = 1;
+const std::uint8_t ackFailure = 0;
+const size_t nonceSize = 16;
+const auto handshakeTimeout = std::chrono::milliseconds{10000};
+// well above the node count of the largest systems: a larger hostlist is malformed
+const size_t maxHostlistSize = 1 << 16;
+
+class FileDescriptor {
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(int fd) : fd{fd} {}
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor(FileDescriptor&& rhs) : fd{rhs.fd} { rhs.fd = -1; }
+    ~FileDescriptor() { close(); }
+
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(FileDescriptor&& rhs) {
+        close();
+        fd = rhs.fd;
+        rhs.fd = -1;
+        return *this;
+    }
+
+    int get() const { return fd; }
+    bool isOpen() const { return fd >= 0; }
+    void close() {
+        if(fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+private:
+    int fd = -1;
+};
+
+struct Child {
+    size_t rank;
+    FileDescriptor socket;
+    std::string linkKey;
+};
+
+void setTimeouts(int fd, std::chrono::milliseconds timeout) {
+    struct timeval tv;
+    tv.tv_sec = timeout.count() / 1000;
+    tv.tv_usec = (timeout.count() % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool sendAll(int fd, const void* data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while(size > 0) {
+        auto n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while(size > 0) {
+        auto n = ::recv(fd, bytes, size, 0);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+void encodeUint64(std::uint64_t value, std::uint8_t* out) {
+    for(size_t i=0; i<8; ++i) {
+        out[i] = static_cast<std::uint8_t>(value >> (56 - 8*i));
+    }
+}
+
+std::uint64_t decodeUint64(const std::uint8_t* in) {
+    auto value = std::uint64_t{0};
+    for(size_t i=0; i<8; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+void encodeUint32(std::uint32_t value, std::uint8_t* out) {
+    for(size_t i=0; i<4; ++i) {
+        out[i] = static_cast<std::uint8_t>(value >> (24 - 8*i));
+    }
+}
+
+std::uint32_t decodeUint32(const std::uint8_t* in) {
+    auto value = std::uint32_t{0};
+    for(size_t i=0; i<4; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+std::string makeNonce() {
+    std::random_device device;
+    auto nonce = std::string(nonceSize, '\0');
+    for(auto& byte : nonce) {
+        byte = static_cast<char>(device());
+    }
+    return nonce;
+}
+
+std::string encodeRank(size_t rank) {
+    std::uint8_t buffer[4];
+    encodeUint32(static_cast<std::uint32_t>(rank), buffer);
+    return std::string(reinterpret_cast<const char*>(buffer), sizeof(buffer));
+}
+
+/**
+ * Authentication codes of the protocol messages. The label makes the codes of
+ * different messages distinct, so that a code cannot be replayed as another one.
+ */
+libsarus::Sha256::Digest authenticate(const std::string& key, const std::string& label, const std::string& message) {
+    return libsarus::Sha256::hmac(key, label + '\0' + message);
+}
+
+libsarus::Sha256::Digest authenticate(const std::string& key, const std::string& label, const void* data, size_t size) {
+    return authenticate(key, label, std::string(static_cast<const char*>(data), size));
+}
+
+// compares in constant time, not to leak how many bytes of a code are correct
+bool isEqual(const libsarus::Sha256::Digest& lhs, const libsarus::Sha256::Digest& rhs) {
+    auto difference = std::uint8_t{0};
+    for(size_t i=0; i<lhs.size(); ++i) {
+        difference |= lhs[i] ^ rhs[i];
+    }
+    return difference == 0;
+}
+
+std::chrono::milliseconds getRemainingTime(const Clock::time_point& deadline) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+    return std::max(remaining, std::chrono::milliseconds{0});
+}
+
+FileDescriptor listenOn(std::uint16_t port, size_t backlog) {
+    // prefer a dual-stack IPv6 socket, fall back to IPv4 if IPv6 is not available
+    auto socket = FileDescriptor{::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    auto isIPv6 = socket.isOpen();
+    if(!isIPv6) {
+        socket = FileDescriptor{::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    }
+    if(!socket.isOpen()) {
+        auto message = boost::format("Failed to create listening socket: %s") % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    int enable = 1;
+    setsockopt(socket.get(), SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    int status;
+    if(isIPv6) {
+        int disable = 0;
+        setsockopt(socket.get(), IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+        struct sockaddr_in6 address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        status = ::bind(socket.get(), reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    }
+    else {
+        struct sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        status = ::bind(socket.get(), reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    }
+    if(status != 0) {
+        auto message = boost::format("Failed to bind listening socket to port %d: %s") % port % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    if(::listen(socket.get(), static_cast<int>(backlog)) != 0) {
+        auto message = boost::format("Failed to listen on port %d: %s") % port % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return socket;
+}
+
+/**
+ * The peer may not be listening yet, thus the connection is retried until the deadline.
+ */
+FileDescriptor connectToPeer(const ImageBroadcast::Peer& peer, const Clock::time_point& deadline) {
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    auto lastError = std::string{};
+    while(true) {
+        struct addrinfo* addresses = nullptr;
+        auto status = getaddrinfo(peer.host.c_str(), std::to_string(peer.port).c_str(), &hints, &addresses);
+        if(status != 0) {
+            lastError = gai_strerror(status);
+        }
+        else {
+            for(auto* address = addresses; address != nullptr; address = address->ai_next) {
+                auto socket = FileDescriptor{::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol)};
+                if(!socket.isOpen()) {
+                    lastError = std::strerror(errno);
+                    continue;
+                }
+                if(::connect(socket.get(), address->ai_addr, address->ai_addrlen) == 0) {
+                    freeaddrinfo(addresses);
+                    return socket;
+                }
+                lastError = std::strerror(errno);
+            }
+            freeaddrinfo(addresses);
+        }
+
+        if(Clock::now() >= deadline) {
+            auto message = boost::format("Failed to connect to %s:%d: %s") % peer.host % peer.port % lastError;
+            SARUS_THROW_ERROR(message.str());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
+}
+
+/**
+ * Handshake of the parent: sends a nonce, then verifies that the child knows the key
+ * and proves to the child that the parent knows it too. Returns the rank of the child
+ * and the key of the link, derived from the nonces of both sides.
+ */
+boost::optional<Child> authenticateChild(FileDescriptor socket, const std::string& key) {
+    auto parentNonce = makeNonce();
+    if(!sendAll(socket.get(), parentNonce.data(), parentNonce.size())) {
+        return boost::none;
+    }
+
+    std::uint8_t request[4 + nonceSize + sizeof(libsarus::Sha256::Digest)];
+    if(!receiveAll(socket.get(), request, sizeof(request))) {
+        return boost::none;
+    }
+    auto rank = static_cast<size_t>(decodeUint32(request));
+    auto childNonce = std::string(reinterpret_cast<const char*>(request) + 4, nonceSize);
+    auto session = encodeRank(rank) + parentNonce + childNonce;
+    auto childProof = libsarus::Sha256::Digest{};
+    std::memcpy(childProof.data(), request + 4 + nonceSize, childProof.size());
+    if(!isEqual(childProof, authenticate(key, "child", session))) {
+        return boost::none;
+    }
+
+    auto parentProof = authenticate(key, "parent", session);
+    if(!sendAll(socket.get(), parentProof.data(), parentProof.size())) {
+        return boost::none;
+    }
+    auto linkKey = authenticate(key, "link", session);
+    return Child{rank, std::move(socket), std::string(linkKey.cbegin(), linkKey.cend())};
+}
+
+/**
+ * Handshake of the child, counterpart of authenticateChild(). Returns the key of the link.
+ */
+std::string authenticateToParent(const FileDescriptor& socket, size_t rank, size_t parent, const std::string& key) {
+    auto parentNonce = std::string(nonceSize, '\0');
+    if(!receiveAll(socket.get(), &parentNonce[0], parentNonce.size())) {
+        auto message = boost::format("Failed to receive handshake from node %d: %s") % parent % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto childNonce = makeNonce();
+    auto session = encodeRank(rank) + parentNonce + childNonce;
+    auto childProof = authenticate(key, "child", session);
+    auto request = encodeRank(rank) + childNonce + std::string(childProof.cbegin(), childProof.cend());
+    if(!sendAll(socket.get(), request.data(), request.size())) {
+        auto message = boost::format("Failed to send handshake to node %d: %s") % parent % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto parentProof = libsarus::Sha256::Digest{};
+    if(!receiveAll(socket.get(), parentProof.data(), parentProof.size())
+       || !isEqual(parentProof, authenticate(key, "parent", session))) {
+        auto message = boost::format("Failed to authenticate node %d: the process listening on its port"
+                                     " does not belong to the same transfer") % parent;
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto linkKey = authenticate(key, "link", session);
+    return std::string(linkKey.cbegin(), linkKey.cend());
+}
+
+std::vector<Child> acceptChildren(const FileDescriptor& listener,
+                                  const std::vector<size_t>& expectedRanks,
+                                  const std::string& key,
+                                  const Clock::time_point& deadline,
+                                  std::chrono::milliseconds timeout,
+                                  const std::string& sysname) {
+    auto children = std::vector<Child>{};
+    while(children.size() < expectedRanks.size()) {
+        struct pollfd pfd;
+        pfd.fd = listener.get();
+        pfd.events = POLLIN;
+        auto status = ::poll(&pfd, 1, static_cast<int>(getRemainingTime(deadline).count()));
+        if(status < 0 && errno == EINTR) {
+            continue;
+        }
+        if(status <= 0) {
+            break;
+        }
+
+        auto socket = FileDescriptor{::accept4(listener.get(), nullptr, nullptr, SOCK_CLOEXEC)};
+        if(!socket.isOpen()) {
+            continue;
+        }
+        // a short timeout for the handshake, so that stalled connections don't hold the tree back
+        setTimeouts(socket.get(), std::min(timeout, handshakeTimeout));
+
+        auto child = authenticateChild(std::move(socket), key);
+        if(!child) {
+            libsarus::Logger::getInstance().log("Rejected connection which failed the authentication",
+                                                sysname, libsarus::LogLevel::WARN);
+            continue;
+        }
+        auto rank = child->rank;
+        auto isExpected = std::find(expectedRanks.cbegin(), expectedRanks.cend(), rank) != expectedRanks.cend();
+        auto isDuplicate = std::find_if(children.cbegin(), children.cend(),
+                                        [rank](const Child& child) { return child.rank == rank; }) != children.cend();
+        if(!isExpected || isDuplicate) {
+            continue;
+        }
+        setTimeouts(child->socket.get(), timeout);
+        children.push_back(std::move(*child));
+    }
+    return children;
+}
+
+void expandHostname(const std::string& prefix, const std::string& rest, std::vector<std::string>& hosts) {
+    auto open = rest.find('[');
+    if(open == std::string::npos) {
+        if(hosts.size() >= maxHostlistSize) {
+            auto message = boost::format("Invalid hostlist expression: more than %d hosts") % maxHostlistSize;
+            SARUS_THROW_ERROR(message.str());
+        }
+        hosts.push_back(prefix + rest);
+        return;
+    }
+    auto close = rest.find(']', open);
+    if(close == std::string::npos) {
+        auto message = boost::format("Invalid hostlist expression: unbalanced brackets in '%s'") % (prefix + rest);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto head = prefix + rest.substr(0, open);
+    auto tail = rest.substr(close + 1);
+    auto rangesList = rest.substr(open + 1, close - open - 1);
+    auto ranges = std::vector<std::string>{};
+    boost::split(ranges, rangesList, boost::is_any_of(","));
+
+    for(const auto& range : ranges) {
+        auto bounds = std::vector<std::string>{};
+        boost::split(bounds, range, boost::is_any_of("-"));
+        auto isNumber = [](const std::string& s) {
+            // the length limit keeps std::stoul within range
+            return !s.empty() && s.size() <= 9 && std::all_of(s.cbegin(), s.cend(), ::isdigit);
+        };
+        if(bounds.size() > 2 || !std::all_of(bounds.cbegin(), bounds.cend(), isNumber)) {
+            auto message = boost::format("Invalid hostlist expression: bad range '%s'") % range;
+            SARUS_THROW_ERROR(message.str());
+        }
+
+        auto first = std::stoul(bounds.front());
+        auto last = std::stoul(bounds.back());
+        auto width = bounds.front().size();
+        if(last < first) {
+            auto message = boost::format("Invalid hostlist expression: bad range '%s'") % range;
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(last - first >= maxHostlistSize) {
+            auto message = boost::format("Invalid hostlist expression: range '%s' has more than %d hosts")
+                % range % maxHostlistSize;
+            SARUS_THROW_ERROR(message.str());
+        }
+        for(auto i=first; i<=last; ++i) {
+            // preserve the zero padding of the range
+            auto index = std::to_string(i);
+            if(index.size() < width) {
+                index.insert(0, width - index.size(), '0');
+            }
+            expandHostname(head + index, tail, hosts);
+        }
+    }
+}
+
+size_t getSubtreeSize(size_t rank, size_t numberOfNodes, size_t fanout) {
+    auto size = size_t{1};
+    for(auto child : ImageBroadcast::getChildren(rank, numberOfNodes, fanout)) {
+        size += getSubtreeSize(child, numberOfNodes, fanout);
+    }
+    return size;
+}
+
+/**
+ * Writes the received data to the local file and forwards it to the children.
+ * Children which fail to receive the data are dropped, so that a single
+ * failing node does not stop the transfer to the rest of the tree.
+ */
+class ChunkForwarder {
+public:
+    ChunkForwarder(std::vector<Child>& children, const boost::filesystem::path& file, const std::string& sysname)
+        : children(children)
+        , sysname(sysname)
+    {
+        fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            auto message = boost::format("Failed to open %s for writing: %s") % file % std::strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
+    ChunkForwarder(const ChunkForwarder&) = delete;
+    ChunkForwarder& operator=(const ChunkForwarder&) = delete;
+
+    ~ChunkForwarder() {
+        if(fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    void forwardHeader(std::uint64_t size) {
+        std::uint8_t header[sizeof(streamMagic) + 8];
+        std::memcpy(header, streamMagic, sizeof(streamMagic));
+        encodeUint64(size, header + sizeof(streamMagic));
+        forward(header, sizeof(header));
+    }
+
+    void forwardChunk(const char* data, size_t size) {
+        auto bytes = data;
+        auto remaining = size;
+        while(remaining > 0) {
+            auto n = ::write(fd, bytes, remaining);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n < 0) {
+                auto message = boost::format("Failed to write staged file: %s") % std::strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+            bytes += n;
+            remaining -= n;
+        }
+        sha.update(data, size);
+
+        std::uint8_t length[4];
+        encodeUint32(static_cast<std::uint32_t>(size), length);
+        forward(length, sizeof(length));
+        forward(data, size);
+    }
+
+    /**
+     * The end of the stream carries the digest of the data, authenticated with the key
+     * of each link together with the size of the data.
+     */
+    void forwardEndOfStream(std::uint64_t size, const libsarus::Sha256::Digest& digest) {
+        std::uint8_t length[4] = {0, 0, 0, 0};
+        forward(length, sizeof(length));
+        forward(digest.data(), digest.size());
+        for(auto& child : children) {
+            if(!child.socket.isOpen()) {
+                continue;
+            }
+            auto code = authenticateEndOfStream(child.linkKey, size, digest);
+            if(!sendAll(child.socket.get(), code.data(), code.size())) {
+                auto message = boost::format("Lost connection to node %d: %s") % child.rank % std::strerror(errno);
+                libsarus::Logger::getInstance().log(message.str(), sysname, libsarus::LogLevel::WARN);
+                child.socket.close();
+            }
+        }
+    }
+
+    static libsarus::Sha256::Digest authenticateEndOfStream(const std::string& linkKey,
+                                                            std::uint64_t size,
+                                                            const libsarus::Sha256::Digest& digest) {
+        std::uint8_t encodedSize[8];
+        encodeUint64(size, encodedSize);
+        auto message = std::string(reinterpret_cast<const char*>(encodedSize), sizeof(encodedSize))
+                     + std::string(digest.cbegin(), digest.cend());
+        return authenticate(linkKey, "end", message);
+    }
+
+    libsarus::Sha256::Digest finalizeDigest() {
+        return sha.finalize();
+    }
+
+    void closeFile() {
+        if(::fsync(fd) != 0 || ::close(fd) != 0) {
+            fd = -1;
+            auto message = boost::format("Failed to close staged file: %s") % std::strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        fd = -1;
+    }
+
+private:
+    void forward(const void* data, size_t size) {
+        for(auto& child : children) {
+            if(!child.socket.isOpen()) {
+                continue;
+            }
+            if(!sendAll(child.socket.get(), data, size)) {
+                auto message = boost::format("Lost connection to node %d: %s") % child.rank % std::strerror(errno);
+                libsarus::Logger::getInstance().log(message.str(), sysname, libsarus::LogLevel::WARN);
+                child.socket.close();
+            }
+        }
+    }
+
+private:
+    std::vector<Child>& children;
+    const std::string& sysname;
+    int fd = -1;
+    libsarus::Sha256 sha;
+};
+
+}
+
+ImageBroadcast::ImageBroadcast(const Topology& topology, const std::string& key, std::chrono::milliseconds timeout)
+    : topology(topology)
+    , key(key)
+    , timeout(timeout)
+{
+    if(topology.peers.empty() || topology.rank >= topology.peers.size()) {
+        auto message = boost::format("Invalid broadcast topology: rank %d with %d nodes")
+                       % topology.rank % topology.peers.size();
+        SARUS_THROW_ERROR(message.str());
+    }
+    if(topology.fanout == 0) {
+        SARUS_THROW_ERROR("Invalid broadcast topology: the fan-out must be greater than zero");
+    }
+    if(key.empty()) {
+        SARUS_THROW_ERROR("Invalid broadcast key: the key must not be empty");
+    }
+}
+
+/**
+ * The source file is only read by the node with rank 0. Every node (rank 0 included)
+ * stores the data in the destination file, which is atomically replaced only after
+ * the digest of the received data has been verified.
+ */
+ImageBroadcast::Result ImageBroadcast::run(const boost::filesystem::path& source,
+                                           const boost::filesystem::path& destination) const {
+    auto numberOfNodes = topology.peers.size();
+    auto parent = getParent(topology.rank, topology.fanout);
+    auto childRanks = getChildren(topology.rank, numberOfNodes, topology.fanout);
+    auto deadline = Clock::now() + timeout;
+
+    printLog(boost::format("Node %d of %d: parent %s, %d children")
+                % topology.rank % numberOfNodes % (parent ? std::to_string(*parent) : std::string{"none"})
+                % childRanks.size(),
+             libsarus::LogLevel::DEBUG);
+
+    auto listener = FileDescriptor{};
+    if(!childRanks.empty()) {
+        listener = listenOn(topology.peers[topology.rank].port, topology.fanout);
+    }
+
+    auto parentSocket = FileDescriptor{};
+    auto parentLinkKey = std::string{};
+    if(parent) {
+        parentSocket = connectToPeer(topology.peers[*parent], deadline);
+        setTimeouts(parentSocket.get(), timeout);
+        parentLinkKey = authenticateToParent(parentSocket, topology.rank, *parent, key);
+    }
+
+    auto children = acceptChildren(listener, childRanks, key, deadline, timeout, sysname);
+    listener.close();
+    if(children.size() < childRanks.size()) {
+        auto message = boost::format("Only %d of %d child nodes connected within the timeout")
+                       % children.size() % childRanks.size();
+        printLog(message, libsarus::LogLevel::WARN);
+    }
+
+    auto result = Result{};
+    auto errorMessage = std::string{};
+    auto partialFile = libsarus::PathRAII{
+        libsarus::filesystem::makeUniquePathWithRandomSuffix(destination.string() + ".partial")};
+
+    try {
+        ChunkForwarder forwarder{children, partialFile.getPath(), sysname};
+        auto buffer = std::vector<char>(chunkSize);
+
+        if(!parent) {
+            auto fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0) {
+                auto message = boost::format("Failed to open %s: %s") % source % std::strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+            auto fdRAII = FileDescriptor{fd};
+
+            struct stat sb;
+            if(fstat(fd, &sb) != 0) {
+                auto message = boost::format("Failed to stat %s: %s") % source % std::strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+            forwarder.forwardHeader(static_cast<std::uint64_t>(sb.st_size));
+
+            while(true) {
+                auto n = ::read(fd, buffer.data(), buffer.size());
+                if(n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if(n < 0) {
+                    auto message = boost::format("Failed to read %s: %s") % source % std::strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                if(n == 0) {
+                    break;
+                }
+                forwarder.forwardChunk(buffer.data(), static_cast<size_t>(n));
+                result.bytes += n;
+            }
+
+            auto digest = forwarder.finalizeDigest();
+            forwarder.forwardEndOfStream(result.bytes, digest);
+            result.digest = libsarus::Sha256::toHex(digest);
+        }
+        else {
+            std::uint8_t header[sizeof(streamMagic) + 8];
+            if(!receiveAll(parentSocket.get(), header, sizeof(header))
+               || std::memcmp(header, streamMagic, sizeof(streamMagic)) != 0) {
+                SARUS_THROW_ERROR("Failed to receive a valid stream header from the parent node");
+            }
+            auto expectedSize = decodeUint64(header + sizeof(streamMagic));
+            forwarder.forwardHeader(expectedSize);
+
+            while(true) {
+                std::uint8_t length[4];
+                if(!receiveAll(parentSocket.get(), length, sizeof(length))) {
+                    SARUS_THROW_ERROR("Lost connection to the parent node");
+                }
+                auto size = decodeUint32(length);
+                if(size == 0) {
+                    break;
+                }
+                if(size > maxChunkSize) {
+                    SARUS_THROW_ERROR("Received invalid chunk size from the parent node");
+                }
+                if(!receiveAll(parentSocket.get(), buffer.data(), size)) {
+                    SARUS_THROW_ERROR("Lost connection to the parent node");
+                }
+                forwarder.forwardChunk(buffer.data(), size);
+                result.bytes += size;
+            }
+
+            auto expectedDigest = libsarus::Sha256::Digest{};
+            auto code = libsarus::Sha256::Digest{};
+            if(!receiveAll(parentSocket.get(), expectedDigest.data(), expectedDigest.size())
+               || !receiveAll(parentSocket.get(), code.data(), code.size())) {
+                SARUS_THROW_ERROR("Lost connection to the parent node");
+            }
+            // children verify the data against the digest computed by the root node, which
+            // is only accepted if it was authenticated with the key of the transfer
+            if(!isEqual(code, ChunkForwarder::authenticateEndOfStream(parentLinkKey, expectedSize, expectedDigest))) {
+                SARUS_THROW_ERROR("Failed to authenticate the digest received from the parent node");
+            }
+            forwarder.forwardEndOfStream(expectedSize, expectedDigest);
+            auto digest = forwarder.finalizeDigest();
+            result.digest = libsarus::Sha256::toHex(digest);
+
+            if(result.bytes != expectedSize) {
+                auto message = boost::format("Received %d bytes, expected %d") % result.bytes % expectedSize;
+                SARUS_THROW_ERROR(message.str());
+            }
+            if(digest != expectedDigest) {
+                auto message = boost::format("Digest mismatch: received data has digest sha256:%s, expected sha256:%s")
+                               % result.digest % libsarus::Sha256::toHex(expectedDigest);
+                SARUS_THROW_ERROR(message.str());
+            }
+        }
+
+        forwarder.closeFile();
+        boost::filesystem::rename(partialFile.getPath(), destination);
+        partialFile.release();
+    }
+    catch(const std::exception& e) {
+        errorMessage = e.what();
+        printLog(boost::format("Failed to stage file on node %d: %s") % topology.rank % errorMessage,
+                 libsarus::LogLevel::ERROR);
+    }
+
+    // gather the number of successful nodes from the subtree
+    result.stagedNodes = errorMessage.empty() ? 1 : 0;
+    for(auto& child : children) {
+        if(!child.socket.isOpen()) {
+            continue;
+        }
+        std::uint8_t ack[9 + sizeof(libsarus::Sha256::Digest)];
+        auto code = libsarus::Sha256::Digest{};
+        if(!receiveAll(child.socket.get(), ack, sizeof(ack))) {
+            printLog(boost::format("Failed to receive acknowledgement from node %d") % child.rank,
+                     libsarus::LogLevel::WARN);
+            continue;
+        }
+        std::memcpy(code.data(), ack + 9, code.size());
+        if(!isEqual(code, authenticate(child.linkKey, "ack", ack, 9))) {
+            printLog(boost::format("Failed to authenticate acknowledgement from node %d") % child.rank,
+                     libsarus::LogLevel::WARN);
+            continue;
+        }
+        result.stagedNodes += static_cast<size_t>(decodeUint64(ack + 1));
+        if(ack[0] != ackSuccess) {
+            printLog(boost::format("Node %d failed to stage the file") % child.rank, libsarus::LogLevel::WARN);
+        }
+    }
+
+    if(parent) {
+        std::uint8_t ack[9 + sizeof(libsarus::Sha256::Digest)];
+        ack[0] = errorMessage.empty() ? ackSuccess : ackFailure;
+        encodeUint64(result.stagedNodes, ack + 1);
+        auto code = authenticate(parentLinkKey, "ack", ack, 9);
+        std::memcpy(ack + 9, code.data(), code.size());
+        if(!sendAll(parentSocket.get(), ack, sizeof(ack))) {
+            printLog(boost::format("Failed to send acknowledgement to node %d") % *parent, libsarus::LogLevel::WARN);
+        }
+    }
+
+    if(!errorMessage.empty()) {
+        SARUS_THROW_ERROR(errorMessage);
+    }
+
+    printLog(boost::format("Staged %d bytes with digest sha256:%s (%d of %d nodes in subtree)")
+                % result.bytes % result.digest % result.stagedNodes
+                % getSubtreeSize(topology.rank, numberOfNodes, topology.fanout),
+             libsarus::LogLevel::INFO);
+
+    return result;
+}
+
+boost::optional<size_t> ImageBroadcast::getParent(size_t rank, size_t fanout) {
+    if(rank == 0) {
+        return boost::none;
+    }
+    return (rank - 1) / fanout;
+}
+
+std::vector<size_t> ImageBroadcast::getChildren(size_t rank, size_t numberOfNodes, size_t fanout) {
+    auto children = std::vector<size_t>{};
+    for(size_t i=1; i<=fanout; ++i) {
+        auto child = rank * fanout + i;
+        if(child >= numberOfNodes) {
+            break;
+        }
+        children.push_back(child);
+    }
+    return children;
+}
+
+/**
+ * Expands a hostlist expression in the format used by Slurm,
+ * e.g. "nid[001-003,007],login1" -> nid001, nid002, nid003, nid007, login1
+ */
+std::vector<std::string> ImageBroadcast::expandHostlist(const std::string& hostlist) {
+    auto hosts = std::vector<std::string>{};
+    auto depth = 0;
+    auto token = std::string{};
+    for(auto c : hostlist + ",") {
+        if(c == '[') {
+            ++depth;
+        }
+        else if(c == ']') {
+            --depth;
+        }
+        if(c == ',' && depth == 0) {
+            boost::algorithm::trim(token);
+            if(!token.empty()) {
+                expandHostname("", token, hosts);
+            }
+            token.clear();
+        }
+        else {
+            token.push_back(c);
+        }
+    }
+    if(depth != 0) {
+        auto message = boost::format("Invalid hostlist expression: unbalanced brackets in '%s'") % hostlist;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return hosts;
+}
+
+/**
+ * The port of the transfers of a job, picked in a range starting at the default port, so that
+ * concurrent jobs sharing nodes don't compete for the same port.
+ */
+std::uint16_t ImageBroadcast::getJobPort(const std::string& jobID) {
+    auto sha = libsarus::Sha256{};
+    sha.update(jobID);
+    auto digest = sha.finalize();
+    auto hash = static_cast<std::uint16_t>((digest[0] << 8) | digest[1]);
+    return defaultPort + hash % jobPortRange;
+}
+
+void ImageBroadcast::printLog(const boost::format& message, libsarus::LogLevel level,
+                              std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void ImageBroadcast::printLog(const std::string& message, libsarus::LogLevel level,
+                              std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
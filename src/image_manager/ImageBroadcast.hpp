@@ -0,0 +1,95 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ImageBroadcast_hpp
+#define sarus_image_manger_ImageBroadcast_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Copies a file from the node with rank 0 to all the nodes of an allocation,
+ * using a k-ary tree of TCP connections: every node receives the file from its
+ * parent in chunks and forwards each chunk to its children as soon as it has been
+ * written locally, so that only the root node reads the file from the source
+ * filesystem and the transfer is pipelined across the levels of the tree.
+ *
+ * The nodes authenticate each other with a key shared by the nodes of the transfer:
+ * parent and child prove the knowledge of the key with HMAC-SHA256 codes of the nonces
+ * exchanged at connection time, and derive from them the key of their link, which
+ * authenticates the digest sent at the end of the stream and the acknowledgements.
+ * Connections from processes which don't know the key are rejected, and a process
+ * listening on the port of a parent in place of the expected node is detected.
+ *
+ * Each node verifies the SHA-256 digest of the received data against the digest
+ * computed by the root, and reports to its parent how many nodes of its subtree
+ * stored the file successfully.
+ */
+class ImageBroadcast {
+public:
+    static const std::uint16_t defaultPort = 23600;
+    static const std::uint16_t jobPortRange = 1000;
+    static const size_t defaultFanout = 4;
+
+    struct Peer {
+        std::string host;
+        std::uint16_t port;
+    };
+
+    struct Topology {
+        size_t rank = 0;
+        std::vector<Peer> peers;
+        size_t fanout = defaultFanout;
+    };
+
+    struct Result {
+        std::string digest;
+        size_t bytes = 0;
+        size_t stagedNodes = 0; // number of nodes of the subtree which stored the file successfully
+    };
+
+public:
+    ImageBroadcast(const Topology& topology, const std::string& key, std::chrono::milliseconds timeout);
+    Result run(const boost::filesystem::path& source, const boost::filesystem::path& destination) const;
+
+    static boost::optional<size_t> getParent(size_t rank, size_t fanout);
+    static std::vector<size_t> getChildren(size_t rank, size_t numberOfNodes, size_t fanout);
+    static std::vector<std::string> expandHostlist(const std::string& hostlist);
+    static std::uint16_t getJobPort(const std::string& jobID);
+
+private:
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    Topology topology;
+    std::string key;
+    std::chrono::milliseconds timeout;
+    const std::string sysname = "ImageBroadcast";
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,421 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/ImageCache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/pointer.h>
+
+#include "image_manager/FilesystemImage.hpp"
+#include "image_manager/StagingPolicy.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/Flock.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+const std::string recordExtension = ".cache.json";
+const std::string partialExtension = ".partial";
+const std::vector<std::string> imageFormats = {FilesystemImage::squashfsFormat, FilesystemImage::erofsFormat};
+
+// ranks starting together may have to wait for another rank to copy a large image
+const auto lockTimeout = std::chrono::milliseconds{10 * 60 * 1000};
+const auto lockWarning = std::chrono::milliseconds{10 * 1000};
+
+struct stat statFile(const boost::filesystem::path& file) {
+    struct stat sb;
+    if(stat(file.c_str(), &sb) != 0) {
+        auto message = boost::format("Failed to stat %s: %s") % file % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return sb;
+}
+
+/**
+ * Removes the files of the entry relative to the subdirectory of its owner, opened
+ * without following symlinks, so that the files removed with root privileges are
+ * always within the cache directory.
+ */
+void removeEntry(const ImageCache::Entry& entry) {
+    auto directory = entry.recordFile.parent_path();
+    auto fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(fd < 0) {
+        auto message = boost::format("Failed to open %s: %s") % directory % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    try {
+        struct stat sb;
+        if(fstat(fd, &sb) != 0 || sb.st_uid != entry.uid) {
+            auto message = boost::format("%s is not owned by user %d") % directory % entry.uid;
+            SARUS_THROW_ERROR(message.str());
+        }
+        // the record goes first: an image file without record is never used
+        for(const auto& file : {entry.recordFile, entry.imageFile}) {
+            if(!file.empty() && unlinkat(fd, file.filename().c_str(), 0) != 0 && errno != ENOENT) {
+                auto message = boost::format("Failed to remove %s: %s") % file % std::strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+        }
+    }
+    catch(...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+}
+
+ImageCache::ImageCache(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+bool ImageCache::isEnabled() const {
+    return rj::Pointer("/nodeLocalImageCache").Get(config->json) != nullptr;
+}
+
+/**
+ * Creates the cache directory shared by all users, its lock file and the subdirectory
+ * of the user. Called by "sarus run" with root privileges, before switching to the
+ * identity of the user.
+ */
+void ImageCache::initialize() const {
+    libsarus::filesystem::createFoldersIfNecessary(getBaseDirectory());
+    libsarus::filesystem::createFileIfNecessary(getLockFile());
+    libsarus::filesystem::createFoldersIfNecessary(getDirectory(), config->userIdentity.uid, config->userIdentity.gid);
+}
+
+boost::filesystem::path ImageCache::getBaseDirectory() const {
+    if(!isEnabled()) {
+        SARUS_THROW_ERROR("The node-local image cache is not enabled");
+    }
+    return rj::Pointer("/nodeLocalImageCache/directory").Get(config->json)->GetString();
+}
+
+boost::filesystem::path ImageCache::getDirectory() const {
+    return getBaseDirectory() / std::to_string(config->userIdentity.uid);
+}
+
+size_t ImageCache::getMaxSize() const {
+    auto maxSizeMB = rj::Pointer("/nodeLocalImageCache/maxSizeMB").Get(config->json)->GetUint64();
+    return static_cast<size_t>(maxSizeMB) * 1024 * 1024;
+}
+
+boost::filesystem::path ImageCache::getCachedImageFile(const common::SarusImage& image) const {
+    auto format = image.format.empty() ? FilesystemImage::squashfsFormat : image.format;
+    return getDirectory() / (image.reference.getUniqueKey() + FilesystemImage::getFileExtension(format));
+}
+
+/**
+ * Returns the node-local copy of the image, populating the cache if needed.
+ * Returns boost::none if the cache is not enabled or the image cannot be cached,
+ * in which case the image should be used directly from the repository.
+ */
+boost::optional<boost::filesystem::path> ImageCache::getCachedImage(const common::SarusImage& image) const {
+    if(!isEnabled()) {
+        return boost::none;
+    }
+
+    auto cachedFile = getCachedImageFile(image);
+    try {
+        initialize();
+
+        {
+            libsarus::Flock lock{getLockFile(), libsarus::Flock::Type::readLock, lockTimeout, lockWarning};
+            if(isEntryValid(image)) {
+                markAsUsed(image);
+                printLog(boost::format("Found cached image %s") % cachedFile, libsarus::LogLevel::INFO);
+                return cachedFile;
+            }
+        }
+
+        // another rank may have populated the entry while we were waiting for the lock
+        libsarus::Flock lock{getLockFile(), libsarus::Flock::Type::writeLock, lockTimeout, lockWarning};
+        if(!isEntryValid(image)) {
+            populate(image);
+            if(!isEntryValid(image)) {
+                return boost::none;
+            }
+        }
+        markAsUsed(image);
+    }
+    catch(const std::exception& e) {
+        printLog(boost::format("Failed to use node-local image cache, falling back to repository image %s: %s")
+                    % image.imageFile % e.what(),
+                 libsarus::LogLevel::WARN);
+        return boost::none;
+    }
+
+    return cachedFile;
+}
+
+/**
+ * Lists the entries of all users, from the least to the most recently used.
+ * Subdirectories which are not owned by the user they are named after are ignored.
+ */
+std::vector<ImageCache::Entry> ImageCache::listEntries() const {
+    auto entries = std::vector<Entry>{};
+    auto baseDirectory = getBaseDirectory();
+    if(!boost::filesystem::is_directory(baseDirectory)) {
+        return entries;
+    }
+
+    for(const auto& userEntry : boost::filesystem::directory_iterator{baseDirectory}) {
+        const auto& directory = userEntry.path();
+        struct stat directoryStat;
+        if(lstat(directory.c_str(), &directoryStat) != 0
+           || !S_ISDIR(directoryStat.st_mode)
+           || directory.filename().string() != std::to_string(directoryStat.st_uid)) {
+            continue;
+        }
+
+        try {
+            for(const auto& dirEntry : boost::filesystem::directory_iterator{directory}) {
+                auto filename = dirEntry.path().filename().string();
+                struct stat recordStat;
+                if(!boost::ends_with(filename, recordExtension)
+                   || lstat(dirEntry.path().c_str(), &recordStat) != 0
+                   || !S_ISREG(recordStat.st_mode)) {
+                    continue;
+                }
+                auto key = filename.substr(0, filename.size() - recordExtension.size());
+                auto entry = Entry{};
+                entry.recordFile = dirEntry.path();
+                entry.uid = directoryStat.st_uid;
+                entry.lastUsed = recordStat.st_mtime;
+                for(const auto& format : imageFormats) {
+                    auto imageFile = directory / (key + FilesystemImage::getFileExtension(format));
+                    struct stat imageStat;
+                    if(lstat(imageFile.c_str(), &imageStat) == 0 && S_ISREG(imageStat.st_mode)) {
+                        entry.imageFile = imageFile;
+                        entry.size = imageStat.st_size;
+                        break;
+                    }
+                }
+                entries.push_back(entry);
+            }
+        }
+        catch(const std::exception& e) {
+            printLog(boost::format("Ignoring entries of node-local image cache in %s: %s") % directory % e.what(),
+                     libsarus::LogLevel::WARN);
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+        return lhs.lastUsed < rhs.lastUsed;
+    });
+    return entries;
+}
+
+bool ImageCache::isEntryValid(const common::SarusImage& image) const {
+    auto recordFile = getRecordFile(image);
+    auto cachedFile = getCachedImageFile(image);
+    if(!boost::filesystem::exists(recordFile) || !boost::filesystem::exists(cachedFile)) {
+        return false;
+    }
+
+    try {
+        auto record = libsarus::json::read(recordFile);
+        auto source = statFile(image.imageFile);
+        auto size = record["size"].GetUint64();
+        if(record["id"].GetString() != image.id
+           || record["created"].GetString() != image.created
+           || static_cast<uint64_t>(source.st_size) != size
+           || record["mtime"].GetInt64() != static_cast<int64_t>(source.st_mtim.tv_sec)
+           || record["mtimeNsec"].GetInt64() != static_cast<int64_t>(source.st_mtim.tv_nsec)
+           || libsarus::filesystem::getFileSize(cachedFile) != size) {
+            printLog(boost::format("Cached image %s does not match the repository image %s")
+                        % cachedFile % image.imageFile,
+                     libsarus::LogLevel::INFO);
+            return false;
+        }
+    }
+    catch(const std::exception& e) {
+        printLog(boost::format("Ignoring cached image %s: failed to read record %s: %s")
+                    % cachedFile % recordFile % e.what(),
+                 libsarus::LogLevel::WARN);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Copies the repository image into the cache. Must be called with the exclusive lock
+ * of the cache held.
+ */
+void ImageCache::populate(const common::SarusImage& image) const {
+    auto cachedFile = getCachedImageFile(image);
+    auto recordFile = getRecordFile(image);
+    auto partialFile = boost::filesystem::path{cachedFile.string() + partialExtension};
+
+    // stale entry of a previous version of the image (possibly of another format),
+    // or leftover of an interrupted copy
+    boost::filesystem::remove(recordFile);
+    for(const auto& format : imageFormats) {
+        auto staleFile = getDirectory() / (image.reference.getUniqueKey() + FilesystemImage::getFileExtension(format));
+        boost::filesystem::remove(staleFile);
+        boost::filesystem::remove(staleFile.string() + partialExtension);
+    }
+
+    auto source = statFile(image.imageFile);
+    auto size = static_cast<size_t>(source.st_size);
+    if(size > getMaxSize()) {
+        printLog(boost::format("Not caching image %s: its size (%s) exceeds the size of the cache (%s)")
+                    % image.imageFile
+                    % common::SarusImage::createSizeString(size)
+                    % common::SarusImage::createSizeString(getMaxSize()),
+                 libsarus::LogLevel::INFO);
+        return;
+    }
+    if(!makeRoomFor(size)) {
+        printLog(boost::format("Not caching image %s: not enough free space in %s")
+                    % image.imageFile % getBaseDirectory(),
+                 libsarus::LogLevel::INFO);
+        return;
+    }
+
+    printLog(boost::format("Copying image %s to node-local cache %s") % image.imageFile % cachedFile,
+             libsarus::LogLevel::INFO);
+    try {
+        libsarus::filesystem::copyFileRange(image.imageFile, partialFile, 0, size);
+        auto sourceAfterCopy = statFile(image.imageFile);
+        if(sourceAfterCopy.st_size != source.st_size
+           || sourceAfterCopy.st_mtim.tv_sec != source.st_mtim.tv_sec
+           || sourceAfterCopy.st_mtim.tv_nsec != source.st_mtim.tv_nsec) {
+            SARUS_THROW_ERROR("the repository image was modified during the copy");
+        }
+        boost::filesystem::rename(partialFile, cachedFile);
+    }
+    catch(const std::exception& e) {
+        boost::filesystem::remove(partialFile);
+        auto message = boost::format("Failed to copy image %s to node-local cache") % image.imageFile;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+
+    auto record = rj::Document{rj::kObjectType};
+    auto& allocator = record.GetAllocator();
+    record.AddMember("id", rj::Value{image.id.c_str(), allocator}, allocator);
+    record.AddMember("created", rj::Value{image.created.c_str(), allocator}, allocator);
+    record.AddMember("size", rj::Value{static_cast<uint64_t>(size)}, allocator);
+    record.AddMember("mtime", rj::Value{static_cast<int64_t>(source.st_mtim.tv_sec)}, allocator);
+    record.AddMember("mtimeNsec", rj::Value{static_cast<int64_t>(source.st_mtim.tv_nsec)}, allocator);
+    record.AddMember("source", rj::Value{image.imageFile.c_str(), allocator}, allocator);
+
+    auto tempFile = libsarus::filesystem::makeUniquePathWithRandomSuffix(recordFile);
+    libsarus::json::write(record, tempFile);
+    boost::filesystem::rename(tempFile, recordFile);
+}
+
+/**
+ * Evicts the least recently used entries of all users until the cache can accommodate
+ * a new entry of the given size, both in terms of the configured maximum size
+ * and of the free space of the underlying filesystem.
+ */
+bool ImageCache::makeRoomFor(size_t size) const {
+    auto entries = listEntries();
+    auto usedSpace = size_t{0};
+    for(const auto& entry : entries) {
+        usedSpace += entry.size;
+    }
+
+    auto hasRoom = [&]() {
+        return usedSpace + size <= getMaxSize()
+            && StagingPolicy::getFreeSpace(getBaseDirectory()) >= size;
+    };
+
+    for(const auto& entry : entries) {
+        if(hasRoom()) {
+            break;
+        }
+        if(evict(entry)) {
+            usedSpace -= entry.size;
+        }
+    }
+
+    return hasRoom();
+}
+
+/**
+ * Removes an entry of the cache. Must be called with the identity of the user: the
+ * entries of other users are removed after switching back to root, which is only
+ * possible within "sarus run".
+ */
+bool ImageCache::evict(const Entry& entry) const {
+    printLog(boost::format("Evicting %s from node-local image cache") % entry.recordFile, libsarus::LogLevel::INFO);
+    try {
+        if(entry.uid == geteuid()) {
+            removeEntry(entry);
+            return true;
+        }
+        if(getuid() != 0) {
+            printLog(boost::format("Cannot evict %s of user %d without root privileges") % entry.recordFile % entry.uid,
+                     libsarus::LogLevel::DEBUG);
+            return false;
+        }
+        // same identity as the one restored by "sarus run" after verifying the image
+        auto rootIdentity = libsarus::UserIdentity{};
+        libsarus::process::switchIdentity(rootIdentity);
+        try {
+            removeEntry(entry);
+        }
+        catch(...) {
+            libsarus::process::switchIdentity(config->userIdentity);
+            throw;
+        }
+        libsarus::process::switchIdentity(config->userIdentity);
+    }
+    catch(const std::exception& e) {
+        printLog(boost::format("Failed to evict %s from node-local image cache: %s") % entry.recordFile % e.what(),
+                 libsarus::LogLevel::WARN);
+        return false;
+    }
+    return true;
+}
+
+void ImageCache::markAsUsed(const common::SarusImage& image) const {
+    boost::filesystem::last_write_time(getRecordFile(image), std::time(nullptr));
+}
+
+boost::filesystem::path ImageCache::getRecordFile(const common::SarusImage& image) const {
+    return getDirectory() / (image.reference.getUniqueKey() + recordExtension);
+}
+
+boost::filesystem::path ImageCache::getLockFile() const {
+    return getBaseDirectory() / ".lock";
+}
+
+void ImageCache::printLog(const boost::format& message, libsarus::LogLevel level,
+                          std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void ImageCache::printLog(const std::string& message, libsarus::LogLevel level,
+                          std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
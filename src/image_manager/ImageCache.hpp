@@ -0,0 +1,90 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ImageCache_hpp
+#define sarus_image_manger_ImageCache_hpp
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "common/SarusImage.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Transparent node-local cache of repository images.
+ *
+ * When the "nodeLocalImageCache" parameter is configured, the first "sarus run" of an
+ * image on a node copies the image file of the repository into a per-user subdirectory
+ * of the cache, and subsequent runs mount the local copy instead of reading the image
+ * from the (usually shared) filesystem of the repository.
+ *
+ * A cached copy is tied to the ID of the image and to the size and modification time of
+ * the repository file, so re-pulling an image invalidates it. The per-user subdirectories
+ * only determine the ownership of the copies: the size cap, the least recently used
+ * eviction and the lock apply to the whole cache directory, shared by all the users of
+ * the node. Population and eviction happen under an exclusive lock, so that many ranks
+ * starting together on a node perform a single copy. The entries of other users are
+ * evicted with the root privileges of "sarus run".
+ */
+class ImageCache {
+public:
+    struct Entry {
+        boost::filesystem::path imageFile;
+        boost::filesystem::path recordFile;
+        uid_t uid = 0;
+        size_t size = 0;
+        std::time_t lastUsed = 0;
+    };
+
+public:
+    ImageCache(std::shared_ptr<const common::Config> config);
+    bool isEnabled() const;
+    void initialize() const;
+    boost::filesystem::path getBaseDirectory() const;
+    boost::filesystem::path getDirectory() const;
+    size_t getMaxSize() const;
+    boost::filesystem::path getCachedImageFile(const common::SarusImage& image) const;
+    boost::optional<boost::filesystem::path> getCachedImage(const common::SarusImage& image) const;
+    std::vector<Entry> listEntries() const;
+
+private:
+    bool isEntryValid(const common::SarusImage& image) const;
+    void populate(const common::SarusImage& image) const;
+    bool makeRoomFor(size_t size) const;
+    bool evict(const Entry& entry) const;
+    void markAsUsed(const common::SarusImage& image) const;
+    boost::filesystem::path getRecordFile(const common::SarusImage& image) const;
+    boost::filesystem::path getLockFile() const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    const std::string sysname = "ImageCache";
+};
+
+}
+}
+
+#endif
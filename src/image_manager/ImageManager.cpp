@@ -10,14 +10,25 @@
 
 #include "image_manager/ImageManager.hpp"
 
+#include <cerrno>
+#include <cstring>
+
 #include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
 #include "libsarus/Error.hpp"
 #include "libsarus/PathRAII.hpp"
+#include "libsarus/Sha256.hpp"
 #include "libsarus/Utility.hpp"
-#include "image_manager/SquashfsImage.hpp"
+#include "image_manager/AccessProfile.hpp"
+#include "image_manager/BlobSource.hpp"
+#include "image_manager/ChunkCache.hpp"
+#include "image_manager/PullCoordinator.hpp"
+#include "image_manager/SifImage.hpp"
+#include "image_manager/FilesystemImage.hpp"
+#include "image_manager/ImagePlacement.hpp"
+#include "image_manager/StagingPolicy.hpp"
 #include "image_manager/Utility.hpp"
 
 
@@ -28,6 +39,8 @@ namespace image_manager {
     : config(config)
     , skopeoDriver(config)
     , imageStore(config)
+    , imagePool(config)
+    , scratchTrash(config)
     {}
 
     /**
@@ -39,6 +52,9 @@ namespace image_manager {
 
         printLog(boost::format("Pulling image %s") % config->imageReference, libsarus::LogLevel::INFO);
 
+        // Scratch trees left in the trash by an interrupted deletion
+        scratchTrash.reclaimInBackground();
+
         printLog( boost::format("# image            : %s") % config->imageReference, libsarus::LogLevel::GENERAL);
         printLog( boost::format("# cache directory  : %s") % config->directories.cache, libsarus::LogLevel::GENERAL);
         printLog( boost::format("# temp directory   : %s") % config->directories.temp, libsarus::LogLevel::GENERAL);
@@ -53,6 +69,8 @@ namespace image_manager {
         //   tag at the storage level
         auto pullReference = config->imageReference.normalize();
 
+        auto report = TimingReport{"pull", pullReference.string()};
+
         if (config->authentication.isAuthenticationNeeded) {
             skopeoDriver.acquireAuthFile(config->authentication, pullReference);
         }
@@ -60,6 +78,7 @@ namespace image_manager {
         // If pulling only with tag, attempt to complete the reference by retrieving
         // the digest from the remote registry, to be consistent with Docker behavior
         if (pullReference.digest.empty()) {
+            TimingReport::ScopedPhase phase{report, "registryDigest"};
             pullReference.digest = retrieveRegistryDigest(transport, pullReference);
         }
         printLog( boost::format("# image digest     : %s") % pullReference.digest, libsarus::LogLevel::GENERAL);
@@ -68,18 +87,48 @@ namespace image_manager {
         if (storedImage && storedImage->reference.digest == pullReference.digest) {
             printLog(boost::format("Image for %s is already available and up to date") % config->imageReference,
                      libsarus::LogLevel::GENERAL);
+            writeTimingReportIfRequested(report);
             return;
         }
 
         printLog("Image not found in local repository or image not up-to-date. Proceeding with pull...",
                  libsarus::LogLevel::INFO);
 
+        // Concurrent pulls of the same image into the same repository are carried out only once:
+        // wait for another process already pulling the image and adopt its result
+        auto isPulled = [this, &pullReference]() {
+            auto image = imageStore.findImage(pullReference);
+            return image && image->reference.digest == pullReference.digest;
+        };
+        auto pullTicket = PullCoordinator{config}.acquire(pullReference, isPulled);
+        if (!pullTicket) {
+            printLog(boost::format("Image for %s was pulled by another process") % config->imageReference,
+                     libsarus::LogLevel::GENERAL);
+            writeTimingReportIfRequested(report);
+            return;
+        }
+
+        if (config->lazyPull) {
+            pullImageLazily(transport, pullReference, report, *pullTicket);
+            pullTicket.reset();
+            writeTimingReportIfRequested(report);
+            printLog("Successfully pulled image index", libsarus::LogLevel::INFO);
+            return;
+        }
+
         // Re-normalize pullReference to always pull by digest internally.
         // This avoids inconsistencies in case the reference resolution done by Skopeo mismatches
         // with the registry digest found by Sarus
+        pullTicket->setPhase("skopeoCopy");
+        TimingReport::ScopedPhase copyPhase{report, "skopeoCopy"};
         auto ociImagePath = skopeoDriver.copyToOCIImage(transport, pullReference.normalize().string());
-        processImage(OCIImage{config, ociImagePath}, pullReference);
+        copyPhase.stop();
+        auto ociImage = OCIImage{config, ociImagePath};
+        processImage(ociImage, pullReference, report, pullTicket.get());
+        pullTicket.reset();
+        disposeScratch(ociImage);
 
+        writeTimingReportIfRequested(report);
         printLog("Successfully pulled image", libsarus::LogLevel::INFO);
     }
 
@@ -92,9 +141,33 @@ namespace image_manager {
 
         printLog(boost::format("Loading image archive %s") % archive, libsarus::LogLevel::INFO);
 
+        // Scratch trees left in the trash by an interrupted deletion
+        scratchTrash.reclaimInBackground();
+
+        auto report = TimingReport{"load", config->imageReference.string()};
+
+        // SIF files already contain a squashfs root filesystem: copy it as it is,
+        // unless its files have to be laid out according to an access profile
+        if (format == "sif" && config->accessProfileFile.empty() && SifImage::isSifFile(archive)) {
+            auto sifImage = SifImage{archive};
+            if (sifImage.hasSquashfsRootfs()) {
+                processSifImage(sifImage, config->imageReference, report);
+                writeTimingReportIfRequested(report);
+                printLog("Successfully loaded image archive", libsarus::LogLevel::INFO);
+                return;
+            }
+            printLog("SIF file does not contain a squashfs root filesystem: converting it to an OCI image",
+                     libsarus::LogLevel::INFO);
+        }
+
+        TimingReport::ScopedPhase copyPhase{report, "skopeoCopy"};
         auto ociImagePath = skopeoDriver.copyToOCIImage(format, archive.string());
-        processImage(OCIImage{config, ociImagePath}, config->imageReference);
+        copyPhase.stop();
+        auto ociImage = OCIImage{config, ociImagePath};
+        processImage(ociImage, config->imageReference, report);
+        disposeScratch(ociImage);
 
+        writeTimingReportIfRequested(report);
         printLog("Successfully loaded image archive", libsarus::LogLevel::INFO);
     }
 
@@ -119,33 +192,342 @@ namespace image_manager {
         printLog(boost::format("removed image %s") % config->imageReference, libsarus::LogLevel::GENERAL);
     }
 
-    void ImageManager::processImage(const OCIImage& image, const common::ImageReference& storageReference) {
+    /**
+     * Materialize the root filesystem of a lazily pulled image from the chunk cache, fetching
+     * the missing chunks, and replace the lazy entry of the repository with the image built
+     * from it. Concurrent materializations of the same image are carried out only once.
+     */
+    common::SarusImage ImageManager::materializeLazyImage(const common::SarusImage& image) {
+        printLog(boost::format("Materializing lazily pulled image %s") % image.reference, libsarus::LogLevel::INFO);
+
+        auto isMaterialized = [this, &image]() {
+            auto storedImage = imageStore.findImage(image.reference);
+            return storedImage && storedImage->format != LazyImage::format;
+        };
+        auto ticket = PullCoordinator{config}.acquire(image.reference, isMaterialized);
+        auto storedImage = imageStore.findImage(image.reference);
+        if (!storedImage) {
+            auto message = boost::format("Image %s was removed from the repository while materializing it") % image.reference;
+            SARUS_THROW_ERROR(message.str());
+        }
+        if (!ticket || storedImage->format != LazyImage::format) {
+            return *storedImage;
+        }
+
+        auto report = TimingReport{"materialize", image.reference.string()};
+        auto lazyImage = LazyImage::read(storedImage->imageFile);
+        auto source = RegistryBlobSource{config, lazyImage.getServer(), lazyImage.getRepository()};
+        auto staging = StagingPolicy{config}.chooseUnpackDirectory(lazyImage.getLayersSize());
+        printLog( boost::format("# unpack directory : %s") % staging.directory, libsarus::LogLevel::GENERAL);
+
+        ticket->setPhase("materialize");
+        TimingReport::ScopedPhase materializePhase{report, "materialize"};
+        auto rootfs = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(
+            staging.directory / "lazy-rootfs")};
+        libsarus::filesystem::createFoldersIfNecessary(rootfs.getPath());
+        lazyImage.materialize(source, ChunkCache{config}, rootfs.getPath(), config->directories.temp);
+        materializePhase.stop();
+        if (isTimingReportRequested()) {
+            report.setCounter("unpackedRootfs", libsarus::filesystem::getDirectorySize(rootfs.getPath()));
+        }
+
+        auto imageFormat = FilesystemImage::getConfiguredFormat(*config);
+        auto buildPhaseName = imageFormat == FilesystemImage::squashfsFormat ? std::string{"mksquashfs"} : "mkfs." + imageFormat;
+        ticket->setPhase(buildPhaseName);
+        TimingReport::ScopedPhase buildPhase{report, buildPhaseName};
+        auto imagePath = imageStore.getImageFile(image.reference, imageFormat);
+        auto filesystemImage = FilesystemImage::create(*config, rootfs.getPath(), imagePath, false, boost::none);
+        auto imageRAII = libsarus::PathRAII{filesystemImage->getPathOfImage()};
+        buildPhase.stop();
+        if (scratchTrash.moveToTrash(rootfs.getPath())) {
+            rootfs.release();
+        }
+        report.setCounter(imageFormat + "Image", libsarus::filesystem::getFileSize(filesystemImage->getPathOfImage()));
+
+        // the lazy image file is released by the repository once the entry is replaced
+        addImageToRepository(image.reference, storedImage->id, storedImage->metadataFile,
+                             filesystemImage->getPathOfImage(), filesystemImage->getFormat(), report);
+        imageRAII.release();
+        ticket.reset();
+        scratchTrash.reclaimInBackground();
+
+        printLog(boost::format("Successfully materialized image %s") % image.reference, libsarus::LogLevel::INFO);
+        return *imageStore.findImage(image.reference);
+    }
+
+    /**
+     * Pull only the image configuration and the tables of contents of the eStargz layers
+     * of the image, and start fetching the file data into the chunk cache in the background.
+     * The image is materialized at its first run.
+     */
+    void ImageManager::pullImageLazily(const std::string& transport,
+                                       const common::ImageReference& pullReference,
+                                       TimingReport& report,
+                                       PullCoordinator::Ticket& pullTicket) {
+        if (config->authentication.isAuthenticationNeeded) {
+            SARUS_THROW_ERROR("Lazy pulls support only registries with anonymous access");
+        }
+
+        pullTicket.setPhase("fetchIndex");
+        TimingReport::ScopedPhase indexPhase{report, "fetchIndex"};
+        auto manifest = libsarus::json::parse(skopeoDriver.inspectRaw(transport, pullReference.normalize().string()));
+        if (manifest.IsObject() && manifest.HasMember("manifests")) {
+            auto platformDigest = utility::getPlatformDigestFromOCIIndex(manifest, utility::getCurrentOCIPlatform());
+            if (platformDigest.empty()) {
+                auto message = boost::format("Failed to find the manifest of image %s for the current platform") % pullReference;
+                SARUS_THROW_ERROR(message.str());
+            }
+            auto platformReference = pullReference;
+            platformReference.digest = platformDigest;
+            manifest = libsarus::json::parse(skopeoDriver.inspectRaw(transport, platformReference.normalize().string()));
+        }
+        if (!manifest.IsObject() || !manifest.HasMember("config") || !manifest["config"].IsObject()
+            || !manifest["config"].HasMember("digest") || !manifest["config"]["digest"].IsString()) {
+            auto message = boost::format("Invalid manifest of image %s: missing configuration digest") % pullReference;
+            SARUS_THROW_ERROR(message.str());
+        }
+
+        auto repository = pullReference.repositoryNamespace.empty()
+            ? pullReference.image
+            : pullReference.repositoryNamespace + "/" + pullReference.image;
+        auto source = RegistryBlobSource{config, pullReference.server, repository};
+
+        std::string configDigest = manifest["config"]["digest"].GetString();
+        auto imageConfigData = source.readBlob(configDigest);
+        auto sha256 = libsarus::Sha256{};
+        sha256.update(imageConfigData);
+        auto imageID = sha256.finalizeHex();
+        if ("sha256:" + imageID != configDigest) {
+            auto message = boost::format("Digest mismatch of the configuration of image %s: got sha256:%s, expected %s")
+                % pullReference % imageID % configDigest;
+            SARUS_THROW_ERROR(message.str());
+        }
+        auto imageConfig = libsarus::json::parse(imageConfigData);
+
+        auto lazyImage = LazyImage::fetchIndex(source, pullReference.server, repository, manifest);
+        indexPhase.stop();
+        report.setCounter("ociLayers", lazyImage.getLayersSize());
+        printLog( boost::format("# lazy pull        : %d eStargz layers, %d bytes")
+                  % lazyImage.getLayers().size() % lazyImage.getLayersSize(), libsarus::LogLevel::GENERAL);
+
+        auto metadataFile = imageStore.getImageMetadataFile(pullReference);
+        common::ImageMetadata(imageConfig["config"]).write(metadataFile);
+        auto metadataRAII = libsarus::PathRAII{metadataFile};
+        auto lazyImageFile = imageStore.getImageFile(pullReference, LazyImage::format);
+        lazyImage.write(lazyImageFile);
+        auto lazyImageRAII = libsarus::PathRAII{lazyImageFile};
+
+        addImageToRepository(pullReference, imageID, metadataFile, lazyImageFile, LazyImage::format, report);
+        metadataRAII.release();
+        lazyImageRAII.release();
+
+        prefetchLazyImageInBackground(lazyImage);
+    }
+
+    /**
+     * Fetch the file data of the image into the chunk cache in a detached background process,
+     * so that the first run of the image finds the chunks already in place
+     */
+    void ImageManager::prefetchLazyImageInBackground(const LazyImage& image) const {
+        printLog("Fetching image data in background process", libsarus::LogLevel::INFO);
+
+        auto prefetch = [this, &image]() {
+            auto source = RegistryBlobSource{config, image.getServer(), image.getRepository()};
+            image.prefetch(source, ChunkCache{config});
+        };
+        if (!utility::runInBackgroundProcess(prefetch)) {
+            printLog(boost::format("Failed to fork background fetch process: %s. The image data will be fetched at"
+                                   " the first run of the image") % strerror(errno), libsarus::LogLevel::WARN);
+        }
+    }
+
+    void ImageManager::processImage(const OCIImage& image,
+                                    const common::ImageReference& storageReference,
+                                    TimingReport& report,
+                                    PullCoordinator::Ticket* pullTicket) {
+        // The OCI image layout holds the compressed layers for the whole duration of the processing
+        auto layersSize = image.getLayersSize();
+        report.setCounter("ociLayers", layersSize);
+        if (isTimingReportRequested()) {
+            report.updateTempUsage(layersSize);
+        }
+
         auto metadata = image.getMetadata();
         auto metadataFile = imageStore.getImageMetadataFile(storageReference);
         metadata.write(metadataFile);
         auto metadataRAII = libsarus::PathRAII{metadataFile};
 
-        auto unpackedImage = image.unpack();
+        auto accessProfile = boost::optional<AccessProfile>{};
+        if (!config->accessProfileFile.empty()) {
+            accessProfile = AccessProfile::read(config->accessProfileFile);
+            printLog( boost::format("# access profile   : %s (%d files)")
+                      % config->accessProfileFile % accessProfile->getFiles().size(),
+                      libsarus::LogLevel::GENERAL);
+        }
+
+        // The same image may have been converted already under another reference or for another repository.
+        // Images of the pool are laid out without access profile: with a profile, the image is converted.
+        auto imageID = image.getImageID();
+        auto imageFormat = FilesystemImage::getConfiguredFormat(*config);
+        auto pooledImage = boost::optional<boost::filesystem::path>{};
+        if (!accessProfile) {
+            pooledImage = imagePool.findImage(imageID);
+        }
+        if (pooledImage) {
+            printLog( boost::format("# image pool       : reusing %s") % *pooledImage, libsarus::LogLevel::GENERAL);
+            report.setCounter(imageFormat + "Image", libsarus::filesystem::getFileSize(*pooledImage));
+            addImageToRepository(storageReference, imageID, metadataRAII.getPath(), *pooledImage, imageFormat, report);
+            metadataRAII.release();
+            return;
+        }
+
+        auto staging = StagingPolicy{config}.chooseUnpackDirectory(layersSize);
+        printLog( boost::format("# unpack directory : %s") % staging.directory, libsarus::LogLevel::GENERAL);
+        if (staging.estimatedSize > 0) {
+            report.setCounter("estimatedUnpackedRootfs", staging.estimatedSize);
+        }
+
+        if (pullTicket) {
+            pullTicket->setPhase("unpack");
+        }
+        TimingReport::ScopedPhase unpackPhase{report, "unpack"};
+        auto unpackedImage = unpackImage(image, staging.directory);
+        unpackPhase.stop();
+        // walking the unpacked rootfs is costly for large images: only done for the timing report
+        auto unpackedSize = size_t{0};
+        if (isTimingReportRequested()) {
+            unpackedSize = libsarus::filesystem::getDirectorySize(unpackedImage.getPath());
+            report.setCounter("unpackedRootfs", unpackedSize);
+            report.updateTempUsage(layersSize + unpackedSize);
+        }
+
+        // the phase is named after the tool which builds the image, e.g. "mksquashfs" or "mkfs.erofs"
+        auto buildPhaseName = imageFormat == FilesystemImage::squashfsFormat ? std::string{"mksquashfs"} : "mkfs." + imageFormat;
+        if (pullTicket) {
+            pullTicket->setPhase(buildPhaseName);
+        }
+        TimingReport::ScopedPhase buildPhase{report, buildPhaseName};
+        // Images converted into the pool must be byte-identical for identical inputs
+        bool isPooled = imagePool.isWritable() && !imageID.empty() && !accessProfile;
+        auto imagePath = isPooled ? imagePool.getImageFile(imageID) : imageStore.getImageFile(storageReference, imageFormat);
+        auto filesystemImage = FilesystemImage::create(*config, unpackedImage.getPath(), imagePath, isPooled, accessProfile);
+        auto imageRAII = libsarus::PathRAII{filesystemImage->getPathOfImage()};
+        if (isPooled) {
+            // other entries may reference the pool image as soon as it exists: never remove it
+            imageRAII.release();
+        }
+        buildPhase.stop();
+        if (scratchTrash.moveToTrash(unpackedImage.getPath())) {
+            unpackedImage.release();
+        }
+
+        auto imageSize = libsarus::filesystem::getFileSize(filesystemImage->getPathOfImage());
+        report.setCounter(imageFormat + "Image", imageSize);
+        // the image is written while the unpacked rootfs is still in place
+        if (isTimingReportRequested()) {
+            report.updateTempUsage(layersSize + unpackedSize + imageSize);
+        }
+
+        addImageToRepository(storageReference, imageID, metadataRAII.getPath(),
+                             filesystemImage->getPathOfImage(), filesystemImage->getFormat(), report);
+        metadataRAII.release();
+        imageRAII.release();
+    }
 
+    /**
+     * Add a SIF image to the repository by extracting its squashfs root filesystem,
+     * skipping the conversion to OCI image, the unpacking and the mksquashfs rebuild.
+     */
+    void ImageManager::processSifImage(const SifImage& image, const common::ImageReference& storageReference, TimingReport& report) {
+        auto metadataFile = imageStore.getImageMetadataFile(storageReference);
+        image.getMetadata().write(metadataFile);
+        auto metadataRAII = libsarus::PathRAII{metadataFile};
+
+        TimingReport::ScopedPhase extractPhase{report, "sifExtract"};
         auto squashfsImagePath = imageStore.getImageSquashfsFile(storageReference);
-        auto squashfs = SquashfsImage{*config, unpackedImage.getPath(), squashfsImagePath};
-        auto squashfsRAII = libsarus::PathRAII{squashfs.getPathOfImage()};
+        image.extractRootfs(squashfsImagePath);
+        auto squashfsRAII = libsarus::PathRAII{squashfsImagePath};
+        ImagePlacement{*config}.apply(squashfsImagePath);
+        extractPhase.stop();
+
+        report.setCounter("squashfsImage", libsarus::filesystem::getFileSize(squashfsImagePath));
 
-        auto imageSize = libsarus::filesystem::getFileSize(squashfsRAII.getPath());
+        addImageToRepository(storageReference, image.getImageID(), metadataRAII.getPath(), squashfsImagePath,
+                             FilesystemImage::squashfsFormat, report);
+        metadataRAII.release();
+        squashfsRAII.release();
+    }
+
+    void ImageManager::addImageToRepository(const common::ImageReference& storageReference,
+                                            const std::string& imageID,
+                                            const boost::filesystem::path& metadataFile,
+                                            const boost::filesystem::path& imageFile,
+                                            const std::string& imageFormat,
+                                            TimingReport& report) {
+        TimingReport::ScopedPhase metadataPhase{report, "metadataUpdate"};
+        // The report stored with the image covers the phases up to the image creation
+        report.appendToMetadataFile(metadataFile);
+
+        auto imageSize = libsarus::filesystem::getFileSize(imageFile);
         auto imageSizeString = sarus::common::SarusImage::createSizeString(imageSize);
         auto created = sarus::common::SarusImage::createTimeString(std::time(nullptr));
         auto sarusImage = common::SarusImage{
             storageReference,
-            image.getImageID(),
+            imageID,
             imageSizeString,
             created,
-            squashfsRAII.getPath(),
-            metadataRAII.getPath()};
+            imageFile,
+            metadataFile,
+            imageFormat};
 
         imageStore.addImage(sarusImage);
+        metadataPhase.stop();
+    }
 
-        metadataRAII.release();
-        squashfsRAII.release();
+    /**
+     * Unpack the image into the staging directory. The size estimate used to choose
+     * the staging directory is only a heuristic: if the unpacking fails (e.g. because
+     * the tmpfs ran out of space), it is retried once in the temporary directory.
+     */
+    libsarus::PathRAII ImageManager::unpackImage(const OCIImage& image, const boost::filesystem::path& stagingDirectory) const {
+        if (stagingDirectory == config->directories.temp) {
+            return image.unpack(stagingDirectory);
+        }
+
+        try {
+            return image.unpack(stagingDirectory);
+        }
+        catch(const libsarus::Error& e) {
+            auto message = boost::format("Failed to unpack image in staging directory %s: %s. "
+                                         "Retrying in temporary directory %s")
+                           % stagingDirectory % e.what() % config->directories.temp;
+            printLog(message, libsarus::LogLevel::WARN);
+        }
+        return image.unpack(config->directories.temp);
+    }
+
+    /**
+     * Move the OCI image layout into the trash, together with the unpack directory
+     * trashed earlier, and reclaim them in the background. Without deferred deletion,
+     * the layout is removed synchronously by the OCIImage object.
+     */
+    void ImageManager::disposeScratch(OCIImage& ociImage) const {
+        if (scratchTrash.moveToTrash(ociImage.getPath())) {
+            ociImage.release();
+        }
+        scratchTrash.reclaimInBackground();
+    }
+
+    bool ImageManager::isTimingReportRequested() const {
+        return !config->timingReportFile.empty();
+    }
+
+    void ImageManager::writeTimingReportIfRequested(const TimingReport& report) const {
+        if(!isTimingReportRequested()) {
+            return;
+        }
+        report.write(config->timingReportFile);
+        printLog(boost::format("# timing report    : %s") % config->timingReportFile, libsarus::LogLevel::GENERAL);
     }
 
     std::string ImageManager::retrieveRegistryDigest(const std::string& transport, const common::ImageReference& targetReference) const {
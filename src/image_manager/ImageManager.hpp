@@ -18,8 +18,14 @@
 #include "libsarus/Logger.hpp"
 #include "common/SarusImage.hpp"
 #include "image_manager/OCIImage.hpp"
+#include "image_manager/ImagePool.hpp"
 #include "image_manager/ImageStore.hpp"
+#include "image_manager/LazyImage.hpp"
+#include "image_manager/PullCoordinator.hpp"
+#include "image_manager/ScratchTrash.hpp"
+#include "image_manager/SifImage.hpp"
 #include "image_manager/SkopeoDriver.hpp"
+#include "image_manager/TimingReport.hpp"
 
 
 namespace sarus {
@@ -32,9 +38,29 @@ public:
     void loadImage(const std::string& format, const boost::filesystem::path& archive);
     void removeImage();
     std::vector<sarus::common::SarusImage> listImages() const;
+    common::SarusImage materializeLazyImage(const common::SarusImage& image);
 
 private:
-    void processImage(const OCIImage& image, const common::ImageReference& storageReference);
+    void processImage(const OCIImage& image,
+                      const common::ImageReference& storageReference,
+                      TimingReport& report,
+                      PullCoordinator::Ticket* pullTicket=nullptr);
+    void pullImageLazily(const std::string& transport,
+                         const common::ImageReference& pullReference,
+                         TimingReport& report,
+                         PullCoordinator::Ticket& pullTicket);
+    void prefetchLazyImageInBackground(const LazyImage& image) const;
+    void processSifImage(const SifImage& image, const common::ImageReference& storageReference, TimingReport& report);
+    void addImageToRepository(const common::ImageReference& storageReference,
+                              const std::string& imageID,
+                              const boost::filesystem::path& metadataFile,
+                              const boost::filesystem::path& imageFile,
+                              const std::string& imageFormat,
+                              TimingReport& report);
+    libsarus::PathRAII unpackImage(const OCIImage& image, const boost::filesystem::path& stagingDirectory) const;
+    void disposeScratch(OCIImage& ociImage) const;
+    bool isTimingReportRequested() const;
+    void writeTimingReportIfRequested(const TimingReport& report) const;
     std::string retrieveRegistryDigest(const std::string& transport, const common::ImageReference& targetReference) const;
     void issueWarningIfIsCentralizedRepositoryAndIsNotRootUser() const;
     void issueErrorIfIsCentralizedRepositoryAndCentralizedRepositoryIsDisabled() const;
@@ -47,6 +73,8 @@ private:
     std::shared_ptr<const common::Config> config;
     SkopeoDriver skopeoDriver;
     ImageStore imageStore;
+    ImagePool imagePool;
+    ScratchTrash scratchTrash;
     const std::string sysname = "ImageManager";  // system name for logger
 };
 
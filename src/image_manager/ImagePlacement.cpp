@@ -0,0 +1,147 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/ImagePlacement.hpp"
+
+#include <algorithm>
+
+#include <rapidjson/pointer.h>
+
+#include "common/SarusImage.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+ImagePlacement::LustreBackend::LustreBackend(const boost::filesystem::path& lfsPath)
+    : lfsPath{lfsPath}
+{}
+
+void ImagePlacement::LustreBackend::setLayout(const boost::filesystem::path& file, const Layout& layout) {
+    libsarus::process::executeCommand(generateLfsArgs(file, layout).string());
+}
+
+libsarus::CLIArguments ImagePlacement::LustreBackend::generateLfsArgs(const boost::filesystem::path& file,
+                                                                      const Layout& layout) const {
+    auto args = libsarus::CLIArguments{lfsPath.string(), "migrate", "-c", std::to_string(layout.stripeCount)};
+    if(layout.stripeSize > 0) {
+        args += libsarus::CLIArguments{"-S", std::to_string(layout.stripeSize)};
+    }
+    args.push_back(file.string());
+    return args;
+}
+
+ImagePlacement::ImagePlacement(const common::Config& config)
+    : config{&config}
+{
+    if(isEnabled()) {
+        backend = createBackend();
+    }
+}
+
+ImagePlacement::ImagePlacement(const common::Config& config, std::shared_ptr<Backend> backend)
+    : config{&config}
+    , backend{std::move(backend)}
+{}
+
+bool ImagePlacement::isEnabled() const {
+    return rapidjson::Pointer("/imagePlacement").Get(config->json) != nullptr;
+}
+
+/**
+ * Returns the configured layouts, sorted by increasing minimum image size.
+ */
+std::vector<ImagePlacement::Layout> ImagePlacement::getLayouts() const {
+    auto layouts = std::vector<Layout>{};
+    const auto* values = rapidjson::Pointer("/imagePlacement/layouts").Get(config->json);
+    if(values == nullptr) {
+        return layouts;
+    }
+    for(const auto& value : values->GetArray()) {
+        auto layout = Layout{};
+        if(value.HasMember("minSizeMB")) {
+            layout.minSize = static_cast<size_t>(value["minSizeMB"].GetUint64()) * 1024 * 1024;
+        }
+        layout.stripeCount = value["stripeCount"].GetInt();
+        if(value.HasMember("stripeSizeMB")) {
+            layout.stripeSize = static_cast<size_t>(value["stripeSizeMB"].GetUint64()) * 1024 * 1024;
+        }
+        layouts.push_back(layout);
+    }
+    std::stable_sort(layouts.begin(), layouts.end(), [](const Layout& lhs, const Layout& rhs) {
+        return lhs.minSize < rhs.minSize;
+    });
+    return layouts;
+}
+
+/**
+ * Returns the layout with the largest minimum size not exceeding the size of the image,
+ * or boost::none if the image is smaller than the minimum size of all the layouts.
+ */
+boost::optional<ImagePlacement::Layout> ImagePlacement::chooseLayout(size_t imageSize) const {
+    auto chosen = boost::optional<Layout>{};
+    for(const auto& layout : getLayouts()) {
+        if(layout.minSize > imageSize) {
+            break;
+        }
+        chosen = layout;
+    }
+    return chosen;
+}
+
+void ImagePlacement::apply(const boost::filesystem::path& imageFile) const {
+    if(!isEnabled()) {
+        return;
+    }
+
+    auto imageSize = libsarus::filesystem::getFileSize(imageFile);
+    auto layout = chooseLayout(imageSize);
+    if(!layout) {
+        printLog(boost::format("No layout configured for image %s of size %s: keeping the default layout")
+                    % imageFile % common::SarusImage::createSizeString(imageSize),
+                 libsarus::LogLevel::DEBUG);
+        return;
+    }
+
+    printLog(boost::format("Setting layout of image %s (%s) with %s backend: stripe count %d, stripe size %s")
+                % imageFile % common::SarusImage::createSizeString(imageSize) % backend->getName()
+                % layout->stripeCount
+                % (layout->stripeSize > 0 ? common::SarusImage::createSizeString(layout->stripeSize) : "default"),
+             libsarus::LogLevel::INFO);
+    try {
+        backend->setLayout(imageFile, *layout);
+    }
+    catch(const std::exception& e) {
+        printLog(boost::format("Failed to set layout of image %s, keeping the default layout: %s") % imageFile % e.what(),
+                 libsarus::LogLevel::WARN);
+    }
+}
+
+std::shared_ptr<ImagePlacement::Backend> ImagePlacement::createBackend() const {
+    const auto* name = rapidjson::Pointer("/imagePlacement/backend").Get(config->json);
+    auto backendName = name ? std::string{name->GetString()} : std::string{"lustre"};
+    if(backendName == "lustre") {
+        auto lfsPath = boost::filesystem::path{"/usr/bin/lfs"};
+        if(const auto* value = rapidjson::Pointer("/imagePlacement/lfsPath").Get(config->json)) {
+            lfsPath = value->GetString();
+        }
+        return std::make_shared<LustreBackend>(lfsPath);
+    }
+    auto message = boost::format("Unsupported imagePlacement backend '%s' in the configuration") % backendName;
+    SARUS_THROW_ERROR(message.str());
+}
+
+void ImagePlacement::printLog(const boost::format& message, libsarus::LogLevel level) const {
+    libsarus::Logger::getInstance().log(message, "ImagePlacement", level);
+}
+
+}} // namespace
@@ -0,0 +1,92 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ImagePlacement_hpp
+#define sarus_image_manger_ImagePlacement_hpp
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "libsarus/CLIArguments.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Sets the layout of newly created image files on the parallel filesystem
+ * hosting the repository, e.g. the striping of the files on Lustre.
+ *
+ * Image files inherit the default layout of their directory, often a single
+ * storage target, which is read by all the nodes mounting the image. When the
+ * "imagePlacement" configuration object is present, the layout of an image is
+ * chosen by its size among the configured layouts and applied by the backend
+ * before the image is published in the repository. Failures to apply a layout
+ * are reported as warnings: the image is usable with its default layout.
+ */
+class ImagePlacement {
+public:
+    struct Layout {
+        size_t minSize = 0;
+        int stripeCount = 0;    // -1 stripes the file over all the storage targets
+        size_t stripeSize = 0;  // 0 keeps the default stripe size
+    };
+
+    class Backend {
+    public:
+        virtual ~Backend() = default;
+        virtual std::string getName() const = 0;
+        virtual void setLayout(const boost::filesystem::path& file, const Layout& layout) = 0;
+    };
+
+    /**
+     * Restripes the file with "lfs migrate", which copies its data to the new
+     * layout. Lustre only sets the layout of a file when it is created, and the
+     * size of an image is known only after it has been written.
+     */
+    class LustreBackend : public Backend {
+    public:
+        LustreBackend(const boost::filesystem::path& lfsPath);
+        std::string getName() const override { return "lustre"; }
+        void setLayout(const boost::filesystem::path& file, const Layout& layout) override;
+        libsarus::CLIArguments generateLfsArgs(const boost::filesystem::path& file, const Layout& layout) const;
+
+    private:
+        boost::filesystem::path lfsPath;
+    };
+
+    ImagePlacement(const common::Config& config);
+    ImagePlacement(const common::Config& config, std::shared_ptr<Backend> backend);
+    bool isEnabled() const;
+    std::vector<Layout> getLayouts() const;
+    boost::optional<Layout> chooseLayout(size_t imageSize) const;
+    void apply(const boost::filesystem::path& imageFile) const;
+
+private:
+    std::shared_ptr<Backend> createBackend() const;
+    void printLog(const boost::format& message, libsarus::LogLevel level) const;
+
+private:
+    const common::Config* config;
+    std::shared_ptr<Backend> backend;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/ImagePool.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <tuple>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/pointer.h>
+
+#include "image_manager/FilesystemImage.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/Flock.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+const auto lockTimeout = std::chrono::milliseconds{60000};
+const auto lockWarning = std::chrono::milliseconds{10000};
+
+}
+
+ImagePool::ImagePool(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+bool ImagePool::isEnabled() const {
+    return rj::Pointer("/imagePool").Get(config->json) != nullptr;
+}
+
+/**
+ * Only the owner of the pool directory adds images and tracks their references.
+ * If the directory does not exist yet, it is created by root.
+ */
+bool ImagePool::isWritable() const {
+    if(!isEnabled()) {
+        return false;
+    }
+    auto directory = getDirectory();
+    if(!boost::filesystem::exists(directory)) {
+        return geteuid() == 0;
+    }
+    return geteuid() == std::get<0>(libsarus::filesystem::getOwner(directory));
+}
+
+boost::filesystem::path ImagePool::getDirectory() const {
+    if(!isEnabled()) {
+        SARUS_THROW_ERROR("The image pool is not enabled");
+    }
+    return rj::Pointer("/imagePool/directory").Get(config->json)->GetString();
+}
+
+/**
+ * The conversion profile identifies the image format and its settings (e.g. the mksquashfs
+ * options): images converted with different settings are different files, even if their
+ * image IDs are the same.
+ */
+std::string ImagePool::getConversionProfile() const {
+    auto hash = libsarus::Sha256{};
+    hash.update(FilesystemImage::getConversionSettings(*config));
+    return hash.finalizeHex().substr(0, 12);
+}
+
+boost::filesystem::path ImagePool::getImageFile(const std::string& imageID) const {
+    auto extension = FilesystemImage::getFileExtension(FilesystemImage::getConfiguredFormat(*config));
+    return getDirectory() / (imageID + "-" + getConversionProfile() + extension);
+}
+
+/**
+ * Returns the squashfs file of the image in the pool, if the image was
+ * converted with the current conversion profile.
+ */
+boost::optional<boost::filesystem::path> ImagePool::findImage(const std::string& imageID) const {
+    if(!isEnabled() || imageID.empty()) {
+        return boost::none;
+    }
+    auto imageFile = getImageFile(imageID);
+    if(!boost::filesystem::exists(imageFile)) {
+        printLog(boost::format("Image %s not found in pool") % imageID, libsarus::LogLevel::DEBUG);
+        return boost::none;
+    }
+    if(!isTrusted(imageFile)) {
+        printLog(boost::format("Ignoring pool image %s, which is not owned by the owner of the pool"
+                               " or is writable by other users") % imageFile,
+                 libsarus::LogLevel::WARN);
+        return boost::none;
+    }
+    // without a reference, the image could be removed while still used by the repository entry
+    if(!isWritable() && !isUserReferencesDirectoryTrusted()) {
+        printLog(boost::format("Not reusing pool image %s: the pool does not track references of other users")
+                    % imageFile,
+                 libsarus::LogLevel::INFO);
+        return boost::none;
+    }
+    printLog(boost::format("Found image %s in pool: %s") % imageID % imageFile, libsarus::LogLevel::INFO);
+    return imageFile;
+}
+
+bool ImagePool::isPoolImage(const boost::filesystem::path& imageFile) const {
+    return isEnabled()
+        && imageFile.parent_path() == getDirectory()
+        && (imageFile.extension() == FilesystemImage::getFileExtension(FilesystemImage::squashfsFormat)
+            || imageFile.extension() == FilesystemImage::getFileExtension(FilesystemImage::erofsFormat));
+}
+
+/**
+ * Records that a repository entry (the referrer) uses the image of the pool.
+ * References of the owner of the pool are stored in the "references" directory,
+ * those of other users in their directories of the "user-references" directory.
+ */
+void ImagePool::addReference(const boost::filesystem::path& imageFile, const std::string& referrer) const {
+    auto isOwner = isWritable();
+    if(isOwner) {
+        libsarus::filesystem::createFileIfNecessary(getLockFile());
+        createUserReferencesDirectory();
+    }
+    else if(!isUserReferencesDirectoryTrusted() || !boost::filesystem::exists(getLockFile())) {
+        auto message = boost::format("Failed to reference pool image %s: the pool does not track"
+                                     " references of other users") % imageFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    // the lock is opened read-only, thus other users can take it too
+    libsarus::Flock lock{getLockFile(), libsarus::Flock::Type::writeLock, lockTimeout, lockWarning};
+
+    // the last reference may have been removed together with the image in the meantime
+    if(!boost::filesystem::exists(imageFile)) {
+        auto message = boost::format("Failed to reference pool image %s: the image was removed from the pool") % imageFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto referenceFile = isOwner ? getReferenceFile(imageFile, referrer) : getUserReferenceFile(imageFile, referrer);
+    if(!isOwner) {
+        // the per-user directory is created by the user and has to be owned by the user
+        auto userDirectory = getUserReferencesDirectory() / std::to_string(geteuid());
+        if(::mkdir(userDirectory.c_str(), 0755) != 0 && errno != EEXIST) {
+            auto message = boost::format("Failed to create %s: %s") % userDirectory % std::strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        struct stat sb;
+        if(::lstat(userDirectory.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode) || sb.st_uid != geteuid()) {
+            auto message = boost::format("Failed to reference pool image %s: %s is not a directory owned by the user")
+                           % imageFile % userDirectory;
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+    libsarus::filesystem::createFoldersIfNecessary(referenceFile.parent_path());
+    libsarus::filesystem::writeTextFile(referrer, referenceFile);
+    printLog(boost::format("Added reference from %s to pool image %s") % referrer % imageFile, libsarus::LogLevel::DEBUG);
+}
+
+/**
+ * Removes the reference of a repository entry (the referrer) to the image of the pool,
+ * and the image itself if it was the last reference.
+ */
+void ImagePool::removeReference(const boost::filesystem::path& imageFile, const std::string& referrer) const {
+    if(!isWritable()) {
+        // other users only remove their own reference, the image is removed by the owner
+        if(!boost::filesystem::exists(getLockFile())) {
+            return;
+        }
+        libsarus::Flock lock{getLockFile(), libsarus::Flock::Type::writeLock, lockTimeout, lockWarning};
+        auto referenceFile = getUserReferenceFile(imageFile, referrer);
+        boost::system::error_code ec;
+        boost::filesystem::remove(referenceFile, ec);
+        boost::filesystem::remove(referenceFile.parent_path(), ec); // only succeeds if empty
+        printLog(boost::format("Removed reference from %s to pool image %s") % referrer % imageFile, libsarus::LogLevel::DEBUG);
+        return;
+    }
+
+    libsarus::filesystem::createFileIfNecessary(getLockFile());
+    libsarus::Flock lock{getLockFile(), libsarus::Flock::Type::writeLock, lockTimeout, lockWarning};
+
+    boost::filesystem::remove(getReferenceFile(imageFile, referrer));
+    printLog(boost::format("Removed reference from %s to pool image %s") % referrer % imageFile, libsarus::LogLevel::DEBUG);
+
+    auto referencesDirectory = getReferencesDirectory(imageFile);
+    if(boost::filesystem::exists(referencesDirectory) && !boost::filesystem::is_empty(referencesDirectory)) {
+        return;
+    }
+    if(isReferencedByUsers(imageFile)) {
+        printLog(boost::format("Keeping pool image %s, which is still referenced by other users") % imageFile,
+                 libsarus::LogLevel::INFO);
+        return;
+    }
+    boost::filesystem::remove(imageFile);
+    boost::filesystem::remove(referencesDirectory);
+    printLog(boost::format("Removed pool image %s, which is not referenced anymore") % imageFile, libsarus::LogLevel::INFO);
+}
+
+std::vector<std::string> ImagePool::getReferences(const boost::filesystem::path& imageFile) const {
+    auto references = std::vector<std::string>{};
+    auto referencesDirectory = getReferencesDirectory(imageFile);
+    if(!boost::filesystem::exists(referencesDirectory)) {
+        return references;
+    }
+    for(const auto& entry : boost::filesystem::directory_iterator{referencesDirectory}) {
+        references.push_back(libsarus::filesystem::readFile(entry.path()));
+    }
+    return references;
+}
+
+bool ImagePool::isTrusted(const boost::filesystem::path& file) const {
+    struct stat sb;
+    if(stat(file.c_str(), &sb) != 0) {
+        return false;
+    }
+    auto poolOwner = std::get<0>(libsarus::filesystem::getOwner(getDirectory()));
+    return sb.st_uid == poolOwner && (sb.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool ImagePool::isUserReferencesDirectoryTrusted() const {
+    struct stat sb;
+    if(lstat(getUserReferencesDirectory().c_str(), &sb) != 0) {
+        return false;
+    }
+    auto poolOwner = std::get<0>(libsarus::filesystem::getOwner(getDirectory()));
+    return S_ISDIR(sb.st_mode) && sb.st_uid == poolOwner && (sb.st_mode & S_ISVTX);
+}
+
+/**
+ * The user directories are writable by their users: they are only trusted to the extent
+ * of keeping images in the pool. Entries not owned by the user they are named after,
+ * symlinks, and references whose repository metadata file was removed are ignored.
+ */
+bool ImagePool::isReferencedByUsers(const boost::filesystem::path& imageFile) const {
+    if(!boost::filesystem::exists(getUserReferencesDirectory())) {
+        return false;
+    }
+
+    for(const auto& userEntry : boost::filesystem::directory_iterator{getUserReferencesDirectory()}) {
+        struct stat sb;
+        if(lstat(userEntry.path().c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode)
+           || userEntry.path().filename().string() != std::to_string(sb.st_uid)) {
+            continue;
+        }
+        auto directory = getUserReferencesDirectory(imageFile, sb.st_uid);
+        if(lstat(directory.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+            continue;
+        }
+        boost::system::error_code ec;
+        for(auto it = boost::filesystem::directory_iterator{directory, ec};
+            !ec && it != boost::filesystem::directory_iterator{};
+            it.increment(ec)) {
+            if(lstat(it->path().c_str(), &sb) != 0 || !S_ISREG(sb.st_mode)) {
+                continue;
+            }
+            // the referrer is "<repository metadata file>#<image key>"
+            auto referrer = libsarus::filesystem::readFile(it->path());
+            auto metadataFile = boost::filesystem::path{referrer.substr(0, referrer.rfind('#'))};
+            auto status = boost::filesystem::status(metadataFile, ec);
+            if(ec && ec != boost::system::errc::no_such_file_or_directory) {
+                return true; // not accessible by the owner of the pool: assume the reference is in use
+            }
+            if(boost::filesystem::exists(status)) {
+                return true;
+            }
+            printLog(boost::format("Ignoring stale reference %s to pool image %s") % it->path() % imageFile,
+                     libsarus::LogLevel::DEBUG);
+        }
+    }
+    return false;
+}
+
+void ImagePool::createUserReferencesDirectory() const {
+    auto directory = getUserReferencesDirectory();
+    if(::mkdir(directory.c_str(), 0755) != 0) {
+        if(errno == EEXIST) {
+            return;
+        }
+        auto message = boost::format("Failed to create %s: %s") % directory % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    // like /tmp: every user can create a directory, but cannot remove those of other users
+    boost::filesystem::permissions(directory, boost::filesystem::perms(01777));
+}
+
+boost::filesystem::path ImagePool::getReferencesDirectory(const boost::filesystem::path& imageFile) const {
+    return getDirectory() / "references" / imageFile.stem();
+}
+
+boost::filesystem::path ImagePool::getReferenceFile(const boost::filesystem::path& imageFile, const std::string& referrer) const {
+    auto hash = libsarus::Sha256{};
+    hash.update(referrer);
+    return getReferencesDirectory(imageFile) / hash.finalizeHex();
+}
+
+boost::filesystem::path ImagePool::getUserReferencesDirectory() const {
+    return getDirectory() / "user-references";
+}
+
+boost::filesystem::path ImagePool::getUserReferencesDirectory(const boost::filesystem::path& imageFile, uid_t uid) const {
+    return getUserReferencesDirectory() / std::to_string(uid) / imageFile.stem();
+}
+
+boost::filesystem::path ImagePool::getUserReferenceFile(const boost::filesystem::path& imageFile, const std::string& referrer) const {
+    auto hash = libsarus::Sha256{};
+    hash.update(referrer);
+    return getUserReferencesDirectory(imageFile, geteuid()) / hash.finalizeHex();
+}
+
+boost::filesystem::path ImagePool::getLockFile() const {
+    return getDirectory() / ".lock";
+}
+
+void ImagePool::printLog(const boost::format& message, libsarus::LogLevel level,
+                         std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void ImagePool::printLog(const std::string& message, libsarus::LogLevel level,
+                         std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
@@ -0,0 +1,84 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ImagePool_hpp
+#define sarus_image_manger_ImagePool_hpp
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Content-addressed pool of squashfs images, shared by all the repositories of a site.
+ *
+ * Each squashfs file in the pool is stored once per image ID (i.e. the digest of the
+ * image configuration) and conversion profile (i.e. the mksquashfs settings), so that
+ * the same image pulled with different tags or into different repositories is converted
+ * and stored only once. Repository entries reference the squashfs files of the pool.
+ *
+ * The pool is managed by the owner of its directory (normally root): only processes
+ * running as the owner add squashfs files and remove them together with their last
+ * reference. Other users reuse the squashfs files already in the pool, recording their
+ * references in per-user directories of the "user-references" directory, which is
+ * created by the owner with the sticky bit set like /tmp. The owner only removes a
+ * squashfs file when no user directory (owned by the user it is named after) holds
+ * a reference to it whose repository metadata file still exists.
+ */
+class ImagePool {
+public:
+    ImagePool(std::shared_ptr<const common::Config> config);
+    bool isEnabled() const;
+    bool isWritable() const;
+    boost::filesystem::path getDirectory() const;
+    std::string getConversionProfile() const;
+    boost::filesystem::path getImageFile(const std::string& imageID) const;
+    boost::optional<boost::filesystem::path> findImage(const std::string& imageID) const;
+    bool isPoolImage(const boost::filesystem::path& imageFile) const;
+    void addReference(const boost::filesystem::path& imageFile, const std::string& referrer) const;
+    void removeReference(const boost::filesystem::path& imageFile, const std::string& referrer) const;
+    std::vector<std::string> getReferences(const boost::filesystem::path& imageFile) const;
+
+private:
+    bool isTrusted(const boost::filesystem::path& file) const;
+    bool isUserReferencesDirectoryTrusted() const;
+    bool isReferencedByUsers(const boost::filesystem::path& imageFile) const;
+    void createUserReferencesDirectory() const;
+    boost::filesystem::path getReferencesDirectory(const boost::filesystem::path& imageFile) const;
+    boost::filesystem::path getReferenceFile(const boost::filesystem::path& imageFile, const std::string& referrer) const;
+    boost::filesystem::path getUserReferencesDirectory() const;
+    boost::filesystem::path getUserReferencesDirectory(const boost::filesystem::path& imageFile, uid_t uid) const;
+    boost::filesystem::path getUserReferenceFile(const boost::filesystem::path& imageFile, const std::string& referrer) const;
+    boost::filesystem::path getLockFile() const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    const std::string sysname = "ImagePool";
+};
+
+}
+}
+
+#endif
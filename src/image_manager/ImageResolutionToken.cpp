@@ -0,0 +1,254 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/ImageResolutionToken.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+#include "image_manager/ImageStore.hpp"
+#include "image_manager/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+const std::string ImageResolutionToken::environmentVariable = "SARUS_IMAGE_TOKEN";
+
+static const std::string tokenPrefix = "sarus1";
+
+static rj::Value makeReferenceValue(const common::ImageReference& reference, rj::Document::AllocatorType& allocator) {
+    auto value = rj::Value{rj::kObjectType};
+    value.AddMember("server", rj::Value{reference.server.c_str(), allocator}, allocator);
+    value.AddMember("namespace", rj::Value{reference.repositoryNamespace.c_str(), allocator}, allocator);
+    value.AddMember("image", rj::Value{reference.image.c_str(), allocator}, allocator);
+    value.AddMember("tag", rj::Value{reference.tag.c_str(), allocator}, allocator);
+    value.AddMember("digest", rj::Value{reference.digest.c_str(), allocator}, allocator);
+    return value;
+}
+
+static common::ImageReference makeReference(const rj::Value& value) {
+    return common::ImageReference{
+        value["server"].GetString(),
+        value["namespace"].GetString(),
+        value["image"].GetString(),
+        value["tag"].GetString(),
+        value["digest"].GetString()
+    };
+}
+
+static std::uint64_t getModificationTimeNs(const struct stat& st) {
+    return static_cast<std::uint64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static struct stat statImageFile(const boost::filesystem::path& imageFile) {
+    auto fd = ::open(imageFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        auto message = boost::format("Failed to open %s: %s") % imageFile % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    struct stat st;
+    auto status = ::fstat(fd, &st);
+    auto fstatErrno = errno;
+    close(fd);
+    if(status != 0) {
+        auto message = boost::format("Failed to fstat %s: %s") % imageFile % strerror(fstatErrno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return st;
+}
+
+ImageResolutionToken::ImageResolutionToken(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+/**
+ * Creates the token of an image found in the repository. The requested reference is the one
+ * passed by the user, which may differ from the reference of the image (e.g. images found
+ * in the repositories of the legacy default server).
+ */
+std::string ImageResolutionToken::create(const common::ImageReference& requestedReference,
+                                         const common::SarusImage& image) const {
+    auto st = statImageFile(image.imageFile);
+
+    auto payload = rj::Document{rj::kObjectType};
+    auto& allocator = payload.GetAllocator();
+    payload.AddMember("requestedReference", makeReferenceValue(requestedReference, allocator), allocator);
+    payload.AddMember("reference", makeReferenceValue(image.reference, allocator), allocator);
+    payload.AddMember("id", rj::Value{image.id.c_str(), allocator}, allocator);
+    payload.AddMember("datasize", rj::Value{image.datasize.c_str(), allocator}, allocator);
+    payload.AddMember("created", rj::Value{image.created.c_str(), allocator}, allocator);
+    payload.AddMember("format", rj::Value{image.format.c_str(), allocator}, allocator);
+    payload.AddMember("imageFile", rj::Value{image.imageFile.c_str(), allocator}, allocator);
+    payload.AddMember("metadataFile", rj::Value{image.metadataFile.c_str(), allocator}, allocator);
+    payload.AddMember("inode", rj::Value{static_cast<std::uint64_t>(st.st_ino)}, allocator);
+    payload.AddMember("size", rj::Value{static_cast<std::uint64_t>(st.st_size)}, allocator);
+    payload.AddMember("mtime", rj::Value{getModificationTimeNs(st)}, allocator);
+    payload.AddMember("uid", rj::Value{static_cast<std::uint64_t>(config->userIdentity.uid)}, allocator);
+    payload.AddMember("jobID", rj::Value{getJobID().c_str(), allocator}, allocator);
+    payload.AddMember("repository", rj::Value{config->directories.repository.c_str(), allocator}, allocator);
+
+    auto serializedPayload = libsarus::json::serialize(payload);
+    auto digest = libsarus::Sha256{};
+    digest.update(serializedPayload);
+    return tokenPrefix + "." + utility::base64Encode(serializedPayload) + "." + digest.finalizeHex();
+}
+
+/**
+ * Looks up the image in the tokens of the SARUS_IMAGE_TOKEN environment variable.
+ * Has to be called with the identity of the user, which opens the image file.
+ */
+boost::optional<common::SarusImage> ImageResolutionToken::findImage(const common::ImageReference& requestedReference) const {
+    const auto& environment = config->commandRun.hostEnvironment;
+    auto tokens = environment.find(environmentVariable);
+    if(tokens == environment.cend()) {
+        return boost::none;
+    }
+    return findImage(requestedReference, tokens->second);
+}
+
+/**
+ * Looks up the image in a whitespace-separated list of tokens, which can carry the images
+ * of several references.
+ */
+boost::optional<common::SarusImage> ImageResolutionToken::findImage(const common::ImageReference& requestedReference,
+                                                                    const std::string& tokens) const {
+    auto trimmedTokens = boost::trim_copy(tokens);
+    if(trimmedTokens.empty()) {
+        return boost::none;
+    }
+
+    auto splitTokens = std::vector<std::string>{};
+    boost::split(splitTokens, trimmedTokens, boost::is_any_of(" \t\n"), boost::token_compress_on);
+    for(const auto& token : splitTokens) {
+        auto image = validate(requestedReference, token);
+        if(image) {
+            printLog(boost::format("Resolved image %s through %s: %s")
+                        % requestedReference % environmentVariable % image->imageFile,
+                     libsarus::LogLevel::INFO);
+            return image;
+        }
+    }
+    return boost::none;
+}
+
+/**
+ * Returns the image of the token if the token was created for the requested reference
+ * within the current scope (user, Slurm job, repository), the image file is a file of the
+ * repository or of the image pool with a supported format, and the image file did not change.
+ */
+boost::optional<common::SarusImage> ImageResolutionToken::validate(const common::ImageReference& requestedReference,
+                                                                   const std::string& token) const {
+    auto payload = rj::Document{};
+    try {
+        auto fields = std::vector<std::string>{};
+        boost::split(fields, token, boost::is_any_of("."));
+        if(fields.size() != 3 || fields[0] != tokenPrefix) {
+            SARUS_THROW_ERROR("unsupported format");
+        }
+        auto serializedPayload = utility::base64Decode(fields[1]);
+        auto digest = libsarus::Sha256{};
+        digest.update(serializedPayload);
+        if(digest.finalizeHex() != fields[2]) {
+            SARUS_THROW_ERROR("digest mismatch");
+        }
+        payload = libsarus::json::parse(serializedPayload);
+        if(!(makeReference(payload["requestedReference"]) == requestedReference)) {
+            // the token of another image
+            return boost::none;
+        }
+    }
+    catch(const std::exception& e) {
+        printLog(boost::format("Ignoring invalid token in %s: %s") % environmentVariable % e.what(),
+                 libsarus::LogLevel::WARN);
+        return boost::none;
+    }
+
+    auto ignoreToken = [&](const std::string& reason) {
+        printLog(boost::format("Ignoring token of image %s in %s: %s. Looking up the image in the repository")
+                    % requestedReference % environmentVariable % reason,
+                 libsarus::LogLevel::INFO);
+        return boost::none;
+    };
+
+    try {
+        if(payload["uid"].GetUint64() != static_cast<std::uint64_t>(config->userIdentity.uid)) {
+            return ignoreToken("created by another user");
+        }
+        if(payload["jobID"].GetString() != getJobID()) {
+            return ignoreToken("created outside of the current Slurm job");
+        }
+        if(payload["repository"].GetString() != config->directories.repository.string()) {
+            return ignoreToken("created for another repository");
+        }
+
+        auto image = common::SarusImage{};
+        image.reference = makeReference(payload["reference"]);
+        image.id = payload["id"].GetString();
+        image.datasize = payload["datasize"].GetString();
+        image.created = payload["created"].GetString();
+        image.format = payload["format"].GetString();
+        image.imageFile = payload["imageFile"].GetString();
+        image.metadataFile = payload["metadataFile"].GetString();
+        // the token is only a hint: the image is mounted as root, thus it has to pass the
+        // checks of the entries of the repository metadata ("sarus resolve" materializes
+        // lazily pulled images, and always records the format)
+        try {
+            auto imageStore = ImageStore{config};
+            ImageStore::checkImageFormat(image.format);
+            imageStore.checkImageFile(image.imageFile);
+        }
+        catch(const std::exception& e) {
+            return ignoreToken(e.what());
+        }
+
+        auto st = statImageFile(image.imageFile);
+        if(static_cast<std::uint64_t>(st.st_ino) != payload["inode"].GetUint64()
+           || static_cast<std::uint64_t>(st.st_size) != payload["size"].GetUint64()
+           || getModificationTimeNs(st) != payload["mtime"].GetUint64()) {
+            return ignoreToken("the image file changed since the creation of the token");
+        }
+        return image;
+    }
+    catch(const std::exception& e) {
+        return ignoreToken(e.what());
+    }
+}
+
+std::string ImageResolutionToken::getJobID() const {
+    const auto& environment = config->commandRun.hostEnvironment;
+    auto jobID = environment.find("SLURM_JOB_ID");
+    return jobID != environment.cend() ? jobID->second : "";
+}
+
+void ImageResolutionToken::printLog(const boost::format& message, libsarus::LogLevel level,
+                                    std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void ImageResolutionToken::printLog(const std::string& message, libsarus::LogLevel level,
+                                    std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
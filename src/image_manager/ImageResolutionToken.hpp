@@ -0,0 +1,77 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ImageResolutionToken_hpp
+#define sarus_image_manger_ImageResolutionToken_hpp
+
+#include <memory>
+#include <string>
+
+#include <boost/format.hpp>
+#include <boost/optional.hpp>
+#include <rapidjson/document.h>
+
+#include "common/Config.hpp"
+#include "common/ImageReference.hpp"
+#include "common/SarusImage.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Tokens carrying the result of the lookup of an image in the repository, created once per
+ * job by "sarus resolve" and passed to the following "sarus run" commands of the job through
+ * the SARUS_IMAGE_TOKEN environment variable.
+ *
+ * A token records the image as found in the repository metadata (reference, ID, size, format,
+ * image and metadata files) together with the inode, size and modification time of the image
+ * file. "sarus run" only accepts a token created for the same image reference, user, Slurm job
+ * and repository, and whose image file still has the recorded inode, size and modification
+ * time, which costs a single open and fstat of the file instead of locking and parsing the
+ * repository metadata. Otherwise the token is ignored and the image is looked up as usual.
+ *
+ * The tokens end with the SHA-256 digest of their content, which detects truncated or
+ * otherwise corrupted tokens. The digest is not a signature: any user can write a token,
+ * which is thus only a hint of the image to use. The image file and format of a token go
+ * through the same checks as the entries of the repository metadata, which is also
+ * writable by the user: the file must be in the images directory of the repository or in
+ * the image pool, and have a format mounted by Sarus.
+ */
+class ImageResolutionToken {
+public:
+    static const std::string environmentVariable;
+
+public:
+    ImageResolutionToken(std::shared_ptr<const common::Config> config);
+    std::string create(const common::ImageReference& requestedReference, const common::SarusImage& image) const;
+    boost::optional<common::SarusImage> findImage(const common::ImageReference& requestedReference) const;
+    boost::optional<common::SarusImage> findImage(const common::ImageReference& requestedReference,
+                                                  const std::string& tokens) const;
+
+private:
+    boost::optional<common::SarusImage> validate(const common::ImageReference& requestedReference,
+                                                 const std::string& token) const;
+    std::string getJobID() const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    const std::string sysname = "ImageResolutionToken";
+};
+
+}
+}
+
+#endif
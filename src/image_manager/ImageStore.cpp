@@ -10,10 +10,16 @@
 
 #include "image_manager/ImageStore.hpp"
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <string>
 #include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
@@ -25,6 +31,8 @@
 #include "libsarus/Utility.hpp"
 #include "libsarus/Flock.hpp"
 #include "common/SarusImage.hpp"
+#include "image_manager/FilesystemImage.hpp"
+#include "image_manager/LazyImage.hpp"
 
 
 namespace rj = rapidjson;
@@ -35,6 +43,9 @@ namespace image_manager {
     ImageStore::ImageStore(std::shared_ptr<const common::Config> config)
         : imagesDirectory{config->directories.images}
         , metadataFile{config->directories.repository / "metadata.json"}
+        , usageDirectory{config->directories.repository / "user-usage"}
+        , isCentralizedRepository{config->useCentralizedRepository}
+        , imagePool{config}
     {
         if (!boost::filesystem::exists(metadataFile)) {
             initRepositoryMetadataFile();
@@ -67,11 +78,20 @@ namespace image_manager {
         try {
             libsarus::Flock lock{metadataFile, libsarus::Flock::Type::writeLock, lockTimeout, lockWarning};
             auto metadata = libsarus::json::read(metadataFile);
+            auto uniqueKey = image.reference.getUniqueKey();
+
+            // Reference the pool image before the repository entry: if the metadata update fails,
+            // a leftover reference only delays the removal of the pool image
+            if (imagePool.isPoolImage(image.imageFile)) {
+                imagePool.addReference(image.imageFile, getPoolReferrer(uniqueKey));
+            }
 
             // remove previous entries with the same image reference (if any)
+            auto replacedImageFiles = std::vector<boost::filesystem::path>{};
             auto& images = metadata["images"];
             for(auto it = images.Begin(); it != images.End(); ) {
-                if ((*it)["uniqueKey"].GetString() == image.reference.getUniqueKey()) {
+                if ((*it)["uniqueKey"].GetString() == uniqueKey) {
+                    replacedImageFiles.emplace_back((*it)["imagePath"].GetString());
                     it = images.Erase(it);
                 } else {
                     ++it;
@@ -84,6 +104,17 @@ namespace image_manager {
                 metadata.GetAllocator());
 
             atomicallyUpdateRepositoryMetadataFile(metadata, &lock);
+            if (isCentralizedRepository) {
+                createUsageDirectory();
+            }
+
+            // the replaced entries may have used a different squashfs file (e.g. when moving
+            // from a repository file to a pool image or vice versa)
+            for (const auto& replacedImageFile : replacedImageFiles) {
+                if (replacedImageFile != image.imageFile) {
+                    releaseImageFile(replacedImageFile, uniqueKey);
+                }
+            }
         }
         catch (const std::exception &e) {
             auto message = boost::format("Failed to add image %s to repository metadata file %s")
@@ -140,8 +171,13 @@ namespace image_manager {
                 // If backing files are present, all image data is available: add the image to list to be visualized.
                 // Else, ensure all image data is cleaned up
                 if (hasImageBackingFiles(imageMetadata)) {
-                    auto image = convertImageMetadataToSarusImage(imageMetadata);
-                    images.push_back(image);
+                    try {
+                        images.push_back(convertImageMetadataToSarusImage(imageMetadata));
+                    }
+                    catch(const std::exception& e) {
+                        printLog(boost::format("Skipping invalid entry of repository metadata: %s") % e.what(),
+                                 libsarus::LogLevel::WARN, std::cerr);
+                    }
                 }
                 else {
                     removeImageBackingFiles(&imageMetadata);
@@ -255,12 +291,66 @@ namespace image_manager {
             getImageID(imageMetadata),
             imageMetadata["datasize"].GetString(),
             imageMetadata["created"].GetString(),
-            boost::filesystem::path{imageMetadata["imagePath"].GetString()},
-            boost::filesystem::path{imageMetadata["metadataPath"].GetString()}
+            getImageFile(imageMetadata),
+            boost::filesystem::path{imageMetadata["metadataPath"].GetString()},
+            getImageFormat(imageMetadata)
         };
         return image;
     }
 
+    /**
+     * The "imageFormat" property was introduced together with the EROFS images,
+     * the entries created before it always refer to squashfs images.
+     * The repository metadata is writable by the user, while the format is used by
+     * "sarus run" to mount the image as root: only the formats of Sarus are accepted.
+     */
+    std::string ImageStore::getImageFormat(const rapidjson::Value& imageMetadata) const {
+        auto itr = imageMetadata.FindMember("imageFormat");
+        if (itr == imageMetadata.MemberEnd()) {
+            return FilesystemImage::squashfsFormat;
+        }
+        auto format = std::string{itr->value.GetString()};
+        if (format != LazyImage::format) {
+            checkImageFormat(format);
+        }
+        return format;
+    }
+
+    boost::filesystem::path ImageStore::getImageFile(const rapidjson::Value& imageMetadata) const {
+        auto imageFile = boost::filesystem::path{imageMetadata["imagePath"].GetString()};
+        checkImageFile(imageFile);
+        return imageFile;
+    }
+
+    /**
+     * Only the formats of the images mounted by "sarus run" are accepted.
+     */
+    void ImageStore::checkImageFormat(const std::string& format) {
+        if (format != FilesystemImage::squashfsFormat && format != FilesystemImage::erofsFormat) {
+            auto message = boost::format("Invalid image format '%s'") % format;
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
+    /**
+     * Like the format, the image file is later mounted as root: it must be a file of the
+     * images directory of the repository or of the image pool, also after resolving symlinks.
+     */
+    void ImageStore::checkImageFile(const boost::filesystem::path& imageFile) const {
+        auto directory = boost::filesystem::canonical(imageFile).parent_path();
+        auto isInImagesDirectory = boost::filesystem::exists(imagesDirectory)
+                                   && directory == boost::filesystem::canonical(imagesDirectory);
+        auto isInImagePool = imagePool.isEnabled()
+                             && boost::filesystem::exists(imagePool.getDirectory())
+                             && directory == boost::filesystem::canonical(imagePool.getDirectory());
+        if (!isInImagesDirectory && !isInImagePool) {
+            auto message = boost::format("Invalid image file %s: the file is neither"
+                                         " in the images directory %s nor in the image pool")
+                                         % imageFile % imagesDirectory;
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
     /**
      * The "id" property was introduced with Sarus 1.5.0
      * This function provides compatibility with image metadata created by an earlier Sarus version
@@ -319,6 +409,11 @@ namespace image_manager {
             ret.AddMember(  "metadataPath",
                             rj::Value{image.metadataFile.c_str(), allocator},
                             allocator);
+            if (!image.format.empty()) {
+                ret.AddMember(  "imageFormat",
+                                rj::Value{image.format.c_str(), allocator},
+                                allocator);
+            }
             ret.AddMember(  "datasize",
                             rj::Value{image.datasize.c_str(), allocator},
                             allocator);
@@ -349,11 +444,31 @@ namespace image_manager {
     void ImageStore::removeImageBackingFiles(const rapidjson::Value* imageMetadata) const {
         auto imagePath = boost::filesystem::path{(*imageMetadata)["imagePath"].GetString()};
         auto metadataPath = boost::filesystem::path{(*imageMetadata)["metadataPath"].GetString()};
-        boost::filesystem::remove_all(imagePath);
+        auto uniqueKey = std::string{(*imageMetadata)["uniqueKey"].GetString()};
+        releaseImageFile(imagePath, uniqueKey);
         boost::filesystem::remove_all(metadataPath);
+        boost::filesystem::remove(imagesDirectory / (uniqueKey + ".lastused"));
+        boost::filesystem::remove(imagesDirectory / (uniqueKey + ".prefetch"));
         printLog("Removed image backing files", libsarus::LogLevel::DEBUG);
     }
 
+    /**
+     * Deletes the squashfs file of a repository entry. Squashfs files in the image pool
+     * are shared with other entries: only the reference of the entry is removed.
+     */
+    void ImageStore::releaseImageFile(const boost::filesystem::path& imageFile, const std::string& uniqueKey) const {
+        if (imagePool.isPoolImage(imageFile)) {
+            imagePool.removeReference(imageFile, getPoolReferrer(uniqueKey));
+        }
+        else {
+            boost::filesystem::remove_all(imageFile);
+        }
+    }
+
+    std::string ImageStore::getPoolReferrer(const std::string& uniqueKey) const {
+        return metadataFile.string() + "#" + uniqueKey;
+    }
+
     /**
      * Atomically update the repository's metadata file. Creates a temporary metadata file
      * and then atomically creates/replaces the actual metadata file by renaming the
@@ -384,7 +499,11 @@ namespace image_manager {
     }
 
     boost::filesystem::path ImageStore::getImageSquashfsFile(const common::ImageReference& reference) const {
-        auto relativePath = reference.getUniqueKey() + ".squashfs";
+        return getImageFile(reference, FilesystemImage::squashfsFormat);
+    }
+
+    boost::filesystem::path ImageStore::getImageFile(const common::ImageReference& reference, const std::string& format) const {
+        auto relativePath = reference.getUniqueKey() + FilesystemImage::getFileExtension(format);
         return imagesDirectory / relativePath;
     }
 
@@ -393,6 +512,150 @@ namespace image_manager {
         return imagesDirectory / relativePath;
     }
 
+    boost::filesystem::path ImageStore::getImageLastUsedFile(const common::ImageReference& reference) const {
+        auto relativePath = reference.getUniqueKey() + ".lastused";
+        return imagesDirectory / relativePath;
+    }
+
+    boost::filesystem::path ImageStore::getImagePrefetchProfileFile(const common::ImageReference& reference) const {
+        auto relativePath = reference.getUniqueKey() + ".prefetch";
+        return imagesDirectory / relativePath;
+    }
+
+    boost::filesystem::path ImageStore::getUserUsageFile(const common::ImageReference& reference, uid_t uid) const {
+        auto relativePath = reference.getUniqueKey() + ".lastused";
+        return usageDirectory / std::to_string(uid) / relativePath;
+    }
+
+    /**
+     * Records the time of use of the image in the modification time of an empty file,
+     * to avoid rewriting the repository metadata file at every container launch.
+     * Users who cannot write the images directory (e.g. the users of the centralized
+     * repository) record the use in their own directory of the "user-usage" directory.
+     * Failures are not errors.
+     */
+    void ImageStore::markImageAsUsed(const common::ImageReference& reference) const {
+        auto lastUsedFile = getImageLastUsedFile(reference);
+        if (utimensat(AT_FDCWD, lastUsedFile.c_str(), nullptr, 0) == 0) {
+            return;
+        }
+        if (errno == ENOENT) {
+            auto fd = open(lastUsedFile.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd != -1) {
+                close(fd);
+                return;
+            }
+        }
+        auto lastUsedErrno = errno;
+        if (markImageAsUsedByUser(reference)) {
+            return;
+        }
+        printLog(boost::format("Failed to record use of image %s in %s: %s") % reference % lastUsedFile % strerror(lastUsedErrno),
+                 libsarus::LogLevel::DEBUG);
+    }
+
+    /**
+     * The most recent use recorded by the owner of the repository or by other users.
+     * Images which were never used by "sarus run" count as used when they were last added.
+     */
+    std::time_t ImageStore::getImageLastUsedTime(const common::SarusImage& image) const {
+        boost::system::error_code ec;
+        auto lastUsed = boost::filesystem::last_write_time(getImageLastUsedFile(image.reference), ec);
+        if (ec) {
+            lastUsed = 0;
+        }
+        lastUsed = std::max(lastUsed, getImageLastUsedTimeByUsers(image.reference));
+        if (lastUsed != 0) {
+            return lastUsed;
+        }
+        lastUsed = boost::filesystem::last_write_time(image.metadataFile, ec);
+        return ec ? 0 : lastUsed;
+    }
+
+    /**
+     * Whether users other than the owner of the repository can record the use of images,
+     * i.e. the "user-usage" directory was created by the owner (at the first pull after
+     * its introduction) and was not tampered with.
+     */
+    bool ImageStore::isUsageOfOtherUsersRecorded() const {
+        struct stat sb;
+        if (lstat(usageDirectory.c_str(), &sb) != 0) {
+            return false;
+        }
+        auto repositoryOwner = std::get<0>(libsarus::filesystem::getOwner(metadataFile.parent_path()));
+        return S_ISDIR(sb.st_mode) && sb.st_uid == repositoryOwner && (sb.st_mode & S_ISVTX);
+    }
+
+    bool ImageStore::markImageAsUsedByUser(const common::ImageReference& reference) const {
+        if (!isUsageOfOtherUsersRecorded()) {
+            return false;
+        }
+
+        // the per-user directory is created by the user and has to be owned by the user
+        auto usageFile = getUserUsageFile(reference, geteuid());
+        auto userDirectory = usageFile.parent_path();
+        if (mkdir(userDirectory.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        struct stat sb;
+        if (lstat(userDirectory.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode) || sb.st_uid != geteuid()) {
+            errno = EPERM;
+            return false;
+        }
+
+        auto fd = open(usageFile.c_str(), O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            return false;
+        }
+        auto status = futimens(fd, nullptr);
+        close(fd);
+        return status == 0;
+    }
+
+    /**
+     * The user directories are writable by their users: they are only trusted to the extent
+     * of keeping images in the repository longer. Entries not owned by the user they are
+     * named after and symlinks are ignored.
+     */
+    std::time_t ImageStore::getImageLastUsedTimeByUsers(const common::ImageReference& reference) const {
+        auto lastUsed = std::time_t{0};
+        if (!isUsageOfOtherUsersRecorded()) {
+            return lastUsed;
+        }
+
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::directory_iterator{usageDirectory, ec};
+             !ec && it != boost::filesystem::directory_iterator{};
+             it.increment(ec)) {
+            struct stat sb;
+            if (lstat(it->path().c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode)
+                || it->path().filename().string() != std::to_string(sb.st_uid)) {
+                continue;
+            }
+            auto usageFile = getUserUsageFile(reference, sb.st_uid);
+            if (lstat(usageFile.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+                lastUsed = std::max(lastUsed, sb.st_mtime);
+            }
+        }
+        return lastUsed;
+    }
+
+    /**
+     * Created by the owner of the centralized repository. Like /tmp: every user can create
+     * a directory, but cannot remove those of other users.
+     */
+    void ImageStore::createUsageDirectory() const {
+        if (mkdir(usageDirectory.c_str(), 0755) != 0) {
+            if (errno != EEXIST) {
+                printLog(boost::format("Failed to create %s, the use of images by other users will not be recorded: %s")
+                            % usageDirectory % strerror(errno),
+                         libsarus::LogLevel::WARN);
+            }
+            return;
+        }
+        boost::filesystem::permissions(usageDirectory, boost::filesystem::perms(01777));
+    }
+
     void ImageStore::printLog(const boost::format& message, libsarus::LogLevel LogLevel,
                               std::ostream& out, std::ostream& err) const {
         printLog(message.str(), LogLevel, out, err);
@@ -15,6 +15,7 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <sys/types.h>
 
 #include <boost/filesystem.hpp>
 #include <rapidjson/document.h>
@@ -22,6 +23,7 @@
 #include "libsarus/Flock.hpp"
 #include "common/Config.hpp"
 #include "common/SarusImage.hpp"
+#include "image_manager/ImagePool.hpp"
 
 
 namespace sarus {
@@ -40,8 +42,18 @@ public:
     const boost::filesystem::path& getRepositoryMetadataFile() const { return metadataFile; }
     std::string getImageID(const rapidjson::Value& imageMetadata) const;
     std::string getRegistryDigest(const rapidjson::Value& imageMetadata) const;
+    std::string getImageFormat(const rapidjson::Value& imageMetadata) const;
     boost::filesystem::path getImageSquashfsFile(const common::ImageReference& reference) const;
+    boost::filesystem::path getImageFile(const common::ImageReference& reference, const std::string& format) const;
     boost::filesystem::path getImageMetadataFile(const common::ImageReference& reference) const;
+    boost::filesystem::path getImageLastUsedFile(const common::ImageReference& reference) const;
+    boost::filesystem::path getImagePrefetchProfileFile(const common::ImageReference& reference) const;
+    boost::filesystem::path getUserUsageFile(const common::ImageReference& reference, uid_t uid) const;
+    static void checkImageFormat(const std::string& format);
+    void checkImageFile(const boost::filesystem::path& imageFile) const;
+    void markImageAsUsed(const common::ImageReference& reference) const;
+    std::time_t getImageLastUsedTime(const common::SarusImage& image) const;
+    bool isUsageOfOtherUsersRecorded() const;
 
 private:
     rapidjson::Document initRepositoryMetadataFile() const;
@@ -49,8 +61,14 @@ private:
     void atomicallyUpdateRepositoryMetadataFile(const rapidjson::Value& metadata, libsarus::Flock* const lock) const;
     rapidjson::Value createImageJSON(const common::SarusImage&, rapidjson::MemoryPoolAllocator<>& allocator) const;
     sarus::common::SarusImage convertImageMetadataToSarusImage(const rapidjson::Value& imageMetadata) const;
+    boost::filesystem::path getImageFile(const rapidjson::Value& imageMetadata) const;
     bool hasImageBackingFiles(const rapidjson::Value& imageMetadata) const;
     void removeImageBackingFiles(const rapidjson::Value* imageMetadata) const;
+    void releaseImageFile(const boost::filesystem::path& imageFile, const std::string& uniqueKey) const;
+    std::string getPoolReferrer(const std::string& uniqueKey) const;
+    bool markImageAsUsedByUser(const common::ImageReference& reference) const;
+    std::time_t getImageLastUsedTimeByUsers(const common::ImageReference& reference) const;
+    void createUsageDirectory() const;
     void removeRepositoryMetadataEntry(const rapidjson::Value* imageMetadata, rapidjson::Document& repositoryMetadata, libsarus::Flock* const lock) const;
     void printLog(const boost::format& message, libsarus::LogLevel LogLevel,
                   std::ostream& out = std::cout, std::ostream& err = std::cerr) const;
@@ -61,6 +79,9 @@ private:
     const std::string sysname = "ImageStore"; // system name for logger
     boost::filesystem::path imagesDirectory;
     boost::filesystem::path metadataFile;
+    boost::filesystem::path usageDirectory; // uses recorded by users other than the owner of the repository
+    bool isCentralizedRepository;
+    ImagePool imagePool;
     milliseconds lockWarning;
     milliseconds lockTimeout;
 };
@@ -0,0 +1,1073 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "LayerExtractor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+
+#include <zlib.h>
+#ifdef SARUS_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <rapidjson/pointer.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+const size_t tarBlockSize = 512;
+const size_t ioBufferSize = 1 << 20;
+const int maxSymlinkTraversals = 255;
+
+void printLog(const boost::format& message, libsarus::LogLevel level) {
+    libsarus::Logger::getInstance().log(message, "LayerExtractor", level);
+}
+
+void writeAll(int fd, const char* data, size_t size, const boost::filesystem::path& file) {
+    while(size > 0) {
+        auto written = ::write(fd, data, size);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            auto message = boost::format("Failed to write to %s: %s") % file % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+class FileDescriptor {
+public:
+    FileDescriptor(int fd) : fd{fd} {}
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    ~FileDescriptor() {
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+    int get() const { return fd; }
+
+private:
+    int fd;
+};
+
+/**
+ * Sequential reader of an uncompressed tar archive
+ */
+class TarReader {
+public:
+    struct Entry {
+        std::string name;
+        std::string linkname;
+        char type;
+        mode_t mode;
+        size_t size;
+        time_t mtime;
+        dev_t device;
+        std::vector<std::pair<std::string, std::string>> xattrs;
+    };
+
+    TarReader(const boost::filesystem::path& file)
+        : file{file}
+        , fd{open(file.c_str(), O_RDONLY | O_CLOEXEC)}
+        , buffer(ioBufferSize)
+    {
+        if(fd.get() < 0) {
+            auto message = boost::format("Failed to open layer %s: %s") % file % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
+    /**
+     * Reads the next entry header, consuming the metadata-only entries
+     * (PAX extended headers and GNU long names) that precede it.
+     * Returns false at the end of the archive.
+     */
+    bool next(Entry& entry) {
+        skip(pendingBytes);
+        pendingBytes = 0;
+
+        auto paxRecords = std::unordered_map<std::string, std::string>{};
+        auto paxXattrs = std::vector<std::pair<std::string, std::string>>{};
+        auto longName = std::string{};
+        auto longLinkname = std::string{};
+
+        while(true) {
+            char header[tarBlockSize];
+            if(!readExactly(header, tarBlockSize, true)) {
+                return false;
+            }
+            if(std::all_of(header, header + tarBlockSize, [](char c) { return c == 0; })) {
+                return false;
+            }
+            validateChecksum(header);
+
+            auto type = header[156];
+            auto size = parseNumber(header + 124, 12);
+
+            if(type == 'x' || type == 'g') {
+                auto data = readData(size);
+                if(type == 'x') {
+                    parsePaxRecords(data, paxRecords, paxXattrs);
+                }
+                else {
+                    printLog(boost::format("Ignoring PAX global header in %s") % file, libsarus::LogLevel::DEBUG);
+                }
+                continue;
+            }
+            else if(type == 'L') {
+                longName = readData(size).c_str();
+                continue;
+            }
+            else if(type == 'K') {
+                longLinkname = readData(size).c_str();
+                continue;
+            }
+
+            entry.type = type;
+            entry.name = parseString(header, 100);
+            auto magic = std::string(header + 257, 5);
+            if(magic == "ustar") {
+                auto prefix = parseString(header + 345, 155);
+                if(!prefix.empty()) {
+                    entry.name = prefix + "/" + entry.name;
+                }
+            }
+            entry.linkname = parseString(header + 157, 100);
+            entry.mode = static_cast<mode_t>(parseNumber(header + 100, 8)) & 07777;
+            entry.size = size;
+            entry.mtime = static_cast<time_t>(parseNumber(header + 136, 12));
+            entry.device = makedev(parseNumber(header + 329, 8), parseNumber(header + 337, 8));
+            entry.xattrs = std::move(paxXattrs);
+
+            if(!longName.empty()) {
+                entry.name = longName;
+            }
+            if(!longLinkname.empty()) {
+                entry.linkname = longLinkname;
+            }
+            if(paxRecords.count("path")) {
+                entry.name = paxRecords["path"];
+            }
+            if(paxRecords.count("linkpath")) {
+                entry.linkname = paxRecords["linkpath"];
+            }
+            if(paxRecords.count("size")) {
+                entry.size = std::stoull(paxRecords["size"]);
+            }
+            if(paxRecords.count("mtime")) {
+                entry.mtime = static_cast<time_t>(std::stoll(paxRecords["mtime"]));
+            }
+
+            // hard links, symlinks, directories and devices never carry data
+            if(type == '1' || type == '2' || type == '3' || type == '4' || type == '5' || type == '6') {
+                entry.size = 0;
+            }
+            pendingBytes = paddedSize(entry.size);
+            return true;
+        }
+    }
+
+    /**
+     * Copies the data of the current entry into the given file descriptor
+     */
+    void copyData(size_t size, int outFd, const boost::filesystem::path& outFile) {
+        auto remaining = size;
+        while(remaining > 0) {
+            fill();
+            auto chunk = std::min(remaining, bufferEnd - bufferBegin);
+            writeAll(outFd, buffer.data() + bufferBegin, chunk, outFile);
+            bufferBegin += chunk;
+            remaining -= chunk;
+        }
+        skip(paddedSize(size) - size);
+        pendingBytes = 0;
+    }
+
+private:
+    static size_t paddedSize(size_t size) {
+        return (size + tarBlockSize - 1) / tarBlockSize * tarBlockSize;
+    }
+
+    static std::string parseString(const char* field, size_t length) {
+        return std::string(field, strnlen(field, length));
+    }
+
+    uint64_t parseNumber(const char* field, size_t length) const {
+        // GNU base-256 encoding, used for values that don't fit the octal field
+        if(static_cast<unsigned char>(field[0]) & 0x80) {
+            auto value = uint64_t{static_cast<unsigned char>(field[0]) & 0x7fu};
+            for(size_t i=1; i<length; ++i) {
+                value = (value << 8) | static_cast<unsigned char>(field[i]);
+            }
+            return value;
+        }
+
+        auto value = uint64_t{0};
+        for(size_t i=0; i<length; ++i) {
+            auto c = field[i];
+            if(c == ' ' && value == 0) {
+                continue;
+            }
+            if(c < '0' || c > '7') {
+                break;
+            }
+            value = value * 8 + (c - '0');
+        }
+        return value;
+    }
+
+    void validateChecksum(const char* header) const {
+        auto expected = parseNumber(header + 148, 8);
+        auto unsignedSum = uint64_t{0};
+        auto signedSum = int64_t{0};
+        for(size_t i=0; i<tarBlockSize; ++i) {
+            auto c = (i >= 148 && i < 156) ? ' ' : header[i];
+            unsignedSum += static_cast<unsigned char>(c);
+            signedSum += static_cast<signed char>(c);
+        }
+        if(expected != unsignedSum && static_cast<int64_t>(expected) != signedSum) {
+            auto message = boost::format("Failed to read layer %s: invalid tar header checksum") % file;
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
+    void parsePaxRecords(const std::string& data,
+                         std::unordered_map<std::string, std::string>& records,
+                         std::vector<std::pair<std::string, std::string>>& xattrs) const {
+        // each record has the format "<length> <key>=<value>\n"
+        size_t position = 0;
+        while(position < data.size()) {
+            auto space = data.find(' ', position);
+            if(space == std::string::npos) {
+                break;
+            }
+            auto length = std::stoull(data.substr(position, space - position));
+            if(length == 0 || position + length > data.size()) {
+                auto message = boost::format("Failed to read layer %s: malformed PAX header") % file;
+                SARUS_THROW_ERROR(message.str());
+            }
+            auto record = data.substr(space + 1, position + length - space - 2);
+            auto equal = record.find('=');
+            if(equal != std::string::npos) {
+                auto key = record.substr(0, equal);
+                auto value = record.substr(equal + 1);
+                const auto xattrPrefix = std::string{"SCHILY.xattr."};
+                if(key.compare(0, xattrPrefix.size(), xattrPrefix) == 0) {
+                    xattrs.emplace_back(key.substr(xattrPrefix.size()), value);
+                }
+                else {
+                    records[key] = value;
+                }
+            }
+            position += length;
+        }
+    }
+
+    std::string readData(size_t size) {
+        auto data = std::string(size, '\0');
+        if(size > 0) {
+            readExactly(&data[0], size, false);
+        }
+        skip(paddedSize(size) - size);
+        return data;
+    }
+
+    void fill() {
+        if(bufferBegin < bufferEnd) {
+            return;
+        }
+        ssize_t bytes;
+        do {
+            bytes = ::read(fd.get(), buffer.data(), buffer.size());
+        } while(bytes < 0 && errno == EINTR);
+        if(bytes < 0) {
+            auto message = boost::format("Failed to read layer %s: %s") % file % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(bytes == 0) {
+            auto message = boost::format("Failed to read layer %s: unexpected end of archive") % file;
+            SARUS_THROW_ERROR(message.str());
+        }
+        bufferBegin = 0;
+        bufferEnd = static_cast<size_t>(bytes);
+    }
+
+    bool readExactly(char* destination, size_t size, bool allowEndOfFile) {
+        auto remaining = size;
+        while(remaining > 0) {
+            if(bufferBegin == bufferEnd && allowEndOfFile && remaining == size) {
+                // a missing end-of-archive marker is tolerated, as in GNU tar
+                ssize_t bytes;
+                do {
+                    bytes = ::read(fd.get(), buffer.data(), buffer.size());
+                } while(bytes < 0 && errno == EINTR);
+                if(bytes == 0) {
+                    return false;
+                }
+                if(bytes < 0) {
+                    auto message = boost::format("Failed to read layer %s: %s") % file % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                bufferBegin = 0;
+                bufferEnd = static_cast<size_t>(bytes);
+            }
+            fill();
+            auto chunk = std::min(remaining, bufferEnd - bufferBegin);
+            memcpy(destination, buffer.data() + bufferBegin, chunk);
+            bufferBegin += chunk;
+            destination += chunk;
+            remaining -= chunk;
+        }
+        return true;
+    }
+
+    void skip(size_t size) {
+        auto remaining = size;
+        while(remaining > 0) {
+            fill();
+            auto chunk = std::min(remaining, bufferEnd - bufferBegin);
+            bufferBegin += chunk;
+            remaining -= chunk;
+        }
+    }
+
+private:
+    boost::filesystem::path file;
+    FileDescriptor fd;
+    std::vector<char> buffer;
+    size_t bufferBegin = 0;
+    size_t bufferEnd = 0;
+    size_t pendingBytes = 0;
+};
+
+/**
+ * Applies the tar layers to the rootfs, one after the other.
+ * All the paths handled internally are relative to the rootfs.
+ */
+class LayerApplier {
+public:
+    LayerApplier(const boost::filesystem::path& rootfs)
+        : rootfs{rootfs}
+    {}
+
+    void apply(const boost::filesystem::path& tarFile) {
+        touchedPaths.clear();
+        TarReader reader{tarFile};
+        auto entry = TarReader::Entry{};
+        while(reader.next(entry)) {
+            applyEntry(reader, entry);
+        }
+    }
+
+    /**
+     * Restores the permissions and the modification times of the directories.
+     * This is deferred to the end of the unpacking, so that directories can
+     * be populated regardless of the permissions stored in the layers.
+     */
+    void finalize() {
+        auto directories = std::vector<std::pair<std::string, DirectoryAttributes>>(deferredDirectories.cbegin(),
+                                                                                      deferredDirectories.cend());
+        // children first, so that setting the mtime of a child doesn't alter the mtime of its parent
+        std::sort(directories.begin(), directories.end(),
+            [](const std::pair<std::string, DirectoryAttributes>& lhs, const std::pair<std::string, DirectoryAttributes>& rhs) {
+                return lhs.first > rhs.first;
+            });
+        for(const auto& directory : directories) {
+            auto path = rootfs / directory.first;
+            struct stat st;
+            if(lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
+            if(chmod(path.c_str(), directory.second.mode) != 0) {
+                auto message = boost::format("Failed to set permissions of %s: %s") % path % strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+            if(directory.second.hasMtime) {
+                setMtime(path, directory.second.mtime);
+            }
+        }
+    }
+
+private:
+    struct DirectoryAttributes {
+        mode_t mode;
+        time_t mtime;
+        bool hasMtime;
+    };
+
+    static std::vector<std::string> splitPath(const std::string& path) {
+        // lexical normalization: ".." can never climb above the root of the layer
+        auto components = std::vector<std::string>{};
+        size_t begin = 0;
+        while(begin <= path.size()) {
+            auto end = path.find('/', begin);
+            if(end == std::string::npos) {
+                end = path.size();
+            }
+            auto component = path.substr(begin, end - begin);
+            if(component == "..") {
+                if(!components.empty()) {
+                    components.pop_back();
+                }
+            }
+            else if(!component.empty() && component != ".") {
+                components.push_back(component);
+            }
+            begin = end + 1;
+        }
+        return components;
+    }
+
+    static std::string joinPath(const std::vector<std::string>& components, size_t count) {
+        auto path = std::string{};
+        for(size_t i=0; i<count; ++i) {
+            if(i > 0) {
+                path += "/";
+            }
+            path += components[i];
+        }
+        return path;
+    }
+
+    static std::string joinPath(const std::string& parent, const std::string& name) {
+        return parent.empty() ? name : parent + "/" + name;
+    }
+
+    /**
+     * Resolves a directory path within the rootfs, following the symlinks found
+     * along the way as if the rootfs was the root of the filesystem.
+     * Missing directories are created, unless specified otherwise.
+     */
+    std::string resolveDirectory(const std::vector<std::string>& components, bool createMissing=true) {
+        auto key = joinPath(components, components.size());
+        auto it = resolvedDirectories.find(key);
+        if(it != resolvedDirectories.cend()) {
+            return it->second;
+        }
+
+        auto traversals = 0;
+        auto isComplete = true;
+        auto pending = std::vector<std::string>(components.rbegin(), components.rend());
+        auto current = std::vector<std::string>{};
+
+        while(!pending.empty()) {
+            auto component = pending.back();
+            pending.pop_back();
+
+            if(component == "..") {
+                if(!current.empty()) {
+                    current.pop_back();
+                }
+                continue;
+            }
+            if(component.empty() || component == ".") {
+                continue;
+            }
+
+            current.push_back(component);
+            auto path = rootfs / joinPath(current, current.size());
+
+            struct stat st;
+            if(lstat(path.c_str(), &st) != 0) {
+                if(errno != ENOENT) {
+                    auto message = boost::format("Failed to stat %s: %s") % path % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                if(!createMissing) {
+                    isComplete = false;
+                    current.insert(current.end(), pending.rbegin(), pending.rend());
+                    break;
+                }
+                makeDirectory(path);
+                deferredDirectories[joinPath(current, current.size())] = DirectoryAttributes{0755, 0, false};
+            }
+            else if(S_ISLNK(st.st_mode)) {
+                if(++traversals > maxSymlinkTraversals) {
+                    auto message = boost::format("Failed to resolve %s within rootfs: too many levels of symbolic links") % key;
+                    SARUS_THROW_ERROR(message.str());
+                }
+                current.pop_back();
+                auto target = readSymlink(path);
+                if(!target.empty() && target[0] == '/') {
+                    current.clear();
+                }
+                auto targetComponents = splitPathKeepingParentReferences(target);
+                pending.insert(pending.end(), targetComponents.rbegin(), targetComponents.rend());
+            }
+            else if(!S_ISDIR(st.st_mode)) {
+                auto message = boost::format("Failed to resolve %s within rootfs: %s is not a directory") % key % path;
+                SARUS_THROW_ERROR(message.str());
+            }
+        }
+
+        auto resolved = joinPath(current, current.size());
+        if(isComplete) {
+            resolvedDirectories[key] = resolved;
+        }
+        return resolved;
+    }
+
+    static std::vector<std::string> splitPathKeepingParentReferences(const std::string& path) {
+        auto components = std::vector<std::string>{};
+        size_t begin = 0;
+        while(begin <= path.size()) {
+            auto end = path.find('/', begin);
+            if(end == std::string::npos) {
+                end = path.size();
+            }
+            auto component = path.substr(begin, end - begin);
+            if(!component.empty() && component != ".") {
+                components.push_back(component);
+            }
+            begin = end + 1;
+        }
+        return components;
+    }
+
+    static std::string readSymlink(const boost::filesystem::path& path) {
+        char target[PATH_MAX];
+        auto length = readlink(path.c_str(), target, sizeof(target));
+        if(length < 0) {
+            auto message = boost::format("Failed to read symlink %s: %s") % path % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        return std::string(target, length);
+    }
+
+    static void makeDirectory(const boost::filesystem::path& path) {
+        // the actual permissions are set by finalize()
+        if(mkdir(path.c_str(), 0700) != 0) {
+            auto message = boost::format("Failed to create directory %s: %s") % path % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
+    static void setMtime(const boost::filesystem::path& path, time_t mtime) {
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = mtime;
+        times[1].tv_nsec = 0;
+        if(utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW) != 0) {
+            auto message = boost::format("Failed to set modification time of %s: %s") % path % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
+    void removePath(const std::string& relativePath) {
+        auto path = rootfs / relativePath;
+        makeTreeWritable(path);
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(path, ec);
+        if(ec) {
+            auto message = boost::format("Failed to remove %s: %s") % path % ec.message();
+            SARUS_THROW_ERROR(message.str());
+        }
+        // symlinks resolved so far might point into the removed tree
+        resolvedDirectories.clear();
+    }
+
+    /**
+     * Directories restored by finalize() of a previous unpacking are not involved
+     * here, but directories created with restrictive permissions by a layer
+     * might need to be emptied by a subsequent layer.
+     */
+    static void makeTreeWritable(const boost::filesystem::path& path) {
+        struct stat st;
+        if(lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            return;
+        }
+        if((st.st_mode & 0700) != 0700) {
+            chmod(path.c_str(), (st.st_mode & 07777) | 0700);
+        }
+        for(auto it = boost::filesystem::directory_iterator{path}; it != boost::filesystem::directory_iterator{}; ++it) {
+            makeTreeWritable(it->path());
+        }
+    }
+
+    /**
+     * Records that a path (and thus all its parent directories) belongs to the
+     * layer being applied, so that opaque whiteouts don't remove it
+     */
+    void markAsTouched(const std::string& relativePath) {
+        auto path = relativePath;
+        while(!path.empty() && touchedPaths.insert(path).second) {
+            auto separator = path.rfind('/');
+            path = separator == std::string::npos ? std::string{} : path.substr(0, separator);
+        }
+    }
+
+    void applyOpaqueWhiteout(const std::string& directory) {
+        auto path = rootfs / directory;
+        struct stat st;
+        if(lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            return;
+        }
+        auto children = std::vector<std::string>{};
+        for(auto it = boost::filesystem::directory_iterator{path}; it != boost::filesystem::directory_iterator{}; ++it) {
+            children.push_back(it->path().filename().string());
+        }
+        for(const auto& child : children) {
+            auto childPath = joinPath(directory, child);
+            if(touchedPaths.count(childPath) == 0) {
+                removePath(childPath);
+            }
+            else {
+                // keep what this layer added, but still hide the lower layers' contents
+                applyOpaqueWhiteout(childPath);
+            }
+        }
+    }
+
+    void applyEntry(TarReader& reader, const TarReader::Entry& entry) {
+        auto components = splitPath(entry.name);
+        if(components.empty()) {
+            // the root of the layer
+            if(entry.type == '5') {
+                deferredDirectories[""] = DirectoryAttributes{entry.mode, entry.mtime, true};
+            }
+            return;
+        }
+
+        auto name = components.back();
+        components.pop_back();
+
+        const auto whiteoutPrefix = std::string{".wh."};
+        auto isWhiteout = name.compare(0, whiteoutPrefix.size(), whiteoutPrefix) == 0;
+        auto parent = resolveDirectory(components, !isWhiteout);
+
+        if(isWhiteout) {
+            if(name == ".wh..wh..opq") {
+                applyOpaqueWhiteout(parent);
+            }
+            else if(name.compare(0, 2*whiteoutPrefix.size(), ".wh..wh.") == 0) {
+                // other AUFS metadata (e.g. ".wh..wh.plnk") is meaningless in the rootfs
+                printLog(boost::format("Ignoring AUFS metadata entry %s") % entry.name, libsarus::LogLevel::DEBUG);
+            }
+            else {
+                auto target = joinPath(parent, name.substr(whiteoutPrefix.size()));
+                struct stat st;
+                if(lstat((rootfs / target).c_str(), &st) == 0) {
+                    removePath(target);
+                }
+            }
+            return;
+        }
+
+        auto relativePath = joinPath(parent, name);
+        auto path = rootfs / relativePath;
+
+        struct stat st;
+        auto exists = lstat(path.c_str(), &st) == 0;
+        if(exists && !(entry.type == '5' && S_ISDIR(st.st_mode))) {
+            removePath(relativePath);
+        }
+
+        switch(entry.type) {
+            case '0':
+            case '\0':
+            case '7': {
+                FileDescriptor fd{open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)};
+                if(fd.get() < 0) {
+                    auto message = boost::format("Failed to create file %s: %s") % path % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                reader.copyData(entry.size, fd.get(), path);
+                if(fchmod(fd.get(), entry.mode) != 0) {
+                    auto message = boost::format("Failed to set permissions of %s: %s") % path % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                break;
+            }
+            case '1': {
+                auto linkComponents = splitPath(entry.linkname);
+                if(linkComponents.empty()) {
+                    auto message = boost::format("Failed to create hard link %s: invalid target '%s'") % path % entry.linkname;
+                    SARUS_THROW_ERROR(message.str());
+                }
+                auto linkName = linkComponents.back();
+                linkComponents.pop_back();
+                auto linkTarget = rootfs / joinPath(resolveDirectory(linkComponents), linkName);
+                if(link(linkTarget.c_str(), path.c_str()) != 0) {
+                    auto message = boost::format("Failed to create hard link %s to %s: %s")
+                        % path % linkTarget % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                break;
+            }
+            case '2': {
+                if(symlink(entry.linkname.c_str(), path.c_str()) != 0) {
+                    auto message = boost::format("Failed to create symlink %s: %s") % path % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                resolvedDirectories.clear();
+                break;
+            }
+            case '3':
+            case '4': {
+                auto type = entry.type == '3' ? S_IFCHR : S_IFBLK;
+                if(mknod(path.c_str(), type | entry.mode, entry.device) != 0) {
+                    if(errno != EPERM) {
+                        auto message = boost::format("Failed to create device file %s: %s") % path % strerror(errno);
+                        SARUS_THROW_ERROR(message.str());
+                    }
+                    // unprivileged users cannot create device files: skip them as umoci does in rootless mode
+                    printLog(boost::format("Skipping device file %s (insufficient privileges)") % entry.name,
+                               libsarus::LogLevel::DEBUG);
+                    return;
+                }
+                break;
+            }
+            case '5': {
+                if(!exists || !S_ISDIR(st.st_mode)) {
+                    makeDirectory(path);
+                }
+                deferredDirectories[relativePath] = DirectoryAttributes{entry.mode, entry.mtime, true};
+                break;
+            }
+            case '6': {
+                if(mkfifo(path.c_str(), entry.mode) != 0) {
+                    auto message = boost::format("Failed to create FIFO %s: %s") % path % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                if(chmod(path.c_str(), entry.mode) != 0) {
+                    auto message = boost::format("Failed to set permissions of %s: %s") % path % strerror(errno);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                break;
+            }
+            default: {
+                printLog(boost::format("Skipping entry %s of unsupported type '%c'") % entry.name % entry.type,
+                           libsarus::LogLevel::WARN);
+                return;
+            }
+        }
+
+        markAsTouched(relativePath);
+
+        for(const auto& xattr : entry.xattrs) {
+            if(lsetxattr(path.c_str(), xattr.first.c_str(), xattr.second.data(), xattr.second.size(), 0) != 0) {
+                // e.g. "security.*" and "trusted.*" attributes require privileges
+                printLog(boost::format("Failed to set extended attribute %s of %s: %s")
+                           % xattr.first % path % strerror(errno), libsarus::LogLevel::DEBUG);
+            }
+        }
+
+        if(entry.type != '1' && entry.type != '5') {
+            setMtime(path, entry.mtime);
+        }
+    }
+
+private:
+    boost::filesystem::path rootfs;
+    std::unordered_map<std::string, std::string> resolvedDirectories;
+    std::unordered_map<std::string, DirectoryAttributes> deferredDirectories;
+    std::unordered_set<std::string> touchedPaths;
+};
+
+/**
+ * Layers decompressed by the worker threads, waiting to be applied in order
+ */
+class DecompressionQueue {
+public:
+    DecompressionQueue(size_t numberOfLayers)
+        : states(numberOfLayers, State::pending)
+        , errors(numberOfLayers)
+    {}
+
+    bool takeNext(size_t& index) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if(isAborted || nextIndex >= states.size()) {
+            return false;
+        }
+        index = nextIndex++;
+        return true;
+    }
+
+    void markDone(size_t index, std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock{mutex};
+        states[index] = error ? State::failed : State::done;
+        errors[index] = error;
+        condition.notify_all();
+    }
+
+    void waitFor(size_t index) {
+        std::unique_lock<std::mutex> lock{mutex};
+        condition.wait(lock, [this, index]() { return states[index] != State::pending; });
+        if(states[index] == State::failed) {
+            std::rethrow_exception(errors[index]);
+        }
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock{mutex};
+        isAborted = true;
+    }
+
+private:
+    enum class State { pending, done, failed };
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<State> states;
+    std::vector<std::exception_ptr> errors;
+    size_t nextIndex = 0;
+    bool isAborted = false;
+};
+
+} // namespace
+
+LayerExtractor::LayerExtractor(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+void LayerExtractor::unpack(const boost::filesystem::path& imagePath, const boost::filesystem::path& unpackPath) const {
+    printLog(boost::format("Unpacking OCI image from %s into %s") % imagePath % unpackPath, libsarus::LogLevel::DEBUG);
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto layers = readLayers(imagePath);
+    auto numberOfThreads = getNumberOfThreads(layers.size());
+    printLog(boost::format("Decompressing %d layers with %d threads") % layers.size() % numberOfThreads,
+             libsarus::LogLevel::INFO);
+
+    auto layersDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(
+        config->directories.temp / "layers-directory")};
+    libsarus::filesystem::createFoldersIfNecessary(layersDir.getPath());
+    auto getTarFile = [&layersDir](size_t index) {
+        return layersDir.getPath() / ("layer-" + std::to_string(index) + ".tar");
+    };
+
+    DecompressionQueue queue{layers.size()};
+    auto worker = [&queue, &layers, &getTarFile]() {
+        size_t index;
+        while(queue.takeNext(index)) {
+            try {
+                decompressLayer(layers[index].blob, getTarFile(index));
+                queue.markDone(index, nullptr);
+            }
+            catch(...) {
+                queue.markDone(index, std::current_exception());
+            }
+        }
+    };
+
+    auto threads = std::vector<std::thread>{};
+    auto joinThreads = [&queue, &threads]() {
+        queue.abort();
+        for(auto& thread : threads) {
+            if(thread.joinable()) {
+                thread.join();
+            }
+        }
+    };
+
+    try {
+        for(size_t i=0; i<numberOfThreads; ++i) {
+            threads.emplace_back(worker);
+        }
+
+        auto applier = LayerApplier{unpackPath};
+        for(size_t i=0; i<layers.size(); ++i) {
+            queue.waitFor(i);
+            printLog(boost::format("Applying layer %s") % layers[i].digest, libsarus::LogLevel::DEBUG);
+            applier.apply(getTarFile(i));
+            boost::filesystem::remove(getTarFile(i));
+        }
+        applier.finalize();
+    }
+    catch(const std::exception& e) {
+        joinThreads();
+        auto message = boost::format("Failed to unpack OCI image %s") % imagePath;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+    joinThreads();
+
+    auto end = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / double(1000);
+    printLog(boost::format("Elapsed time on unpacking    : %s [sec]") % elapsed, libsarus::LogLevel::INFO);
+}
+
+size_t LayerExtractor::getNumberOfThreads(size_t numberOfLayers) const {
+    auto numberOfThreads = size_t{std::thread::hardware_concurrency()};
+    if (const rj::Value* configThreads = rj::Pointer("/unpackThreads").Get(config->json)) {
+        numberOfThreads = configThreads->GetUint();
+    }
+    numberOfThreads = std::min(numberOfThreads, numberOfLayers);
+    return std::max(numberOfThreads, size_t{1});
+}
+
+std::vector<LayerExtractor::Layer> LayerExtractor::readLayers(const boost::filesystem::path& imagePath) {
+    auto imageIndex = libsarus::json::read(imagePath / "index.json");
+    std::string manifestDigest = imageIndex["manifests"][0]["digest"].GetString();
+    auto manifestHash = manifestDigest.substr(manifestDigest.find(":")+1);
+    auto imageManifest = libsarus::json::read(imagePath / "blobs/sha256" / manifestHash);
+
+    auto layers = std::vector<Layer>{};
+    if (!imageManifest.HasMember("layers")) {
+        return layers;
+    }
+    for (const auto& layer : imageManifest["layers"].GetArray()) {
+        std::string digest = layer["digest"].GetString();
+        auto separator = digest.find(":");
+        if (separator == std::string::npos) {
+            auto message = boost::format("Invalid layer digest '%s' in manifest of OCI image %s") % digest % imagePath;
+            SARUS_THROW_ERROR(message.str());
+        }
+        auto algorithm = digest.substr(0, separator);
+        auto hash = digest.substr(separator+1);
+        layers.push_back(Layer{imagePath / "blobs" / algorithm / hash, digest});
+    }
+    return layers;
+}
+
+/**
+ * Applies uncompressed tar layers to the rootfs, in order. The tar file of a layer is
+ * requested right before it is applied (e.g. to generate it) and removed afterwards.
+ */
+void LayerExtractor::applyLayers(const boost::filesystem::path& rootfs,
+                                 size_t numberOfLayers,
+                                 const std::function<boost::filesystem::path(size_t)>& getTarFile) {
+    auto applier = LayerApplier{rootfs};
+    for(size_t i=0; i<numberOfLayers; ++i) {
+        auto tarFile = getTarFile(i);
+        applier.apply(tarFile);
+        boost::filesystem::remove(tarFile);
+    }
+    applier.finalize();
+}
+
+/**
+ * Decompresses a layer blob into an uncompressed tar file.
+ * The compression format is detected from the magic number of the blob.
+ * Note that a single gzip stream cannot be inflated in parallel,
+ * thus the parallelism is achieved across layers.
+ */
+void LayerExtractor::decompressLayer(const boost::filesystem::path& blob, const boost::filesystem::path& destination) {
+    auto magic = std::array<unsigned char, 4>{{0, 0, 0, 0}};
+    {
+        FileDescriptor fd{open(blob.c_str(), O_RDONLY | O_CLOEXEC)};
+        if(fd.get() < 0) {
+            auto message = boost::format("Failed to open layer blob %s: %s") % blob % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(::read(fd.get(), magic.data(), magic.size()) < 0) {
+            auto message = boost::format("Failed to read layer blob %s: %s") % blob % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+
+    FileDescriptor out{open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)};
+    if(out.get() < 0) {
+        auto message = boost::format("Failed to create %s: %s") % destination % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto buffer = std::vector<char>(ioBufferSize);
+
+    auto isZstd = magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd;
+    if(isZstd) {
+#ifdef SARUS_ENABLE_ZSTD
+        FileDescriptor in{open(blob.c_str(), O_RDONLY | O_CLOEXEC)};
+        auto stream = std::unique_ptr<ZSTD_DStream, size_t(*)(ZSTD_DStream*)>{ZSTD_createDStream(), ZSTD_freeDStream};
+        ZSTD_initDStream(stream.get());
+        auto inBuffer = std::vector<char>(ioBufferSize);
+        auto ret = size_t{1}; // zero only when a frame has been completely decoded and flushed
+        ssize_t bytes;
+        while((bytes = ::read(in.get(), inBuffer.data(), inBuffer.size())) > 0) {
+            auto input = ZSTD_inBuffer{inBuffer.data(), static_cast<size_t>(bytes), 0};
+            // when the output buffer is filled, the decoder may hold more data to flush
+            // even if the input has been consumed
+            auto isOutputFull = false;
+            while(input.pos < input.size || isOutputFull) {
+                auto output = ZSTD_outBuffer{buffer.data(), buffer.size(), 0};
+                ret = ZSTD_decompressStream(stream.get(), &output, &input);
+                if(ZSTD_isError(ret)) {
+                    auto message = boost::format("Failed to decompress layer blob %s: %s") % blob % ZSTD_getErrorName(ret);
+                    SARUS_THROW_ERROR(message.str());
+                }
+                writeAll(out.get(), buffer.data(), output.pos, destination);
+                isOutputFull = output.pos == output.size;
+            }
+        }
+        if(bytes < 0) {
+            auto message = boost::format("Failed to read layer blob %s: %s") % blob % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(ret != 0) {
+            auto message = boost::format("Failed to decompress layer blob %s: the zstd frame is truncated") % blob;
+            SARUS_THROW_ERROR(message.str());
+        }
+        return;
+#else
+        auto message = boost::format("Failed to decompress layer blob %s: this Sarus installation was built"
+                                     " without support for zstd-compressed layers."
+                                     " Please contact your system administrator.") % blob;
+        SARUS_THROW_ERROR(message.str());
+#endif
+    }
+
+    // zlib transparently handles both gzip-compressed (also multi-member) and uncompressed blobs
+    auto in = std::unique_ptr<gzFile_s, int(*)(gzFile)>{gzopen(blob.c_str(), "rb"), gzclose};
+    if(!in) {
+        auto message = boost::format("Failed to open layer blob %s: %s") % blob % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    gzbuffer(in.get(), ioBufferSize);
+    int bytes;
+    while((bytes = gzread(in.get(), buffer.data(), buffer.size())) > 0) {
+        writeAll(out.get(), buffer.data(), bytes, destination);
+    }
+    if(bytes < 0) {
+        int errorNumber;
+        auto message = boost::format("Failed to decompress layer blob %s: %s") % blob % gzerror(in.get(), &errorNumber);
+        SARUS_THROW_ERROR(message.str());
+    }
+}
+
+void LayerExtractor::printLog(const boost::format &message, libsarus::LogLevel level,
+                              std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void LayerExtractor::printLog(const std::string& message, libsarus::LogLevel level,
+                              std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}} // namespace
@@ -0,0 +1,69 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_LayerExtractor_hpp
+#define sarus_image_manger_LayerExtractor_hpp
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "common/Config.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Native replacement for "umoci raw unpack --rootless".
+ *
+ * The layers of the OCI image are decompressed in parallel (one layer per worker
+ * thread) into temporary tar files, which are then applied to the rootfs strictly
+ * in manifest order as soon as they become available. Whiteouts follow the OCI
+ * image-spec semantics and, as in umoci's rootless mode, the ownership recorded
+ * in the layers is not restored: all the files are owned by the unpacking user.
+ */
+class LayerExtractor {
+public:
+    struct Layer {
+        boost::filesystem::path blob;
+        std::string digest;
+    };
+
+    LayerExtractor(std::shared_ptr<const common::Config> config);
+    void unpack(const boost::filesystem::path& imagePath, const boost::filesystem::path& unpackPath) const;
+    size_t getNumberOfThreads(size_t numberOfLayers) const;
+
+    static std::vector<Layer> readLayers(const boost::filesystem::path& imagePath);
+    static void decompressLayer(const boost::filesystem::path& blob, const boost::filesystem::path& destination);
+    static void applyLayers(const boost::filesystem::path& rootfs,
+                            size_t numberOfLayers,
+                            const std::function<boost::filesystem::path(size_t)>& getTarFile);
+
+private:
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    const std::string sysname = "LayerExtractor";
+};
+
+}
+}
+
+#endif
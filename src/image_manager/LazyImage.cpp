@@ -0,0 +1,341 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/LazyImage.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include "image_manager/LayerExtractor.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+const size_t tarBlockSize = 512;
+const std::uint64_t maxOctalSize = 077777777777;  // largest size of the 12-byte octal field
+
+// files added by the eStargz converter to mark the end of the prioritized files
+const std::vector<std::string> landmarkFiles = {".prefetch.landmark", ".no.prefetch.landmark"};
+
+void writeOctal(char* field, size_t length, std::uint64_t value) {
+    std::snprintf(field, length, "%0*llo", static_cast<int>(length - 1), static_cast<unsigned long long>(value));
+}
+
+void writeHeader(std::ostream& tar, const std::string& name, char type, std::uint32_t mode, std::uint64_t size,
+                 std::time_t modificationTime, const std::string& linkName, std::uint32_t devMajor, std::uint32_t devMinor) {
+    char header[tarBlockSize] = {};
+    std::strncpy(header, name.c_str(), 99);
+    writeOctal(header + 100, 8, mode & 07777);
+    writeOctal(header + 108, 8, 0);
+    writeOctal(header + 116, 8, 0);
+    writeOctal(header + 124, 12, size > maxOctalSize ? 0 : size);
+    writeOctal(header + 136, 12, modificationTime > 0 ? modificationTime : 0);
+    header[156] = type;
+    std::strncpy(header + 157, linkName.c_str(), 99);
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+    writeOctal(header + 329, 8, devMajor);
+    writeOctal(header + 337, 8, devMinor);
+
+    std::memset(header + 148, ' ', 8);
+    auto checksum = 0u;
+    for(auto c : header) {
+        checksum += static_cast<unsigned char>(c);
+    }
+    std::snprintf(header + 148, 7, "%06o", checksum);
+    header[155] = ' ';
+    tar.write(header, tarBlockSize);
+}
+
+void writePadding(std::ostream& tar, std::uint64_t size) {
+    static const char zeros[tarBlockSize] = {};
+    auto remainder = size % tarBlockSize;
+    if(remainder > 0) {
+        tar.write(zeros, tarBlockSize - remainder);
+    }
+}
+
+/**
+ * Each PAX record has the format "<length> <key>=<value>\n", where <length> includes itself
+ */
+std::string makePaxRecord(const std::string& key, const std::string& value) {
+    auto record = " " + key + "=" + value + "\n";
+    auto length = record.size() + std::to_string(record.size()).size();
+    while(record.size() + std::to_string(length).size() != length) {
+        length = record.size() + std::to_string(length).size();
+    }
+    return std::to_string(length) + record;
+}
+
+void writeEntryHeader(std::ostream& tar, const EStargzIndex::Entry& entry, char type, std::uint64_t size) {
+    auto records = std::string{};
+    if(entry.name.size() > 99) {
+        records += makePaxRecord("path", entry.name);
+    }
+    if(entry.linkName.size() > 99) {
+        records += makePaxRecord("linkpath", entry.linkName);
+    }
+    if(size > maxOctalSize) {
+        records += makePaxRecord("size", std::to_string(size));
+    }
+    for(const auto& xattr : entry.xattrs) {
+        records += makePaxRecord("SCHILY.xattr." + xattr.first, xattr.second);
+    }
+    if(!records.empty()) {
+        writeHeader(tar, "PaxHeader", 'x', 0644, records.size(), 0, "", 0, 0);
+        tar.write(records.data(), records.size());
+        writePadding(tar, records.size());
+    }
+    writeHeader(tar, entry.name, type, entry.mode, size, entry.modificationTime, entry.linkName, entry.devMajor, entry.devMinor);
+}
+
+bool isLandmark(const std::string& name) {
+    auto path = boost::starts_with(name, "./") ? name.substr(2) : name;
+    return std::find(landmarkFiles.cbegin(), landmarkFiles.cend(), path) != landmarkFiles.cend();
+}
+
+std::string getString(const rj::Value& value, const char* key, const std::string& context) {
+    if(!value.IsObject() || !value.HasMember(key) || !value[key].IsString()) {
+        auto message = boost::format("Invalid %s: missing string property '%s'") % context % key;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return value[key].GetString();
+}
+
+std::uint64_t getUint64(const rj::Value& value, const char* key, const std::string& context) {
+    if(!value.IsObject() || !value.HasMember(key) || !value[key].IsUint64()) {
+        auto message = boost::format("Invalid %s: missing unsigned integer property '%s'") % context % key;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return value[key].GetUint64();
+}
+
+}
+
+const std::string LazyImage::format = "lazy";
+const std::string LazyImage::tocDigestAnnotation = "containerd.io/snapshot/stargz/toc.digest";
+
+/**
+ * Reads the TOCs of the layers of the image manifest from the source. Only the
+ * footer and the TOC at the end of each layer are fetched.
+ */
+LazyImage LazyImage::fetchIndex(const BlobSource& source,
+                                const std::string& server,
+                                const std::string& repository,
+                                const rj::Value& manifest) {
+    if(!manifest.IsObject() || !manifest.HasMember("layers") || !manifest["layers"].IsArray()) {
+        SARUS_THROW_ERROR("Invalid image manifest: missing array of layers");
+    }
+
+    auto layers = std::vector<Layer>{};
+    for(const auto& value : manifest["layers"].GetArray()) {
+        auto layer = Layer{};
+        layer.digest = getString(value, "digest", "image manifest");
+        layer.size = getUint64(value, "size", "image manifest");
+        try {
+            layer.index = EStargzIndex::read(source, layer.digest, layer.size);
+        }
+        catch(const std::exception& e) {
+            auto message = boost::format("Failed to read the index of layer %s: lazy pulls require"
+                                         " images with eStargz layers") % layer.digest;
+            SARUS_RETHROW_ERROR(e, message.str());
+        }
+
+        // the TOC is only trusted through the digest annotated in the manifest, and the
+        // data of the chunks through their digests in the TOC
+        auto annotations = value.FindMember("annotations");
+        if(annotations == value.MemberEnd()
+           || !annotations->value.IsObject()
+           || !annotations->value.HasMember(tocDigestAnnotation.c_str())
+           || !annotations->value[tocDigestAnnotation.c_str()].IsString()) {
+            auto message = boost::format("Layer %s has no %s annotation: lazy pulls require eStargz layers"
+                                         " whose TOC digest is annotated in the image manifest")
+                % layer.digest % tocDigestAnnotation;
+            SARUS_THROW_ERROR(message.str());
+        }
+        auto expectedDigest = std::string{annotations->value[tocDigestAnnotation.c_str()].GetString()};
+        if(layer.index.getTOCDigest() != expectedDigest) {
+            auto message = boost::format("Digest mismatch of the TOC of layer %s: got %s, expected %s")
+                % layer.digest % layer.index.getTOCDigest() % expectedDigest;
+            SARUS_THROW_ERROR(message.str());
+        }
+        for(const auto* chunk : layer.index.getChunks()) {
+            if(chunk->chunkDigest.empty()) {
+                auto message = boost::format("Chunk of '%s' at offset %d in layer %s has no digest in the TOC:"
+                                             " lazy pulls require eStargz layers with chunk digests")
+                    % chunk->name % chunk->offset % layer.digest;
+                SARUS_THROW_ERROR(message.str());
+            }
+        }
+        layers.push_back(std::move(layer));
+    }
+    return LazyImage{server, repository, std::move(layers)};
+}
+
+LazyImage LazyImage::read(const boost::filesystem::path& file) {
+    try {
+        auto json = libsarus::json::read(file);
+        auto layers = std::vector<Layer>{};
+        if(!json.IsObject() || !json.HasMember("layers") || !json["layers"].IsArray()) {
+            SARUS_THROW_ERROR("missing array of layers");
+        }
+        for(const auto& value : json["layers"].GetArray()) {
+            if(!value.IsObject() || !value.HasMember("toc")) {
+                SARUS_THROW_ERROR("missing TOC of layer");
+            }
+            auto layer = Layer{};
+            layer.digest = getString(value, "digest", "lazy image");
+            layer.size = getUint64(value, "size", "lazy image");
+            layer.index = EStargzIndex{value["toc"], getUint64(value, "tocOffset", "lazy image")};
+            layers.push_back(std::move(layer));
+        }
+        return LazyImage{getString(json, "server", "lazy image"),
+                         getString(json, "repository", "lazy image"),
+                         std::move(layers)};
+    }
+    catch(const std::exception& e) {
+        auto message = boost::format("Failed to read lazy image %s") % file;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+LazyImage::LazyImage(const std::string& server, const std::string& repository, std::vector<Layer> layers)
+    : server{server}
+    , repository{repository}
+    , layers{std::move(layers)}
+{}
+
+void LazyImage::write(const boost::filesystem::path& file) const {
+    auto json = rj::Document{rj::kObjectType};
+    auto& allocator = json.GetAllocator();
+    json.AddMember("server", rj::Value{server.c_str(), allocator}, allocator);
+    json.AddMember("repository", rj::Value{repository.c_str(), allocator}, allocator);
+    auto layersJSON = rj::Value{rj::kArrayType};
+    for(const auto& layer : layers) {
+        auto layerJSON = rj::Value{rj::kObjectType};
+        layerJSON.AddMember("digest", rj::Value{layer.digest.c_str(), allocator}, allocator);
+        layerJSON.AddMember("size", rj::Value{layer.size}, allocator);
+        layerJSON.AddMember("tocOffset", rj::Value{layer.index.getTOCOffset()}, allocator);
+        layerJSON.AddMember("toc", rj::Value{layer.index.getTOC(), allocator}, allocator);
+        layersJSON.PushBack(layerJSON, allocator);
+    }
+    json.AddMember("layers", layersJSON, allocator);
+    libsarus::json::write(json, file);
+}
+
+std::uint64_t LazyImage::getLayersSize() const {
+    auto size = std::uint64_t{0};
+    for(const auto& layer : layers) {
+        size += layer.size;
+    }
+    return size;
+}
+
+/**
+ * Fetches all the chunks missing from the cache. Returns the number of bytes fetched.
+ */
+std::uint64_t LazyImage::prefetch(const BlobSource& source, const ChunkCache& cache) const {
+    auto fetchedSize = std::uint64_t{0};
+    for(const auto& layer : layers) {
+        fetchedSize += cache.fetchChunks(source, layer.digest, layer.index.getChunks());
+    }
+    return fetchedSize;
+}
+
+/**
+ * Materializes the root filesystem of the image: the layers are rebuilt as tar
+ * archives from their TOCs and the cached chunks, one at a time, and applied.
+ */
+void LazyImage::materialize(const BlobSource& source,
+                            const ChunkCache& cache,
+                            const boost::filesystem::path& rootfs,
+                            const boost::filesystem::path& tempDirectory) const {
+    auto layersDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(
+        tempDirectory / "lazy-layers")};
+    libsarus::filesystem::createFoldersIfNecessary(layersDir.getPath());
+    LayerExtractor::applyLayers(rootfs, layers.size(), [&](size_t index) {
+        auto tarFile = layersDir.getPath() / ("layer-" + std::to_string(index) + ".tar");
+        writeLayerTar(source, cache, layers[index], tarFile);
+        return tarFile;
+    });
+}
+
+void LazyImage::writeLayerTar(const BlobSource& source,
+                              const ChunkCache& cache,
+                              const Layer& layer,
+                              const boost::filesystem::path& tarFile) {
+    // fetch the missing chunks of the layer in a few range requests
+    cache.fetchChunks(source, layer.digest, layer.index.getChunks());
+
+    auto tar = std::ofstream{tarFile.string(), std::ios::binary | std::ios::trunc};
+    if(!tar) {
+        auto message = boost::format("Failed to create %s") % tarFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    static const std::unordered_map<std::string, char> typeFlags = {
+        {"reg", '0'}, {"hardlink", '1'}, {"symlink", '2'}, {"char", '3'},
+        {"block", '4'}, {"dir", '5'}, {"fifo", '6'}
+    };
+    const auto& entries = layer.index.getEntries();
+    for(auto entry = entries.cbegin(); entry != entries.cend(); ++entry) {
+        if(entry->type == "chunk" || (entry->type == "reg" && isLandmark(entry->name))) {
+            continue;
+        }
+        writeEntryHeader(tar, *entry, typeFlags.at(entry->type), entry->type == "reg" ? entry->size : 0);
+        if(entry->type != "reg") {
+            continue;
+        }
+
+        // the data of a regular file is its own chunk followed by the "chunk" entries of the file
+        auto writtenSize = std::uint64_t{0};
+        for(auto chunk = entry; chunk != entries.cend() && writtenSize < entry->size; ++chunk) {
+            if(chunk != entry && (chunk->type != "chunk" || chunk->name != entry->name)) {
+                break;
+            }
+            if(chunk->chunkSize == 0) {
+                continue;
+            }
+            auto data = cache.getChunk(source, layer.digest, *chunk);
+            tar.write(data.data(), data.size());
+            writtenSize += data.size();
+        }
+        if(writtenSize != entry->size) {
+            auto message = boost::format("Failed to rebuild file '%s' of layer %s: got %d bytes of data, expected %d")
+                % entry->name % layer.digest % writtenSize % entry->size;
+            SARUS_THROW_ERROR(message.str());
+        }
+        writePadding(tar, entry->size);
+    }
+
+    static const char endOfArchive[2 * tarBlockSize] = {};
+    tar.write(endOfArchive, sizeof(endOfArchive));
+    tar.close();
+    if(!tar) {
+        auto message = boost::format("Failed to write %s") % tarFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+}
+
+}} // namespace
@@ -0,0 +1,81 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_LazyImage_hpp
+#define sarus_image_manger_LazyImage_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "image_manager/BlobSource.hpp"
+#include "image_manager/ChunkCache.hpp"
+#include "image_manager/EStargzIndex.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Image pulled lazily ("sarus pull --lazy"): only the tables of contents of its
+ * eStargz layers are stored in the repository, in a "<image>.lazy" file.
+ *
+ * The file data is fetched into the chunk cache by a background process started
+ * by the pull and, on demand, by the first run of the image, which materializes
+ * the root filesystem from the cached chunks and converts it into the configured
+ * image format. From then on, the image is a regular image of the repository.
+ */
+class LazyImage {
+public:
+    struct Layer {
+        std::string digest;
+        std::uint64_t size = 0;
+        EStargzIndex index;
+    };
+
+    static const std::string format;
+    static const std::string tocDigestAnnotation;
+
+    static LazyImage fetchIndex(const BlobSource& source,
+                                const std::string& server,
+                                const std::string& repository,
+                                const rapidjson::Value& manifest);
+    static LazyImage read(const boost::filesystem::path& file);
+
+    LazyImage(const std::string& server, const std::string& repository, std::vector<Layer> layers);
+    void write(const boost::filesystem::path& file) const;
+    const std::string& getServer() const { return server; }
+    const std::string& getRepository() const { return repository; }
+    const std::vector<Layer>& getLayers() const { return layers; }
+    std::uint64_t getLayersSize() const;
+    std::uint64_t prefetch(const BlobSource& source, const ChunkCache& cache) const;
+    void materialize(const BlobSource& source,
+                     const ChunkCache& cache,
+                     const boost::filesystem::path& rootfs,
+                     const boost::filesystem::path& tempDirectory) const;
+
+    static void writeLayerTar(const BlobSource& source,
+                              const ChunkCache& cache,
+                              const Layer& layer,
+                              const boost::filesystem::path& tarFile);
+
+private:
+    std::string server;
+    std::string repository;
+    std::vector<Layer> layers;
+};
+
+}
+}
+
+#endif
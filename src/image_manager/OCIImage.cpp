@@ -10,10 +10,13 @@
 
 #include "OCIImage.hpp"
 
+#include <rapidjson/pointer.h>
+
 #include "libsarus/PathRAII.hpp"
 #include "libsarus/Utility.hpp"
 #include "image_manager/Utility.hpp"
 #include "image_manager/UmociDriver.hpp"
+#include "image_manager/LayerExtractor.hpp"
 
 
 namespace sarus {
@@ -35,6 +38,14 @@ OCIImage::OCIImage(std::shared_ptr<const common::Config> config, const boost::fi
     auto manifestHash = manifestDigest.substr(manifestDigest.find(":")+1);
     auto imageManifest = libsarus::json::read(imageDir.getPath() / "blobs/sha256" / manifestHash);
 
+    if (imageManifest.HasMember("layers")) {
+        for (const auto& layer : imageManifest["layers"].GetArray()) {
+            if (layer.HasMember("size")) {
+                layersSize += layer["size"].GetUint64();
+            }
+        }
+    }
+
     std::string configDigest = imageManifest["config"]["digest"].GetString();
     log(boost::format("Found config digest: %s") % configDigest, libsarus::LogLevel::DEBUG);
     auto configHash = configDigest.substr(configDigest.find(":")+1);
@@ -45,19 +56,34 @@ OCIImage::OCIImage(std::shared_ptr<const common::Config> config, const boost::fi
 }
 
 libsarus::PathRAII OCIImage::unpack() const {
+    return unpack(config->directories.temp);
+}
+
+libsarus::PathRAII OCIImage::unpack(const boost::filesystem::path& parentDirectory) const {
     log(boost::format("> unpacking OCI image"), libsarus::LogLevel::GENERAL);
 
-    auto unpackDir = libsarus::PathRAII{makeTemporaryUnpackDirectory()};
+    auto unpackDir = libsarus::PathRAII{makeTemporaryUnpackDirectory(parentDirectory)};
 
-    auto umociDriver = UmociDriver{config};
-    umociDriver.unpack(imageDir.getPath(), unpackDir.getPath());
+    auto backend = std::string{"umoci"};
+    if (const rapidjson::Value* configBackend = rapidjson::Pointer("/unpackBackend").Get(config->json)) {
+        backend = configBackend->GetString();
+    }
+
+    if (backend == "native") {
+        auto layerExtractor = LayerExtractor{config};
+        layerExtractor.unpack(imageDir.getPath(), unpackDir.getPath());
+    }
+    else {
+        auto umociDriver = UmociDriver{config};
+        umociDriver.unpack(imageDir.getPath(), unpackDir.getPath());
+    }
 
     log(boost::format("Successfully unpacked OCI image"), libsarus::LogLevel::INFO);
     return unpackDir;
 }
 
-boost::filesystem::path OCIImage::makeTemporaryUnpackDirectory() const {
-    auto tempUnpackDir = libsarus::filesystem::makeUniquePathWithRandomSuffix(config->directories.temp / "unpack-directory");
+boost::filesystem::path OCIImage::makeTemporaryUnpackDirectory(const boost::filesystem::path& parentDirectory) const {
+    auto tempUnpackDir = libsarus::filesystem::makeUniquePathWithRandomSuffix(parentDirectory / "unpack-directory");
     try {
         libsarus::filesystem::createFoldersIfNecessary(tempUnpackDir);
     }
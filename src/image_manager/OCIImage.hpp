@@ -26,12 +26,15 @@ class OCIImage {
 public:
     OCIImage(std::shared_ptr<const common::Config> config, const boost::filesystem::path& imagePath);
     libsarus::PathRAII unpack() const;
+    libsarus::PathRAII unpack(const boost::filesystem::path& parentDirectory) const;
     std::string getImageID() const {return imageID;};
     sarus::common::ImageMetadata getMetadata() const {return metadata;};
+    size_t getLayersSize() const {return layersSize;};
+    const boost::filesystem::path& getPath() const {return imageDir.getPath();};
     void release();
 
 private:
-    boost::filesystem::path makeTemporaryUnpackDirectory() const;
+    boost::filesystem::path makeTemporaryUnpackDirectory(const boost::filesystem::path& parentDirectory) const;
     void log(const boost::format &message, libsarus::LogLevel,
              std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
     void log(const std::string& message, libsarus::LogLevel,
@@ -42,6 +45,7 @@ private:
     libsarus::PathRAII imageDir;
     common::ImageMetadata metadata;
     std::string imageID;
+    size_t layersSize = 0;
 };
 
 }
@@ -0,0 +1,265 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/PullCoordinator.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <rapidjson/document.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+const std::chrono::seconds PullCoordinator::defaultStaleTimeout = std::chrono::seconds{60};
+const std::chrono::milliseconds PullCoordinator::defaultPollInterval = std::chrono::milliseconds{1000};
+
+PullCoordinator::Ticket::Ticket(const boost::filesystem::path& markerFile,
+                                const Marker& marker,
+                                std::chrono::milliseconds heartbeatInterval)
+    : markerFile{markerFile}
+    , marker{marker}
+    , heartbeatInterval{heartbeatInterval}
+{
+    writeMarker();
+    heartbeatThread = std::thread{&Ticket::refreshPeriodically, this};
+}
+
+PullCoordinator::Ticket::~Ticket() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        isStopRequested = true;
+    }
+    stopCondition.notify_all();
+    heartbeatThread.join();
+    boost::system::error_code ec;
+    boost::filesystem::remove(markerFile, ec);
+}
+
+void PullCoordinator::Ticket::setPhase(const std::string& phase) {
+    std::lock_guard<std::mutex> lock{mutex};
+    marker.phase = phase;
+    writeMarker();
+}
+
+void PullCoordinator::Ticket::writeMarker() {
+    try {
+        PullCoordinator::writeMarker(marker, markerFile);
+    }
+    catch(const std::exception& e) {
+        // failing to refresh the marker only affects the waiting pullers
+        auto message = boost::format("Failed to refresh pull marker %s: %s") % markerFile % e.what();
+        libsarus::Logger::getInstance().log(message.str(), "PullCoordinator", libsarus::LogLevel::WARN);
+    }
+}
+
+void PullCoordinator::Ticket::refreshPeriodically() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while(!stopCondition.wait_for(lock, heartbeatInterval, [this]() { return isStopRequested; })) {
+        writeMarker();
+    }
+}
+
+PullCoordinator::PullCoordinator(std::shared_ptr<const common::Config> config,
+                                 std::chrono::milliseconds staleTimeout,
+                                 std::chrono::milliseconds pollInterval)
+    : config{std::move(config)}
+    , staleTimeout{staleTimeout}
+    , pollInterval{pollInterval}
+{}
+
+/**
+ * Returns a ticket if the calling process is responsible for pulling the image,
+ * or nullptr if the image was added to the repository by another process meanwhile.
+ */
+std::unique_ptr<PullCoordinator::Ticket> PullCoordinator::acquire(const common::ImageReference& reference,
+                                                                  const std::function<bool()>& isImageAvailable) const {
+    auto markerFile = getMarkerFile(reference);
+    libsarus::filesystem::createFoldersIfNecessary(markerFile.parent_path());
+
+    auto lastPhase = std::string{};
+    auto lastModification = std::time_t{0};
+    auto lastChangeObserved = std::chrono::steady_clock::now();
+
+    while(true) {
+        if(createMarkerAtomically(markerFile)) {
+            // the previous puller may have completed right before we created the marker
+            if(isImageAvailable()) {
+                boost::filesystem::remove(markerFile);
+                return nullptr;
+            }
+            auto marker = Marker{};
+            marker.hostname = libsarus::process::getHostname();
+            marker.pid = getpid();
+            marker.digest = reference.digest;
+            marker.phase = "started";
+            marker.started = std::time(nullptr);
+            return std::unique_ptr<Ticket>{new Ticket{markerFile, marker, staleTimeout / 4}};
+        }
+
+        boost::system::error_code ec;
+        auto modification = boost::filesystem::last_write_time(markerFile, ec);
+        if(ec) {
+            // marker removed in the meantime
+            if(isImageAvailable()) {
+                return nullptr;
+            }
+            continue;
+        }
+        auto marker = readMarker(markerFile);
+
+        // staleness is based on changes observed with the local clock,
+        // so that clock skews between nodes sharing the repository don't matter
+        auto now = std::chrono::steady_clock::now();
+        if(modification != lastModification) {
+            lastModification = modification;
+            lastChangeObserved = now;
+        }
+
+        if((marker && isOwnerDead(*marker)) || now - lastChangeObserved > staleTimeout) {
+            if(marker) {
+                printLog(boost::format("Taking over the pull of %s from process %d on %s, which is not responding")
+                            % reference % marker->pid % marker->hostname,
+                         libsarus::LogLevel::WARN);
+            }
+            removeStaleMarker(markerFile, marker);
+            lastModification = 0;
+            continue;
+        }
+
+        if(!marker) {
+            // marker being created by another puller
+            std::this_thread::sleep_for(pollInterval / 10);
+            continue;
+        }
+
+        if(marker->phase != lastPhase) {
+            printLog(boost::format("Waiting for process %d on %s, which is pulling the same image (%s)")
+                        % marker->pid % marker->hostname % marker->phase,
+                     libsarus::LogLevel::GENERAL);
+            lastPhase = marker->phase;
+        }
+
+        std::this_thread::sleep_for(pollInterval);
+
+        if(!boost::filesystem::exists(markerFile) && isImageAvailable()) {
+            printLog(boost::format("Image %s was pulled by process %d on %s") % reference % marker->pid % marker->hostname,
+                     libsarus::LogLevel::INFO);
+            return nullptr;
+        }
+    }
+}
+
+boost::filesystem::path PullCoordinator::getMarkerFile(const common::ImageReference& reference) const {
+    return config->directories.images / (reference.getUniqueKey() + ".pull");
+}
+
+void PullCoordinator::writeMarker(const Marker& marker, const boost::filesystem::path& file) {
+    auto json = rj::Document{rj::kObjectType};
+    auto& allocator = json.GetAllocator();
+    json.AddMember("hostname", rj::Value{marker.hostname.c_str(), allocator}, allocator);
+    json.AddMember("pid", rj::Value{static_cast<int64_t>(marker.pid)}, allocator);
+    json.AddMember("digest", rj::Value{marker.digest.c_str(), allocator}, allocator);
+    json.AddMember("phase", rj::Value{marker.phase.c_str(), allocator}, allocator);
+    json.AddMember("started", rj::Value{static_cast<int64_t>(marker.started)}, allocator);
+
+    // replace atomically, so that waiting pullers never read a partial marker
+    auto tempFile = libsarus::filesystem::makeUniquePathWithRandomSuffix(file);
+    libsarus::json::write(json, tempFile);
+    boost::filesystem::rename(tempFile, file);
+}
+
+boost::optional<PullCoordinator::Marker> PullCoordinator::readMarker(const boost::filesystem::path& file) {
+    try {
+        if(!boost::filesystem::exists(file) || boost::filesystem::file_size(file) == 0) {
+            return boost::none;
+        }
+        auto json = libsarus::json::read(file);
+        auto marker = Marker{};
+        marker.hostname = json["hostname"].GetString();
+        marker.pid = static_cast<pid_t>(json["pid"].GetInt64());
+        marker.digest = json["digest"].GetString();
+        marker.phase = json["phase"].GetString();
+        marker.started = static_cast<std::time_t>(json["started"].GetInt64());
+        return marker;
+    }
+    catch(const std::exception&) {
+        return boost::none;
+    }
+}
+
+bool PullCoordinator::createMarkerAtomically(const boost::filesystem::path& file) const {
+    auto fd = open(file.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    if(fd == -1) {
+        if(errno != EEXIST) {
+            auto message = boost::format("Failed to create pull marker %s: %s") % file % std::strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+bool PullCoordinator::isOwnerDead(const Marker& marker) const {
+    if(marker.hostname != libsarus::process::getHostname()) {
+        return false;
+    }
+    return kill(marker.pid, 0) != 0 && errno == ESRCH;
+}
+
+/**
+ * Moves the marker out of the way before removing it, so that among many pullers
+ * detecting the same stale marker only one actually removes it. If the moved marker
+ * turns out to be a fresh one, created by a puller which took over in the meantime,
+ * it is put back in place.
+ */
+void PullCoordinator::removeStaleMarker(const boost::filesystem::path& file, const boost::optional<Marker>& stale) const {
+    auto staleFile = libsarus::filesystem::makeUniquePathWithRandomSuffix(file.string() + ".stale");
+    boost::system::error_code ec;
+    boost::filesystem::rename(file, staleFile, ec);
+    if(ec) {
+        return;
+    }
+
+    auto moved = readMarker(staleFile);
+    bool isSameMarker = (!moved && !stale)
+                        || (moved && stale
+                            && moved->hostname == stale->hostname
+                            && moved->pid == stale->pid
+                            && moved->started == stale->started);
+    if(!isSameMarker) {
+        // fails if yet another marker was created: then that one stays
+        link(staleFile.c_str(), file.c_str());
+    }
+    boost::filesystem::remove(staleFile, ec);
+}
+
+void PullCoordinator::printLog(const boost::format& message, libsarus::LogLevel level,
+                               std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void PullCoordinator::printLog(const std::string& message, libsarus::LogLevel level,
+                               std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
@@ -0,0 +1,119 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_PullCoordinator_hpp
+#define sarus_image_manger_PullCoordinator_hpp
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <sys/types.h>
+
+#include "common/Config.hpp"
+#include "common/ImageReference.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Deduplicates concurrent pulls of the same image into the same repository
+ * (e.g. by the tasks of a job array).
+ *
+ * The first puller atomically creates an in-progress marker next to the files of the
+ * image in the repository and becomes responsible for the pull. Later pullers find the
+ * marker, report the progress of the first puller and wait for the marker to disappear:
+ * then they adopt the image added to the repository, or take over the pull if the first
+ * puller failed.
+ *
+ * The puller responsible for the pull periodically refreshes the marker. A marker which
+ * has not been refreshed for longer than the stale timeout, or whose process no longer
+ * exists on the local host, is left over by a crashed puller and is taken over.
+ */
+class PullCoordinator {
+public:
+    struct Marker {
+        std::string hostname;
+        pid_t pid = 0;
+        std::string digest;
+        std::string phase;
+        std::time_t started = 0;
+    };
+
+    /**
+     * Held by the process responsible for the pull: refreshes the marker
+     * in the background and removes it on destruction.
+     */
+    class Ticket {
+    public:
+        Ticket(const boost::filesystem::path& markerFile, const Marker& marker, std::chrono::milliseconds heartbeatInterval);
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket();
+        void setPhase(const std::string& phase);
+
+    private:
+        void writeMarker();
+        void refreshPeriodically();
+
+    private:
+        boost::filesystem::path markerFile;
+        Marker marker;
+        std::chrono::milliseconds heartbeatInterval;
+        std::mutex mutex;
+        std::condition_variable stopCondition;
+        bool isStopRequested = false;
+        std::thread heartbeatThread;
+    };
+
+    static const std::chrono::seconds defaultStaleTimeout;
+    static const std::chrono::milliseconds defaultPollInterval;
+
+public:
+    PullCoordinator(std::shared_ptr<const common::Config> config,
+                    std::chrono::milliseconds staleTimeout=defaultStaleTimeout,
+                    std::chrono::milliseconds pollInterval=defaultPollInterval);
+    std::unique_ptr<Ticket> acquire(const common::ImageReference& reference,
+                                    const std::function<bool()>& isImageAvailable) const;
+    boost::filesystem::path getMarkerFile(const common::ImageReference& reference) const;
+
+    static void writeMarker(const Marker& marker, const boost::filesystem::path& file);
+    static boost::optional<Marker> readMarker(const boost::filesystem::path& file);
+
+private:
+    bool createMarkerAtomically(const boost::filesystem::path& file) const;
+    bool isOwnerDead(const Marker& marker) const;
+    void removeStaleMarker(const boost::filesystem::path& file, const boost::optional<Marker>& stale) const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    std::chrono::milliseconds staleTimeout;
+    std::chrono::milliseconds pollInterval;
+    const std::string sysname = "PullCoordinator";
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,337 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/RepositoryPruner.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <map>
+#include <set>
+#include <tuple>
+#include <sys/stat.h>
+
+#include <boost/algorithm/string.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/pointer.h>
+
+#include "common/SarusImage.hpp"
+#include "image_manager/ChunkCache.hpp"
+#include "image_manager/LazyImage.hpp"
+#include "image_manager/StagingPolicy.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+// unpack directories and OCI layouts are not modified while mksquashfs runs,
+// which can take long for large images
+const std::chrono::seconds RepositoryPruner::defaultGracePeriod = std::chrono::seconds{6 * 3600};
+
+size_t RepositoryPruner::Report::getReclaimableSize() const {
+    size_t size = 0;
+    for(const auto& item : items) {
+        size += item.size;
+    }
+    return size;
+}
+
+RepositoryPruner::RepositoryPruner(std::shared_ptr<const common::Config> config, std::chrono::seconds gracePeriod)
+    : config{config}
+    , imageStore{config}
+    , imagePool{config}
+    , gracePeriod{gracePeriod}
+{}
+
+boost::optional<size_t> RepositoryPruner::getConfiguredQuota() const {
+    if(const rj::Value* quotaMB = rj::Pointer("/repositoryQuotaMB").Get(config->json)) {
+        return static_cast<size_t>(quotaMB->GetUint64()) * 1024 * 1024;
+    }
+    return boost::none;
+}
+
+RepositoryPruner::Report RepositoryPruner::prune(bool isDryRun, const boost::optional<size_t>& quota) const {
+    printLog(boost::format("Pruning repository %s%s") % config->directories.repository % (isDryRun ? " (dry run)" : ""),
+             libsarus::LogLevel::INFO);
+
+    auto report = Report{};
+
+    // listing the images also drops the entries whose squashfs or metadata file is missing
+    auto images = imageStore.listImages();
+    for(const auto& image : images) {
+        report.imagesSizeBefore += getImageSize(image);
+    }
+
+    collectOrphanedImageFiles(images, report);
+    collectAbandonedDirectories(config->directories.cache / "ociImages", "image-", "abandoned OCI image layout", report);
+    collectAbandonedDirectories(config->directories.temp, "unpack-directory-", "abandoned unpack directory", report);
+    for(const auto& directory : StagingPolicy{config}.getStagingDirectories()) {
+        if(directory != config->directories.temp) {
+            collectAbandonedDirectories(directory, "unpack-directory-", "abandoned unpack directory", report);
+        }
+    }
+    collectUnusedChunks(images, report);
+
+    report.imagesSizeAfter = report.imagesSizeBefore;
+    if(quota) {
+        collectLeastRecentlyUsedImages(images, *quota, report);
+    }
+
+    if(!isDryRun) {
+        removeItems(report);
+    }
+
+    printLog(boost::format("%s %s") % (isDryRun ? "Reclaimable space:" : "Reclaimed space:")
+                % common::SarusImage::createSizeString(report.getReclaimableSize()),
+             libsarus::LogLevel::INFO);
+    return report;
+}
+
+/**
+ * Files in the images directory which belong to no image of the repository metadata,
+ * e.g. squashfs and metadata files of pulls interrupted before the metadata update,
+ * temporary files of interrupted conversions and stale pull markers.
+ */
+void RepositoryPruner::collectOrphanedImageFiles(const std::vector<common::SarusImage>& images, Report& report) const {
+    auto ownedFiles = std::set<boost::filesystem::path>{};
+    for(const auto& image : images) {
+        ownedFiles.insert(image.imageFile);
+        ownedFiles.insert(image.metadataFile);
+        ownedFiles.insert(imageStore.getImageLastUsedFile(image.reference));
+        ownedFiles.insert(imageStore.getImagePrefetchProfileFile(image.reference));
+    }
+
+    const auto& imagesDirectory = config->directories.images;
+    if(!boost::filesystem::exists(imagesDirectory)) {
+        return;
+    }
+    for(const auto& entry : boost::filesystem::recursive_directory_iterator{imagesDirectory}) {
+        const auto& path = entry.path();
+        if(!boost::filesystem::is_regular_file(entry.symlink_status())
+           || ownedFiles.count(path)
+           || isWithinGracePeriod(path)) {
+            continue;
+        }
+        report.items.push_back(Item{path, boost::filesystem::file_size(path), "orphaned file", boost::none});
+    }
+}
+
+/**
+ * Directories created by the current user with a random suffix appended to the prefix,
+ * which are normally removed at the end of a pull or load.
+ */
+void RepositoryPruner::collectAbandonedDirectories(const boost::filesystem::path& parentDirectory,
+                                                   const std::string& prefix,
+                                                   const std::string& reason,
+                                                   Report& report) const {
+    if(!boost::filesystem::is_directory(parentDirectory)) {
+        return;
+    }
+    for(const auto& entry : boost::filesystem::directory_iterator{parentDirectory}) {
+        const auto& path = entry.path();
+        if(!boost::starts_with(path.filename().string(), prefix)
+           || !boost::filesystem::is_directory(entry.symlink_status())
+           || std::get<0>(libsarus::filesystem::getOwner(path)) != config->userIdentity.uid
+           || isWithinGracePeriod(path)) {
+            continue;
+        }
+        report.items.push_back(Item{path, getSize(path), reason, boost::none});
+    }
+}
+
+/**
+ * Chunks are only needed until the lazily pulled images referencing them are materialized.
+ * If the index of a lazy image cannot be read, no chunk is considered unused.
+ */
+void RepositoryPruner::collectUnusedChunks(const std::vector<common::SarusImage>& images, Report& report) const {
+    auto cache = ChunkCache{config};
+    if(!boost::filesystem::is_directory(cache.getDirectory())) {
+        return;
+    }
+
+    auto usedChunks = std::set<boost::filesystem::path>{};
+    for(const auto& image : images) {
+        if(image.format != LazyImage::format) {
+            continue;
+        }
+        try {
+            auto lazyImage = LazyImage::read(image.imageFile);
+            for(const auto& layer : lazyImage.getLayers()) {
+                for(const auto* chunk : layer.index.getChunks()) {
+                    usedChunks.insert(cache.getChunkFile(layer.digest, *chunk));
+                }
+            }
+        }
+        catch(const std::exception& e) {
+            printLog(boost::format("Failed to read lazy image %s, keeping the chunk cache: %s") % image.reference % e.what(),
+                     libsarus::LogLevel::WARN);
+            return;
+        }
+    }
+
+    for(const auto& entry : boost::filesystem::recursive_directory_iterator{cache.getDirectory()}) {
+        const auto& path = entry.path();
+        if(!boost::filesystem::is_regular_file(entry.symlink_status())
+           || usedChunks.count(path)
+           || isWithinGracePeriod(path)) {
+            continue;
+        }
+        report.items.push_back(Item{path, boost::filesystem::file_size(path), "unused chunk", boost::none});
+    }
+}
+
+void RepositoryPruner::collectLeastRecentlyUsedImages(std::vector<common::SarusImage> images, size_t quota, Report& report) const {
+    if(report.imagesSizeAfter <= quota) {
+        return;
+    }
+
+    if(config->useCentralizedRepository && !imageStore.isUsageOfOtherUsersRecorded()) {
+        printLog(boost::format("The use of images by other users is not recorded in repository %s (it will be"
+                               " after the next pull): least recently used images are selected according to"
+                               " their use by the owner of the repository and to their pull time")
+                    % config->directories.repository,
+                 libsarus::LogLevel::WARN);
+    }
+
+    auto lastUsed = std::map<std::string, std::time_t>{};
+    for(const auto& image : images) {
+        lastUsed[image.reference.getUniqueKey()] = imageStore.getImageLastUsedTime(image);
+    }
+    std::stable_sort(images.begin(), images.end(), [&lastUsed](const common::SarusImage& lhs, const common::SarusImage& rhs) {
+        return lastUsed[lhs.reference.getUniqueKey()] < lastUsed[rhs.reference.getUniqueKey()];
+    });
+
+    for(const auto& image : images) {
+        if(report.imagesSizeAfter <= quota) {
+            break;
+        }
+        auto size = getImageSize(image);
+        auto reason = boost::format("least recently used image %s (last used %s)")
+                      % image.reference
+                      % common::SarusImage::createTimeString(lastUsed[image.reference.getUniqueKey()]);
+        report.items.push_back(Item{image.imageFile, size, reason.str(), image.reference});
+        report.imagesSizeAfter -= size;
+    }
+
+    if(report.imagesSizeAfter > quota) {
+        printLog(boost::format("Failed to bring repository within quota of %s")
+                    % common::SarusImage::createSizeString(quota),
+                 libsarus::LogLevel::WARN);
+    }
+}
+
+/**
+ * The squashfs files of the image pool are shared with other repositories:
+ * they don't count towards the size of the repository.
+ */
+size_t RepositoryPruner::getImageSize(const common::SarusImage& image) const {
+    size_t size = 0;
+    boost::system::error_code ec;
+    if(!imagePool.isPoolImage(image.imageFile)) {
+        auto imageSize = boost::filesystem::file_size(image.imageFile, ec);
+        size += ec ? 0 : imageSize;
+    }
+    auto metadataSize = boost::filesystem::file_size(image.metadataFile, ec);
+    size += ec ? 0 : metadataSize;
+    return size;
+}
+
+/**
+ * Directories are considered in use if any of their entries was modified recently.
+ */
+bool RepositoryPruner::isWithinGracePeriod(const boost::filesystem::path& path) const {
+    auto threshold = std::time(nullptr) - static_cast<std::time_t>(gracePeriod.count());
+    auto isRecent = [threshold](const boost::filesystem::path& p) {
+        struct stat sb;
+        return lstat(p.c_str(), &sb) == 0 && sb.st_mtime > threshold;
+    };
+
+    if(isRecent(path)) {
+        return true;
+    }
+    if(boost::filesystem::is_directory(boost::filesystem::symlink_status(path))) {
+        boost::system::error_code ec;
+        for(auto it = boost::filesystem::recursive_directory_iterator{path, ec};
+            it != boost::filesystem::recursive_directory_iterator{};
+            it.increment(ec)) {
+            if(ec) {
+                break;
+            }
+            if(isRecent(it->path())) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t RepositoryPruner::getSize(const boost::filesystem::path& path) const {
+    try {
+        return libsarus::filesystem::getDirectorySize(path);
+    }
+    catch(const std::exception& e) {
+        printLog(boost::format("Failed to compute size of %s: %s") % path % e.what(), libsarus::LogLevel::DEBUG);
+        return 0;
+    }
+}
+
+void RepositoryPruner::removeItems(const Report& report) const {
+    for(const auto& item : report.items) {
+        printLog(boost::format("Removing %s (%s)") % item.path % item.reason, libsarus::LogLevel::INFO);
+        if(item.image) {
+            imageStore.removeImage(*item.image);
+        }
+        else {
+            // PathRAII also removes unpacked files without owner write permissions
+            auto leftover = libsarus::PathRAII{item.path};
+        }
+    }
+    removeEmptyDirectories(config->directories.images);
+    removeEmptyDirectories(ChunkCache{config}.getDirectory());
+}
+
+/**
+ * Removes the directories left empty in the images directory
+ * (one directory per server, namespace and image name).
+ */
+void RepositoryPruner::removeEmptyDirectories(const boost::filesystem::path& directory) const {
+    if(!boost::filesystem::is_directory(directory)) {
+        return;
+    }
+    auto subdirectories = std::vector<boost::filesystem::path>{};
+    for(const auto& entry : boost::filesystem::directory_iterator{directory}) {
+        if(boost::filesystem::is_directory(entry.symlink_status())) {
+            subdirectories.push_back(entry.path());
+        }
+    }
+    for(const auto& subdirectory : subdirectories) {
+        removeEmptyDirectories(subdirectory);
+        if(boost::filesystem::is_empty(subdirectory)) {
+            boost::filesystem::remove(subdirectory);
+        }
+    }
+}
+
+void RepositoryPruner::printLog(const boost::format& message, libsarus::LogLevel level,
+                                std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void RepositoryPruner::printLog(const std::string& message, libsarus::LogLevel level,
+                                std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
@@ -0,0 +1,98 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_RepositoryPruner_hpp
+#define sarus_image_manger_RepositoryPruner_hpp
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "image_manager/ImageStore.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Reclaims the space of a repository:
+ * - reconciles the repository with its metadata, removing the files in the images directory
+ *   which do not belong to any image (e.g. left over by interrupted pulls or by manual changes);
+ * - removes the OCI image layouts in the cache and the unpack directories in the temporary
+ *   and staging directories abandoned by interrupted pulls and loads;
+ * - removes the chunks of the chunk cache which belong to no lazily pulled image still
+ *   waiting to be materialized;
+ * - if a quota is set, removes the least recently used images until the size of the
+ *   images fits within the quota.
+ *
+ * Leftovers are only removed if they were not modified during the grace period, so that
+ * pulls and loads in progress are not affected. In dry-run mode nothing is removed and
+ * the reclaimable space is reported.
+ */
+class RepositoryPruner {
+public:
+    struct Item {
+        boost::filesystem::path path;
+        size_t size;
+        std::string reason;
+        boost::optional<common::ImageReference> image; // evicted images are removed through the image store
+    };
+
+    struct Report {
+        std::vector<Item> items;
+        size_t imagesSizeBefore = 0;
+        size_t imagesSizeAfter = 0;
+        size_t getReclaimableSize() const;
+    };
+
+    static const std::chrono::seconds defaultGracePeriod;
+
+public:
+    RepositoryPruner(std::shared_ptr<const common::Config> config, std::chrono::seconds gracePeriod=defaultGracePeriod);
+    Report prune(bool isDryRun, const boost::optional<size_t>& quota) const;
+    boost::optional<size_t> getConfiguredQuota() const;
+
+private:
+    void collectOrphanedImageFiles(const std::vector<common::SarusImage>& images, Report& report) const;
+    void collectAbandonedDirectories(const boost::filesystem::path& parentDirectory,
+                                     const std::string& prefix,
+                                     const std::string& reason,
+                                     Report& report) const;
+    void collectUnusedChunks(const std::vector<common::SarusImage>& images, Report& report) const;
+    void collectLeastRecentlyUsedImages(std::vector<common::SarusImage> images, size_t quota, Report& report) const;
+    size_t getImageSize(const common::SarusImage& image) const;
+    bool isWithinGracePeriod(const boost::filesystem::path& path) const;
+    size_t getSize(const boost::filesystem::path& path) const;
+    void removeItems(const Report& report) const;
+    void removeEmptyDirectories(const boost::filesystem::path& directory) const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    ImageStore imageStore;
+    ImagePool imagePool;
+    std::chrono::seconds gracePeriod;
+    const std::string sysname = "RepositoryPruner";
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/ScratchTrash.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/pointer.h>
+
+#include "image_manager/StagingPolicy.hpp"
+#include "image_manager/Utility.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+bool isSameFilesystem(const boost::filesystem::path& lhs, const boost::filesystem::path& rhs) {
+    struct stat lhsStat, rhsStat;
+    return stat(lhs.c_str(), &lhsStat) == 0
+        && stat(rhs.c_str(), &rhsStat) == 0
+        && lhsStat.st_dev == rhsStat.st_dev;
+}
+
+
+std::vector<std::string> readDirectoryEntries(int directoryFd) {
+    auto entries = std::vector<std::string>{};
+    auto fd = dup(directoryFd);
+    auto* directory = fd >= 0 ? fdopendir(fd) : nullptr;
+    if(directory == nullptr) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        auto message = boost::format("Failed to read directory: %s") % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    rewinddir(directory);
+    while(auto* entry = readdir(directory)) {
+        auto name = std::string{entry->d_name};
+        if(name != "." && name != "..") {
+            entries.push_back(name);
+        }
+    }
+    closedir(directory);
+    return entries;
+}
+
+/**
+ * Removes a tree relative to a directory file descriptor, without following symlinks.
+ * Like PathRAII, it also removes unpacked directories without owner write permissions.
+ */
+void removeTreeAt(int parentFd, const std::string& name) {
+    struct stat st;
+    if(fstatat(parentFd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        if(errno == ENOENT) {
+            return;
+        }
+        auto message = boost::format("Failed to stat %s: %s") % name % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    if(S_ISDIR(st.st_mode)) {
+        auto fd = openat(parentFd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if(fd < 0) {
+            auto message = boost::format("Failed to open directory %s: %s") % name % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        try {
+            fchmod(fd, (st.st_mode & 07777) | S_IRWXU);
+            for(const auto& entry : readDirectoryEntries(fd)) {
+                removeTreeAt(fd, entry);
+            }
+        }
+        catch(...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+    }
+
+    if(unlinkat(parentFd, name.c_str(), S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0) != 0 && errno != ENOENT) {
+        auto message = boost::format("Failed to remove %s: %s") % name % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+}
+}
+
+ScratchTrash::ScratchTrash(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+bool ScratchTrash::isEnabled() const {
+    const rj::Value* mode = rj::Pointer("/scratchCleanup").Get(config->json);
+    return mode && std::string{mode->GetString()} == "deferred";
+}
+
+/**
+ * Returns false if deferred deletion is disabled or the scratch tree could not be moved:
+ * then the caller is responsible for removing the tree.
+ */
+bool ScratchTrash::moveToTrash(const boost::filesystem::path& path) const {
+    if(!isEnabled()) {
+        return false;
+    }
+
+    auto trashDirectory = getTrashDirectory(path);
+    if(mkdir(trashDirectory.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+        printLog(boost::format("Failed to create trash directory %s: %s") % trashDirectory % strerror(errno),
+                 libsarus::LogLevel::DEBUG);
+        return false;
+    }
+    auto trashFd = openTrashDirectory(trashDirectory);
+    if(trashFd < 0) {
+        return false;
+    }
+
+    // rename relative to the verified directory, which can't be swapped in the meantime
+    auto destination = trashDirectory / path.filename();
+    if(renameat(AT_FDCWD, path.c_str(), trashFd, path.filename().c_str()) != 0) {
+        printLog(boost::format("Failed to move %s into trash directory %s: %s") % path % trashDirectory % strerror(errno),
+                 libsarus::LogLevel::DEBUG);
+        close(trashFd);
+        return false;
+    }
+    close(trashFd);
+
+    printLog(boost::format("Moved %s to %s") % path % destination, libsarus::LogLevel::DEBUG);
+    return true;
+}
+
+std::vector<boost::filesystem::path> ScratchTrash::getTrashDirectories() const {
+    auto directories = std::vector<boost::filesystem::path>{config->directories.repository / "trash"};
+    auto userTrash = "sarus-trash-" + std::to_string(config->userIdentity.uid);
+    auto scratchParents = StagingPolicy{config}.getStagingDirectories();
+    scratchParents.insert(scratchParents.begin(), config->directories.temp);
+    scratchParents.insert(scratchParents.begin(), config->directories.cache / "ociImages");
+    for(const auto& parent : scratchParents) {
+        auto directory = parent / userTrash;
+        if(std::find(directories.cbegin(), directories.cend(), directory) == directories.cend()) {
+            directories.push_back(directory);
+        }
+    }
+    return directories;
+}
+
+bool ScratchTrash::isEmpty() const {
+    for(const auto& directory : getTrashDirectories()) {
+        auto fd = openTrashDirectory(directory);
+        if(fd < 0) {
+            continue;
+        }
+        auto isDirectoryEmpty = true;
+        try {
+            isDirectoryEmpty = readDirectoryEntries(fd).empty();
+        }
+        catch(const libsarus::Error&) {}
+        close(fd);
+        if(!isDirectoryEmpty) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Removes the contents of the trash directories. Concurrent reclaims of the same
+ * trash directory are serialized by a lock on the directory, and each one empties
+ * the directory before releasing the lock, so that trees moved into the trash while
+ * another reclaim is in progress are not missed. The trees are removed relative to
+ * the file descriptor of the verified trash directory, without following symlinks.
+ */
+void ScratchTrash::reclaim() const {
+    for(const auto& directory : getTrashDirectories()) {
+        auto fd = openTrashDirectory(directory);
+        if(fd < 0) {
+            continue;
+        }
+
+        if(flock(fd, LOCK_EX) != 0) {
+            printLog(boost::format("Failed to lock trash directory %s: %s") % directory % strerror(errno),
+                     libsarus::LogLevel::DEBUG);
+            close(fd);
+            continue;
+        }
+        try {
+            while(true) {
+                auto entries = readDirectoryEntries(fd);
+                if(entries.empty()) {
+                    break;
+                }
+
+                bool isProgress = false;
+                for(const auto& entry : entries) {
+                    try {
+                        removeTreeAt(fd, entry);
+                        isProgress = true;
+                    }
+                    catch(const std::exception& e) {
+                        printLog(boost::format("Failed to remove %s: %s") % (directory / entry) % e.what(),
+                                 libsarus::LogLevel::DEBUG);
+                    }
+                }
+                if(!isProgress) {
+                    break;
+                }
+            }
+        }
+        catch(const std::exception& e) {
+            printLog(boost::format("Failed to reclaim trash directory %s: %s") % directory % e.what(),
+                     libsarus::LogLevel::DEBUG);
+        }
+        close(fd); // also releases the lock
+    }
+}
+
+/**
+ * Reclaims the trash in a detached grandchild process, which is reparented to init
+ * and is not waited for. The child is waited for, to avoid leaving zombies behind.
+ */
+void ScratchTrash::reclaimInBackground() const {
+    if(isEmpty()) {
+        return;
+    }
+
+    printLog("Reclaiming trash in background process", libsarus::LogLevel::INFO);
+
+    if(!utility::runInBackgroundProcess([this]() { reclaim(); })) {
+        printLog(boost::format("Failed to fork trash reclaim process: %s") % strerror(errno),
+                 libsarus::LogLevel::WARN);
+    }
+}
+
+/**
+ * The scratch tree must be moved within its filesystem for the rename to be atomic.
+ */
+boost::filesystem::path ScratchTrash::getTrashDirectory(const boost::filesystem::path& scratch) const {
+    const auto& repository = config->directories.repository;
+    if(isSameFilesystem(scratch.parent_path(), repository)) {
+        return repository / "trash";
+    }
+    return scratch.parent_path() / ("sarus-trash-" + std::to_string(config->userIdentity.uid));
+}
+
+/**
+ * Returns a file descriptor of the trash directory, or -1 if the directory does not exist
+ * or is not a directory owned by the process owner (e.g. a symlink or a directory created
+ * in advance by another user in a world-writable directory such as /tmp). The directory
+ * is made private, so that the trees moved into it are not accessible to other users.
+ */
+int ScratchTrash::openTrashDirectory(const boost::filesystem::path& directory) const {
+    auto fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(fd < 0) {
+        if(errno != ENOENT) {
+            printLog(boost::format("Ignoring trash directory %s: %s") % directory % strerror(errno),
+                     libsarus::LogLevel::WARN);
+        }
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid()) {
+        printLog(boost::format("Ignoring trash directory %s: not owned by user %d") % directory % geteuid(),
+                 libsarus::LogLevel::WARN);
+        close(fd);
+        return -1;
+    }
+    // e.g. created by a previous version of Sarus with the default permissions
+    if((st.st_mode & (S_IRWXG | S_IRWXO)) != 0 && fchmod(fd, S_IRWXU) != 0) {
+        printLog(boost::format("Ignoring trash directory %s: failed to make it private: %s")
+                    % directory % strerror(errno),
+                 libsarus::LogLevel::WARN);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void ScratchTrash::printLog(const boost::format& message, libsarus::LogLevel level,
+                            std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void ScratchTrash::printLog(const std::string& message, libsarus::LogLevel level,
+                            std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
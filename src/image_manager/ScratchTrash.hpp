@@ -0,0 +1,72 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_ScratchTrash_hpp
+#define sarus_image_manger_ScratchTrash_hpp
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "common/Config.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Deferred deletion of the scratch trees of pulls and loads (unpack directories and
+ * OCI image layouts), enabled with "scratchCleanup": "deferred" in the configuration.
+ *
+ * Deleting a tree of many small files can be slow on parallel filesystems. Scratch
+ * trees are instead renamed into a trash directory on the same filesystem, which
+ * is atomic and immediate, and the trash is emptied by a detached child process
+ * running with idle I/O priority and the lowest CPU priority. The trash of the
+ * repository filesystem is the "trash" directory of the repository, while scratch
+ * trees on other filesystems (e.g. the temporary directory) are moved into a
+ * per-user "sarus-trash-<uid>" directory next to them. As these can be world-writable
+ * directories, a trash directory is only used if it is a directory (not a symlink)
+ * owned by the user, it is made private, and it is filled and emptied through file
+ * descriptors without following symlinks.
+ *
+ * Trees left in the trash by an interrupted deletion are reclaimed by the next pull
+ * or load.
+ */
+class ScratchTrash {
+public:
+    ScratchTrash(std::shared_ptr<const common::Config> config);
+    bool isEnabled() const;
+    bool moveToTrash(const boost::filesystem::path& scratch) const;
+    std::vector<boost::filesystem::path> getTrashDirectories() const;
+    bool isEmpty() const;
+    void reclaim() const;
+    void reclaimInBackground() const;
+
+private:
+    boost::filesystem::path getTrashDirectory(const boost::filesystem::path& scratch) const;
+    int openTrashDirectory(const boost::filesystem::path& directory) const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    const std::string sysname = "ScratchTrash";
+};
+
+}
+}
+
+#endif
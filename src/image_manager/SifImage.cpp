@@ -0,0 +1,333 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/SifImage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#include <boost/algorithm/string.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+const char sifMagic[] = "SIF_MAGIC";
+const size_t magicOffset = 32;
+const char squashfsMagic[] = "hsqs";
+
+// JSON objects (labels, OCI index, manifest and config) are small: refuse to load huge ones in memory
+const std::uint64_t maxJSONSize = 64 << 20;
+
+template<typename T>
+T readLittleEndian(const char* data) {
+    auto value = T{0};
+    for(size_t i=0; i<sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<std::uint8_t>(data[i])) << (8*i);
+    }
+    return value;
+}
+
+std::string readBytes(std::ifstream& is, const boost::filesystem::path& file, std::uint64_t offset, std::uint64_t size) {
+    auto data = std::string(size, '\0');
+    is.clear();
+    is.seekg(static_cast<std::streamoff>(offset));
+    if(!is.read(&data[0], static_cast<std::streamsize>(size))) {
+        auto message = boost::format("Failed to read %d bytes at offset %d of SIF file %s") % size % offset % file;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return data;
+}
+
+std::string stripDigestAlgorithm(const std::string& digest) {
+    if(!boost::starts_with(digest, "sha256:")) {
+        auto message = boost::format("Unsupported digest algorithm in SIF OCI image: %s") % digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return digest.substr(std::strlen("sha256:"));
+}
+
+}
+
+SifImage::SifImage(const boost::filesystem::path& file)
+    : file{file}
+{
+    printLog(boost::format("Reading SIF file %s") % file, libsarus::LogLevel::INFO);
+    try {
+        parseHeaderAndDescriptors();
+        findRootfsAndMetadata();
+    }
+    catch(const std::exception& e) {
+        auto message = boost::format("Failed to read SIF file %s") % file;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+const SifImage::Descriptor& SifImage::getRootfsDescriptor() const {
+    if(!rootfs) {
+        auto message = boost::format("SIF file %s doesn't contain a squashfs root filesystem") % file;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return *rootfs;
+}
+
+/**
+ * Copies the squashfs root filesystem to the destination, atomically creating
+ * or replacing the destination file.
+ */
+void SifImage::extractRootfs(const boost::filesystem::path& destination) const {
+    const auto& descriptor = getRootfsDescriptor();
+    printLog(boost::format("> extracting squashfs partition of SIF file: %s") % destination, libsarus::LogLevel::GENERAL);
+
+    auto tempFile = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(destination)};
+    libsarus::filesystem::createFoldersIfNecessary(destination.parent_path());
+    libsarus::filesystem::copyFileRange(file, tempFile.getPath(), descriptor.offset, descriptor.size);
+    // hash the extracted copy rather than the SIF file, so that what is verified is what gets installed
+    if(!descriptor.digest.empty() && libsarus::Sha256::hexDigestOfFile(tempFile.getPath()) != descriptor.digest) {
+        auto message = boost::format("squashfs layer of SIF file %s doesn't match its digest sha256:%s")
+            % file % descriptor.digest;
+        SARUS_THROW_ERROR(message.str());
+    }
+    boost::filesystem::rename(tempFile.getPath(), destination);
+    tempFile.release();
+
+    printLog(boost::format("Successfully extracted %d bytes of squashfs data") % descriptor.size, libsarus::LogLevel::INFO);
+}
+
+bool SifImage::isSifFile(const boost::filesystem::path& file) {
+    std::ifstream is(file.c_str(), std::ios::binary);
+    auto data = std::string(magicOffset + sizeof(sifMagic), '\0');
+    if(!is.read(&data[0], data.size())) {
+        return false;
+    }
+    return data.compare(magicOffset, sizeof(sifMagic), sifMagic, sizeof(sifMagic)) == 0;
+}
+
+void SifImage::parseHeaderAndDescriptors() {
+    std::ifstream is(file.c_str(), std::ios::binary);
+    if(!is) {
+        auto message = boost::format("Failed to open %s: %s") % file % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto header = readBytes(is, file, 0, headerSize);
+    if(header.compare(magicOffset, sizeof(sifMagic), sifMagic, sizeof(sifMagic)) != 0) {
+        SARUS_THROW_ERROR("not a SIF file (bad magic number)");
+    }
+
+    auto descriptorsTotal = readLittleEndian<std::uint64_t>(&header[88]);
+    auto descriptorsOffset = readLittleEndian<std::uint64_t>(&header[96]);
+    auto descriptorsSize = readLittleEndian<std::uint64_t>(&header[104]);
+    if(descriptorsTotal > descriptorsSize / descriptorSize) {
+        auto message = boost::format("inconsistent descriptor table (%d descriptors in %d bytes)")
+            % descriptorsTotal % descriptorsSize;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto fileSize = libsarus::filesystem::getFileSize(file);
+    if(descriptorsOffset > fileSize || descriptorsSize > fileSize - descriptorsOffset) {
+        SARUS_THROW_ERROR("descriptor table exceeds the size of the file");
+    }
+
+    auto table = readBytes(is, file, descriptorsOffset, descriptorsTotal * descriptorSize);
+
+    for(size_t i=0; i<descriptorsTotal; ++i) {
+        const char* raw = &table[i * descriptorSize];
+        bool isUsed = raw[4] != 0;
+        if(!isUsed) {
+            continue;
+        }
+        auto descriptor = Descriptor{};
+        descriptor.dataType = readLittleEndian<std::int32_t>(raw);
+        descriptor.id = readLittleEndian<std::uint32_t>(raw + 5);
+        descriptor.groupID = readLittleEndian<std::uint32_t>(raw + 9);
+        descriptor.linkedID = readLittleEndian<std::uint32_t>(raw + 13);
+        descriptor.offset = readLittleEndian<std::uint64_t>(raw + 17);
+        descriptor.size = readLittleEndian<std::uint64_t>(raw + 25);
+        descriptor.name = std::string(raw + 73, strnlen(raw + 73, 128));
+        if(descriptor.dataType == dataPartition) {
+            descriptor.fsType = readLittleEndian<std::int32_t>(raw + 201);
+            descriptor.partType = readLittleEndian<std::int32_t>(raw + 205);
+        }
+        if(descriptor.offset > fileSize || descriptor.size > fileSize - descriptor.offset) {
+            auto message = boost::format("data object %d exceeds the size of the file") % descriptor.id;
+            SARUS_THROW_ERROR(message.str());
+        }
+        descriptors.push_back(descriptor);
+    }
+
+    // without an OCI configuration the image is identified by its header and descriptors,
+    // which change whenever a data object is added, removed or modified
+    auto hash = libsarus::Sha256{};
+    hash.update(header);
+    hash.update(table);
+    imageID = hash.finalizeHex();
+
+    printLog(boost::format("Found %d data objects in SIF file") % descriptors.size(), libsarus::LogLevel::DEBUG);
+}
+
+void SifImage::findRootfsAndMetadata() {
+    if(findOCIImage()) {
+        return;
+    }
+
+    for(const auto& descriptor : descriptors) {
+        if(descriptor.dataType == dataPartition
+           && descriptor.partType == partPrimSys
+           && descriptor.fsType == fsSquash) {
+            rootfs = descriptor;
+        }
+        else if(descriptor.dataType == dataLabels && descriptor.size > 0) {
+            auto labels = libsarus::json::parse(readData(descriptor));
+            if(labels.IsObject()) {
+                for(const auto& label : labels.GetObject()) {
+                    if(label.value.IsString()) {
+                        metadata.labels[label.name.GetString()] = label.value.GetString();
+                    }
+                }
+            }
+        }
+        else if(descriptor.dataType == dataGenericJSON && descriptor.size > 0) {
+            // OCI image configuration stored alongside the partition
+            auto json = libsarus::json::parse(readData(descriptor));
+            if(json.IsObject() && json.HasMember("config") && json["config"].IsObject()) {
+                printLog(boost::format("Using OCI configuration from data object '%s'") % descriptor.name,
+                         libsarus::LogLevel::INFO);
+                auto labels = metadata.labels;
+                metadata = common::ImageMetadata{json["config"]};
+                metadata.labels.insert(labels.cbegin(), labels.cend());
+            }
+        }
+    }
+
+    if(rootfs) {
+        auto superblock = *rootfs;
+        superblock.size = std::min<std::uint64_t>(superblock.size, 4);
+        if(readData(superblock) != squashfsMagic) {
+            printLog("Primary system partition doesn't start with a squashfs superblock", libsarus::LogLevel::WARN);
+            rootfs = boost::none;
+        }
+    }
+}
+
+/**
+ * Looks for an OCI image (OCI-SIF), whose layer is a squashfs filesystem.
+ * Returns false if the file doesn't contain an OCI image.
+ */
+bool SifImage::findOCIImage() {
+    auto rootIndex = std::find_if(descriptors.cbegin(), descriptors.cend(), [](const Descriptor& d) {
+        return d.dataType == dataOCIRootIndex;
+    });
+    if(rootIndex == descriptors.cend()) {
+        return false;
+    }
+
+    auto index = libsarus::json::parse(readData(*rootIndex));
+    const auto& manifestEntry = index["manifests"][0];
+    auto manifestBlob = findOCIBlob(manifestEntry["digest"].GetString(), manifestEntry["size"].GetUint64());
+    if(!manifestBlob) {
+        SARUS_THROW_ERROR("OCI image manifest referenced by the root index not found");
+    }
+
+    auto manifest = libsarus::json::parse(readData(*manifestBlob));
+    auto configDigest = std::string{manifest["config"]["digest"].GetString()};
+    auto configBlob = findOCIBlob(configDigest, manifest["config"]["size"].GetUint64());
+    if(!configBlob) {
+        SARUS_THROW_ERROR("OCI image configuration referenced by the manifest not found");
+    }
+    auto config = libsarus::json::parse(readData(*configBlob));
+    if(config.HasMember("config") && config["config"].IsObject()) {
+        metadata = common::ImageMetadata{config["config"]};
+    }
+    imageID = stripDigestAlgorithm(configDigest);
+
+    const auto& layers = manifest["layers"];
+    if(layers.Size() == 1 && boost::ends_with(layers[0]["mediaType"].GetString(), ".squashfs")) {
+        rootfs = findOCIBlob(layers[0]["digest"].GetString(), layers[0]["size"].GetUint64());
+    }
+    else {
+        printLog(boost::format("OCI image in SIF file has %d layers: expected a single squashfs layer")
+                    % layers.Size(),
+                 libsarus::LogLevel::INFO);
+    }
+    return true;
+}
+
+/**
+ * Finds the OCI blob with the given digest. Small blobs are identified by hashing their content,
+ * while a large blob (i.e. the squashfs layer) is identified by its size when it is the only
+ * blob of that size, to avoid reading the whole layer once more: its digest is then recorded
+ * in the descriptor and verified when the layer is extracted.
+ */
+boost::optional<SifImage::Descriptor> SifImage::findOCIBlob(const std::string& digest, std::uint64_t size) const {
+    auto hexDigest = stripDigestAlgorithm(digest);
+
+    auto candidates = std::vector<Descriptor>{};
+    for(const auto& descriptor : descriptors) {
+        if(descriptor.dataType == dataOCIBlob && descriptor.size == size) {
+            candidates.push_back(descriptor);
+        }
+    }
+
+    if(candidates.size() == 1 && size > maxJSONSize) {
+        auto candidate = candidates.front();
+        candidate.digest = hexDigest;
+        return candidate;
+    }
+
+    std::ifstream is(file.c_str(), std::ios::binary);
+    for(const auto& candidate : candidates) {
+        auto hash = libsarus::Sha256{};
+        auto remaining = candidate.size;
+        auto offset = candidate.offset;
+        while(remaining > 0) {
+            auto count = std::min(remaining, std::uint64_t{1} << 20);
+            hash.update(readBytes(is, file, offset, count));
+            offset += count;
+            remaining -= count;
+        }
+        if(hash.finalizeHex() == hexDigest) {
+            return candidate;
+        }
+    }
+    return boost::none;
+}
+
+std::string SifImage::readData(const Descriptor& descriptor) const {
+    if(descriptor.size > maxJSONSize) {
+        auto message = boost::format("data object %d is too large (%d bytes)") % descriptor.id % descriptor.size;
+        SARUS_THROW_ERROR(message.str());
+    }
+    std::ifstream is(file.c_str(), std::ios::binary);
+    return readBytes(is, file, descriptor.offset, descriptor.size);
+}
+
+void SifImage::printLog(const boost::format& message, libsarus::LogLevel level,
+                        std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void SifImage::printLog(const std::string& message, libsarus::LogLevel level,
+                        std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
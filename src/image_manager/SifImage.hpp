@@ -0,0 +1,111 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_SifImage_hpp
+#define sarus_image_manger_SifImage_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/ImageMetadata.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Reader of Singularity Image Format (SIF) files.
+ *
+ * A SIF file is made of a global header, a table of descriptors and the data
+ * objects referenced by the descriptors. Images built by Singularity/Apptainer store
+ * the root filesystem as a squashfs "primary system partition", while OCI-SIF images
+ * store an OCI image whose single layer is a squashfs filesystem. In both cases the
+ * squashfs data can be copied verbatim into the Sarus repository, without converting
+ * the image through an OCI layout, unpacking it and rebuilding it with mksquashfs.
+ *
+ * The layout of the header and descriptors follows the SIF specification implemented
+ * by https://github.com/sylabs/sif (all integers are little-endian).
+ */
+class SifImage {
+public:
+    // data object types
+    static const std::int32_t dataDeffile = 0x4001;
+    static const std::int32_t dataEnvVar = 0x4002;
+    static const std::int32_t dataLabels = 0x4003;
+    static const std::int32_t dataPartition = 0x4004;
+    static const std::int32_t dataSignature = 0x4005;
+    static const std::int32_t dataGenericJSON = 0x4006;
+    static const std::int32_t dataGeneric = 0x4007;
+    static const std::int32_t dataCryptoMessage = 0x4008;
+    static const std::int32_t dataSBOM = 0x4009;
+    static const std::int32_t dataOCIRootIndex = 0x400a;
+    static const std::int32_t dataOCIBlob = 0x400b;
+
+    // partition filesystem and partition types
+    static const std::int32_t fsSquash = 1;
+    static const std::int32_t partPrimSys = 2;
+
+    static const size_t headerSize = 128;
+    static const size_t descriptorSize = 585;
+
+    struct Descriptor {
+        std::int32_t dataType = 0;
+        std::uint32_t id = 0;
+        std::uint32_t groupID = 0;
+        std::uint32_t linkedID = 0;
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+        std::string name;
+        std::int32_t fsType = 0;    // only for partitions
+        std::int32_t partType = 0;  // only for partitions
+        std::string digest;         // only for OCI blobs whose content is yet to be verified
+    };
+
+public:
+    SifImage(const boost::filesystem::path& file);
+    const std::vector<Descriptor>& getDescriptors() const { return descriptors; }
+    bool hasSquashfsRootfs() const { return static_cast<bool>(rootfs); }
+    const Descriptor& getRootfsDescriptor() const;
+    std::string getImageID() const { return imageID; }
+    common::ImageMetadata getMetadata() const { return metadata; }
+    void extractRootfs(const boost::filesystem::path& destination) const;
+
+    static bool isSifFile(const boost::filesystem::path& file);
+
+private:
+    void parseHeaderAndDescriptors();
+    void findRootfsAndMetadata();
+    bool findOCIImage();
+    boost::optional<Descriptor> findOCIBlob(const std::string& digest, std::uint64_t size) const;
+    std::string readData(const Descriptor& descriptor) const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    boost::filesystem::path file;
+    std::vector<Descriptor> descriptors;
+    boost::optional<Descriptor> rootfs;
+    common::ImageMetadata metadata;
+    std::string imageID;
+    const std::string sysname = "SifImage";
+};
+
+}
+}
+
+#endif
@@ -16,26 +16,49 @@
 #include "libsarus/Utility.hpp"
 #include "libsarus/Logger.hpp"
 #include "libsarus/PathRAII.hpp"
+#include "image_manager/ImagePlacement.hpp"
 
 
 namespace sarus {
 namespace image_manager {
 
+// The unpacked files keep the timestamps of the image layers: only the creation time
+// of the filesystem changes between conversions (requires squashfs-tools 4.4 or later)
+const libsarus::CLIArguments SquashfsImage::reproducibleArgs = {"-noappend", "-mkfs-time", "0"};
+
 libsarus::CLIArguments SquashfsImage::generateMksquashfsArgs(const common::Config& config,
                                                            const boost::filesystem::path& sourcePath,
-                                                           const boost::filesystem::path& destinationPath) {
+                                                           const boost::filesystem::path& destinationPath,
+                                                           bool isReproducible,
+                                                           const boost::filesystem::path& sortFile) {
     auto mksquashfsPath = boost::filesystem::path(config.json["mksquashfsPath"].GetString());
     auto args = libsarus::CLIArguments{mksquashfsPath.string(), sourcePath.string(), destinationPath.string()};
     if (const rapidjson::Value* configOpts = rapidjson::Pointer("/mksquashfsOptions").Get(config.json)) {
         args.push_back(configOpts->GetString());
     }
+    if (isReproducible) {
+        args += reproducibleArgs;
+    }
+    if (!sortFile.empty()) {
+        args += libsarus::CLIArguments{"-sort", sortFile.string()};
+    }
     return args;
 }
 
+std::string SquashfsImage::getConversionSettings(const common::Config& config) {
+    auto settings = reproducibleArgs.string();
+    if (const rapidjson::Value* options = rapidjson::Pointer("/mksquashfsOptions").Get(config.json)) {
+        settings += std::string{" "} + options->GetString();
+    }
+    return settings;
+}
+
 SquashfsImage::SquashfsImage(const common::Config& config,
                              const boost::filesystem::path& unpackedImage,
-                             const boost::filesystem::path& pathOfImage)
-    : pathOfImage{pathOfImage}
+                             const boost::filesystem::path& pathOfImage,
+                             bool isReproducible,
+                             const boost::optional<AccessProfile>& accessProfile)
+    : FilesystemImage{pathOfImage}
 {
     auto pathTemp = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(pathOfImage)};
     libsarus::filesystem::createFoldersIfNecessary(pathTemp.getPath().parent_path());
@@ -45,11 +68,20 @@ SquashfsImage::SquashfsImage(const common::Config& config,
         libsarus::LogLevel::INFO);
 
     auto start = std::chrono::system_clock::now();
-    
-    auto args = generateMksquashfsArgs(config, unpackedImage, pathTemp.getPath());
+
+    // files accessed together are laid out contiguously, in order of access
+    auto sortFile = libsarus::PathRAII{};
+    if (accessProfile) {
+        sortFile = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(config.directories.temp / "sarus-sort-file")};
+        accessProfile->writeSortFile(unpackedImage, sortFile.getPath());
+    }
+
+    auto args = generateMksquashfsArgs(config, unpackedImage, pathTemp.getPath(), isReproducible,
+                                       accessProfile ? sortFile.getPath() : boost::filesystem::path{});
     auto mksquashfsOutput = libsarus::process::executeCommand(args.string());
     log(boost::format("mksquashfs output:\n%s") % mksquashfsOutput, libsarus::LogLevel::DEBUG);
 
+    ImagePlacement{config}.apply(pathTemp.getPath());
     boost::filesystem::rename(pathTemp.getPath(), pathOfImage); // atomically create/replace squashfs file
     pathTemp.release();
 
@@ -60,10 +92,6 @@ SquashfsImage::SquashfsImage(const common::Config& config,
     log(boost::format("successfully created squashfs file"), libsarus::LogLevel::INFO);
 }
 
-boost::filesystem::path SquashfsImage::getPathOfImage() const {
-    return pathOfImage;
-}
-
 void SquashfsImage::log(const boost::format &message, libsarus::LogLevel level) const {
     libsarus::Logger::getInstance().log(message, "SquashfsImage", level);
 }
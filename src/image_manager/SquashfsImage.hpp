@@ -12,8 +12,11 @@
 #define sarus_image_manger_SquashfsImage_hpp
 
 #include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
 
 #include "common/Config.hpp"
+#include "image_manager/AccessProfile.hpp"
+#include "image_manager/FilesystemImage.hpp"
 
 
 namespace sarus {
@@ -22,22 +25,27 @@ namespace image_manager {
 /**
  * This class builds and represents the squashfs image.
  */
-class SquashfsImage {
+class SquashfsImage : public FilesystemImage {
 public:
+    // settings for byte-identical squashfs files from identical unpacked images
+    static const libsarus::CLIArguments reproducibleArgs;
+
     static libsarus::CLIArguments generateMksquashfsArgs(const common::Config& config,
                                                        const boost::filesystem::path& sourcePath,
-                                                       const boost::filesystem::path& destinationPath);
+                                                       const boost::filesystem::path& destinationPath,
+                                                       bool isReproducible=false,
+                                                       const boost::filesystem::path& sortFile={});
+    static std::string getConversionSettings(const common::Config& config);
 
     SquashfsImage(const common::Config& config,
                   const boost::filesystem::path& unpackedImage,
-                  const boost::filesystem::path& pathOfImage);
-    boost::filesystem::path getPathOfImage() const;
+                  const boost::filesystem::path& pathOfImage,
+                  bool isReproducible=false,
+                  const boost::optional<AccessProfile>& accessProfile=boost::none);
+    std::string getFormat() const override { return squashfsFormat; }
 
 private:
     void log(const boost::format &message, libsarus::LogLevel level) const;
-
-private:
-    boost::filesystem::path pathOfImage;
 };
 
 }
@@ -0,0 +1,244 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/StagedImageRegistry.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/pointer.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+static struct stat statFile(const boost::filesystem::path& file, bool followSymlinks) {
+    struct stat st;
+    auto status = followSymlinks ? ::stat(file.c_str(), &st) : ::lstat(file.c_str(), &st);
+    if(status != 0) {
+        auto message = boost::format("Failed to stat %s: %s") % file % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return st;
+}
+
+static std::uint64_t getModificationTimeNs(const struct stat& st) {
+    return static_cast<std::uint64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+StagedImageRegistry::StagedImageRegistry(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+bool StagedImageRegistry::isEnabled() const {
+    return rj::Pointer("/nodeLocalImageDir").Get(config->json) != nullptr;
+}
+
+boost::filesystem::path StagedImageRegistry::getDirectory() const {
+    if(!isEnabled()) {
+        SARUS_THROW_ERROR("Staging of images on node-local storage is not enabled. Please contact your"
+                          " system administrator to configure the 'nodeLocalImageDir' parameter");
+    }
+    auto baseDir = boost::filesystem::path{rj::Pointer("/nodeLocalImageDir").Get(config->json)->GetString()};
+    return baseDir / std::to_string(config->userIdentity.uid);
+}
+
+boost::filesystem::path StagedImageRegistry::getStagedImageFile(const common::SarusImage& image) const {
+    return getDirectory() / (image.reference.getUniqueKey() + ".squashfs");
+}
+
+void StagedImageRegistry::registerImage(const common::SarusImage& image, const std::string& digest) const {
+    auto stagedFile = getStagedImageFile(image);
+
+    auto stagedStat = statFile(stagedFile, false);
+    auto sourceStat = statFile(image.imageFile, true);
+
+    auto record = rj::Document{rj::kObjectType};
+    auto& allocator = record.GetAllocator();
+    record.AddMember("id", rj::Value{image.id.c_str(), allocator}, allocator);
+    record.AddMember("digest", rj::Value{("sha256:" + digest).c_str(), allocator}, allocator);
+    record.AddMember("size", rj::Value{static_cast<uint64_t>(stagedStat.st_size)}, allocator);
+    record.AddMember("inode", rj::Value{static_cast<uint64_t>(stagedStat.st_ino)}, allocator);
+    record.AddMember("mtime", rj::Value{getModificationTimeNs(stagedStat)}, allocator);
+    record.AddMember("source", rj::Value{image.imageFile.c_str(), allocator}, allocator);
+    record.AddMember("sourceMtime", rj::Value{getModificationTimeNs(sourceStat)}, allocator);
+
+    // write to a temporary file and rename, so that "sarus run" never sees a partial record
+    auto recordFile = getRecordFile(image);
+    auto tempFile = libsarus::filesystem::makeUniquePathWithRandomSuffix(recordFile);
+    libsarus::json::write(record, tempFile);
+    boost::filesystem::rename(tempFile, recordFile);
+
+    printLog(boost::format("Registered staged image %s (sha256:%s)") % stagedFile % digest, libsarus::LogLevel::INFO);
+}
+
+boost::optional<boost::filesystem::path> StagedImageRegistry::findStagedImage(const common::SarusImage& image) const {
+    if(!isEnabled()) {
+        return boost::none;
+    }
+
+    auto recordFile = getRecordFile(image);
+    auto stagedFile = getStagedImageFile(image);
+    if(!boost::filesystem::exists(recordFile) || !boost::filesystem::exists(stagedFile)) {
+        return boost::none;
+    }
+
+    try {
+        auto record = libsarus::json::read(recordFile);
+        auto size = record["size"].GetUint64();
+        auto stagedStat = statFile(stagedFile, false);
+        auto sourceStat = statFile(image.imageFile, true);
+        if(!S_ISREG(stagedStat.st_mode) || stagedStat.st_uid != config->userIdentity.uid) {
+            printLog(boost::format("Ignoring staged image %s: not a regular file owned by the user") % stagedFile,
+                     libsarus::LogLevel::WARN);
+            return boost::none;
+        }
+        if(record["id"].GetString() != image.id
+           || record["source"].GetString() != image.imageFile.string()
+           || static_cast<uint64_t>(stagedStat.st_size) != size
+           || static_cast<uint64_t>(stagedStat.st_ino) != record["inode"].GetUint64()
+           || getModificationTimeNs(stagedStat) != record["mtime"].GetUint64()
+           || static_cast<uint64_t>(sourceStat.st_size) != size
+           || getModificationTimeNs(sourceStat) != record["sourceMtime"].GetUint64()) {
+            printLog(boost::format("Ignoring staged image %s: it does not match the repository image %s")
+                        % stagedFile % image.imageFile,
+                     libsarus::LogLevel::INFO);
+            return boost::none;
+        }
+    }
+    catch(const std::exception& e) {
+        printLog(boost::format("Ignoring staged image %s: failed to read record %s: %s")
+                    % stagedFile % recordFile % e.what(),
+                 libsarus::LogLevel::WARN);
+        return boost::none;
+    }
+
+    printLog(boost::format("Found staged image %s") % stagedFile, libsarus::LogLevel::INFO);
+    return stagedFile;
+}
+
+/**
+ * Returns the key of the transfer of the image within the job. Has to be called with the
+ * identity of the user, which creates the secret file if necessary.
+ */
+std::string StagedImageRegistry::getTransferKey(const common::SarusImage& image, const std::string& jobID) const {
+    auto secretFile = getSecretFile();
+    if(!boost::filesystem::exists(secretFile)) {
+        createSecretFile(secretFile);
+    }
+    auto secret = readSecretFile(secretFile);
+
+    // bind the key to the repository image, so that the nodes only accept the image
+    // they found in the repository metadata
+    auto context = boost::format("sarus-stage\n%s\n%s\n%s\n%d")
+                   % jobID % image.id % image.imageFile.string() % libsarus::filesystem::getFileSize(image.imageFile);
+    auto key = libsarus::Sha256::hmac(secret, context.str());
+    return std::string(key.cbegin(), key.cend());
+}
+
+boost::filesystem::path StagedImageRegistry::getRecordFile(const common::SarusImage& image) const {
+    return getDirectory() / (image.reference.getUniqueKey() + ".staged.json");
+}
+
+boost::filesystem::path StagedImageRegistry::getSecretFile() const {
+    return config->getLocalRepositoryDirectory() / "stage.key";
+}
+
+/**
+ * The nodes of a job may attempt to create the secret file concurrently: the file is
+ * written to a temporary file and hard-linked in place, so that the first node wins
+ * and all the nodes read the same complete secret.
+ */
+void StagedImageRegistry::createSecretFile(const boost::filesystem::path& secretFile) const {
+    libsarus::filesystem::createFoldersIfNecessary(secretFile.parent_path());
+
+    std::random_device device;
+    auto secret = std::string{};
+    for(size_t i=0; i<8; ++i) {
+        secret += (boost::format("%08x") % device()).str();
+    }
+
+    auto tempFile = libsarus::filesystem::makeUniquePathWithRandomSuffix(secretFile);
+    auto fd = ::open(tempFile.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if(fd < 0) {
+        auto message = boost::format("Failed to create %s: %s") % tempFile % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto written = ::write(fd, secret.data(), secret.size());
+    auto writeErrno = errno;
+    ::close(fd);
+    if(written != static_cast<ssize_t>(secret.size())) {
+        ::unlink(tempFile.c_str());
+        auto message = boost::format("Failed to write %s: %s") % tempFile % std::strerror(writeErrno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto status = ::link(tempFile.c_str(), secretFile.c_str());
+    auto linkErrno = errno;
+    ::unlink(tempFile.c_str());
+    if(status != 0 && linkErrno != EEXIST) {
+        auto message = boost::format("Failed to create %s: %s") % secretFile % std::strerror(linkErrno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    printLog(boost::format("Created secret file %s for the transfers of staged images") % secretFile,
+             libsarus::LogLevel::DEBUG);
+}
+
+std::string StagedImageRegistry::readSecretFile(const boost::filesystem::path& secretFile) const {
+    auto fd = ::open(secretFile.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if(fd < 0) {
+        auto message = boost::format("Failed to open %s: %s") % secretFile % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    struct stat st;
+    auto status = ::fstat(fd, &st);
+    if(status != 0 || !S_ISREG(st.st_mode) || st.st_uid != config->userIdentity.uid
+       || (st.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+        ::close(fd);
+        auto message = boost::format("Failed to use secret file %s: it has to be a regular file"
+                                     " owned by the user and not accessible by other users") % secretFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    char buffer[128];
+    auto size = ::read(fd, buffer, sizeof(buffer));
+    ::close(fd);
+    if(size <= 0) {
+        auto message = boost::format("Failed to read %s: the file is empty or unreadable") % secretFile;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return std::string(buffer, static_cast<size_t>(size));
+}
+
+void StagedImageRegistry::printLog(const boost::format& message, libsarus::LogLevel level,
+                                   std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void StagedImageRegistry::printLog(const std::string& message, libsarus::LogLevel level,
+                                   std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
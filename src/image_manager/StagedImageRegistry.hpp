@@ -0,0 +1,73 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_StagedImageRegistry_hpp
+#define sarus_image_manger_StagedImageRegistry_hpp
+
+#include <memory>
+#include <string>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "common/SarusImage.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Keeps track of the node-local copies of repository images created by "sarus stage".
+ *
+ * Each staged image is stored in a per-user subdirectory of the "nodeLocalImageDir"
+ * configured by the system administrator, together with a small record file which
+ * ties the copy to the ID, size and modification time of the repository image it was
+ * created from, and to the inode, size and modification time of the copy itself.
+ * A staged copy is only used as long as it matches the image in the repository and
+ * was not modified after its registration, so that re-pulling or removing an image
+ * never leads to running a stale copy.
+ *
+ * The copies are transferred between the nodes with a key derived from a secret file
+ * in the local repository of the user, which is expected to be on a filesystem shared
+ * by the nodes, and from the Slurm job and the repository image. Only processes of the
+ * user staging the same image within the same job can thus take part in a transfer.
+ */
+class StagedImageRegistry {
+public:
+    StagedImageRegistry(std::shared_ptr<const common::Config> config);
+    bool isEnabled() const;
+    boost::filesystem::path getDirectory() const;
+    boost::filesystem::path getStagedImageFile(const common::SarusImage& image) const;
+    void registerImage(const common::SarusImage& image, const std::string& digest) const;
+    boost::optional<boost::filesystem::path> findStagedImage(const common::SarusImage& image) const;
+    std::string getTransferKey(const common::SarusImage& image, const std::string& jobID) const;
+
+private:
+    boost::filesystem::path getRecordFile(const common::SarusImage& image) const;
+    boost::filesystem::path getSecretFile() const;
+    void createSecretFile(const boost::filesystem::path& secretFile) const;
+    std::string readSecretFile(const boost::filesystem::path& secretFile) const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    const std::string sysname = "StagedImageRegistry";
+};
+
+}
+}
+
+#endif
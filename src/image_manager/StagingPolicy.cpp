@@ -0,0 +1,325 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "image_manager/StagingPolicy.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/statfs.h>
+#include <sys/statvfs.h>
+#include <linux/magic.h>
+
+#include <boost/algorithm/string.hpp>
+#include <rapidjson/pointer.h>
+
+#include "common/SarusImage.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+namespace {
+
+const double defaultExpansionFactor = 3.0;
+const double defaultMemoryBudgetFraction = 0.5;
+
+// cgroup v1 reports the absence of a limit with a huge (page-aligned) value
+const size_t unlimitedCgroupV1Threshold = size_t{1} << 62;
+
+boost::optional<size_t> readCgroupValue(const boost::filesystem::path& file) {
+    if(!boost::filesystem::exists(file)) {
+        return boost::none;
+    }
+    auto content = libsarus::filesystem::readFile(file);
+    boost::algorithm::trim(content);
+    if(content.empty() || content == "max") {
+        return boost::none;
+    }
+    try {
+        return static_cast<size_t>(std::stoull(content));
+    }
+    catch(const std::exception&) {
+        return boost::none;
+    }
+}
+
+/**
+ * Walks the cgroup hierarchy from the given cgroup up to the root of the hierarchy,
+ * since a limit set on any ancestor also applies to the cgroup.
+ */
+boost::optional<size_t> findMinimumHeadroom(const boost::filesystem::path& hierarchyRoot,
+                                            const std::string& cgroup,
+                                            const std::string& limitFile,
+                                            const std::string& usageFile) {
+    auto headroom = boost::optional<size_t>{};
+    auto relativePath = boost::filesystem::path{cgroup}.relative_path();
+    auto directory = hierarchyRoot / relativePath;
+
+    while(true) {
+        auto limit = readCgroupValue(directory / limitFile);
+        if(limit && *limit < unlimitedCgroupV1Threshold) {
+            auto usage = readCgroupValue(directory / usageFile).value_or(0);
+            auto current = *limit > usage ? *limit - usage : size_t{0};
+            headroom = headroom ? std::min(*headroom, current) : current;
+        }
+        if(relativePath.empty()) {
+            break;
+        }
+        relativePath = relativePath.parent_path();
+        directory = hierarchyRoot / relativePath;
+    }
+
+    return headroom;
+}
+
+}
+
+StagingPolicy::StagingPolicy(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+{}
+
+StagingPolicy::Decision StagingPolicy::chooseUnpackDirectory(size_t layersSize) const {
+    auto decision = Decision{};
+    decision.directory = config->directories.temp;
+
+    if(!isEnabled()) {
+        printLog("Staging of the unpacked image on tmpfs is not enabled", libsarus::LogLevel::DEBUG);
+        return decision;
+    }
+
+    decision.estimatedSize = estimateUnpackedSize(layersSize);
+    printLog(boost::format("Estimated size of the unpacked image: %s (compressed layers: %s)")
+                % common::SarusImage::createSizeString(decision.estimatedSize)
+                % common::SarusImage::createSizeString(layersSize),
+             libsarus::LogLevel::INFO);
+
+    if(!config->directories.tempFromCLI.empty()) {
+        printLog(boost::format("Temporary directory %s was specified through the CLI: skipping tmpfs staging")
+                    % config->directories.temp,
+                 libsarus::LogLevel::INFO);
+        return decision;
+    }
+
+    auto memoryBudget = getMemoryBudget();
+    if(memoryBudget) {
+        printLog(boost::format("Memory budget for tmpfs staging: %s")
+                    % common::SarusImage::createSizeString(*memoryBudget),
+                 libsarus::LogLevel::INFO);
+    }
+
+    for(const auto& candidate : getStagingDirectories()) {
+        auto reason = getRejectionReason(candidate, decision.estimatedSize, memoryBudget);
+        if(reason) {
+            printLog(boost::format("Discarded staging directory %s: %s") % candidate % *reason,
+                     libsarus::LogLevel::INFO);
+            continue;
+        }
+        decision.directory = candidate;
+        decision.isMemoryBacked = isMemoryBacked(candidate);
+        printLog(boost::format("Selected staging directory %s") % candidate, libsarus::LogLevel::INFO);
+        return decision;
+    }
+
+    printLog(boost::format("No suitable staging directory found: falling back to temporary directory %s")
+                % config->directories.temp,
+             libsarus::LogLevel::INFO);
+    return decision;
+}
+
+/**
+ * Returns the candidate staging directories, in order of preference.
+ */
+std::vector<boost::filesystem::path> StagingPolicy::getStagingDirectories() const {
+    if(!isEnabled()) {
+        return {};
+    }
+    auto candidates = std::vector<boost::filesystem::path>{"/dev/shm"};
+    if(const rapidjson::Value* directories = rapidjson::Pointer("/tmpfsStaging/directories").Get(config->json)) {
+        candidates.clear();
+        for(const auto& directory : directories->GetArray()) {
+            candidates.emplace_back(directory.GetString());
+        }
+    }
+    return candidates;
+}
+
+size_t StagingPolicy::estimateUnpackedSize(size_t layersSize) const {
+    auto factor = defaultExpansionFactor;
+    if(const rapidjson::Value* value = rapidjson::Pointer("/tmpfsStaging/expansionFactor").Get(config->json)) {
+        factor = value->GetDouble();
+    }
+    return static_cast<size_t>(static_cast<double>(layersSize) * factor);
+}
+
+/**
+ * The budget is a fraction of the memory that can still be used by the process,
+ * i.e. the minimum between the available memory of the node and the headroom
+ * left by the memory cgroup, optionally capped by an absolute amount.
+ * Returns boost::none if no bound could be determined.
+ */
+boost::optional<size_t> StagingPolicy::getMemoryBudget() const {
+    auto usableMemory = readAvailableMemory("/proc/meminfo");
+    auto cgroupHeadroom = readCgroupMemoryHeadroom("/proc/self/cgroup", "/sys/fs/cgroup");
+    if(cgroupHeadroom) {
+        printLog(boost::format("Memory cgroup headroom: %s")
+                    % common::SarusImage::createSizeString(*cgroupHeadroom),
+                 libsarus::LogLevel::DEBUG);
+        usableMemory = usableMemory ? std::min(*usableMemory, *cgroupHeadroom) : *cgroupHeadroom;
+    }
+
+    auto budget = boost::optional<size_t>{};
+    if(usableMemory) {
+        auto fraction = defaultMemoryBudgetFraction;
+        if(const rapidjson::Value* value = rapidjson::Pointer("/tmpfsStaging/memoryBudgetFraction").Get(config->json)) {
+            fraction = value->GetDouble();
+        }
+        budget = static_cast<size_t>(static_cast<double>(*usableMemory) * fraction);
+    }
+
+    if(const rapidjson::Value* value = rapidjson::Pointer("/tmpfsStaging/memoryBudgetMB").Get(config->json)) {
+        auto configuredBudget = static_cast<size_t>(value->GetUint64()) * 1024 * 1024;
+        budget = budget ? std::min(*budget, configuredBudget) : configuredBudget;
+    }
+
+    return budget;
+}
+
+boost::optional<size_t> StagingPolicy::readAvailableMemory(const boost::filesystem::path& meminfo) {
+    std::ifstream is(meminfo.c_str());
+    if(!is) {
+        return boost::none;
+    }
+    auto line = std::string{};
+    while(std::getline(is, line)) {
+        if(!boost::starts_with(line, "MemAvailable:")) {
+            continue;
+        }
+        std::stringstream ss{line.substr(std::strlen("MemAvailable:"))};
+        auto kilobytes = size_t{0};
+        auto unit = std::string{};
+        if(ss >> kilobytes >> unit && unit == "kB") {
+            return kilobytes * 1024;
+        }
+        return boost::none;
+    }
+    return boost::none;
+}
+
+/**
+ * Parses a /proc/<pid>/cgroup file and returns the minimum headroom (limit minus usage)
+ * of the memory controller, for both cgroup v1 and the v2 unified hierarchy.
+ * Returns boost::none if the process is not subject to any memory limit.
+ */
+boost::optional<size_t> StagingPolicy::readCgroupMemoryHeadroom(const boost::filesystem::path& procCgroupFile,
+                                                                const boost::filesystem::path& cgroupRoot) {
+    std::ifstream is(procCgroupFile.c_str());
+    if(!is) {
+        return boost::none;
+    }
+
+    auto headroom = boost::optional<size_t>{};
+    auto line = std::string{};
+    while(std::getline(is, line)) {
+        // format of entries: hierarchy-ID:controller-list:cgroup-path
+        auto firstColon = line.find(':');
+        auto secondColon = line.find(':', firstColon + 1);
+        if(firstColon == std::string::npos || secondColon == std::string::npos) {
+            continue;
+        }
+        auto hierarchyID = line.substr(0, firstColon);
+        auto controllers = std::vector<std::string>{};
+        auto controllersList = line.substr(firstColon + 1, secondColon - firstColon - 1);
+        boost::split(controllers, controllersList, boost::is_any_of(","));
+        auto cgroup = line.substr(secondColon + 1);
+
+        auto current = boost::optional<size_t>{};
+        if(hierarchyID == "0" && controllersList.empty()) {
+            current = findMinimumHeadroom(cgroupRoot, cgroup, "memory.max", "memory.current");
+        }
+        else if(std::find(controllers.cbegin(), controllers.cend(), "memory") != controllers.cend()) {
+            current = findMinimumHeadroom(cgroupRoot / "memory", cgroup,
+                                          "memory.limit_in_bytes", "memory.usage_in_bytes");
+        }
+
+        if(current) {
+            headroom = headroom ? std::min(*headroom, *current) : *current;
+        }
+    }
+    return headroom;
+}
+
+size_t StagingPolicy::getFreeSpace(const boost::filesystem::path& directory) {
+    struct statvfs sb;
+    if(statvfs(directory.c_str(), &sb) != 0) {
+        auto message = boost::format("Failed to statvfs %s: %s") % directory % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return static_cast<size_t>(sb.f_bavail) * static_cast<size_t>(sb.f_frsize);
+}
+
+bool StagingPolicy::isMemoryBacked(const boost::filesystem::path& directory) {
+    struct statfs sb;
+    if(statfs(directory.c_str(), &sb) != 0) {
+        auto message = boost::format("Failed to statfs %s: %s") % directory % std::strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return sb.f_type == TMPFS_MAGIC || sb.f_type == RAMFS_MAGIC;
+}
+
+bool StagingPolicy::isEnabled() const {
+    return rapidjson::Pointer("/tmpfsStaging").Get(config->json) != nullptr;
+}
+
+boost::optional<std::string> StagingPolicy::getRejectionReason(const boost::filesystem::path& candidate,
+                                                               size_t estimatedSize,
+                                                               const boost::optional<size_t>& memoryBudget) const {
+    if(!boost::filesystem::is_directory(candidate)) {
+        return std::string{"not an existing directory"};
+    }
+    if(access(candidate.c_str(), W_OK | X_OK) != 0) {
+        return std::string{"not writable"};
+    }
+
+    auto freeSpace = getFreeSpace(candidate);
+    if(estimatedSize > freeSpace) {
+        return (boost::format("estimated size exceeds free space (%s)")
+                    % common::SarusImage::createSizeString(freeSpace)).str();
+    }
+
+    if(isMemoryBacked(candidate)) {
+        if(!memoryBudget) {
+            return std::string{"memory-backed filesystem and memory budget could not be determined"};
+        }
+        if(estimatedSize > *memoryBudget) {
+            return std::string{"memory-backed filesystem and estimated size exceeds memory budget"};
+        }
+    }
+
+    return boost::none;
+}
+
+void StagingPolicy::printLog(const boost::format& message, libsarus::LogLevel level,
+                             std::ostream& outStream, std::ostream& errStream) const {
+    printLog(message.str(), level, outStream, errStream);
+}
+
+void StagingPolicy::printLog(const std::string& message, libsarus::LogLevel level,
+                             std::ostream& outStream, std::ostream& errStream) const {
+    libsarus::Logger::getInstance().log(message, sysname, level, outStream, errStream);
+}
+
+}
+}
@@ -0,0 +1,79 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_StagingPolicy_hpp
+#define sarus_image_manger_StagingPolicy_hpp
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * Chooses the directory where an OCI image is unpacked before the creation
+ * of the squashfs file.
+ *
+ * When the "tmpfsStaging" configuration object is present, the candidate
+ * directories (by default /dev/shm) are tried in order: a candidate is chosen
+ * if it has enough free space for the estimated unpacked size and, for
+ * memory-backed filesystems, if the estimate also fits within the memory budget.
+ * The budget is bound by the available memory of the node and by the limit
+ * of the memory cgroup of the process, because tmpfs pages are charged to
+ * the cgroup of the writer. Otherwise the temporary directory is used.
+ */
+class StagingPolicy {
+public:
+    struct Decision {
+        boost::filesystem::path directory;
+        size_t estimatedSize = 0;
+        bool isMemoryBacked = false;
+    };
+
+    StagingPolicy(std::shared_ptr<const common::Config> config);
+    Decision chooseUnpackDirectory(size_t layersSize) const;
+    std::vector<boost::filesystem::path> getStagingDirectories() const;
+    size_t estimateUnpackedSize(size_t layersSize) const;
+    boost::optional<size_t> getMemoryBudget() const;
+
+    static boost::optional<size_t> readAvailableMemory(const boost::filesystem::path& meminfo);
+    static boost::optional<size_t> readCgroupMemoryHeadroom(const boost::filesystem::path& procCgroupFile,
+                                                            const boost::filesystem::path& cgroupRoot);
+    static size_t getFreeSpace(const boost::filesystem::path& directory);
+    static bool isMemoryBacked(const boost::filesystem::path& directory);
+
+private:
+    bool isEnabled() const;
+    boost::optional<std::string> getRejectionReason(const boost::filesystem::path& candidate,
+                                                    size_t estimatedSize,
+                                                    const boost::optional<size_t>& memoryBudget) const;
+    void printLog(const boost::format& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+    void printLog(const std::string& message, libsarus::LogLevel level,
+                  std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr) const;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    const std::string sysname = "StagingPolicy";
+};
+
+}
+}
+
+#endif
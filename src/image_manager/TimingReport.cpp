@@ -0,0 +1,153 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "TimingReport.hpp"
+
+#include <algorithm>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+
+TimingReport::ScopedPhase::ScopedPhase(TimingReport& report, const std::string& name)
+    : report{&report}
+    , name{name}
+    , start{Clock::now()}
+{}
+
+TimingReport::ScopedPhase::~ScopedPhase() {
+    // A phase interrupted by an exception is still reported, since knowing
+    // how long it took before failing is useful for diagnostics
+    stop();
+}
+
+void TimingReport::ScopedPhase::stop() {
+    if(isStopped) {
+        return;
+    }
+    isStopped = true;
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / double(1000000);
+    report->addPhase(name, elapsed);
+}
+
+TimingReport::TimingReport(const std::string& operation, const std::string& image)
+    : operation{operation}
+    , image{image}
+    , start{Clock::now()}
+{}
+
+void TimingReport::addPhase(const std::string& name, double seconds) {
+    log(boost::format("Elapsed time on %s: %s [s]") % name % seconds, libsarus::LogLevel::INFO);
+    phases.push_back(Phase{name, seconds});
+}
+
+void TimingReport::setCounter(const std::string& name, size_t bytes) {
+    log(boost::format("Size of %s: %d [bytes]") % name % bytes, libsarus::LogLevel::DEBUG);
+    auto it = std::find_if(counters.begin(), counters.end(), [&name](const std::pair<std::string, size_t>& counter) {
+        return counter.first == name;
+    });
+    if(it != counters.end()) {
+        it->second = bytes;
+    }
+    else {
+        counters.emplace_back(name, bytes);
+    }
+}
+
+/**
+ * Records an estimate of the temporary space currently in use, computed from the sizes
+ * of the artifacts on disk. Only the maximum of the samples is retained.
+ */
+void TimingReport::updateTempUsage(size_t bytes) {
+    peakTempUsage = std::max(peakTempUsage, bytes);
+}
+
+double TimingReport::getTotalSeconds() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / double(1000000);
+}
+
+rj::Document TimingReport::toJSON() const {
+    auto json = rj::Document{rj::kObjectType};
+    auto& allocator = json.GetAllocator();
+
+    json.AddMember("operation", rj::Value{operation.c_str(), allocator}, allocator);
+    json.AddMember("image", rj::Value{image.c_str(), allocator}, allocator);
+    json.AddMember("totalSeconds", rj::Value{getTotalSeconds()}, allocator);
+
+    auto phasesJSON = rj::Value{rj::kArrayType};
+    for(const auto& phase : phases) {
+        auto phaseJSON = rj::Value{rj::kObjectType};
+        phaseJSON.AddMember("name", rj::Value{phase.name.c_str(), allocator}, allocator);
+        phaseJSON.AddMember("seconds", rj::Value{phase.seconds}, allocator);
+        phasesJSON.PushBack(phaseJSON, allocator);
+    }
+    json.AddMember("phases", phasesJSON, allocator);
+
+    auto bytesJSON = rj::Value{rj::kObjectType};
+    for(const auto& counter : counters) {
+        bytesJSON.AddMember(rj::Value{counter.first.c_str(), allocator},
+                            rj::Value{static_cast<uint64_t>(counter.second)},
+                            allocator);
+    }
+    json.AddMember("bytes", bytesJSON, allocator);
+
+    // not sampled when the sizes of the artifacts were not computed
+    if(peakTempUsage > 0) {
+        json.AddMember("estimatedPeakTempBytes", rj::Value{static_cast<uint64_t>(peakTempUsage)}, allocator);
+    }
+
+    return json;
+}
+
+void TimingReport::write(const boost::filesystem::path& file) const {
+    log(boost::format("Writing timing report to %s") % file, libsarus::LogLevel::INFO);
+    try {
+        libsarus::json::write(toJSON(), file);
+    }
+    catch(const libsarus::Error& e) {
+        auto message = boost::format("Failed to write timing report to %s") % file;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+/**
+ * Adds the report to the image metadata file, under the "SarusTimingReport" key.
+ * Other consumers of the metadata file ignore unknown keys.
+ */
+void TimingReport::appendToMetadataFile(const boost::filesystem::path& metadataFile) const {
+    log(boost::format("Appending timing report to metadata file %s") % metadataFile, libsarus::LogLevel::DEBUG);
+    try {
+        auto metadata = libsarus::json::read(metadataFile);
+        auto& allocator = metadata.GetAllocator();
+        auto report = rj::Value{toJSON(), allocator};
+        metadata.RemoveMember("SarusTimingReport");
+        metadata.AddMember("SarusTimingReport", report, allocator);
+        libsarus::json::write(metadata, metadataFile);
+    }
+    catch(const libsarus::Error& e) {
+        auto message = boost::format("Failed to append timing report to metadata file %s") % metadataFile;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+void TimingReport::log(const boost::format& message, libsarus::LogLevel level) const {
+    log(message.str(), level);
+}
+
+void TimingReport::log(const std::string& message, libsarus::LogLevel level) const {
+    libsarus::Logger::getInstance().log(message, "TimingReport", level);
+}
+
+}} // namespace
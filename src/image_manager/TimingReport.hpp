@@ -0,0 +1,93 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_image_manger_TimingReport_hpp
+#define sarus_image_manger_TimingReport_hpp
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Logger.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+
+/**
+ * This class collects the per-phase durations, byte counters and temporary
+ * space usage of an image pull or load, for diagnostic purposes.
+ * Durations are measured with a monotonic clock.
+ */
+class TimingReport {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Measures the duration of a phase from construction to destruction
+     * (or to the explicit call of stop()).
+     */
+    class ScopedPhase {
+    public:
+        ScopedPhase(TimingReport& report, const std::string& name);
+        ScopedPhase(const ScopedPhase&) = delete;
+        ScopedPhase& operator=(const ScopedPhase&) = delete;
+        ~ScopedPhase();
+        void stop();
+
+    private:
+        TimingReport* report;
+        std::string name;
+        Clock::time_point start;
+        bool isStopped = false;
+    };
+
+    struct Phase {
+        std::string name;
+        double seconds;
+    };
+
+    TimingReport(const std::string& operation, const std::string& image);
+
+    void addPhase(const std::string& name, double seconds);
+    void setCounter(const std::string& name, size_t bytes);
+    void updateTempUsage(size_t bytes);
+
+    const std::vector<Phase>& getPhases() const { return phases; }
+    const std::vector<std::pair<std::string, size_t>>& getCounters() const { return counters; }
+    size_t getPeakTempUsage() const { return peakTempUsage; }
+    double getTotalSeconds() const;
+
+    rapidjson::Document toJSON() const;
+    void write(const boost::filesystem::path& file) const;
+    void appendToMetadataFile(const boost::filesystem::path& metadataFile) const;
+
+private:
+    void log(const boost::format& message, libsarus::LogLevel level) const;
+    void log(const std::string& message, libsarus::LogLevel level) const;
+
+private:
+    std::string operation;
+    std::string image;
+    Clock::time_point start;
+    std::vector<Phase> phases;
+    std::vector<std::pair<std::string, size_t>> counters;
+    size_t peakTempUsage = 0;
+};
+
+}
+}
+
+#endif
@@ -10,10 +10,18 @@
 
 #include "image_manager/Utility.hpp"
 
+#include <cerrno>
 #include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 
 #include <boost/predef.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
+#include <boost/archive/iterators/binary_from_base64.hpp>
 #include <boost/archive/iterators/transform_width.hpp>
 
 #include "libsarus/Error.hpp"
@@ -156,6 +164,78 @@ std::string base64Encode(const std::string& input) {
     return ss.str();
 }
 
+std::string base64Decode(const std::string& input) {
+    namespace bai = boost::archive::iterators;
+    typedef std::string::const_iterator iterator_type;
+
+    // Convert base64 characters to 6 bit integers and retrieve a sequence of 8 bit bytes
+    typedef bai::transform_width<bai::binary_from_base64<iterator_type>, 8, 6> base64_dec;
+
+    // Complete the last group of 4 characters with zero bits, which are dropped after decoding
+    auto encoded = boost::trim_right_copy_if(input, boost::is_any_of("="));
+    auto padding = (4 - encoded.size() % 4) % 4;
+    encoded.append(padding, 'A');
+
+    try {
+        auto output = std::string(base64_dec(encoded.cbegin()), base64_dec(encoded.cend()));
+        output.resize(output.size() - std::min(output.size(), padding));
+        return output;
+    }
+    catch(const std::exception& e) {
+        auto message = boost::format("Failed to decode base64 string '%s'") % input;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+/**
+ * Runs the task in a detached grandchild process, which is reparented to init and is
+ * not waited for. The child is waited for, to avoid leaving zombies behind. The task
+ * runs with idle I/O priority and the lowest CPU priority, detached from the terminal
+ * and from the files (and file locks) of the caller. Returns false if the fork failed.
+ */
+bool runInBackgroundProcess(const std::function<void()>& task) {
+    // from linux/ioprio.h, which is not exported by all kernel headers packages
+    const int ioprioWhoProcess = 1;
+    const int ioprioClassIdle = 3;
+    const int ioprioClassShift = 13;
+
+    auto pid = fork();
+    if(pid == -1) {
+        return false;
+    }
+
+    if(pid == 0) {
+        setsid();
+        if(fork() == 0) {
+            auto devNull = open("/dev/null", O_RDWR);
+            if(devNull != -1) {
+                dup2(devNull, STDIN_FILENO);
+                dup2(devNull, STDOUT_FILENO);
+                dup2(devNull, STDERR_FILENO);
+            }
+            for(int fd = STDERR_FILENO + 1, maxFd = sysconf(_SC_OPEN_MAX); fd < maxFd && fd < 65536; ++fd) {
+                close(fd);
+            }
+
+            setpriority(PRIO_PROCESS, 0, 19);
+            syscall(SYS_ioprio_set, ioprioWhoProcess, 0, ioprioClassIdle << ioprioClassShift);
+
+            try {
+                task();
+            }
+            catch(...) {
+                _exit(1);
+            }
+            _exit(0);
+        }
+        _exit(0);
+    }
+
+    int status;
+    while(waitpid(pid, &status, 0) == -1 && errno == EINTR);
+    return true;
+}
+
 void printLog(const boost::format& message, libsarus::LogLevel level,
               std::ostream& outStream, std::ostream& errStream) {
     printLog(message.str(), level, outStream, errStream);
@@ -11,6 +11,7 @@
 #ifndef sarus_image_manger_Utility_hpp
 #define sarus_image_manger_Utility_hpp
 
+#include <functional>
 #include <string>
 
 #include <boost/format.hpp>
@@ -25,6 +26,8 @@ namespace utility {
 rapidjson::Document getCurrentOCIPlatform();
 std::string getPlatformDigestFromOCIIndex(const rapidjson::Document& index, const rapidjson::Document& targetPlatform);
 std::string base64Encode(const std::string& input);
+std::string base64Decode(const std::string& input);
+bool runInBackgroundProcess(const std::function<void()>& task);
 
 void printLog(const boost::format& message, libsarus::LogLevel LogLevel,
               std::ostream& outStream=std::cout, std::ostream& errStream=std::cerr);
@@ -0,0 +1,109 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+#include "image_manager/AccessProfile.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+TEST_GROUP(AccessProfileTestGroup) {
+};
+
+TEST(AccessProfileTestGroup, read) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-access-profile")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto profileFile = testDir.getPath() / "profile.txt";
+
+    libsarus::filesystem::writeTextFile(
+        "# recorded from python3 -c 'import json'\n"
+        "/usr/bin/python3\n"
+        "\n"
+        "  /usr/lib/libpython3.so  \n"
+        "/usr/bin/python3\n"
+        "/usr/lib/python3/json/__init__.py\n",
+        profileFile);
+    auto profile = AccessProfile::read(profileFile);
+    auto expectedFiles = std::vector<boost::filesystem::path>{
+        "/usr/bin/python3",
+        "/usr/lib/libpython3.so",
+        "/usr/lib/python3/json/__init__.py"};
+    CHECK(profile.getFiles() == expectedFiles);
+
+    // relative paths
+    libsarus::filesystem::writeTextFile("/usr/bin/python3\nusr/lib/libpython3.so\n", profileFile);
+    CHECK_THROWS(libsarus::Error, AccessProfile::read(profileFile));
+
+    // missing profile
+    CHECK_THROWS(libsarus::Error, AccessProfile::read(testDir.getPath() / "missing.txt"));
+}
+
+TEST(AccessProfileTestGroup, sort_file) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-access-profile")};
+    auto rootfs = testDir.getPath() / "rootfs";
+    libsarus::filesystem::createFoldersIfNecessary(rootfs / "usr/bin");
+    libsarus::filesystem::createFoldersIfNecessary(rootfs / "usr/lib");
+    libsarus::filesystem::createFileIfNecessary(rootfs / "usr/bin/python3.11");
+    libsarus::filesystem::createFileIfNecessary(rootfs / "usr/lib/libpython3.11.so.1.0");
+    libsarus::filesystem::createFileIfNecessary(rootfs / "usr/lib/file with spaces");
+    boost::filesystem::create_symlink("python3.11", rootfs / "usr/bin/python3");
+    boost::filesystem::create_symlink("/usr/lib/libpython3.11.so.1.0", rootfs / "usr/lib/libpython3.11.so");
+    boost::filesystem::create_symlink("/usr/lib", rootfs / "lib");
+
+    auto profile = AccessProfile{{
+        "/usr/bin/python3",                // relative symlink
+        "/lib/libpython3.11.so",           // absolute symlinks within the rootfs
+        "/usr/bin/python3.11",             // already listed through its symlink
+        "/usr/lib",                        // directory
+        "/usr/lib/missing.so",             // missing file
+        "/usr/lib/file with spaces",       // cannot be represented in the sort file
+        "/usr/bin/../lib/libpython3.11.so.1.0"}};
+
+    auto sortFile = testDir.getPath() / "sort.txt";
+    CHECK_EQUAL(profile.writeSortFile(rootfs, sortFile), 2);
+
+    auto expectedSortFile = (rootfs / "usr/bin/python3.11").string() + " 32767\n"
+                          + (rootfs / "usr/lib/libpython3.11.so.1.0").string() + " 32766\n";
+    CHECK_EQUAL(libsarus::filesystem::readFile(sortFile), expectedSortFile);
+}
+
+TEST(AccessProfileTestGroup, priorities_of_large_profiles) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-access-profile")};
+    auto rootfs = testDir.getPath() / "rootfs";
+    libsarus::filesystem::createFoldersIfNecessary(rootfs);
+
+    auto files = std::vector<boost::filesystem::path>{};
+    for(int i=0; i<AccessProfile::maxPriority + 10; ++i) {
+        auto file = boost::filesystem::path{"/file" + std::to_string(i)};
+        libsarus::filesystem::createFileIfNecessary(rootfs / file);
+        files.push_back(file);
+    }
+
+    auto sortFile = testDir.getPath() / "sort.txt";
+    CHECK_EQUAL(AccessProfile{files}.writeSortFile(rootfs, sortFile), files.size());
+
+    // files beyond the range of priorities keep the lowest positive priority
+    auto lines = std::vector<std::string>{};
+    auto content = libsarus::filesystem::readFile(sortFile);
+    boost::split(lines, content, boost::is_any_of("\n"), boost::token_compress_on);
+    CHECK(boost::ends_with(lines.front(), " 32767"));
+    CHECK(boost::ends_with(lines[AccessProfile::maxPriority - 1], " 1"));
+    CHECK(boost::ends_with(lines[files.size() - 1], " 1"));
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
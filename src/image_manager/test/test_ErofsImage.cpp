@@ -0,0 +1,120 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/ErofsImage.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+TEST_GROUP(ErofsImageTestGroup) {
+};
+
+TEST(ErofsImageTestGroup, testGenerateMkfsErofsArgs) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto& allocator = config.json.GetAllocator();
+
+    auto sourcePath = std::string{"/tmp/test-source-image"};
+    auto destinationPath = std::string{"/tmp/test-destination-image"};
+
+    // mkfs.erofs not configured
+    CHECK_THROWS(libsarus::Error, ErofsImage::generateMkfsErofsArgs(config, sourcePath, destinationPath));
+
+    config.json.AddMember("mkfsErofsPath", rj::Value{"/usr/bin/mkfs.erofs", allocator}, allocator);
+    auto generatedArgs = ErofsImage::generateMkfsErofsArgs(config, sourcePath, destinationPath);
+    auto expectedArgs = libsarus::CLIArguments{"/usr/bin/mkfs.erofs", destinationPath, sourcePath};
+    CHECK(generatedArgs == expectedArgs);
+
+    // compression
+    config.json.AddMember("erofsCompression", rj::Value{"lz4", allocator}, allocator);
+    generatedArgs = ErofsImage::generateMkfsErofsArgs(config, sourcePath, destinationPath);
+    expectedArgs = libsarus::CLIArguments{"/usr/bin/mkfs.erofs", "-zlz4", destinationPath, sourcePath};
+    CHECK(generatedArgs == expectedArgs);
+
+    // chunk-based deduplication of uncompressed images
+    config.json["erofsCompression"].SetString("none", allocator);
+    config.json.AddMember("erofsChunkSizeKB", rj::Value{64}, allocator);
+    generatedArgs = ErofsImage::generateMkfsErofsArgs(config, sourcePath, destinationPath);
+    expectedArgs = libsarus::CLIArguments{"/usr/bin/mkfs.erofs", "--chunksize=65536", destinationPath, sourcePath};
+    CHECK(generatedArgs == expectedArgs);
+
+    // reproducible conversion
+    generatedArgs = ErofsImage::generateMkfsErofsArgs(config, sourcePath, destinationPath, true);
+    expectedArgs = libsarus::CLIArguments{"/usr/bin/mkfs.erofs", "--chunksize=65536",
+                                          "-U", "00000000-0000-0000-0000-000000000000",
+                                          destinationPath, sourcePath};
+    CHECK(generatedArgs == expectedArgs);
+
+    // chunk size not a power of two
+    config.json["erofsChunkSizeKB"].SetUint64(48);
+    CHECK_THROWS(libsarus::Error, ErofsImage::generateMkfsErofsArgs(config, sourcePath, destinationPath));
+}
+
+TEST(ErofsImageTestGroup, testConfiguredFormat) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto& allocator = config.json.GetAllocator();
+
+    CHECK_EQUAL(FilesystemImage::getConfiguredFormat(config), FilesystemImage::squashfsFormat);
+    auto squashfsSettings = FilesystemImage::getConversionSettings(config);
+
+    config.json.AddMember("imageFormat", rj::Value{"erofs", allocator}, allocator);
+    CHECK_EQUAL(FilesystemImage::getConfiguredFormat(config), FilesystemImage::erofsFormat);
+    CHECK_EQUAL(FilesystemImage::getFileExtension(FilesystemImage::erofsFormat), std::string{".erofs"});
+    // images of different formats are told apart in the image pool
+    CHECK(FilesystemImage::getConversionSettings(config) != squashfsSettings);
+
+    config.json["imageFormat"].SetString("ext4", allocator);
+    auto unpackedImage = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-unpackedImage")};
+    libsarus::filesystem::createFoldersIfNecessary(unpackedImage.getPath());
+    CHECK_THROWS(libsarus::Error, FilesystemImage::create(config, unpackedImage.getPath(), config.getImageFile()));
+}
+
+TEST(ErofsImageTestGroup, testErofsImage) {
+    auto mkfsErofsPath = boost::filesystem::path{"/usr/bin/mkfs.erofs"};
+    if(!boost::filesystem::exists(mkfsErofsPath)) {
+        return; // erofs-utils not installed
+    }
+
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto& allocator = config.json.GetAllocator();
+    config.json.AddMember("imageFormat", rj::Value{"erofs", allocator}, allocator);
+    config.json.AddMember("mkfsErofsPath", rj::Value{mkfsErofsPath.c_str(), allocator}, allocator);
+
+    libsarus::PathRAII testDir{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-erofs")};
+    auto unpackedImage = testDir.getPath() / "rootfs";
+    libsarus::filesystem::createFoldersIfNecessary(unpackedImage / "etc");
+    libsarus::filesystem::writeTextFile("alpine", unpackedImage / "etc/hostname");
+
+    auto image = FilesystemImage::create(config, unpackedImage, testDir.getPath() / "image.erofs");
+    CHECK_EQUAL(image->getFormat(), FilesystemImage::erofsFormat);
+    CHECK(boost::filesystem::exists(testDir.getPath() / "image.erofs"));
+
+    // reproducible conversion
+    auto firstImage = testDir.getPath() / "first.erofs";
+    auto secondImage = testDir.getPath() / "second.erofs";
+    ErofsImage{config, unpackedImage, firstImage, true};
+    ErofsImage{config, unpackedImage, secondImage, true};
+    CHECK(libsarus::filesystem::readFile(firstImage) == libsarus::filesystem::readFile(secondImage));
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,220 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <random>
+#include <set>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Sha256.hpp"
+#include "image_manager/ImageBroadcast.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static ImageBroadcast::Topology makeLocalTopology(size_t numberOfNodes, size_t fanout) {
+    // pick a random port range to reduce the likelihood of collisions between concurrent test runs
+    auto generator = std::mt19937{static_cast<std::mt19937::result_type>(getpid())};
+    auto basePort = std::uniform_int_distribution<int>{20000, 40000}(generator);
+
+    auto topology = ImageBroadcast::Topology{};
+    topology.fanout = fanout;
+    for(size_t rank=0; rank<numberOfNodes; ++rank) {
+        topology.peers.push_back(ImageBroadcast::Peer{"localhost", static_cast<std::uint16_t>(basePort + rank)});
+    }
+    return topology;
+}
+
+static boost::filesystem::path getDestination(const boost::filesystem::path& directory, size_t rank) {
+    return directory / ("node-" + std::to_string(rank)) / "image.squashfs";
+}
+
+/**
+ * Simulates the nodes of an allocation as processes on the local machine.
+ * The node with rank 0 runs in the test process, the others in child processes.
+ * Returns the result of rank 0 and the exit statuses of the other nodes.
+ */
+static ImageBroadcast::Result broadcast(const ImageBroadcast::Topology& topology,
+                                        const boost::filesystem::path& source,
+                                        const boost::filesystem::path& directory,
+                                        const std::set<size_t>& failingNodes,
+                                        std::vector<int>& exitStatuses,
+                                        const std::set<size_t>& nodesWithWrongKey = {}) {
+    auto timeout = std::chrono::milliseconds{3000};
+    auto key = std::string{"job key"};
+    auto pids = std::vector<pid_t>{};
+
+    for(size_t rank=0; rank<topology.peers.size(); ++rank) {
+        libsarus::filesystem::createFoldersIfNecessary(getDestination(directory, rank).parent_path());
+    }
+
+    for(size_t rank=1; rank<topology.peers.size(); ++rank) {
+        if(failingNodes.count(rank)) {
+            continue;
+        }
+        auto pid = fork();
+        if(pid == 0) {
+            auto nodeTopology = topology;
+            nodeTopology.rank = rank;
+            try {
+                auto nodeKey = nodesWithWrongKey.count(rank) ? std::string{"another key"} : key;
+                ImageBroadcast{nodeTopology, nodeKey, timeout}.run("", getDestination(directory, rank));
+                _exit(0);
+            }
+            catch(...) {
+                _exit(1);
+            }
+        }
+        pids.push_back(pid);
+    }
+
+    auto rootTopology = topology;
+    rootTopology.rank = 0;
+    auto result = ImageBroadcast{rootTopology, key, timeout}.run(source, getDestination(directory, 0));
+
+    for(auto pid : pids) {
+        int status;
+        waitpid(pid, &status, 0);
+        exitStatuses.push_back(WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+    return result;
+}
+
+TEST_GROUP(ImageBroadcastTestGroup) {
+};
+
+TEST(ImageBroadcastTestGroup, tree_topology) {
+    CHECK(!ImageBroadcast::getParent(0, 4));
+    CHECK_EQUAL(*ImageBroadcast::getParent(1, 4), 0);
+    CHECK_EQUAL(*ImageBroadcast::getParent(4, 4), 0);
+    CHECK_EQUAL(*ImageBroadcast::getParent(5, 4), 1);
+    CHECK_EQUAL(*ImageBroadcast::getParent(20, 4), 4);
+    CHECK_EQUAL(*ImageBroadcast::getParent(21, 4), 5);
+
+    CHECK(ImageBroadcast::getChildren(0, 10, 4) == (std::vector<size_t>{1, 2, 3, 4}));
+    CHECK(ImageBroadcast::getChildren(1, 10, 4) == (std::vector<size_t>{5, 6, 7, 8}));
+    CHECK(ImageBroadcast::getChildren(2, 10, 4) == (std::vector<size_t>{9}));
+    CHECK(ImageBroadcast::getChildren(3, 10, 4).empty());
+    CHECK(ImageBroadcast::getChildren(0, 1, 4).empty());
+
+    // binary tree: every node but the root has exactly one parent
+    for(size_t rank=1; rank<100; ++rank) {
+        auto parent = *ImageBroadcast::getParent(rank, 2);
+        auto siblings = ImageBroadcast::getChildren(parent, 100, 2);
+        CHECK(std::find(siblings.cbegin(), siblings.cend(), rank) != siblings.cend());
+    }
+}
+
+TEST(ImageBroadcastTestGroup, expandHostlist) {
+    CHECK(ImageBroadcast::expandHostlist("nid001") == (std::vector<std::string>{"nid001"}));
+    CHECK(ImageBroadcast::expandHostlist("nid[001-003,007],login1")
+          == (std::vector<std::string>{"nid001", "nid002", "nid003", "nid007", "login1"}));
+    CHECK(ImageBroadcast::expandHostlist("node[8-11]")
+          == (std::vector<std::string>{"node8", "node9", "node10", "node11"}));
+    CHECK(ImageBroadcast::expandHostlist("rack[1-2]-n[1,3]")
+          == (std::vector<std::string>{"rack1-n1", "rack1-n3", "rack2-n1", "rack2-n3"}));
+    CHECK(ImageBroadcast::expandHostlist("a, b").size() == 2);
+
+    CHECK_THROWS(libsarus::Error, ImageBroadcast::expandHostlist("nid[001-003"));
+    CHECK_THROWS(libsarus::Error, ImageBroadcast::expandHostlist("nid[3-1]"));
+    CHECK_THROWS(libsarus::Error, ImageBroadcast::expandHostlist("nid[a-b]"));
+    CHECK_THROWS(libsarus::Error, ImageBroadcast::expandHostlist("nid[0-999999999]"));
+    CHECK_THROWS(libsarus::Error, ImageBroadcast::expandHostlist("nid[0-99999999999999999999]"));
+    CHECK_THROWS(libsarus::Error, ImageBroadcast::expandHostlist("a[0-999]b[0-999]"));
+}
+
+TEST(ImageBroadcastTestGroup, job_port) {
+    auto port = ImageBroadcast::getJobPort("12345.0");
+    CHECK_EQUAL(port, ImageBroadcast::getJobPort("12345.0"));
+    CHECK(port >= ImageBroadcast::defaultPort);
+    CHECK(port < ImageBroadcast::defaultPort + ImageBroadcast::jobPortRange);
+
+    // different jobs are spread over the range
+    auto ports = std::set<std::uint16_t>{};
+    for(size_t job=0; job<100; ++job) {
+        ports.insert(ImageBroadcast::getJobPort(std::to_string(job)));
+    }
+    CHECK(ports.size() > 50);
+}
+
+TEST(ImageBroadcastTestGroup, broadcast_to_many_nodes) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-broadcast")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+
+    // a few chunks plus a partial one
+    auto source = testDir.getPath() / "source.squashfs";
+    auto data = std::string{};
+    auto generator = std::mt19937{42};
+    for(size_t i=0; i<(3<<20) + 12345; ++i) {
+        data.push_back(static_cast<char>(generator()));
+    }
+    libsarus::filesystem::writeTextFile(data, source);
+    auto expectedDigest = libsarus::Sha256::hexDigestOfFile(source);
+
+    auto topology = makeLocalTopology(13, 3);
+    auto exitStatuses = std::vector<int>{};
+    auto result = broadcast(topology, source, testDir.getPath(), {}, exitStatuses);
+
+    CHECK_EQUAL(result.digest, expectedDigest);
+    CHECK_EQUAL(result.bytes, data.size());
+    CHECK_EQUAL(result.stagedNodes, 13);
+    for(auto status : exitStatuses) {
+        CHECK_EQUAL(status, 0);
+    }
+    for(size_t rank=0; rank<13; ++rank) {
+        CHECK_EQUAL(libsarus::Sha256::hexDigestOfFile(getDestination(testDir.getPath(), rank)), expectedDigest);
+    }
+}
+
+TEST(ImageBroadcastTestGroup, missing_node) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-broadcast")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto source = testDir.getPath() / "source.squashfs";
+    libsarus::filesystem::writeTextFile(std::string(100000, 'x'), source);
+
+    // node 1 never starts: its children (4, 5, 6) cannot connect to it
+    auto topology = makeLocalTopology(8, 3);
+    auto exitStatuses = std::vector<int>{};
+    auto result = broadcast(topology, source, testDir.getPath(), {1}, exitStatuses);
+
+    CHECK_EQUAL(result.stagedNodes, 4);
+    auto failures = std::count(exitStatuses.cbegin(), exitStatuses.cend(), 1);
+    CHECK_EQUAL(failures, 3);
+    CHECK(boost::filesystem::exists(getDestination(testDir.getPath(), 7)));
+    CHECK(!boost::filesystem::exists(getDestination(testDir.getPath(), 4)));
+}
+
+TEST(ImageBroadcastTestGroup, unauthenticated_node) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-broadcast")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto source = testDir.getPath() / "source.squashfs";
+    libsarus::filesystem::writeTextFile(std::string(100000, 'x'), source);
+
+    // node 2 doesn't know the key of the transfer: its parent rejects it
+    auto topology = makeLocalTopology(4, 3);
+    auto exitStatuses = std::vector<int>{};
+    auto result = broadcast(topology, source, testDir.getPath(), {}, exitStatuses, {2});
+
+    CHECK_EQUAL(result.stagedNodes, 3);
+    auto failures = std::count(exitStatuses.cbegin(), exitStatuses.cend(), 1);
+    CHECK_EQUAL(failures, 1);
+    CHECK(boost::filesystem::exists(getDestination(testDir.getPath(), 3)));
+    CHECK(!boost::filesystem::exists(getDestination(testDir.getPath(), 2)));
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
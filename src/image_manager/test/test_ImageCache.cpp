@@ -0,0 +1,215 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/ImageCache.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static void setCacheConfig(common::Config& config, const boost::filesystem::path& directory, size_t maxSizeMB) {
+    auto& allocator = config.json.GetAllocator();
+    auto cache = rj::Value{rj::kObjectType};
+    cache.AddMember("directory", rj::Value{directory.c_str(), allocator}, allocator);
+    cache.AddMember("maxSizeMB", rj::Value{static_cast<uint64_t>(maxSizeMB)}, allocator);
+    config.json.AddMember("nodeLocalImageCache", cache, allocator);
+}
+
+static common::SarusImage makeImage(const boost::filesystem::path& repository, const std::string& name, size_t size) {
+    auto imageFile = repository / (name + ".squashfs");
+    libsarus::filesystem::createFoldersIfNecessary(repository);
+    libsarus::filesystem::writeTextFile(std::string(size, name[0]), imageFile);
+    return common::SarusImage{
+        common::ImageReference{"docker.io", "library", name, "latest", ""},
+        "id-of-" + name,
+        common::SarusImage::createSizeString(size),
+        common::SarusImage::createTimeString(0),
+        imageFile,
+        repository / (name + ".meta")};
+}
+
+TEST_GROUP(ImageCacheTestGroup) {
+};
+
+TEST(ImageCacheTestGroup, populate_and_reuse) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-image-cache")};
+    auto image = makeImage(testDir.getPath() / "repository", "alpine", 100000);
+
+    // cache not configured
+    CHECK(!ImageCache{configRAII.config}.getCachedImage(image));
+
+    setCacheConfig(config, testDir.getPath() / "cache", 1);
+    auto cache = ImageCache{configRAII.config};
+    CHECK(cache.getDirectory() == testDir.getPath() / "cache" / std::to_string(config.userIdentity.uid));
+
+    // first use copies the image
+    auto cachedFile = cache.getCachedImage(image);
+    CHECK(cachedFile);
+    CHECK(*cachedFile == cache.getCachedImageFile(image));
+    CHECK(libsarus::filesystem::readFile(*cachedFile) == libsarus::filesystem::readFile(image.imageFile));
+    CHECK_EQUAL(cache.listEntries().size(), 1);
+
+    // second use finds the copy (a new copy would have a recent modification time)
+    auto oldTime = boost::filesystem::last_write_time(*cachedFile) - 100;
+    boost::filesystem::last_write_time(*cachedFile, oldTime);
+    CHECK(*cache.getCachedImage(image) == *cachedFile);
+    CHECK_EQUAL(boost::filesystem::last_write_time(*cachedFile), oldTime);
+
+    // re-pulled image invalidates the copy
+    libsarus::filesystem::writeTextFile(std::string(50000, 'x'), image.imageFile);
+    boost::filesystem::last_write_time(image.imageFile, boost::filesystem::last_write_time(image.imageFile) + 10);
+    cachedFile = cache.getCachedImage(image);
+    CHECK(cachedFile);
+    CHECK(libsarus::filesystem::readFile(*cachedFile) == std::string(50000, 'x'));
+    CHECK_EQUAL(cache.listEntries().size(), 1);
+
+    // different image ID invalidates the copy
+    boost::filesystem::last_write_time(*cachedFile, oldTime);
+    image.id = "other-id";
+    CHECK(*cache.getCachedImage(image) == *cachedFile);
+    CHECK(boost::filesystem::last_write_time(*cachedFile) != oldTime);
+}
+
+TEST(ImageCacheTestGroup, lru_eviction) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-image-cache")};
+    setCacheConfig(config, testDir.getPath() / "cache", 1);
+    auto cache = ImageCache{configRAII.config};
+
+    auto repository = testDir.getPath() / "repository";
+    auto first = makeImage(repository, "first", 400000);
+    auto second = makeImage(repository, "second", 400000);
+    auto third = makeImage(repository, "third", 400000);
+    auto tooLarge = makeImage(repository, "large", 2000000);
+
+    CHECK(cache.getCachedImage(first));
+    CHECK(cache.getCachedImage(second));
+    CHECK_EQUAL(cache.listEntries().size(), 2);
+
+    // make "first" the most recently used entry
+    auto now = std::time(nullptr);
+    for(const auto& entry : cache.listEntries()) {
+        boost::filesystem::last_write_time(entry.recordFile, now - 100);
+    }
+    CHECK(cache.getCachedImage(first));
+    CHECK(cache.listEntries().back().imageFile == cache.getCachedImageFile(first));
+
+    // "second" is evicted to make room for "third"
+    CHECK(cache.getCachedImage(third));
+    auto entries = cache.listEntries();
+    CHECK_EQUAL(entries.size(), 2);
+    CHECK(boost::filesystem::exists(cache.getCachedImageFile(first)));
+    CHECK(!boost::filesystem::exists(cache.getCachedImageFile(second)));
+    CHECK(boost::filesystem::exists(cache.getCachedImageFile(third)));
+
+    // images larger than the cache are used from the repository
+    CHECK(!cache.getCachedImage(tooLarge));
+    CHECK_EQUAL(cache.listEntries().size(), 2);
+}
+
+TEST(ImageCacheTestGroup, concurrent_population) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-image-cache")};
+    setCacheConfig(config, testDir.getPath() / "cache", 64);
+    auto image = makeImage(testDir.getPath() / "repository", "alpine", 8 << 20);
+
+    // simulate the ranks of a job starting together on the node
+    auto pids = std::vector<pid_t>{};
+    for(int rank=0; rank<8; ++rank) {
+        auto pid = fork();
+        if(pid == 0) {
+            auto cachedFile = ImageCache{configRAII.config}.getCachedImage(image);
+            _exit(cachedFile && libsarus::filesystem::getFileSize(*cachedFile) == (8 << 20) ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+    for(auto pid : pids) {
+        int status;
+        waitpid(pid, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    auto cache = ImageCache{configRAII.config};
+    CHECK_EQUAL(cache.listEntries().size(), 1);
+    CHECK(libsarus::filesystem::readFile(cache.getCachedImageFile(image)) == libsarus::filesystem::readFile(image.imageFile));
+    // no leftovers of the copy, the lock is shared by all users
+    CHECK_EQUAL(libsarus::filesystem::countFilesInDirectory(cache.getDirectory()), 2);
+    CHECK(boost::filesystem::exists(cache.getBaseDirectory() / ".lock"));
+}
+
+TEST(ImageCacheTestGroup, erofs_images) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-image-cache")};
+    setCacheConfig(config, testDir.getPath() / "cache", 1);
+    auto cache = ImageCache{configRAII.config};
+    auto image = makeImage(testDir.getPath() / "repository", "alpine", 100000);
+
+    CHECK(cache.getCachedImage(image));
+    auto squashfsFile = cache.getCachedImageFile(image);
+    CHECK_EQUAL(squashfsFile.extension().string(), std::string{".squashfs"});
+
+    // the image is re-pulled with the EROFS format
+    image.format = "erofs";
+    image.id = "other-id";
+    auto cachedFile = cache.getCachedImage(image);
+    CHECK(cachedFile);
+    CHECK_EQUAL(cachedFile->extension().string(), std::string{".erofs"});
+    CHECK(!boost::filesystem::exists(squashfsFile));
+    auto entries = cache.listEntries();
+    CHECK_EQUAL(entries.size(), 1);
+    CHECK(entries[0].imageFile == *cachedFile);
+    CHECK_EQUAL(entries[0].size, 100000);
+}
+
+TEST(ImageCacheTestGroup, entries_of_all_users) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-image-cache")};
+    setCacheConfig(config, testDir.getPath() / "cache", 1);
+    auto cache = ImageCache{configRAII.config};
+    auto image = makeImage(testDir.getPath() / "repository", "alpine", 100000);
+    CHECK(cache.getCachedImage(image));
+
+    // subdirectories not owned by the user they are named after are ignored
+    auto otherUid = config.userIdentity.uid + 1;
+    auto otherDirectory = cache.getBaseDirectory() / std::to_string(otherUid);
+    libsarus::filesystem::createFoldersIfNecessary(otherDirectory);
+    libsarus::filesystem::writeTextFile(std::string(500000, 'x'), otherDirectory / "other.squashfs");
+    libsarus::filesystem::writeTextFile("{}", otherDirectory / "other.cache.json");
+    CHECK_EQUAL(cache.listEntries().size(), 1);
+
+    // the entries of all users are listed
+    auto otherConfigRAII = test_utility::config::makeConfig();
+    setCacheConfig(*otherConfigRAII.config, testDir.getPath() / "cache", 1);
+    otherConfigRAII.config->userIdentity.uid = otherUid;
+    auto otherCache = ImageCache{otherConfigRAII.config};
+    CHECK(otherCache.listEntries().size() == cache.listEntries().size());
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
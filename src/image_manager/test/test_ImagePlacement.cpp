@@ -0,0 +1,158 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/ImagePlacement.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static void addLayout(rj::Value& layouts, size_t minSizeMB, int stripeCount, size_t stripeSizeMB, rj::Document::AllocatorType& allocator) {
+    auto layout = rj::Value{rj::kObjectType};
+    layout.AddMember("minSizeMB", rj::Value{static_cast<uint64_t>(minSizeMB)}, allocator);
+    layout.AddMember("stripeCount", rj::Value{stripeCount}, allocator);
+    if(stripeSizeMB > 0) {
+        layout.AddMember("stripeSizeMB", rj::Value{static_cast<uint64_t>(stripeSizeMB)}, allocator);
+    }
+    layouts.PushBack(layout, allocator);
+}
+
+static void setPlacementConfig(common::Config& config) {
+    auto& allocator = config.json.GetAllocator();
+    auto placement = rj::Value{rj::kObjectType};
+    auto layouts = rj::Value{rj::kArrayType};
+    // layouts are not required to be sorted
+    addLayout(layouts, 4096, -1, 4, allocator);
+    addLayout(layouts, 1, 4, 0, allocator);
+    placement.AddMember("layouts", layouts, allocator);
+    config.json.AddMember("imagePlacement", placement, allocator);
+}
+
+/**
+ * Records the layouts instead of applying them, to test the placement
+ * without a parallel filesystem.
+ */
+class MockBackend : public ImagePlacement::Backend {
+public:
+    std::string getName() const override { return "mock"; }
+    void setLayout(const boost::filesystem::path& file, const ImagePlacement::Layout& layout) override {
+        appliedLayouts.emplace_back(file, layout);
+    }
+    const std::vector<std::pair<boost::filesystem::path, ImagePlacement::Layout>>& getAppliedLayouts() const {
+        return appliedLayouts;
+    }
+
+private:
+    std::vector<std::pair<boost::filesystem::path, ImagePlacement::Layout>> appliedLayouts;
+};
+
+class FailingBackend : public ImagePlacement::Backend {
+public:
+    std::string getName() const override { return "failing"; }
+    void setLayout(const boost::filesystem::path&, const ImagePlacement::Layout&) override {
+        SARUS_THROW_ERROR("layout not supported");
+    }
+};
+
+TEST_GROUP(ImagePlacementTestGroup) {
+};
+
+TEST(ImagePlacementTestGroup, chooseLayout) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+
+    auto placement = ImagePlacement{config};
+    CHECK_FALSE(placement.isEnabled());
+    CHECK_FALSE(placement.chooseLayout(size_t{1} << 30));
+
+    setPlacementConfig(config);
+    placement = ImagePlacement{config};
+    CHECK(placement.isEnabled());
+
+    // smaller than all the layouts
+    CHECK_FALSE(placement.chooseLayout(1024));
+
+    auto layout = placement.chooseLayout(size_t{1} << 20);
+    CHECK_EQUAL(layout->stripeCount, 4);
+    CHECK_EQUAL(layout->stripeSize, 0);
+
+    layout = placement.chooseLayout(size_t{4095} << 20);
+    CHECK_EQUAL(layout->stripeCount, 4);
+
+    layout = placement.chooseLayout(size_t{4096} << 20);
+    CHECK_EQUAL(layout->stripeCount, -1);
+    CHECK_EQUAL(layout->stripeSize, size_t{4} << 20);
+}
+
+TEST(ImagePlacementTestGroup, apply) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    setPlacementConfig(config);
+
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-placement")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto smallImage = testDir.getPath() / "small.squashfs";
+    auto largeImage = testDir.getPath() / "large.squashfs";
+    libsarus::filesystem::writeTextFile(std::string(1024, 's'), smallImage);
+    libsarus::filesystem::writeTextFile(std::string(2 * 1024 * 1024, 'l'), largeImage);
+
+    auto backend = std::make_shared<MockBackend>();
+    auto placement = ImagePlacement{config, backend};
+    placement.apply(smallImage);
+    CHECK(backend->getAppliedLayouts().empty());
+
+    placement.apply(largeImage);
+    CHECK_EQUAL(backend->getAppliedLayouts().size(), 1);
+    CHECK(backend->getAppliedLayouts()[0].first == largeImage);
+    CHECK_EQUAL(backend->getAppliedLayouts()[0].second.stripeCount, 4);
+
+    // failures of the backend leave the image with its default layout
+    ImagePlacement{config, std::make_shared<FailingBackend>()}.apply(largeImage);
+    CHECK(boost::filesystem::exists(largeImage));
+}
+
+TEST(ImagePlacementTestGroup, backends) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    setPlacementConfig(config);
+    auto& allocator = config.json.GetAllocator();
+
+    auto lustre = ImagePlacement::LustreBackend{"/usr/bin/lfs"};
+    auto layout = ImagePlacement::Layout{};
+    layout.stripeCount = 8;
+    CHECK(lustre.generateLfsArgs("/repo/image.squashfs", layout)
+          == libsarus::CLIArguments({"/usr/bin/lfs", "migrate", "-c", "8", "/repo/image.squashfs"}));
+    layout.stripeCount = -1;
+    layout.stripeSize = size_t{4} << 20;
+    CHECK(lustre.generateLfsArgs("/repo/image.squashfs", layout)
+          == libsarus::CLIArguments({"/usr/bin/lfs", "migrate", "-c", "-1", "-S", "4194304", "/repo/image.squashfs"}));
+
+    config.json["imagePlacement"].AddMember("backend", rj::Value{"lustre", allocator}, allocator);
+    ImagePlacement{config};
+    // the mock backend of the tests is only injected through the constructor
+    config.json["imagePlacement"]["backend"].SetString("mock", allocator);
+    CHECK_THROWS(libsarus::Error, ImagePlacement{config});
+    config.json["imagePlacement"]["backend"].SetString("gpfs", allocator);
+    CHECK_THROWS(libsarus::Error, ImagePlacement{config});
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
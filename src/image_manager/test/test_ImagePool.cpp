@@ -0,0 +1,197 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Utility.hpp"
+#include "image_manager/ImagePool.hpp"
+#include "image_manager/ImageStore.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static void setPoolConfig(common::Config& config, const boost::filesystem::path& directory) {
+    auto& allocator = config.json.GetAllocator();
+    auto pool = rj::Value{rj::kObjectType};
+    pool.AddMember("directory", rj::Value{directory.c_str(), allocator}, allocator);
+    config.json.AddMember("imagePool", pool, allocator);
+}
+
+static common::SarusImage makeImage(const ImageStore& imageStore,
+                                    const common::ImageReference& reference,
+                                    const boost::filesystem::path& imageFile) {
+    auto metadataFile = imageStore.getImageMetadataFile(reference);
+    libsarus::filesystem::createFileIfNecessary(imageFile);
+    libsarus::filesystem::createFileIfNecessary(metadataFile);
+    return common::SarusImage{
+        reference,
+        "image-id",
+        common::SarusImage::createSizeString(0),
+        common::SarusImage::createTimeString(0),
+        imageFile,
+        metadataFile};
+}
+
+TEST_GROUP(ImagePoolTestGroup) {
+};
+
+TEST(ImagePoolTestGroup, image_files) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto poolDirectory = config.directories.repository / "pool";
+
+    // pool not configured
+    auto pool = ImagePool{configRAII.config};
+    CHECK_FALSE(pool.isEnabled());
+    CHECK_FALSE(pool.isWritable());
+    CHECK_FALSE(pool.findImage("image-id"));
+    CHECK_FALSE(pool.isPoolImage(poolDirectory / "image-id.squashfs"));
+
+    setPoolConfig(config, poolDirectory);
+    CHECK(pool.isEnabled());
+    libsarus::filesystem::createFoldersIfNecessary(poolDirectory);
+    CHECK(pool.isWritable());
+
+    // image files are keyed by image ID and conversion profile
+    auto profile = pool.getConversionProfile();
+    CHECK_EQUAL(profile.size(), 12);
+    CHECK(pool.getImageFile("image-id") == poolDirectory / ("image-id-" + profile + ".squashfs"));
+    CHECK(pool.isPoolImage(pool.getImageFile("image-id")));
+    CHECK_FALSE(pool.isPoolImage(config.directories.images / "image-id.squashfs"));
+
+    config.json["mksquashfsOptions"].SetString("-comp zstd", config.json.GetAllocator());
+    CHECK(pool.getConversionProfile() != profile);
+
+    // lookup
+    CHECK_FALSE(pool.findImage("image-id"));
+    libsarus::filesystem::createFileIfNecessary(pool.getImageFile("image-id"));
+    boost::filesystem::permissions(pool.getImageFile("image-id"), boost::filesystem::perms(0644));
+    CHECK(*pool.findImage("image-id") == pool.getImageFile("image-id"));
+
+    // image files writable by other users are not trusted
+    boost::filesystem::permissions(pool.getImageFile("image-id"), boost::filesystem::perms(0666));
+    CHECK_FALSE(pool.findImage("image-id"));
+}
+
+TEST(ImagePoolTestGroup, reference_counting) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    setPoolConfig(config, config.directories.repository / "pool");
+    auto pool = ImagePool{configRAII.config};
+    auto imageStore = ImageStore{configRAII.config};
+    auto poolImageFile = pool.getImageFile("image-id");
+
+    // two references to the same pool image
+    auto latest = common::ImageReference{"docker.io", "library", "alpine", "latest", "sha256:alpine-digest"};
+    auto tagged = common::ImageReference{"docker.io", "library", "alpine", "3.18", "sha256:alpine-digest"};
+    imageStore.addImage(makeImage(imageStore, latest, poolImageFile));
+    imageStore.addImage(makeImage(imageStore, tagged, poolImageFile));
+    CHECK_EQUAL(pool.getReferences(poolImageFile).size(), 2);
+
+    // re-adding the same entry does not add references
+    imageStore.addImage(makeImage(imageStore, tagged, poolImageFile));
+    CHECK_EQUAL(pool.getReferences(poolImageFile).size(), 2);
+
+    // the pool image is removed together with its last reference
+    imageStore.removeImage(latest);
+    CHECK_EQUAL(pool.getReferences(poolImageFile).size(), 1);
+    CHECK(boost::filesystem::exists(poolImageFile));
+    imageStore.removeImage(tagged);
+    CHECK(pool.getReferences(poolImageFile).empty());
+    CHECK_FALSE(boost::filesystem::exists(poolImageFile));
+}
+
+TEST(ImagePoolTestGroup, references_of_other_users) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto poolDirectory = config.directories.repository / "pool";
+    setPoolConfig(config, poolDirectory);
+    auto pool = ImagePool{configRAII.config};
+    auto imageStore = ImageStore{configRAII.config};
+    auto poolImageFile = pool.getImageFile("image-id");
+    auto latest = common::ImageReference{"docker.io", "library", "alpine", "latest", "sha256:alpine-digest"};
+    auto tagged = common::ImageReference{"docker.io", "library", "alpine", "3.18", "sha256:alpine-digest"};
+
+    // the owner creates the directory of the references of other users, like /tmp
+    imageStore.addImage(makeImage(imageStore, latest, poolImageFile));
+    auto userReferencesDirectory = poolDirectory / "user-references";
+    CHECK(boost::filesystem::is_directory(userReferencesDirectory));
+    CHECK((boost::filesystem::status(userReferencesDirectory).permissions() & 07777) == 01777);
+
+    // reference of another user, as recorded by a non-owner pull
+    auto otherRepository = config.directories.repository / "other-user";
+    auto otherMetadataFile = otherRepository / "metadata.json";
+    libsarus::filesystem::createFoldersIfNecessary(otherRepository);
+    libsarus::filesystem::createFileIfNecessary(otherMetadataFile);
+    auto userDirectory = userReferencesDirectory / std::to_string(geteuid()) / poolImageFile.stem();
+    libsarus::filesystem::createFoldersIfNecessary(userDirectory);
+    libsarus::filesystem::writeTextFile(otherMetadataFile.string() + "#" + tagged.getUniqueKey(), userDirectory / "reference");
+
+    // the image is kept while referenced by other users
+    imageStore.removeImage(latest);
+    CHECK(boost::filesystem::exists(poolImageFile));
+
+    // stale references (the repository was removed) don't keep the image
+    imageStore.addImage(makeImage(imageStore, latest, poolImageFile));
+    boost::filesystem::remove_all(otherRepository);
+    imageStore.removeImage(latest);
+    CHECK_FALSE(boost::filesystem::exists(poolImageFile));
+
+    // directories not owned by the user they are named after are ignored
+    imageStore.addImage(makeImage(imageStore, latest, poolImageFile));
+    libsarus::filesystem::createFoldersIfNecessary(otherRepository);
+    libsarus::filesystem::createFileIfNecessary(otherMetadataFile);
+    auto spoofedDirectory = userReferencesDirectory / std::to_string(geteuid() + 1) / poolImageFile.stem();
+    libsarus::filesystem::createFoldersIfNecessary(spoofedDirectory);
+    libsarus::filesystem::writeTextFile(otherMetadataFile.string() + "#" + tagged.getUniqueKey(), spoofedDirectory / "reference");
+    imageStore.removeImage(latest);
+    CHECK_FALSE(boost::filesystem::exists(poolImageFile));
+}
+
+TEST(ImagePoolTestGroup, replaced_entries) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    setPoolConfig(config, config.directories.repository / "pool");
+    auto pool = ImagePool{configRAII.config};
+    auto imageStore = ImageStore{configRAII.config};
+    auto reference = common::ImageReference{"docker.io", "library", "alpine", "latest", "sha256:alpine-digest"};
+
+    // an entry moving into the pool releases its repository file
+    auto repositoryImageFile = imageStore.getImageSquashfsFile(reference);
+    imageStore.addImage(makeImage(imageStore, reference, repositoryImageFile));
+    auto poolImageFile = pool.getImageFile("image-id");
+    imageStore.addImage(makeImage(imageStore, reference, poolImageFile));
+    CHECK_FALSE(boost::filesystem::exists(repositoryImageFile));
+    CHECK_EQUAL(pool.getReferences(poolImageFile).size(), 1);
+    CHECK(imageStore.findImage(reference)->imageFile == poolImageFile);
+
+    // an entry referencing another pool image releases the previous one
+    auto otherPoolImageFile = pool.getImageFile("other-image-id");
+    imageStore.addImage(makeImage(imageStore, reference, otherPoolImageFile));
+    CHECK_FALSE(boost::filesystem::exists(poolImageFile));
+    CHECK_EQUAL(pool.getReferences(otherPoolImageFile).size(), 1);
+
+    // entries whose pool image was removed are cleaned up
+    boost::filesystem::remove(otherPoolImageFile);
+    CHECK_FALSE(imageStore.findImage(reference));
+    CHECK(pool.getReferences(otherPoolImageFile).empty());
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
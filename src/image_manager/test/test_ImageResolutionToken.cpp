@@ -0,0 +1,136 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/ImageResolutionToken.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+TEST_GROUP(ImageResolutionTokenTestGroup) {
+};
+
+TEST(ImageResolutionTokenTestGroup, create_and_find) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    config.commandRun.hostEnvironment = {{"SLURM_JOB_ID", "1234"}};
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-image-tokens")};
+
+    auto repositoryImage = config.directories.images / "alpine.squashfs";
+    libsarus::filesystem::createFoldersIfNecessary(repositoryImage.parent_path());
+    libsarus::filesystem::writeTextFile("squashfs image", repositoryImage);
+    auto requestedReference = common::ImageReference{"docker.io", "library", "alpine", "latest", ""};
+    auto image = common::SarusImage{
+        common::ImageReference{"index.docker.io", "library", "alpine", "latest", ""},
+        "1234567890abcdef",
+        common::SarusImage::createSizeString(14),
+        common::SarusImage::createTimeString(0),
+        repositoryImage,
+        config.directories.images / "alpine.meta",
+        "squashfs"};
+
+    auto tokens = ImageResolutionToken{configRAII.config};
+    auto token = tokens.create(requestedReference, image);
+    CHECK(token.find_first_of(" \t\n") == std::string::npos);
+
+    // no token in the environment
+    CHECK(!tokens.findImage(requestedReference));
+
+    // valid token
+    {
+        auto foundImage = tokens.findImage(requestedReference, token);
+        CHECK(foundImage);
+        CHECK(*foundImage == image);
+        CHECK_EQUAL(foundImage->format, std::string{"squashfs"});
+    }
+    // token passed through the environment, together with the token of another image
+    {
+        auto otherReference = common::ImageReference{"docker.io", "library", "ubuntu", "latest", ""};
+        auto otherToken = tokens.create(otherReference, image);
+        config.commandRun.hostEnvironment[ImageResolutionToken::environmentVariable] = otherToken + " " + token;
+        auto foundImage = tokens.findImage(requestedReference);
+        CHECK(foundImage && *foundImage == image);
+    }
+    // token of another image
+    {
+        auto otherReference = common::ImageReference{"docker.io", "library", "alpine", "3.18", ""};
+        CHECK(!tokens.findImage(otherReference, token));
+    }
+    // corrupted tokens
+    {
+        CHECK(!tokens.findImage(requestedReference, "garbage"));
+        CHECK(!tokens.findImage(requestedReference, token.substr(0, token.size() - 1)));
+        auto tamperedToken = token;
+        tamperedToken[10] = tamperedToken[10] == 'A' ? 'B' : 'A';
+        CHECK(!tokens.findImage(requestedReference, tamperedToken));
+    }
+    // token of another job
+    {
+        config.commandRun.hostEnvironment["SLURM_JOB_ID"] = "5678";
+        CHECK(!tokens.findImage(requestedReference, token));
+        config.commandRun.hostEnvironment["SLURM_JOB_ID"] = "1234";
+    }
+    // token of another user
+    {
+        auto uid = config.userIdentity.uid;
+        config.userIdentity.uid = uid + 1;
+        CHECK(!tokens.findImage(requestedReference, token));
+        config.userIdentity.uid = uid;
+    }
+    // token of another repository
+    {
+        config.directories.initialize(true, config);
+        CHECK(!tokens.findImage(requestedReference, token));
+        config.directories.initialize(false, config);
+        CHECK(tokens.findImage(requestedReference, token));
+    }
+    // forged tokens of files which are not images of the repository
+    {
+        auto userFile = testDir.getPath() / "user.squashfs";
+        libsarus::filesystem::writeTextFile("squashfs image", userFile);
+        auto forgedImage = image;
+        forgedImage.imageFile = userFile;
+        CHECK(!tokens.findImage(requestedReference, tokens.create(requestedReference, forgedImage)));
+
+        auto symlink = config.directories.images / "link.squashfs";
+        boost::filesystem::create_symlink(userFile, symlink);
+        forgedImage.imageFile = symlink;
+        CHECK(!tokens.findImage(requestedReference, tokens.create(requestedReference, forgedImage)));
+
+        forgedImage = image;
+        forgedImage.format = "";
+        CHECK(!tokens.findImage(requestedReference, tokens.create(requestedReference, forgedImage)));
+        forgedImage.format = "ext4";
+        CHECK(!tokens.findImage(requestedReference, tokens.create(requestedReference, forgedImage)));
+    }
+    // image file replaced after the creation of the token
+    {
+        boost::filesystem::remove(repositoryImage);
+        libsarus::filesystem::writeTextFile("new squashfs image", repositoryImage);
+        CHECK(!tokens.findImage(requestedReference, token));
+    }
+    // image file removed
+    {
+        boost::filesystem::remove(repositoryImage);
+        CHECK(!tokens.findImage(requestedReference, token));
+        CHECK_THROWS(libsarus::Error, tokens.create(requestedReference, image));
+    }
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
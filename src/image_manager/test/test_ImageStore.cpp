@@ -15,6 +15,7 @@
 
 #include "test_utility/config.hpp"
 #include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
 #include "image_manager/ImageStore.hpp" 
 #include "test_utility/unittest_main_function.hpp"
 
@@ -120,6 +121,49 @@ TEST(ImageStoreTestGroup, getImageID) {
     CHECK(imageStore.getImageID(metadata).empty());
 }
 
+TEST(ImageStoreTestGroup, imageFormat) {
+    // entries created before the introduction of the image formats refer to squashfs images
+    auto image = imageVector[0];
+    addImageHarness(imageStore, image);
+    CHECK_EQUAL(imageStore.findImage(image.reference)->format, std::string{"squashfs"});
+
+    image.imageFile = imageStore.getImageFile(image.reference, "erofs");
+    image.format = "erofs";
+    CHECK_EQUAL(image.imageFile.extension().string(), std::string{".erofs"});
+    addImageHarness(imageStore, image);
+    CHECK_EQUAL(imageStore.findImage(image.reference)->format, std::string{"erofs"});
+    CHECK(imageStore.findImage(image.reference)->imageFile == image.imageFile);
+}
+
+TEST(ImageStoreTestGroup, invalid_entries) {
+    // the format and the file of the images are mounted as root: the values written
+    // by users into the repository metadata are only accepted if they are valid
+    auto image = imageVector[0];
+    image.format = "ext4";
+    addImageHarness(imageStore, image);
+    CHECK_THROWS(libsarus::Error, imageStore.findImage(image.reference));
+    CHECK(imageStore.listImages().empty());
+
+    auto outsideDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-outside-repository")};
+    image = imageVector[1];
+    image.imageFile = outsideDir.getPath() / "image.squashfs";
+    libsarus::filesystem::createFoldersIfNecessary(outsideDir.getPath());
+    addImageHarness(imageStore, image);
+    CHECK_THROWS(libsarus::Error, imageStore.findImage(image.reference));
+
+    // symlinks are resolved
+    image = imageVector[2];
+    libsarus::filesystem::createFoldersIfNecessary(image.imageFile.parent_path());
+    boost::filesystem::create_symlink(outsideDir.getPath() / "image.squashfs", image.imageFile);
+    imageStore.addImage(image);
+    libsarus::filesystem::createFileIfNecessary(image.metadataFile);
+    CHECK_THROWS(libsarus::Error, imageStore.findImage(image.reference));
+
+    addImageHarness(imageStore, imageVector[3]);
+    CHECK(imageStore.findImage(imageVector[3].reference).value() == imageVector[3]);
+    CHECK_EQUAL(imageStore.listImages().size(), 1u);
+}
+
 TEST(ImageStoreTestGroup, findImage) {
     // add images and create dummy backing files
     for (const auto& image : imageVector) {
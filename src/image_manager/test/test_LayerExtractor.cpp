@@ -0,0 +1,342 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/LayerExtractor.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static const time_t testMtime = 1000000;
+
+/**
+ * Minimal writer of ustar archives, used to craft layers with
+ * contents that regular tar tools would refuse to produce
+ */
+class TarBuilder {
+public:
+    TarBuilder& file(const std::string& name, const std::string& data, mode_t mode=0644) {
+        addEntry(name, '0', data, mode);
+        return *this;
+    }
+    TarBuilder& directory(const std::string& name, mode_t mode=0755) {
+        addEntry(name, '5', "", mode);
+        return *this;
+    }
+    TarBuilder& symlink(const std::string& name, const std::string& target) {
+        addEntry(name, '2', "", 0777, target);
+        return *this;
+    }
+    TarBuilder& hardlink(const std::string& name, const std::string& target) {
+        addEntry(name, '1', "", 0644, target);
+        return *this;
+    }
+    TarBuilder& longFile(const std::string& name, const std::string& data) {
+        // GNU long name extension
+        addEntry("././@LongLink", 'L', name + std::string(1, '\0'), 0644);
+        addEntry(name.substr(0, 99), '0', data, 0644);
+        return *this;
+    }
+    TarBuilder& corruptLastChecksum() {
+        archive[archive.size() - lastHeaderSize + 148] ^= 1;
+        return *this;
+    }
+    std::string build() const {
+        return archive + std::string(2*512, '\0');
+    }
+
+private:
+    void addEntry(const std::string& name, char type, const std::string& data, mode_t mode, const std::string& linkname="") {
+        char header[512];
+        memset(header, 0, sizeof(header));
+        strncpy(header, name.c_str(), 100);
+        snprintf(header + 100, 8, "%07o", mode);
+        snprintf(header + 108, 8, "%07o", 0);
+        snprintf(header + 116, 8, "%07o", 0);
+        snprintf(header + 124, 12, "%011lo", static_cast<unsigned long>(data.size()));
+        snprintf(header + 136, 12, "%011lo", static_cast<unsigned long>(testMtime));
+        memset(header + 148, ' ', 8);
+        header[156] = type;
+        strncpy(header + 157, linkname.c_str(), 100);
+        memcpy(header + 257, "ustar", 6);
+        memcpy(header + 263, "00", 2);
+        unsigned int checksum = 0;
+        for(size_t i=0; i<sizeof(header); ++i) {
+            checksum += static_cast<unsigned char>(header[i]);
+        }
+        snprintf(header + 148, 8, "%06o", checksum);
+
+        auto paddedData = data + std::string((512 - data.size() % 512) % 512, '\0');
+        lastHeaderSize = 512 + paddedData.size();
+        archive += std::string(header, sizeof(header)) + paddedData;
+    }
+
+private:
+    std::string archive;
+    size_t lastHeaderSize = 0;
+};
+
+/**
+ * Creates an OCI image layout with the given layers
+ */
+static void createImage(const boost::filesystem::path& imageDir, const std::vector<std::string>& layers, bool compress=true) {
+    auto blobsDir = imageDir / "blobs/sha256";
+    libsarus::filesystem::createFoldersIfNecessary(blobsDir);
+
+    auto manifest = rj::Document{rj::kObjectType};
+    auto& allocator = manifest.GetAllocator();
+    auto layersJSON = rj::Value{rj::kArrayType};
+    for(size_t i=0; i<layers.size(); ++i) {
+        auto hash = "layer" + std::to_string(i);
+        auto blob = blobsDir / hash;
+        if(compress) {
+            auto file = gzopen(blob.c_str(), "wb");
+            gzwrite(file, layers[i].data(), layers[i].size());
+            gzclose(file);
+        }
+        else {
+            libsarus::filesystem::writeTextFile(layers[i], blob);
+        }
+        auto layer = rj::Value{rj::kObjectType};
+        layer.AddMember("digest", rj::Value{("sha256:" + hash).c_str(), allocator}, allocator);
+        layer.AddMember("size", rj::Value{static_cast<uint64_t>(boost::filesystem::file_size(blob))}, allocator);
+        layersJSON.PushBack(layer, allocator);
+    }
+    manifest.AddMember("layers", layersJSON, allocator);
+    libsarus::json::write(manifest, blobsDir / "manifest");
+
+    libsarus::filesystem::writeTextFile("{\"schemaVersion\": 2, \"manifests\": [{\"digest\": \"sha256:manifest\"}]}",
+                                        imageDir / "index.json");
+}
+
+static void unpack(const std::vector<std::string>& layers, const boost::filesystem::path& unpackDir,
+                   size_t threads=4, bool compress=true) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& allocator = configRAII.config->json.GetAllocator();
+    configRAII.config->json.AddMember("unpackThreads", rj::Value{static_cast<unsigned>(threads)}, allocator);
+
+    auto imageDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-oci-image")};
+    createImage(imageDir.getPath(), layers, compress);
+
+    libsarus::filesystem::createFoldersIfNecessary(unpackDir);
+    LayerExtractor{configRAII.config}.unpack(imageDir.getPath(), unpackDir);
+}
+
+static libsarus::PathRAII makeRootfsPath() {
+    return libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-unpack")};
+}
+
+static mode_t getMode(const boost::filesystem::path& path) {
+    struct stat st;
+    lstat(path.c_str(), &st);
+    return st.st_mode & 07777;
+}
+
+static bool pathExists(const boost::filesystem::path& path) {
+    struct stat st;
+    return lstat(path.c_str(), &st) == 0;
+}
+
+TEST_GROUP(LayerExtractorTestGroup) {
+};
+
+TEST(LayerExtractorTestGroup, regular_entries) {
+    auto layer = TarBuilder{}
+        .directory("./")
+        .directory("etc/", 0750)
+        .file("etc/hostname", "container\n", 0640)
+        .file("bin/tool", "#!/bin/sh\n", 0755)
+        .symlink("usr/bin", "/bin")
+        .hardlink("etc/hostname-link", "etc/hostname")
+        .build();
+    auto rootfs = makeRootfsPath();
+    unpack({layer}, rootfs.getPath());
+    const auto& root = rootfs.getPath();
+
+    CHECK_EQUAL(libsarus::filesystem::readFile(root / "etc/hostname"), std::string{"container\n"});
+    CHECK_EQUAL(getMode(root / "etc"), 0750);
+    CHECK_EQUAL(getMode(root / "etc/hostname"), 0640);
+    CHECK_EQUAL(getMode(root / "bin/tool"), 0755);
+    CHECK(boost::filesystem::is_symlink(root / "usr/bin"));
+    CHECK_EQUAL(boost::filesystem::read_symlink(root / "usr/bin").string(), std::string{"/bin"});
+    CHECK(boost::filesystem::equivalent(root / "etc/hostname", root / "etc/hostname-link"));
+    CHECK_EQUAL(boost::filesystem::last_write_time(root / "etc/hostname"), testMtime);
+    CHECK_EQUAL(boost::filesystem::last_write_time(root / "etc"), testMtime);
+
+    // rootless mode: everything is owned by the unpacking user
+    uid_t uid; gid_t gid;
+    std::tie(uid, gid) = libsarus::filesystem::getOwner(root / "etc/hostname");
+    CHECK_EQUAL(uid, geteuid());
+}
+
+TEST(LayerExtractorTestGroup, whiteouts) {
+    auto lower = TarBuilder{}
+        .file("a/removed", "x")
+        .file("a/kept", "x")
+        .file("opaque/lower-file", "x")
+        .file("opaque/subdir/lower-file", "x")
+        .build();
+    auto upper = TarBuilder{}
+        .file("a/.wh.removed", "")
+        .file("opaque/subdir/upper-file", "x")
+        .file("opaque/.wh..wh..opq", "")
+        .file("opaque/upper-file", "x")
+        .file("nonexistent/.wh.file", "")
+        .build();
+    auto rootfs = makeRootfsPath();
+    unpack({lower, upper}, rootfs.getPath());
+    const auto& root = rootfs.getPath();
+
+    CHECK(!pathExists(root / "a/removed"));
+    CHECK(!pathExists(root / "a/.wh.removed"));
+    CHECK(pathExists(root / "a/kept"));
+    CHECK(!pathExists(root / "opaque/lower-file"));
+    CHECK(!pathExists(root / "opaque/subdir/lower-file"));
+    CHECK(!pathExists(root / "opaque/.wh..wh..opq"));
+    CHECK(pathExists(root / "opaque/upper-file"));
+    CHECK(pathExists(root / "opaque/subdir/upper-file"));
+}
+
+TEST(LayerExtractorTestGroup, replacements) {
+    auto lower = TarBuilder{}
+        .file("file-to-dir", "x")
+        .file("dir-to-file/content", "x")
+        .file("overwritten", "old", 0400)
+        .build();
+    auto upper = TarBuilder{}
+        .directory("file-to-dir/")
+        .file("file-to-dir/content", "new")
+        .file("dir-to-file", "new")
+        .file("overwritten", "new")
+        .build();
+    auto rootfs = makeRootfsPath();
+    unpack({lower, upper}, rootfs.getPath());
+    const auto& root = rootfs.getPath();
+
+    CHECK(boost::filesystem::is_directory(root / "file-to-dir"));
+    CHECK_EQUAL(libsarus::filesystem::readFile(root / "file-to-dir/content"), std::string{"new"});
+    CHECK(boost::filesystem::is_regular_file(root / "dir-to-file"));
+    CHECK_EQUAL(libsarus::filesystem::readFile(root / "overwritten"), std::string{"new"});
+    CHECK_EQUAL(getMode(root / "overwritten"), 0644);
+}
+
+TEST(LayerExtractorTestGroup, confinement_within_rootfs) {
+    auto outsideFile = libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-outside");
+    auto layer = TarBuilder{}
+        .file("../../../.." + outsideFile.string(), "x")
+        .symlink("escape", "/../../../../tmp")
+        .file("escape/" + outsideFile.filename().string(), "x")
+        .symlink("relative-escape", "../../../../../tmp")
+        .file("relative-escape/" + outsideFile.filename().string() + "-relative", "x")
+        .build();
+    auto rootfs = makeRootfsPath();
+    unpack({layer}, rootfs.getPath());
+    const auto& root = rootfs.getPath();
+
+    CHECK(!pathExists(outsideFile));
+    CHECK(!pathExists(outsideFile.string() + "-relative"));
+    CHECK(pathExists(root / outsideFile));
+    CHECK(pathExists(root / (outsideFile.string() + "-relative")));
+}
+
+TEST(LayerExtractorTestGroup, restrictive_permissions) {
+    auto lower = TarBuilder{}
+        .directory("readonly/", 0555)
+        .file("readonly/lower", "x", 0444)
+        .build();
+    auto upper = TarBuilder{}
+        .file("readonly/upper", "x")
+        .file("readonly/.wh.lower", "")
+        .build();
+    auto rootfs = makeRootfsPath();
+    unpack({lower, upper}, rootfs.getPath());
+    const auto& root = rootfs.getPath();
+
+    CHECK(pathExists(root / "readonly/upper"));
+    CHECK(!pathExists(root / "readonly/lower"));
+    CHECK_EQUAL(getMode(root / "readonly"), 0555);
+
+    // allow the cleanup of the test directory
+    chmod((root / "readonly").c_str(), 0755);
+}
+
+TEST(LayerExtractorTestGroup, long_names) {
+    auto longName = std::string(120, 'd') + "/" + std::string(150, 'f');
+    auto layer = TarBuilder{}
+        .longFile(longName, "long")
+        .build();
+    auto rootfs = makeRootfsPath();
+    unpack({layer}, rootfs.getPath());
+    CHECK_EQUAL(libsarus::filesystem::readFile(rootfs.getPath() / longName), std::string{"long"});
+}
+
+TEST(LayerExtractorTestGroup, uncompressed_layers_and_thread_counts) {
+    auto layers = std::vector<std::string>{};
+    for(int i=0; i<8; ++i) {
+        layers.push_back(TarBuilder{}
+            .file("shared", std::to_string(i))
+            .file("layer" + std::to_string(i), "x")
+            .build());
+    }
+
+    for(auto threads : {1, 3, 8}) {
+        for(auto compress : {true, false}) {
+            auto rootfs = makeRootfsPath();
+            unpack(layers, rootfs.getPath(), threads, compress);
+            // layers must be applied in order regardless of the decompression order
+            CHECK_EQUAL(libsarus::filesystem::readFile(rootfs.getPath() / "shared"), std::string{"7"});
+            CHECK_EQUAL(libsarus::filesystem::countFilesInDirectory(rootfs.getPath()), 9);
+        }
+    }
+}
+
+TEST(LayerExtractorTestGroup, corrupted_layer) {
+    auto layer = TarBuilder{}
+        .file("file", "x")
+        .corruptLastChecksum()
+        .build();
+    auto rootfs = makeRootfsPath();
+    CHECK_THROWS(libsarus::Error, unpack({layer}, rootfs.getPath()));
+}
+
+TEST(LayerExtractorTestGroup, number_of_threads) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto extractor = LayerExtractor{configRAII.config};
+    CHECK(extractor.getNumberOfThreads(1) == 1);
+    CHECK(extractor.getNumberOfThreads(0) == 1);
+
+    auto& allocator = configRAII.config->json.GetAllocator();
+    configRAII.config->json.AddMember("unpackThreads", rj::Value{2u}, allocator);
+    CHECK(extractor.getNumberOfThreads(10) == 2);
+    CHECK(extractor.getNumberOfThreads(1) == 1);
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
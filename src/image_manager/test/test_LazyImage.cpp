@@ -0,0 +1,320 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+#include "image_manager/BlobSource.hpp"
+#include "image_manager/ChunkCache.hpp"
+#include "image_manager/EStargzIndex.hpp"
+#include "image_manager/LazyImage.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static std::string sha256Digest(const std::string& data) {
+    auto sha256 = libsarus::Sha256{};
+    sha256.update(data);
+    return "sha256:" + sha256.finalizeHex();
+}
+
+static std::string gzipMember(const std::string& data) {
+    auto stream = z_stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    auto output = std::string(deflateBound(&stream, data.size()) + 32, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = output.size();
+    deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return output;
+}
+
+// empty gzip member with the offset of the TOC in the extra field, as written by the eStargz converter
+static std::string makeFooter(std::uint64_t tocOffset) {
+    auto footer = std::string{"\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff", 10};
+    footer += std::string{"\x1a\x00" "SG" "\x16\x00", 6};
+    footer += (boost::format("%016xSTARGZ") % tocOffset).str();
+    footer += std::string{"\x01\x00\x00\xff\xff", 5};
+    footer += std::string(8, '\0');
+    return footer;
+}
+
+static std::string makeTOCTar(const std::string& toc) {
+    auto header = std::string(512, '\0');
+    std::strcpy(&header[0], "stargz.index.json");
+    std::snprintf(&header[124], 12, "%011o", static_cast<unsigned>(toc.size()));
+    header[156] = '0';
+    auto padding = std::string((512 - toc.size() % 512) % 512, '\0');
+    return header + toc + padding + std::string(1024, '\0');
+}
+
+/**
+ * eStargz layer with a directory, a small file, a file split in two chunks,
+ * a symlink, a hard link and the prefetch landmark
+ */
+class EStargzLayer {
+public:
+    EStargzLayer(const boost::filesystem::path& ociLayout, bool isTOCDigestAnnotated=true, bool hasChunkDigests=true)
+        : ociLayout{ociLayout}
+    {
+        // the tar headers precede the gzip members of the data and are not read by lazy pulls
+        blob = gzipMember(std::string(1024, 'h'));
+        auto helloOffset = append(hello);
+        auto bigOffset = append(bigFirstChunk);
+        auto bigSecondOffset = append(bigSecondChunk);
+        auto landmarkOffset = append("f");
+
+        auto toc = boost::format(R"({"version": 1, "entries": [)"
+            R"({"name": "bin/", "type": "dir", "mode": 493, "modtime": "2023-05-01T12:00:00Z"},)"
+            R"({"name": "bin/hello", "type": "reg", "size": %d, "mode": 420, "offset": %d, "chunkDigest": "%s",)"
+            R"( "modtime": "2023-05-01T12:00:00Z", "xattrs": {"user.origin": "ZXN0YXJneg=="}},)"
+            R"({"name": "bin/big", "type": "reg", "size": %d, "mode": 493, "offset": %d, "chunkSize": %d, "chunkDigest": "%s"},)"
+            R"({"name": "bin/big", "type": "chunk", "offset": %d, "chunkOffset": %d, "chunkSize": %d%s},)"
+            R"({"name": "bin/sh", "type": "symlink", "linkName": "hello"},)"
+            R"({"name": "bin/hello-link", "type": "hardlink", "linkName": "bin/hello"},)"
+            R"({"name": ".prefetch.landmark", "type": "reg", "size": 1, "offset": %d, "chunkDigest": "%s"}]})")
+            % hello.size() % helloOffset % sha256Digest(hello)
+            % (bigFirstChunk.size() + bigSecondChunk.size()) % bigOffset % bigFirstChunk.size() % sha256Digest(bigFirstChunk)
+            % bigSecondOffset % bigFirstChunk.size() % bigSecondChunk.size()
+            % (hasChunkDigests ? R"(, "chunkDigest": ")" + sha256Digest(bigSecondChunk) + "\"" : std::string{})
+            % landmarkOffset % sha256Digest("f");
+        tocJSON = toc.str();
+        tocOffset = blob.size();
+        blob += gzipMember(makeTOCTar(tocJSON));
+        blob += makeFooter(tocOffset);
+
+        digest = sha256Digest(blob);
+        auto blobFile = ociLayout / "blobs/sha256" / digest.substr(7);
+        libsarus::filesystem::createFoldersIfNecessary(blobFile.parent_path());
+        libsarus::filesystem::writeTextFile(blob, blobFile);
+
+        auto annotation = isTOCDigestAnnotated
+            ? (boost::format(R"(, "annotations": {"%s": "%s"})") % LazyImage::tocDigestAnnotation % sha256Digest(tocJSON)).str()
+            : std::string{};
+        manifest = (boost::format(R"({"schemaVersion": 2, "layers": [{"digest": "%s", "size": %d%s}]})")
+            % digest % blob.size() % annotation).str();
+    }
+
+    std::string hello = "hello world\n";
+    std::string bigFirstChunk = std::string(100000, 'a');
+    std::string bigSecondChunk = std::string(50000, 'b');
+    std::string blob;
+    std::string digest;
+    std::string tocJSON;
+    std::uint64_t tocOffset;
+    std::string manifest;
+
+private:
+    std::uint64_t append(const std::string& data) {
+        auto offset = blob.size();
+        blob += gzipMember(data);
+        return offset;
+    }
+
+private:
+    boost::filesystem::path ociLayout;
+};
+
+// registry stand-in which is not reachable anymore
+class UnreachableBlobSource : public BlobSource {
+public:
+    std::string getDescription() const override { return "unreachable"; }
+    std::string readRange(const std::string&, std::uint64_t, std::uint64_t) const override {
+        SARUS_THROW_ERROR("registry is unreachable");
+    }
+    std::string readBlob(const std::string&) const override {
+        SARUS_THROW_ERROR("registry is unreachable");
+    }
+};
+
+TEST_GROUP(LazyImageTestGroup) {
+};
+
+TEST(LazyImageTestGroup, parseFooter) {
+    auto offset = EStargzIndex::parseFooter(makeFooter(0x1234));
+    CHECK_EQUAL(makeFooter(0x1234).size(), EStargzIndex::footerSize);
+    CHECK(offset && *offset == 0x1234);
+    CHECK(!EStargzIndex::parseFooter(std::string(EStargzIndex::footerSize, '\0')));
+    CHECK(!EStargzIndex::parseFooter("not-hexadecimal!STARGZ"));
+}
+
+TEST(LazyImageTestGroup, read_index) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto ociLayout = libsarus::PathRAII{configRAII.config->directories.temp / "oci-layout"};
+    auto layer = EStargzLayer{ociLayout.getPath()};
+    auto source = DirectoryBlobSource{ociLayout.getPath()};
+
+    auto index = EStargzIndex::read(source, layer.digest, layer.blob.size());
+    CHECK_EQUAL(index.getTOCOffset(), layer.tocOffset);
+    CHECK_EQUAL(index.getTOCDigest(), sha256Digest(layer.tocJSON));
+    CHECK_EQUAL(index.getEntries().size(), 7);
+
+    const auto& hello = index.getEntries()[1];
+    CHECK_EQUAL(hello.name, std::string{"bin/hello"});
+    CHECK_EQUAL(hello.chunkSize, layer.hello.size());
+    CHECK_EQUAL(hello.mode, 0644);
+    CHECK_EQUAL(hello.modificationTime, 1682942400);
+    CHECK(hello.compressedEnd == index.getEntries()[2].offset);
+    CHECK(hello.xattrs.size() == 1 && hello.xattrs[0].second == "estargz");
+
+    auto chunks = index.getChunks();
+    CHECK_EQUAL(chunks.size(), 4);
+    CHECK(chunks.back()->compressedEnd == layer.tocOffset);
+
+    // layers which are not in eStargz format
+    auto plainLayer = gzipMember("plain tar");
+    auto plainDigest = sha256Digest(plainLayer);
+    libsarus::filesystem::writeTextFile(plainLayer, source.getBlobFile(plainDigest));
+    CHECK_THROWS(libsarus::Error, EStargzIndex::read(source, plainDigest, plainLayer.size()));
+    CHECK_THROWS(libsarus::Error, source.readRange("sha256:../../etc/passwd", 0, 1));
+}
+
+TEST(LazyImageTestGroup, fetchIndex_write_read) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto ociLayout = libsarus::PathRAII{configRAII.config->directories.temp / "oci-layout"};
+    auto layer = EStargzLayer{ociLayout.getPath()};
+    auto source = DirectoryBlobSource{ociLayout.getPath()};
+
+    auto image = LazyImage::fetchIndex(source, "registry.example.com", "library/app", libsarus::json::parse(layer.manifest));
+    CHECK_EQUAL(image.getLayers().size(), 1);
+    CHECK_EQUAL(image.getLayersSize(), layer.blob.size());
+
+    auto file = libsarus::PathRAII{configRAII.config->directories.images / "app.lazy"};
+    image.write(file.getPath());
+    auto readImage = LazyImage::read(file.getPath());
+    CHECK_EQUAL(readImage.getServer(), std::string{"registry.example.com"});
+    CHECK_EQUAL(readImage.getRepository(), std::string{"library/app"});
+    CHECK_EQUAL(readImage.getLayers()[0].digest, layer.digest);
+    CHECK_EQUAL(readImage.getLayers()[0].index.getTOCOffset(), layer.tocOffset);
+    CHECK_EQUAL(readImage.getLayers()[0].index.getEntries().size(), 7);
+
+    // the TOC must match the digest annotated in the manifest
+    auto tamperedManifest = layer.manifest;
+    auto position = tamperedManifest.find(sha256Digest(layer.tocJSON));
+    tamperedManifest.replace(position, 71, sha256Digest("tampered TOC"));
+    CHECK_THROWS(libsarus::Error, LazyImage::fetchIndex(source, "registry.example.com", "library/app",
+                                                        libsarus::json::parse(tamperedManifest)));
+}
+
+TEST(LazyImageTestGroup, unverifiable_layers) {
+    auto configRAII = test_utility::config::makeConfig();
+
+    // the TOC digest is not annotated in the manifest
+    {
+        auto ociLayout = libsarus::PathRAII{configRAII.config->directories.temp / "oci-layout"};
+        auto layer = EStargzLayer{ociLayout.getPath(), false};
+        auto source = DirectoryBlobSource{ociLayout.getPath()};
+        CHECK_THROWS(libsarus::Error, LazyImage::fetchIndex(source, "registry.example.com", "library/app",
+                                                            libsarus::json::parse(layer.manifest)));
+    }
+    // a chunk has no digest in the TOC
+    {
+        auto ociLayout = libsarus::PathRAII{configRAII.config->directories.temp / "oci-layout"};
+        auto layer = EStargzLayer{ociLayout.getPath(), true, false};
+        auto source = DirectoryBlobSource{ociLayout.getPath()};
+        CHECK_THROWS(libsarus::Error, LazyImage::fetchIndex(source, "registry.example.com", "library/app",
+                                                            libsarus::json::parse(layer.manifest)));
+    }
+}
+
+TEST(LazyImageTestGroup, materialize) {
+    auto configRAII = test_utility::config::makeConfig();
+    const auto& config = configRAII.config;
+    auto ociLayout = libsarus::PathRAII{config->directories.temp / "oci-layout"};
+    auto layer = EStargzLayer{ociLayout.getPath()};
+    auto source = DirectoryBlobSource{ociLayout.getPath()};
+    auto cache = ChunkCache{config};
+
+    auto image = LazyImage::fetchIndex(source, "registry.example.com", "library/app", libsarus::json::parse(layer.manifest));
+    auto rootfs = libsarus::PathRAII{config->directories.temp / "rootfs"};
+    libsarus::filesystem::createFoldersIfNecessary(rootfs.getPath());
+    image.materialize(source, cache, rootfs.getPath(), config->directories.temp);
+
+    CHECK_EQUAL(libsarus::filesystem::readFile(rootfs.getPath() / "bin/hello"), layer.hello);
+    CHECK_EQUAL(libsarus::filesystem::readFile(rootfs.getPath() / "bin/big"), layer.bigFirstChunk + layer.bigSecondChunk);
+    CHECK(boost::filesystem::read_symlink(rootfs.getPath() / "bin/sh") == "hello");
+    CHECK_EQUAL(boost::filesystem::hard_link_count(rootfs.getPath() / "bin/hello"), 2);
+    CHECK((boost::filesystem::status(rootfs.getPath() / "bin/big").permissions() & 0777) == 0755);
+    CHECK(!boost::filesystem::exists(rootfs.getPath() / ".prefetch.landmark"));
+
+    // chunks are stored by digest
+    const auto& chunks = image.getLayers()[0].index.getChunks();
+    CHECK(cache.getChunkFile(layer.digest, *chunks[0]) == cache.getDirectory() / "sha256" / sha256Digest(layer.hello).substr(7));
+    for(const auto* chunk : chunks) {
+        CHECK(cache.contains(layer.digest, *chunk));
+    }
+
+    // everything is fetched already: materializing again needs no registry
+    CHECK_EQUAL(image.prefetch(source, cache), 0);
+    auto secondRootfs = libsarus::PathRAII{config->directories.temp / "second-rootfs"};
+    libsarus::filesystem::createFoldersIfNecessary(secondRootfs.getPath());
+    image.materialize(UnreachableBlobSource{}, cache, secondRootfs.getPath(), config->directories.temp);
+    CHECK_EQUAL(libsarus::filesystem::readFile(secondRootfs.getPath() / "bin/big"), layer.bigFirstChunk + layer.bigSecondChunk);
+}
+
+TEST(LazyImageTestGroup, prefetch_and_verify_chunks) {
+    auto configRAII = test_utility::config::makeConfig();
+    const auto& config = configRAII.config;
+    auto ociLayout = libsarus::PathRAII{config->directories.temp / "oci-layout"};
+    auto layer = EStargzLayer{ociLayout.getPath()};
+    auto source = DirectoryBlobSource{ociLayout.getPath()};
+    auto cache = ChunkCache{config};
+
+    auto image = LazyImage::fetchIndex(source, "registry.example.com", "library/app", libsarus::json::parse(layer.manifest));
+    // the data members of the layer are fetched with a single range request
+    CHECK_EQUAL(image.prefetch(source, cache), layer.tocOffset - image.getLayers()[0].index.getChunks()[0]->offset);
+    CHECK_EQUAL(image.prefetch(source, cache), 0);
+
+    // chunks whose data doesn't match their digest are rejected
+    auto entry = *image.getLayers()[0].index.getChunks()[1];
+    entry.chunkDigest = sha256Digest("something else");
+    CHECK_THROWS(libsarus::Error, cache.fetchChunks(source, layer.digest, {&entry}));
+    CHECK(!cache.contains(layer.digest, entry));
+
+    // chunks without digest are rejected
+    entry.chunkDigest.clear();
+    CHECK_THROWS(libsarus::Error, cache.fetchChunks(source, layer.digest, {&entry}));
+}
+
+TEST(LazyImageTestGroup, registry) {
+    CHECK_EQUAL(RegistryBlobSource::getRegistryHost("docker.io"), std::string{"registry-1.docker.io"});
+    CHECK_EQUAL(RegistryBlobSource::getRegistryHost("ghcr.io"), std::string{"ghcr.io"});
+
+    auto headers = std::string{
+        "HTTP/1.1 401 Unauthorized\r\n"
+        "Content-Type: application/json\r\n"
+        "Www-Authenticate: Bearer realm=\"https://auth.docker.io/token\",service=\"registry.docker.io\"\r\n"};
+    CHECK_EQUAL(RegistryBlobSource::parseAuthenticateHeader(headers, "library/alpine"),
+                std::string{"https://auth.docker.io/token?scope=repository:library/alpine:pull&service=registry.docker.io"});
+    CHECK(RegistryBlobSource::parseAuthenticateHeader("HTTP/1.1 200 OK\r\n", "library/alpine").empty());
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,199 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Utility.hpp"
+#include "image_manager/PullCoordinator.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static const auto staleTimeout = std::chrono::milliseconds{1000};
+static const auto pollInterval = std::chrono::milliseconds{50};
+
+static common::ImageReference makeReference() {
+    return common::ImageReference{"localhost:5000", "library", "alpine", "latest", "sha256:1234"};
+}
+
+/**
+ * Stand-in for the skopeo, unpack and mksquashfs pipeline of a pull from a registry:
+ * records that the conversion was performed, then atomically "adds" the image.
+ */
+static void convertImage(PullCoordinator::Ticket& ticket,
+                         const boost::filesystem::path& conversionsLog,
+                         const boost::filesystem::path& image) {
+    auto fd = open(conversionsLog.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    auto line = std::to_string(getpid()) + "\n";
+    CHECK(write(fd, line.c_str(), line.size()) == static_cast<ssize_t>(line.size()));
+    close(fd);
+
+    for(const auto& phase : {"skopeoCopy", "unpack", "mksquashfs"}) {
+        ticket.setPhase(phase);
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
+
+    auto tempImage = libsarus::filesystem::makeUniquePathWithRandomSuffix(image);
+    libsarus::filesystem::writeTextFile("squashfs", tempImage);
+    boost::filesystem::rename(tempImage, image);
+}
+
+TEST_GROUP(PullCoordinatorTestGroup) {
+};
+
+TEST(PullCoordinatorTestGroup, marker_lifecycle) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto coordinator = PullCoordinator{configRAII.config, staleTimeout, pollInterval};
+    auto reference = makeReference();
+    auto markerFile = coordinator.getMarkerFile(reference);
+
+    {
+        auto ticket = coordinator.acquire(reference, []() { return false; });
+        CHECK(ticket != nullptr);
+        auto marker = PullCoordinator::readMarker(markerFile);
+        CHECK(marker);
+        CHECK_EQUAL(marker->pid, getpid());
+        CHECK(marker->hostname == libsarus::process::getHostname());
+        CHECK(marker->digest == "sha256:1234");
+
+        ticket->setPhase("unpack");
+        CHECK(PullCoordinator::readMarker(markerFile)->phase == "unpack");
+    }
+    CHECK(!boost::filesystem::exists(markerFile));
+
+    // image added right before the marker was created
+    CHECK(coordinator.acquire(reference, []() { return true; }) == nullptr);
+    CHECK(!boost::filesystem::exists(markerFile));
+}
+
+TEST(PullCoordinatorTestGroup, concurrent_pulls) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto reference = makeReference();
+    auto image = configRAII.config->directories.images / "alpine.squashfs";
+    auto conversionsLog = configRAII.config->directories.repository / "conversions.log";
+    libsarus::filesystem::createFoldersIfNecessary(image.parent_path());
+
+    const int numberOfPullers = 16;
+    auto pids = std::vector<pid_t>{};
+    for(int i=0; i<numberOfPullers; ++i) {
+        auto pid = fork();
+        if(pid == 0) {
+            auto coordinator = PullCoordinator{configRAII.config, staleTimeout, pollInterval};
+            auto ticket = coordinator.acquire(reference, [&image]() { return boost::filesystem::exists(image); });
+            if(ticket) {
+                convertImage(*ticket, conversionsLog, image);
+            }
+            _exit(boost::filesystem::exists(image) ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+
+    for(auto pid : pids) {
+        int status;
+        waitpid(pid, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    // the image was converted only once
+    auto conversions = libsarus::filesystem::readFile(conversionsLog);
+    CHECK_EQUAL(std::count(conversions.cbegin(), conversions.cend(), '\n'), 1);
+    CHECK(!boost::filesystem::exists(PullCoordinator{configRAII.config}.getMarkerFile(reference)));
+}
+
+TEST(PullCoordinatorTestGroup, failed_puller_is_taken_over) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto coordinator = PullCoordinator{configRAII.config, staleTimeout, pollInterval};
+    auto reference = makeReference();
+
+    auto pid = fork();
+    if(pid == 0) {
+        // acquires the pull, then fails without adding the image
+        auto ticket = coordinator.acquire(reference, []() { return false; });
+        std::this_thread::sleep_for(std::chrono::milliseconds{300});
+        _exit(ticket ? 0 : 1);
+    }
+
+    // let the child acquire the pull first
+    auto markerFile = coordinator.getMarkerFile(reference);
+    while(!PullCoordinator::readMarker(markerFile)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    auto ticket = coordinator.acquire(reference, []() { return false; });
+    CHECK(ticket != nullptr);
+    CHECK_EQUAL(PullCoordinator::readMarker(markerFile)->pid, getpid());
+
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+TEST(PullCoordinatorTestGroup, stale_markers) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto coordinator = PullCoordinator{configRAII.config, staleTimeout, pollInterval};
+    auto reference = makeReference();
+    auto markerFile = coordinator.getMarkerFile(reference);
+    libsarus::filesystem::createFoldersIfNecessary(markerFile.parent_path());
+
+    // crashed puller on the local host
+    {
+        auto pid = fork();
+        if(pid == 0) {
+            _exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+
+        auto marker = PullCoordinator::Marker{};
+        marker.hostname = libsarus::process::getHostname();
+        marker.pid = pid;
+        marker.phase = "unpack";
+        PullCoordinator::writeMarker(marker, markerFile);
+
+        auto start = std::chrono::steady_clock::now();
+        auto ticket = coordinator.acquire(reference, []() { return false; });
+        CHECK(ticket != nullptr);
+        CHECK(std::chrono::steady_clock::now() - start < staleTimeout);
+    }
+
+    // puller on another host which stopped refreshing its marker
+    {
+        auto marker = PullCoordinator::Marker{};
+        marker.hostname = "other-host";
+        marker.pid = 1;
+        marker.phase = "mksquashfs";
+        PullCoordinator::writeMarker(marker, markerFile);
+
+        auto start = std::chrono::steady_clock::now();
+        auto ticket = coordinator.acquire(reference, []() { return false; });
+        CHECK(ticket != nullptr);
+        CHECK(std::chrono::steady_clock::now() - start >= staleTimeout);
+        CHECK(PullCoordinator::readMarker(markerFile)->hostname == libsarus::process::getHostname());
+    }
+
+    // empty marker left by a puller which crashed right after creating it
+    {
+        libsarus::filesystem::writeTextFile("", markerFile);
+        auto ticket = coordinator.acquire(reference, []() { return false; });
+        CHECK(ticket != nullptr);
+    }
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,197 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <ctime>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Utility.hpp"
+#include "image_manager/ImageStore.hpp"
+#include "image_manager/RepositoryPruner.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static const auto gracePeriod = std::chrono::seconds{3600};
+
+static common::SarusImage addImage(const ImageStore& imageStore, const std::string& name, size_t size) {
+    auto reference = common::ImageReference{"docker.io", "library", name, "latest", "sha256:" + name};
+    auto image = common::SarusImage{
+        reference,
+        "id-of-" + name,
+        common::SarusImage::createSizeString(size),
+        common::SarusImage::createTimeString(0),
+        imageStore.getImageSquashfsFile(reference),
+        imageStore.getImageMetadataFile(reference)};
+    libsarus::filesystem::createFoldersIfNecessary(image.imageFile.parent_path());
+    libsarus::filesystem::writeTextFile(std::string(size, 'x'), image.imageFile);
+    libsarus::filesystem::writeTextFile("{}", image.metadataFile);
+    imageStore.addImage(image);
+    return image;
+}
+
+static void setModificationTime(const boost::filesystem::path& path, std::time_t time) {
+    if(boost::filesystem::is_directory(path)) {
+        for(const auto& entry : boost::filesystem::recursive_directory_iterator{path}) {
+            boost::filesystem::last_write_time(entry.path(), time);
+        }
+    }
+    boost::filesystem::last_write_time(path, time);
+}
+
+static void makeOld(const boost::filesystem::path& path) {
+    setModificationTime(path, std::time(nullptr) - 2 * gracePeriod.count());
+}
+
+TEST_GROUP(RepositoryPrunerTestGroup) {
+};
+
+TEST(RepositoryPrunerTestGroup, orphans_and_leftovers) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    config.directories.temp = config.directories.repository / "temp";
+    libsarus::filesystem::createFoldersIfNecessary(config.directories.temp);
+    auto imageStore = ImageStore{configRAII.config};
+
+    auto image = addImage(imageStore, "alpine", 1000);
+    auto prefetchProfile = imageStore.getImagePrefetchProfileFile(image.reference);
+    libsarus::filesystem::writeTextFile("{}", prefetchProfile);
+    makeOld(image.imageFile);
+    makeOld(image.metadataFile);
+    makeOld(prefetchProfile);
+
+    // leftovers of interrupted pulls
+    auto orphanedImage = config.directories.images / "docker.io/library/ubuntu/latest.squashfs";
+    auto temporarySquashfs = config.directories.images / "docker.io/library/alpine/latest.squashfs-0123456789abcdef";
+    auto ociLayout = config.directories.cache / "ociImages/image-0123456789abcdef";
+    auto unpackDirectory = config.directories.temp / "unpack-directory-0123456789abcdef";
+    libsarus::filesystem::createFoldersIfNecessary(orphanedImage.parent_path());
+    libsarus::filesystem::writeTextFile(std::string(2000, 'u'), orphanedImage);
+    libsarus::filesystem::writeTextFile(std::string(3000, 't'), temporarySquashfs);
+    libsarus::filesystem::createFoldersIfNecessary(ociLayout / "blobs");
+    libsarus::filesystem::writeTextFile(std::string(4000, 'o'), ociLayout / "index.json");
+    libsarus::filesystem::createFoldersIfNecessary(unpackDirectory / "rootfs/etc");
+    libsarus::filesystem::writeTextFile(std::string(5000, 'r'), unpackDirectory / "rootfs/etc/hostname");
+    for(const auto& path : {orphanedImage, temporarySquashfs, ociLayout, unpackDirectory}) {
+        makeOld(path);
+    }
+
+    // recent files may belong to a pull in progress
+    auto recentSquashfs = config.directories.images / "docker.io/library/alpine/latest.squashfs-fedcba9876543210";
+    libsarus::filesystem::writeTextFile("x", recentSquashfs);
+    auto activeUnpackDirectory = config.directories.temp / "unpack-directory-fedcba9876543210";
+    libsarus::filesystem::createFoldersIfNecessary(activeUnpackDirectory / "rootfs");
+    makeOld(activeUnpackDirectory);
+    libsarus::filesystem::writeTextFile("x", activeUnpackDirectory / "rootfs/file-being-extracted");
+
+    auto pruner = RepositoryPruner{configRAII.config, gracePeriod};
+
+    // dry run
+    auto report = pruner.prune(true, boost::none);
+    CHECK_EQUAL(report.items.size(), 4);
+    CHECK_EQUAL(report.getReclaimableSize(), 2000 + 3000 + 4000 + 5000);
+    for(const auto& path : {orphanedImage, temporarySquashfs, ociLayout, unpackDirectory}) {
+        CHECK(boost::filesystem::exists(path));
+    }
+
+    // actual run
+    report = pruner.prune(false, boost::none);
+    CHECK_EQUAL(report.getReclaimableSize(), 2000 + 3000 + 4000 + 5000);
+    for(const auto& path : {orphanedImage, temporarySquashfs, ociLayout, unpackDirectory}) {
+        CHECK_FALSE(boost::filesystem::exists(path));
+    }
+    CHECK_FALSE(boost::filesystem::exists(orphanedImage.parent_path()));
+    CHECK(boost::filesystem::exists(recentSquashfs));
+    CHECK(boost::filesystem::exists(activeUnpackDirectory));
+    CHECK(boost::filesystem::exists(prefetchProfile));
+    CHECK(imageStore.listImages() == std::vector<common::SarusImage>{image});
+
+    // nothing left to reclaim
+    CHECK(pruner.prune(false, boost::none).items.empty());
+}
+
+TEST(RepositoryPrunerTestGroup, quota) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto imageStore = ImageStore{configRAII.config};
+    auto pruner = RepositoryPruner{configRAII.config, gracePeriod};
+    auto now = std::time(nullptr);
+
+    auto alpine = addImage(imageStore, "alpine", 100000);
+    auto ubuntu = addImage(imageStore, "ubuntu", 200000);
+    auto fedora = addImage(imageStore, "fedora", 300000);
+
+    // fedora was pulled last but never run, ubuntu was run after alpine
+    setModificationTime(fedora.metadataFile, now - 100);
+    imageStore.markImageAsUsed(alpine.reference);
+    setModificationTime(imageStore.getImageLastUsedFile(alpine.reference), now - 300);
+    imageStore.markImageAsUsed(ubuntu.reference);
+    setModificationTime(imageStore.getImageLastUsedFile(ubuntu.reference), now - 200);
+    CHECK_EQUAL(imageStore.getImageLastUsedTime(alpine), now - 300);
+    CHECK_EQUAL(imageStore.getImageLastUsedTime(fedora), now - 100);
+
+    // within quota
+    auto report = pruner.prune(false, size_t{1000000});
+    CHECK(report.items.empty());
+    CHECK_EQUAL(imageStore.listImages().size(), 3);
+
+    // dry run
+    report = pruner.prune(true, size_t{550000});
+    CHECK_EQUAL(report.items.size(), 1);
+    CHECK(*report.items[0].image == alpine.reference);
+    CHECK_EQUAL(imageStore.listImages().size(), 3);
+
+    // least recently used images are evicted first
+    report = pruner.prune(false, size_t{350000});
+    CHECK_EQUAL(report.items.size(), 2);
+    CHECK(*report.items[0].image == alpine.reference);
+    CHECK(*report.items[1].image == ubuntu.reference);
+    CHECK(imageStore.listImages() == std::vector<common::SarusImage>{fedora});
+    CHECK_FALSE(boost::filesystem::exists(alpine.imageFile));
+    CHECK_FALSE(boost::filesystem::exists(imageStore.getImageLastUsedFile(alpine.reference)));
+    CHECK(report.imagesSizeAfter <= 350000);
+}
+
+TEST(RepositoryPrunerTestGroup, usage_of_other_users) {
+    auto configRAII = test_utility::config::makeConfig();
+    configRAII.config->useCentralizedRepository = true;
+    auto imageStore = ImageStore{configRAII.config};
+    auto pruner = RepositoryPruner{configRAII.config, gracePeriod};
+    auto now = std::time(nullptr);
+
+    auto alpine = addImage(imageStore, "alpine", 100000);
+    auto ubuntu = addImage(imageStore, "ubuntu", 200000);
+    CHECK(imageStore.isUsageOfOtherUsersRecorded());
+    imageStore.markImageAsUsed(ubuntu.reference);
+    setModificationTime(imageStore.getImageLastUsedFile(ubuntu.reference), now - 200);
+
+    // the last use of alpine cannot be recorded in the images directory
+    auto lastUsedFile = imageStore.getImageLastUsedFile(alpine.reference);
+    boost::filesystem::create_symlink(configRAII.config->directories.repository / "missing" / "file", lastUsedFile);
+    imageStore.markImageAsUsed(alpine.reference);
+    auto usageFile = imageStore.getUserUsageFile(alpine.reference, geteuid());
+    CHECK(boost::filesystem::is_regular_file(usageFile));
+    setModificationTime(usageFile, now - 100);
+    CHECK_EQUAL(imageStore.getImageLastUsedTime(alpine), now - 100);
+
+    // the use recorded by the user keeps alpine in the repository
+    auto report = pruner.prune(false, size_t{150000});
+    CHECK_EQUAL(report.items.size(), 1);
+    CHECK(*report.items[0].image == ubuntu.reference);
+    CHECK(imageStore.listImages() == std::vector<common::SarusImage>{alpine});
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,149 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+#include "image_manager/ScratchTrash.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static void enableDeferredCleanup(common::Config& config) {
+    auto& allocator = config.json.GetAllocator();
+    config.json.AddMember("scratchCleanup", rj::Value{"deferred", allocator}, allocator);
+}
+
+static boost::filesystem::path createScratchTree(const boost::filesystem::path& parent) {
+    auto tree = libsarus::filesystem::makeUniquePathWithRandomSuffix(parent / "unpack-directory");
+    libsarus::filesystem::createFoldersIfNecessary(tree / "rootfs/usr/bin");
+    libsarus::filesystem::createFileIfNecessary(tree / "rootfs/usr/bin/ls");
+    // some images contain directories without owner write permissions
+    boost::filesystem::permissions(tree / "rootfs/usr/bin", boost::filesystem::perms(0555));
+    return tree;
+}
+
+TEST_GROUP(ScratchTrashTestGroup) {
+};
+
+TEST(ScratchTrashTestGroup, disabled) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto trash = ScratchTrash{configRAII.config};
+    auto tree = libsarus::PathRAII{createScratchTree(configRAII.config->directories.cache / "ociImages")};
+
+    CHECK_FALSE(trash.isEnabled());
+    CHECK_FALSE(trash.moveToTrash(tree.getPath()));
+    CHECK(boost::filesystem::exists(tree.getPath()));
+    CHECK(trash.isEmpty());
+}
+
+TEST(ScratchTrashTestGroup, move_and_reclaim) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    enableDeferredCleanup(config);
+    auto trash = ScratchTrash{configRAII.config};
+    CHECK(trash.isEnabled());
+
+    // scratch trees on the filesystem of the repository are moved into the repository trash
+    auto tree = createScratchTree(config.directories.cache / "ociImages");
+    CHECK(trash.moveToTrash(tree));
+    CHECK_FALSE(boost::filesystem::exists(tree));
+    CHECK(boost::filesystem::exists(config.directories.repository / "trash" / tree.filename() / "rootfs/usr/bin/ls"));
+    CHECK_FALSE(trash.isEmpty());
+
+    // missing trees are not moved
+    CHECK_FALSE(trash.moveToTrash(tree));
+
+    trash.reclaim();
+    CHECK(trash.isEmpty());
+    CHECK(boost::filesystem::is_empty(config.directories.repository / "trash"));
+}
+
+TEST(ScratchTrashTestGroup, reclaim_in_background) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    enableDeferredCleanup(config);
+    auto trash = ScratchTrash{configRAII.config};
+
+    // trees left over by an interrupted reclaim
+    for(int i=0; i<3; ++i) {
+        CHECK(trash.moveToTrash(createScratchTree(config.directories.cache / "ociImages")));
+    }
+
+    trash.reclaimInBackground();
+
+    // the reclaim process is detached: poll for its completion
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{30};
+    while(!trash.isEmpty() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    }
+    CHECK(trash.isEmpty());
+}
+
+TEST(ScratchTrashTestGroup, untrusted_trash_directories) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    enableDeferredCleanup(config);
+    auto trash = ScratchTrash{configRAII.config};
+    auto trashDirectory = config.directories.repository / "trash";
+
+    // a symlink planted in place of the trash directory is neither filled nor emptied
+    auto victimDirectory = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-trash-victim")};
+    libsarus::filesystem::createFoldersIfNecessary(victimDirectory.getPath());
+    libsarus::filesystem::createFileIfNecessary(victimDirectory.getPath() / "file");
+    boost::filesystem::create_symlink(victimDirectory.getPath(), trashDirectory);
+
+    auto tree = libsarus::PathRAII{createScratchTree(config.directories.cache / "ociImages")};
+    CHECK_FALSE(trash.moveToTrash(tree.getPath()));
+    CHECK(boost::filesystem::exists(tree.getPath()));
+    CHECK(trash.isEmpty());
+    trash.reclaim();
+    CHECK(boost::filesystem::exists(victimDirectory.getPath() / "file"));
+
+    // a trash directory accessible to other users is made private before use
+    boost::filesystem::remove(trashDirectory);
+    libsarus::filesystem::createFoldersIfNecessary(trashDirectory);
+    boost::filesystem::permissions(trashDirectory, boost::filesystem::perms(0777));
+    CHECK(trash.moveToTrash(tree.getPath()));
+    CHECK(boost::filesystem::status(trashDirectory).permissions() == boost::filesystem::perms(0700));
+
+    // symlinks in the trash are removed, not followed
+    boost::filesystem::create_symlink(victimDirectory.getPath(), trashDirectory / "symlink");
+    trash.reclaim();
+    CHECK(trash.isEmpty());
+    CHECK(boost::filesystem::exists(victimDirectory.getPath() / "file"));
+}
+
+TEST(ScratchTrashTestGroup, trash_directories) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto trash = ScratchTrash{configRAII.config};
+    auto userTrash = "sarus-trash-" + std::to_string(config.userIdentity.uid);
+
+    auto directories = trash.getTrashDirectories();
+    CHECK(directories.at(0) == config.directories.repository / "trash");
+    CHECK(std::find(directories.cbegin(), directories.cend(), config.directories.temp / userTrash) != directories.cend());
+    CHECK(std::find(directories.cbegin(), directories.cend(), config.directories.cache / "ociImages" / userTrash) != directories.cend());
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,209 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <cstdint>
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Sha256.hpp"
+#include "image_manager/SifImage.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+struct DataObject {
+    std::int32_t dataType;
+    std::string name;
+    std::string data;
+    std::int32_t fsType;
+    std::int32_t partType;
+};
+
+template<typename T>
+static void putLittleEndian(std::string& buffer, size_t offset, T value) {
+    for(size_t i=0; i<sizeof(T); ++i) {
+        buffer[offset + i] = static_cast<char>((static_cast<std::uint64_t>(value) >> (8*i)) & 0xff);
+    }
+}
+
+/**
+ * Writes a SIF file with the layout of the SIF specification: global header,
+ * descriptor table and data objects.
+ */
+static void writeSifFile(const boost::filesystem::path& file, const std::vector<DataObject>& objects) {
+    auto numberOfDescriptors = objects.size();
+    auto dataOffset = SifImage::headerSize + numberOfDescriptors * SifImage::descriptorSize;
+
+    auto header = std::string(SifImage::headerSize, '\0');
+    header.replace(0, 31, "#!/usr/bin/env run-singularity\n");
+    header.replace(32, 9, "SIF_MAGIC");
+    header.replace(42, 2, "01");
+    header.replace(45, 2, "02");
+    putLittleEndian<std::int64_t>(header, 88, numberOfDescriptors);
+    putLittleEndian<std::int64_t>(header, 96, SifImage::headerSize);
+    putLittleEndian<std::int64_t>(header, 104, numberOfDescriptors * SifImage::descriptorSize);
+    putLittleEndian<std::int64_t>(header, 112, dataOffset);
+
+    auto table = std::string{};
+    auto data = std::string{};
+    for(size_t i=0; i<objects.size(); ++i) {
+        const auto& object = objects[i];
+        auto descriptor = std::string(SifImage::descriptorSize, '\0');
+        putLittleEndian<std::int32_t>(descriptor, 0, object.dataType);
+        descriptor[4] = 1; // used
+        putLittleEndian<std::uint32_t>(descriptor, 5, i + 1);
+        putLittleEndian<std::uint32_t>(descriptor, 9, 0xf0000001);
+        putLittleEndian<std::int64_t>(descriptor, 17, dataOffset + data.size());
+        putLittleEndian<std::int64_t>(descriptor, 25, object.data.size());
+        putLittleEndian<std::int64_t>(descriptor, 33, object.data.size());
+        descriptor.replace(73, object.name.size(), object.name);
+        putLittleEndian<std::int32_t>(descriptor, 201, object.fsType);
+        putLittleEndian<std::int32_t>(descriptor, 205, object.partType);
+        table += descriptor;
+        data += object.data;
+    }
+    putLittleEndian<std::int64_t>(header, 120, data.size());
+
+    libsarus::filesystem::writeTextFile(header + table + data, file);
+}
+
+static std::string makeSquashfsData(size_t size) {
+    auto data = std::string{"hsqs"};
+    for(size_t i=data.size(); i<size; ++i) {
+        data.push_back(static_cast<char>(i % 253));
+    }
+    return data;
+}
+
+static std::string digestOf(const std::string& data) {
+    auto hash = libsarus::Sha256{};
+    hash.update(data);
+    return "sha256:" + hash.finalizeHex();
+}
+
+TEST_GROUP(SifImageTestGroup) {
+};
+
+TEST(SifImageTestGroup, not_a_sif_file) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-sif")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto file = testDir.getPath() / "image.tar";
+    libsarus::filesystem::writeTextFile(std::string(4096, 'x'), file);
+
+    CHECK_FALSE(SifImage::isSifFile(file));
+    CHECK_FALSE(SifImage::isSifFile(testDir.getPath() / "non-existent"));
+    CHECK_THROWS(libsarus::Error, SifImage{file});
+
+    // truncated descriptor table
+    writeSifFile(file, {DataObject{SifImage::dataPartition, "rootfs", makeSquashfsData(100), SifImage::fsSquash, SifImage::partPrimSys}});
+    libsarus::filesystem::writeTextFile(libsarus::filesystem::readFile(file).substr(0, 300), file);
+    CHECK(SifImage::isSifFile(file));
+    CHECK_THROWS(libsarus::Error, SifImage{file});
+
+    // descriptor table larger than the file
+    writeSifFile(file, {DataObject{SifImage::dataPartition, "rootfs", makeSquashfsData(100), SifImage::fsSquash, SifImage::partPrimSys}});
+    auto data = libsarus::filesystem::readFile(file);
+    putLittleEndian<std::int64_t>(data, 88, std::int64_t{1} << 40);
+    putLittleEndian<std::int64_t>(data, 104, (std::int64_t{1} << 40) * SifImage::descriptorSize);
+    libsarus::filesystem::writeTextFile(data, file);
+    CHECK_THROWS(libsarus::Error, SifImage{file});
+}
+
+TEST(SifImageTestGroup, primary_system_partition) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-sif")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto file = testDir.getPath() / "image.sif";
+    auto squashfs = makeSquashfsData(200000);
+
+    writeSifFile(file, {
+        DataObject{SifImage::dataDeffile, "", "Bootstrap: docker\nFrom: alpine\n", 0, 0},
+        DataObject{SifImage::dataLabels, "", R"({"org.label-schema.schema-version": "1.0", "maintainer": "sarus"})", 0, 0},
+        DataObject{SifImage::dataGenericJSON, "oci-config.json",
+                   R"({"config": {"Env": ["PATH=/usr/bin:/bin"], "Cmd": ["/bin/sh"], "WorkingDir": "/work"}})", 0, 0},
+        DataObject{SifImage::dataPartition, "", squashfs, SifImage::fsSquash, SifImage::partPrimSys}
+    });
+
+    CHECK(SifImage::isSifFile(file));
+    auto image = SifImage{file};
+    CHECK_EQUAL(image.getDescriptors().size(), 4);
+    CHECK(image.hasSquashfsRootfs());
+    CHECK_EQUAL(image.getRootfsDescriptor().size, squashfs.size());
+    CHECK_EQUAL(image.getImageID().size(), 64);
+
+    auto metadata = image.getMetadata();
+    CHECK(metadata.labels["maintainer"] == "sarus");
+    CHECK(metadata.labels["org.label-schema.schema-version"] == "1.0");
+    CHECK(metadata.env["PATH"] == "/usr/bin:/bin");
+    CHECK(*metadata.cmd == libsarus::CLIArguments{"/bin/sh"});
+    CHECK(*metadata.workdir == "/work");
+
+    auto destination = testDir.getPath() / "repository/image.squashfs";
+    image.extractRootfs(destination);
+    CHECK(libsarus::filesystem::readFile(destination) == squashfs);
+    CHECK_EQUAL(libsarus::filesystem::countFilesInDirectory(destination.parent_path()), 1);
+}
+
+TEST(SifImageTestGroup, unsupported_partition) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-sif")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto file = testDir.getPath() / "image.sif";
+
+    // ext3 partition
+    const std::int32_t fsExt3 = 2;
+    writeSifFile(file, {DataObject{SifImage::dataPartition, "", std::string(4096, 'e'), fsExt3, SifImage::partPrimSys}});
+    CHECK_FALSE(SifImage{file}.hasSquashfsRootfs());
+    CHECK_THROWS(libsarus::Error, SifImage{file}.extractRootfs(testDir.getPath() / "image.squashfs"));
+
+    // squashfs type without squashfs superblock
+    writeSifFile(file, {DataObject{SifImage::dataPartition, "", std::string(4096, 'x'), SifImage::fsSquash, SifImage::partPrimSys}});
+    CHECK_FALSE(SifImage{file}.hasSquashfsRootfs());
+}
+
+TEST(SifImageTestGroup, oci_sif) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-sif")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto file = testDir.getPath() / "image.oci.sif";
+
+    auto layer = makeSquashfsData(300000);
+    auto config = std::string{R"({"architecture": "amd64", "os": "linux",)"
+                              R"( "config": {"Entrypoint": ["/usr/bin/entry"], "Env": ["HOME=/root"]},)"
+                              R"( "rootfs": {"type": "layers", "diff_ids": []}})"};
+    auto manifest = (boost::format(R"({"schemaVersion": 2,)"
+                                   R"( "config": {"mediaType": "application/vnd.oci.image.config.v1+json", "digest": "%s", "size": %d},)"
+                                   R"( "layers": [{"mediaType": "application/vnd.sylabs.image.layer.v1.squashfs", "digest": "%s", "size": %d}]})")
+                     % digestOf(config) % config.size() % digestOf(layer) % layer.size()).str();
+    auto index = (boost::format(R"({"schemaVersion": 2, "manifests": [{"mediaType": "application/vnd.oci.image.manifest.v1+json", "digest": "%s", "size": %d}]})")
+                  % digestOf(manifest) % manifest.size()).str();
+
+    writeSifFile(file, {
+        DataObject{SifImage::dataOCIBlob, "", config, 0, 0},
+        DataObject{SifImage::dataOCIBlob, "", layer, 0, 0},
+        DataObject{SifImage::dataOCIBlob, "", manifest, 0, 0},
+        DataObject{SifImage::dataOCIRootIndex, "", index, 0, 0}
+    });
+
+    auto image = SifImage{file};
+    CHECK(image.hasSquashfsRootfs());
+    CHECK(image.getImageID() == digestOf(config).substr(7));
+    CHECK(*image.getMetadata().entry == libsarus::CLIArguments{"/usr/bin/entry"});
+    CHECK(image.getMetadata().env["HOME"] == "/root");
+
+    auto destination = testDir.getPath() / "image.squashfs";
+    image.extractRootfs(destination);
+    CHECK(libsarus::filesystem::readFile(destination) == layer);
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -8,6 +8,10 @@
  *
  */
 
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+
 #include "libsarus/Utility.hpp"
 #include "libsarus/PathRAII.hpp"
 #include "image_manager/SquashfsImage.hpp"
@@ -37,6 +41,46 @@ TEST(SquashfsImageTestGroup, testSquashfsImage) {
     CHECK(boost::filesystem::exists(config.getImageFile()));
 }
 
+TEST(SquashfsImageTestGroup, testReproducibleSquashfsImage) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+
+    libsarus::PathRAII testDir{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-reproducible")};
+    auto unpackedImage = testDir.getPath() / "rootfs";
+    libsarus::filesystem::createFoldersIfNecessary(unpackedImage / "etc");
+    libsarus::filesystem::writeTextFile("alpine", unpackedImage / "etc/hostname");
+
+    auto firstImage = testDir.getPath() / "first.squashfs";
+    auto secondImage = testDir.getPath() / "second.squashfs";
+    SquashfsImage{config, unpackedImage, firstImage, true};
+    sleep(1); // the filesystem creation time would differ
+    SquashfsImage{config, unpackedImage, secondImage, true};
+
+    CHECK(libsarus::filesystem::readFile(firstImage) == libsarus::filesystem::readFile(secondImage));
+}
+
+TEST(SquashfsImageTestGroup, testSquashfsImageWithAccessProfile) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+
+    libsarus::PathRAII testDir{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-access-profile")};
+    auto unpackedImage = testDir.getPath() / "rootfs";
+    libsarus::filesystem::createFoldersIfNecessary(unpackedImage / "usr/bin");
+    libsarus::filesystem::createFoldersIfNecessary(unpackedImage / "etc");
+    libsarus::filesystem::writeTextFile("binary", unpackedImage / "usr/bin/app");
+    libsarus::filesystem::writeTextFile("alpine", unpackedImage / "etc/hostname");
+
+    auto profile = AccessProfile{{"/usr/bin/app", "/etc/hostname", "/missing"}};
+    auto image = testDir.getPath() / "image.squashfs";
+    SquashfsImage{config, unpackedImage, image, false, profile};
+
+    CHECK(boost::filesystem::exists(image));
+    // the sort file is removed together with the other temporary files
+    for(const auto& entry : boost::filesystem::directory_iterator{config.directories.temp}) {
+        CHECK_FALSE(boost::starts_with(entry.path().filename().string(), "sarus-sort-file"));
+    }
+}
+
 TEST(SquashfsImageTestGroup, testGenerateMksquashfsArgs) {
     auto configRAII = test_utility::config::makeConfig();
     auto& config = configRAII.config;
@@ -51,6 +95,18 @@ TEST(SquashfsImageTestGroup, testGenerateMksquashfsArgs) {
     auto expectedArgs = libsarus::CLIArguments{expectedMksquashfsPath, sourcePath, destinationPath, "-comp gzip -Xcompression-level 6"};
     CHECK(generatedArgs == expectedArgs);
 
+    // Reproducible conversion
+    generatedArgs = SquashfsImage::generateMksquashfsArgs(*config, sourcePath, destinationPath, true);
+    expectedArgs = libsarus::CLIArguments{expectedMksquashfsPath, sourcePath, destinationPath, "-comp gzip -Xcompression-level 6",
+                                          "-noappend", "-mkfs-time", "0"};
+    CHECK(generatedArgs == expectedArgs);
+
+    // Sort file of access profile
+    generatedArgs = SquashfsImage::generateMksquashfsArgs(*config, sourcePath, destinationPath, false, "/tmp/test-sort-file");
+    expectedArgs = libsarus::CLIArguments{expectedMksquashfsPath, sourcePath, destinationPath, "-comp gzip -Xcompression-level 6",
+                                          "-sort", "/tmp/test-sort-file"};
+    CHECK(generatedArgs == expectedArgs);
+
     // Options not present in config
     config->json.RemoveMember("mksquashfsOptions");
     generatedArgs = SquashfsImage::generateMksquashfsArgs(*config, sourcePath, destinationPath);
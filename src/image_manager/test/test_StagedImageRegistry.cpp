@@ -0,0 +1,146 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/StagedImageRegistry.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+TEST_GROUP(StagedImageRegistryTestGroup) {
+};
+
+TEST(StagedImageRegistryTestGroup, register_and_find) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-staged-images")};
+
+    auto repositoryImage = testDir.getPath() / "repository/alpine.squashfs";
+    libsarus::filesystem::createFoldersIfNecessary(repositoryImage.parent_path());
+    libsarus::filesystem::writeTextFile("squashfs image", repositoryImage);
+    auto image = common::SarusImage{
+        common::ImageReference{"docker.io", "library", "alpine", "latest", ""},
+        "1234567890abcdef",
+        common::SarusImage::createSizeString(14),
+        common::SarusImage::createTimeString(0),
+        repositoryImage,
+        testDir.getPath() / "repository/alpine.meta"};
+
+    // staging not configured
+    {
+        auto registry = StagedImageRegistry{configRAII.config};
+        CHECK_FALSE(registry.isEnabled());
+        CHECK(!registry.findStagedImage(image));
+        CHECK_THROWS(libsarus::Error, registry.getDirectory());
+    }
+
+    auto nodeLocalDir = testDir.getPath() / "node-local";
+    config.json.AddMember("nodeLocalImageDir", rj::Value{nodeLocalDir.c_str(), config.json.GetAllocator()}, config.json.GetAllocator());
+    auto registry = StagedImageRegistry{configRAII.config};
+    CHECK(registry.isEnabled());
+    CHECK(registry.getDirectory() == nodeLocalDir / std::to_string(config.userIdentity.uid));
+
+    // image not staged yet
+    CHECK(!registry.findStagedImage(image));
+
+    // staged image matching the repository image
+    libsarus::filesystem::createFoldersIfNecessary(registry.getDirectory());
+    auto stagedFile = registry.getStagedImageFile(image);
+    libsarus::filesystem::copyFile(repositoryImage, stagedFile);
+    registry.registerImage(image, "abcd");
+    CHECK(registry.findStagedImage(image) && *registry.findStagedImage(image) == stagedFile);
+
+    // repository image was re-pulled: the staged copy is stale
+    {
+        auto repulledImage = image;
+        repulledImage.id = "fedcba0987654321";
+        CHECK(!registry.findStagedImage(repulledImage));
+    }
+    // staged copy modified after its registration, with the same size
+    {
+        libsarus::filesystem::writeTextFile("squashfs imag3", stagedFile);
+        boost::filesystem::last_write_time(stagedFile, boost::filesystem::last_write_time(stagedFile) - 10);
+        CHECK(!registry.findStagedImage(image));
+        registry.registerImage(image, "abcd");
+        CHECK(registry.findStagedImage(image));
+    }
+    // repository image modified with the same size
+    {
+        boost::filesystem::last_write_time(repositoryImage, boost::filesystem::last_write_time(repositoryImage) - 10);
+        CHECK(!registry.findStagedImage(image));
+        registry.registerImage(image, "abcd");
+        CHECK(registry.findStagedImage(image));
+    }
+    // staged copy replaced by a symlink
+    {
+        boost::filesystem::remove(stagedFile);
+        boost::filesystem::create_symlink(repositoryImage, stagedFile);
+        CHECK(!registry.findStagedImage(image));
+        boost::filesystem::remove(stagedFile);
+        libsarus::filesystem::copyFile(repositoryImage, stagedFile);
+        registry.registerImage(image, "abcd");
+    }
+    // size mismatch
+    {
+        libsarus::filesystem::writeTextFile("truncated", stagedFile);
+        CHECK(!registry.findStagedImage(image));
+    }
+}
+
+TEST(StagedImageRegistryTestGroup, transfer_key) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-staged-images")};
+    auto nodeLocalDir = testDir.getPath() / "node-local";
+    config.json.AddMember("nodeLocalImageDir", rj::Value{nodeLocalDir.c_str(), config.json.GetAllocator()}, config.json.GetAllocator());
+
+    auto repositoryImage = testDir.getPath() / "repository/alpine.squashfs";
+    libsarus::filesystem::createFoldersIfNecessary(repositoryImage.parent_path());
+    libsarus::filesystem::writeTextFile("squashfs image", repositoryImage);
+    auto image = common::SarusImage{
+        common::ImageReference{"docker.io", "library", "alpine", "latest", ""},
+        "1234567890abcdef",
+        common::SarusImage::createSizeString(14),
+        common::SarusImage::createTimeString(0),
+        repositoryImage,
+        testDir.getPath() / "repository/alpine.meta"};
+
+    // the secret file is created once and only accessible by the user
+    auto registry = StagedImageRegistry{configRAII.config};
+    auto key = registry.getTransferKey(image, "1234.0");
+    auto secretFile = config.getLocalRepositoryDirectory() / "stage.key";
+    CHECK(boost::filesystem::exists(secretFile));
+    CHECK((boost::filesystem::status(secretFile).permissions() & 0777) == 0600);
+    CHECK(registry.getTransferKey(image, "1234.0") == key);
+
+    // other jobs and images get other keys
+    CHECK(registry.getTransferKey(image, "1234.1") != key);
+    auto otherImage = image;
+    otherImage.id = "fedcba0987654321";
+    CHECK(registry.getTransferKey(otherImage, "1234.0") != key);
+
+    // the secret is rejected when accessible by other users
+    boost::filesystem::permissions(secretFile, boost::filesystem::perms(0644));
+    CHECK_THROWS(libsarus::Error, registry.getTransferKey(image, "1234.0"));
+    boost::filesystem::remove(secretFile);
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
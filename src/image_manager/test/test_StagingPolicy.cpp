@@ -0,0 +1,162 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/StagingPolicy.hpp"
+#include "test_utility/config.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+static void setStagingConfig(common::Config& config, const std::vector<boost::filesystem::path>& directories) {
+    auto& allocator = config.json.GetAllocator();
+    auto staging = rj::Value{rj::kObjectType};
+    auto array = rj::Value{rj::kArrayType};
+    for(const auto& directory : directories) {
+        array.PushBack(rj::Value{directory.c_str(), allocator}, allocator);
+    }
+    staging.AddMember("directories", array, allocator);
+    config.json.AddMember("tmpfsStaging", staging, allocator);
+}
+
+TEST_GROUP(StagingPolicyTestGroup) {
+};
+
+TEST(StagingPolicyTestGroup, readAvailableMemory) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-staging")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto meminfo = testDir.getPath() / "meminfo";
+
+    libsarus::filesystem::writeTextFile("MemTotal:       65536000 kB\n"
+                                        "MemFree:         1024000 kB\n"
+                                        "MemAvailable:   32768000 kB\n"
+                                        "Buffers:          102400 kB\n", meminfo);
+    CHECK(*StagingPolicy::readAvailableMemory(meminfo) == size_t{32768000} * 1024);
+
+    // old kernels do not provide MemAvailable
+    libsarus::filesystem::writeTextFile("MemTotal:       65536000 kB\n"
+                                        "MemFree:         1024000 kB\n", meminfo);
+    CHECK(!StagingPolicy::readAvailableMemory(meminfo));
+
+    CHECK(!StagingPolicy::readAvailableMemory(testDir.getPath() / "non-existent"));
+}
+
+TEST(StagingPolicyTestGroup, readCgroupMemoryHeadroom_v2) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-staging")};
+    auto procCgroup = testDir.getPath() / "cgroup";
+    auto cgroupRoot = testDir.getPath() / "sys/fs/cgroup";
+    auto jobCgroup = cgroupRoot / "slurm/job_1";
+    auto stepCgroup = jobCgroup / "step_0";
+    libsarus::filesystem::createFoldersIfNecessary(stepCgroup);
+    libsarus::filesystem::writeTextFile("0::/slurm/job_1/step_0\n", procCgroup);
+
+    // no limits
+    libsarus::filesystem::writeTextFile("max\n", stepCgroup / "memory.max");
+    libsarus::filesystem::writeTextFile("1000\n", stepCgroup / "memory.current");
+    CHECK(!StagingPolicy::readCgroupMemoryHeadroom(procCgroup, cgroupRoot));
+
+    // limit on the ancestor applies
+    libsarus::filesystem::writeTextFile("10000\n", jobCgroup / "memory.max");
+    libsarus::filesystem::writeTextFile("4000\n", jobCgroup / "memory.current");
+    CHECK(*StagingPolicy::readCgroupMemoryHeadroom(procCgroup, cgroupRoot) == 6000);
+
+    // the most restrictive limit applies
+    libsarus::filesystem::writeTextFile("3000\n", stepCgroup / "memory.max");
+    CHECK(*StagingPolicy::readCgroupMemoryHeadroom(procCgroup, cgroupRoot) == 2000);
+
+    // usage above the limit
+    libsarus::filesystem::writeTextFile("5000\n", stepCgroup / "memory.current");
+    CHECK(*StagingPolicy::readCgroupMemoryHeadroom(procCgroup, cgroupRoot) == 0);
+}
+
+TEST(StagingPolicyTestGroup, readCgroupMemoryHeadroom_v1) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-staging")};
+    auto procCgroup = testDir.getPath() / "cgroup";
+    auto cgroupRoot = testDir.getPath() / "sys/fs/cgroup";
+    auto memoryCgroup = cgroupRoot / "memory/slurm/uid_1000/job_1";
+    libsarus::filesystem::createFoldersIfNecessary(memoryCgroup);
+    libsarus::filesystem::createFoldersIfNecessary(cgroupRoot / "memory");
+    libsarus::filesystem::writeTextFile("12:devices:/slurm/uid_1000/job_1\n"
+                                        "4:memory:/slurm/uid_1000/job_1\n"
+                                        "1:name=systemd:/user.slice\n", procCgroup);
+
+    // unlimited root of the hierarchy
+    libsarus::filesystem::writeTextFile("9223372036854771712\n", cgroupRoot / "memory/memory.limit_in_bytes");
+    libsarus::filesystem::writeTextFile("123456789\n", cgroupRoot / "memory/memory.usage_in_bytes");
+    CHECK(!StagingPolicy::readCgroupMemoryHeadroom(procCgroup, cgroupRoot));
+
+    libsarus::filesystem::writeTextFile("8192\n", memoryCgroup / "memory.limit_in_bytes");
+    libsarus::filesystem::writeTextFile("4096\n", memoryCgroup / "memory.usage_in_bytes");
+    CHECK(*StagingPolicy::readCgroupMemoryHeadroom(procCgroup, cgroupRoot) == 4096);
+}
+
+TEST(StagingPolicyTestGroup, estimateAndBudget) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    setStagingConfig(config, {});
+
+    CHECK_EQUAL(StagingPolicy{configRAII.config}.estimateUnpackedSize(1000), 3000);
+    config.json["tmpfsStaging"].AddMember("expansionFactor", 2.5, config.json.GetAllocator());
+    CHECK_EQUAL(StagingPolicy{configRAII.config}.estimateUnpackedSize(1000), 2500);
+
+    config.json["tmpfsStaging"].AddMember("memoryBudgetMB", 1, config.json.GetAllocator());
+    auto budget = StagingPolicy{configRAII.config}.getMemoryBudget();
+    CHECK(budget);
+    CHECK(*budget <= 1024*1024);
+}
+
+TEST(StagingPolicyTestGroup, chooseUnpackDirectory) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = *configRAII.config;
+    auto candidate = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-staging")};
+    libsarus::filesystem::createFoldersIfNecessary(candidate.getPath());
+
+    // staging not enabled
+    {
+        auto decision = StagingPolicy{configRAII.config}.chooseUnpackDirectory(1024);
+        CHECK(decision.directory == config.directories.temp);
+        CHECK_EQUAL(decision.estimatedSize, 0);
+    }
+
+    setStagingConfig(config, {candidate.getPath() / "non-existent", candidate.getPath()});
+    config.json["tmpfsStaging"].AddMember("memoryBudgetMB", 1, config.json.GetAllocator());
+
+    // estimate fits: the first valid candidate is chosen
+    {
+        auto decision = StagingPolicy{configRAII.config}.chooseUnpackDirectory(1024);
+        CHECK(decision.directory == candidate.getPath());
+        CHECK_EQUAL(decision.estimatedSize, 3072);
+        CHECK_EQUAL(decision.isMemoryBacked, StagingPolicy::isMemoryBacked(candidate.getPath()));
+    }
+    // estimate exceeds the free space of the candidate: fall back to the temporary directory
+    {
+        auto layersSize = StagingPolicy::getFreeSpace(candidate.getPath());
+        auto decision = StagingPolicy{configRAII.config}.chooseUnpackDirectory(layersSize);
+        CHECK(decision.directory == config.directories.temp);
+    }
+    // temporary directory from the CLI takes precedence
+    {
+        config.directories.tempFromCLI = config.directories.temp.string();
+        auto decision = StagingPolicy{configRAII.config}.chooseUnpackDirectory(1024);
+        CHECK(decision.directory == config.directories.temp);
+    }
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
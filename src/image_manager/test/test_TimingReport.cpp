@@ -0,0 +1,123 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Utility.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "image_manager/TimingReport.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+namespace sarus {
+namespace image_manager {
+namespace test {
+
+TEST_GROUP(TimingReportTestGroup) {
+};
+
+TEST(TimingReportTestGroup, testScopedPhase) {
+    auto report = TimingReport{"pull", "docker.io/library/alpine:latest"};
+
+    // phase measured until explicit stop
+    {
+        TimingReport::ScopedPhase phase{report, "first"};
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        phase.stop();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    // phase measured until destruction
+    {
+        TimingReport::ScopedPhase phase{report, "second"};
+    }
+    // phase interrupted by an exception is still reported
+    try {
+        TimingReport::ScopedPhase phase{report, "third"};
+        SARUS_THROW_ERROR("test exception");
+    }
+    catch(const libsarus::Error&) {}
+
+    const auto& phases = report.getPhases();
+    CHECK_EQUAL(phases.size(), 3);
+    CHECK_EQUAL(phases[0].name, std::string{"first"});
+    CHECK(phases[0].seconds >= 0.02);
+    CHECK_EQUAL(phases[1].name, std::string{"second"});
+    CHECK_EQUAL(phases[2].name, std::string{"third"});
+    CHECK(report.getTotalSeconds() >= phases[0].seconds + phases[1].seconds + phases[2].seconds);
+}
+
+TEST(TimingReportTestGroup, testCountersAndTempUsage) {
+    auto report = TimingReport{"load", "load/library/image:latest"};
+
+    report.setCounter("ociLayers", 100);
+    report.setCounter("unpackedRootfs", 300);
+    report.setCounter("ociLayers", 200);
+    CHECK_EQUAL(report.getCounters().size(), 2);
+    CHECK_EQUAL(report.getCounters()[0].first, std::string{"ociLayers"});
+    CHECK_EQUAL(report.getCounters()[0].second, 200);
+
+    report.updateTempUsage(500);
+    report.updateTempUsage(1000);
+    report.updateTempUsage(700);
+    CHECK_EQUAL(report.getPeakTempUsage(), 1000);
+}
+
+TEST(TimingReportTestGroup, testJSON) {
+    auto report = TimingReport{"pull", "docker.io/library/alpine:latest"};
+    report.addPhase("unpack", 1.5);
+    report.addPhase("mksquashfs", 2.5);
+    report.setCounter("squashfsImage", 4096);
+    report.updateTempUsage(8192);
+
+    auto json = report.toJSON();
+    CHECK_EQUAL(json["operation"].GetString(), std::string{"pull"});
+    CHECK_EQUAL(json["image"].GetString(), std::string{"docker.io/library/alpine:latest"});
+    CHECK_EQUAL(json["phases"].Size(), 2);
+    CHECK_EQUAL(json["phases"][0]["name"].GetString(), std::string{"unpack"});
+    CHECK(json["phases"][0]["seconds"].GetDouble() == 1.5);
+    CHECK_EQUAL(json["phases"][1]["name"].GetString(), std::string{"mksquashfs"});
+    CHECK_EQUAL(json["bytes"]["squashfsImage"].GetUint64(), 4096);
+    CHECK_EQUAL(json["estimatedPeakTempBytes"].GetUint64(), 8192);
+    CHECK(json["totalSeconds"].IsNumber());
+
+    // the temporary space is only estimated when the sizes of the artifacts are computed
+    auto reportWithoutTempUsage = TimingReport{"pull", "docker.io/library/alpine:latest"};
+    CHECK(!reportWithoutTempUsage.toJSON().HasMember("estimatedPeakTempBytes"));
+
+    // write to file
+    auto reportFile = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-timing-report")};
+    report.write(reportFile.getPath());
+    auto readback = libsarus::json::read(reportFile.getPath());
+    CHECK_EQUAL(readback["phases"].Size(), 2);
+    CHECK_EQUAL(readback["bytes"]["squashfsImage"].GetUint64(), 4096);
+}
+
+TEST(TimingReportTestGroup, testAppendToMetadataFile) {
+    auto metadataFile = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-metadata")};
+    libsarus::filesystem::writeTextFile("{\"Cmd\": [\"/bin/sh\"], \"Env\": []}", metadataFile.getPath());
+
+    auto report = TimingReport{"pull", "docker.io/library/alpine:latest"};
+    report.addPhase("unpack", 1.0);
+    report.appendToMetadataFile(metadataFile.getPath());
+
+    // appending twice replaces the previous report
+    report.addPhase("mksquashfs", 1.0);
+    report.appendToMetadataFile(metadataFile.getPath());
+
+    auto metadata = libsarus::json::read(metadataFile.getPath());
+    CHECK_EQUAL(metadata["Cmd"][0].GetString(), std::string{"/bin/sh"});
+    CHECK_EQUAL(metadata["SarusTimingReport"]["phases"].Size(), 2);
+}
+
+}}} // namespace
+
+SARUS_UNITTEST_MAIN_FUNCTION();
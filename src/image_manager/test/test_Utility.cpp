@@ -111,6 +111,16 @@ TEST(ImageManagerUtilityTestGroup, base64Encode) {
     CHECK(utility::base64Encode("alice:Aw3s0m&_P@s5w0rD") == "YWxpY2U6QXczczBtJl9QQHM1dzByRA==");
 }
 
+TEST(ImageManagerUtilityTestGroup, base64Decode) {
+    CHECK(utility::base64Decode("") == "");
+    CHECK(utility::base64Decode("YWJj") == "abc");
+    CHECK(utility::base64Decode("YWJjMQ==") == "abc1");
+    CHECK(utility::base64Decode("YWJjMQ") == "abc1");
+    CHECK(utility::base64Decode("Wnl4V3Z1dDA5ODc2NTQ=") == "ZyxWvut0987654");
+    CHECK(utility::base64Decode("YWxpY2U6QXczczBtJl9QQHM1dzByRA==") == "alice:Aw3s0m&_P@s5w0rD");
+    CHECK_THROWS(libsarus::Error, utility::base64Decode("YW*j"));
+}
+
 }}} // namespace
 
 SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,340 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "MountPlan.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/format.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+
+// The new mount API is called through syscall(), because the glibc wrappers
+// and the definitions of the headers are only available in recent versions
+#ifndef __NR_open_tree
+#define __NR_open_tree 428
+#endif
+#ifndef __NR_move_mount
+#define __NR_move_mount 429
+#endif
+#ifndef __NR_mount_setattr
+#define __NR_mount_setattr 442
+#endif
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef MOVE_MOUNT_T_EMPTY_PATH
+#define MOVE_MOUNT_T_EMPTY_PATH 0x00000040
+#endif
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#endif
+#ifndef MOUNT_ATTR_NOSUID
+#define MOUNT_ATTR_NOSUID 0x00000002
+#endif
+
+namespace libsarus {
+
+namespace {
+
+// layout of struct mount_attr (linux/mount.h)
+struct MountAttributes {
+    std::uint64_t attr_set;
+    std::uint64_t attr_clr;
+    std::uint64_t propagation;
+    std::uint64_t userns_fd;
+};
+
+/**
+ * Returns the components of the destination, without "." and with ".." applied,
+ * to compare destinations regardless of their spelling.
+ */
+std::vector<std::string> getComponents(const boost::filesystem::path& destination) {
+    auto components = std::vector<std::string>{};
+    for(const auto& component : destination) {
+        auto name = component.string();
+        if(name.empty() || name == "/" || name == ".") {
+            continue;
+        }
+        if(name == "..") {
+            if(!components.empty()) {
+                components.pop_back();
+            }
+            continue;
+        }
+        components.push_back(name);
+    }
+    return components;
+}
+
+bool isStrictPrefix(const std::vector<std::string>& prefix, const std::vector<std::string>& components) {
+    return prefix.size() < components.size()
+        && std::equal(prefix.cbegin(), prefix.cend(), components.cbegin());
+}
+
+std::string formatFlags(unsigned long flags) {
+    return (flags & MS_RDONLY) ? "ro" : "rw";
+}
+
+}
+
+MountPlan::MountPlan(const boost::filesystem::path& rootfsDir, const UserIdentity& userIdentity, bool rootless)
+    : rootfsDir{rootfsDir}
+    , userIdentity{userIdentity}
+    , rootless{rootless}
+    , resolver{new RootfsResolver{rootfsDir}}
+{}
+
+void MountPlan::add(const Mount& mount, const std::string& origin) {
+    if(isResolved) {
+        SARUS_THROW_ERROR("Internal error: attempted to add a mount to a mount plan already resolved");
+    }
+    auto entry = Entry{};
+    entry.source = mount.getSource();
+    entry.destination = mount.getDestination();
+    entry.flags = mount.getFlags();
+    entry.origin = origin;
+    entries.push_back(std::move(entry));
+}
+
+/**
+ * Deduplicates the entries by destination, orders them by depth of the destination
+ * and marks the entries nested in the destination of another entry.
+ */
+void MountPlan::order() {
+    auto seenDestinations = std::unordered_set<std::string>{};
+    auto keptEntries = std::vector<Entry>{};
+    for(auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        auto key = boost::algorithm::join(getComponents(it->destination), "/");
+        if(!seenDestinations.insert(key).second) {
+            logMessage(boost::format("Mount plan: dropping %s mount %s -> %s, overridden by a later mount of the same destination")
+                % it->origin % it->source % it->destination, LogLevel::DEBUG);
+            continue;
+        }
+        keptEntries.push_back(std::move(*it));
+    }
+    std::reverse(keptEntries.begin(), keptEntries.end());
+
+    std::stable_sort(keptEntries.begin(), keptEntries.end(), [](const Entry& lhs, const Entry& rhs) {
+        return getComponents(lhs.destination).size() < getComponents(rhs.destination).size();
+    });
+
+    for(auto& entry : keptEntries) {
+        auto components = getComponents(entry.destination);
+        entry.isNested = std::any_of(keptEntries.cbegin(), keptEntries.cend(), [&](const Entry& other) {
+            return isStrictPrefix(getComponents(other.destination), components);
+        });
+    }
+    entries = std::move(keptEntries);
+}
+
+/**
+ * Resolves and validates the sources and destinations of the entries which are not
+ * nested, switching to the user identity once, so that the user must have access to
+ * the sources also on root_squashed filesystems. See mount::validatedBindMount.
+ */
+void MountPlan::resolve() {
+    order();
+
+    auto rootIdentity = UserIdentity{};
+    auto targetIdentity = rootless ? rootIdentity : userIdentity;
+    const Entry* current = nullptr;
+    try {
+        process::switchIdentity(targetIdentity);
+        for(auto& entry : entries) {
+            if(entry.isNested) {
+                continue;
+            }
+            current = &entry;
+            entry.sourceReal = mount::getValidatedMountSource(entry.source);
+            entry.destinationReal = mount::getValidatedMountDestination(entry.destination, *resolver);
+            entry.isSourceDirectory = boost::filesystem::is_directory(entry.sourceReal);
+        }
+        process::switchIdentity(rootIdentity);
+    }
+    catch(std::exception& e) {
+        process::switchIdentity(rootIdentity);
+        if(!current) {
+            SARUS_RETHROW_ERROR(e, "Failed to resolve the mounts of the mount plan");
+        }
+        logAndRethrow(e, *current);
+    }
+    isResolved = true;
+}
+
+void MountPlan::execute() {
+    if(!isResolved) {
+        resolve();
+    }
+
+    // the mount points are created as root, to enable mounts to the root-owned /dev directory in the container
+    auto mountPoints = std::vector<RootfsResolver::Descriptor>(entries.size());
+    for(size_t i = 0; i < entries.size(); ++i) {
+        if(!entries[i].isNested) {
+            try {
+                mountPoints[i] = createMountPoint(entries[i]);
+            }
+            catch(std::exception& e) {
+                logAndRethrow(e, entries[i]);
+            }
+        }
+    }
+
+    // the sources are accessed with the user's filesystem identity, to support root_squashed filesystems
+    auto rootIdentity = UserIdentity{};
+    if(!rootless) process::setFilesystemUid(userIdentity);
+    for(size_t i = 0; i < entries.size(); ++i) {
+        if(!entries[i].isNested) {
+            try {
+                performMount(entries[i], mountPoints[i]);
+            }
+            catch(std::exception& e) {
+                if(!rootless) process::setFilesystemUid(rootIdentity);
+                logAndRethrow(e, entries[i]);
+            }
+        }
+    }
+    if(!rootless) process::setFilesystemUid(rootIdentity);
+
+    // the nested entries are validated against the mounts performed above
+    for(const auto& entry : entries) {
+        if(entry.isNested) {
+            try {
+                mount::validatedBindMount(entry.source, entry.destination, userIdentity, rootfsDir, entry.flags, rootless);
+            }
+            catch(Error& e) {
+                logMessage(e.getErrorTrace().back().errorMessage, LogLevel::GENERAL, std::cerr);
+                SARUS_RETHROW_ERROR(e, std::string("Failed to perform custom bind mount"), LogLevel::INFO);
+            }
+        }
+    }
+}
+
+std::string MountPlan::dump() const {
+    std::stringstream stream;
+    stream << boost::format("Mount plan of %s (%d mounts, %s):")
+        % rootfsDir % entries.size() % (isNewMountApiAvailable() ? "new mount API" : "mount(2)");
+    auto index = 0;
+    for(const auto& entry : entries) {
+        stream << boost::format("\n  %d. [%s] %s -> %s (%s%s)")
+            % ++index % entry.origin % entry.source.string() % entry.destination.string()
+            % formatFlags(entry.flags) % (entry.isNested ? ", nested" : "");
+        if(!entry.sourceReal.empty()) {
+            stream << boost::format("\n     resolved: %s -> %s") % entry.sourceReal.string() % entry.destinationReal.string();
+        }
+    }
+    return stream.str();
+}
+
+RootfsResolver::Descriptor MountPlan::createMountPoint(const Entry& entry) const {
+    // the ownership of the mount point has no effect on the mounted resource,
+    // but a non-root-owned mount point reduces cleanup problems
+    if(entry.isSourceDirectory) {
+        return resolver->createFoldersIfNecessary(entry.destination, userIdentity.uid, userIdentity.gid);
+    }
+    else {
+        return resolver->createFileIfNecessary(entry.destination, userIdentity.uid, userIdentity.gid);
+    }
+}
+
+void MountPlan::performMount(const Entry& entry, const RootfsResolver::Descriptor& mountPoint) const {
+    logMessage(boost::format("Performing bind mount: source = %s; target = %s; mount flags = %d")
+        % entry.sourceReal.string() % entry.destinationReal.string() % entry.flags, LogLevel::DEBUG);
+    if(!performMountWithNewApi(entry, mountPoint)) {
+        mount::bindMount(entry.sourceReal, entry.destinationReal, entry.flags);
+    }
+}
+
+/**
+ * Returns false if the new mount API is not supported by the kernel, in which case
+ * nothing was mounted.
+ */
+bool MountPlan::performMountWithNewApi(const Entry& entry, const RootfsResolver::Descriptor& mountPoint) const {
+    if(!isNewMountApiAvailable()) {
+        return false;
+    }
+
+    auto fd = static_cast<int>(syscall(__NR_open_tree, AT_FDCWD, entry.sourceReal.c_str(),
+                                       OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE));
+    if(fd < 0 && (errno == ENOSYS || errno == EPERM)) {
+        // open_tree() can be filtered by seccomp independently of mount_setattr()
+        logMessage(boost::format("open_tree not available (error: %s): falling back to mount(2)") % strerror(errno),
+                   LogLevel::DEBUG);
+        return false;
+    }
+    if(fd < 0) {
+        auto message = boost::format("Failed to clone mount tree of %s (error: %s)") % entry.sourceReal % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto attributes = MountAttributes{};
+    attributes.attr_set = MOUNT_ATTR_NOSUID | ((entry.flags & MS_RDONLY) ? MOUNT_ATTR_RDONLY : 0);
+    attributes.propagation = MS_PRIVATE;
+    if(syscall(__NR_mount_setattr, fd, "", AT_EMPTY_PATH | AT_RECURSIVE, &attributes, sizeof(attributes)) != 0) {
+        auto message = boost::format("Failed to set attributes of mount tree of %s (error: %s)") % entry.sourceReal % strerror(errno);
+        close(fd);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto result = mountPoint.isValid()
+        ? syscall(__NR_move_mount, fd, "", mountPoint.get(), "", MOVE_MOUNT_F_EMPTY_PATH | MOVE_MOUNT_T_EMPTY_PATH)
+        : syscall(__NR_move_mount, fd, "", AT_FDCWD, entry.destinationReal.c_str(), MOVE_MOUNT_F_EMPTY_PATH);
+    if(result != 0) {
+        auto message = boost::format("Failed to bind mount %s -> %s (error: %s)")
+            % entry.sourceReal % entry.destinationReal % strerror(errno);
+        close(fd);
+        SARUS_THROW_ERROR(message.str());
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * The new mount API is available if mount_setattr() (Linux 5.12, the most recent of the
+ * three syscalls) is. The probe passes an invalid file descriptor, which fails with
+ * EBADF if the syscall exists, and with ENOSYS otherwise (or EPERM if it is filtered by seccomp).
+ */
+bool MountPlan::isNewMountApiAvailable() {
+    static const bool isAvailable = [] {
+        auto attributes = MountAttributes{};
+        auto result = syscall(__NR_mount_setattr, -1, "", AT_EMPTY_PATH, &attributes, sizeof(attributes));
+        return result == 0 || (errno != ENOSYS && errno != EPERM);
+    }();
+    return isAvailable;
+}
+
+void MountPlan::logAndRethrow(std::exception& error, const Entry& entry) const {
+    auto message = boost::format("Failed to bind mount %s on container's %s: %s")
+                   % entry.source.string() % entry.destination.string() % error.what();
+    logMessage(message.str(), LogLevel::GENERAL, std::cerr);
+    SARUS_RETHROW_ERROR(error, std::string("Failed to perform custom bind mount"), LogLevel::INFO);
+}
+
+}
@@ -0,0 +1,92 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef libsarus_MountPlan_hpp
+#define libsarus_MountPlan_hpp
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Mount.hpp"
+#include "libsarus/RootfsResolver.hpp"
+#include "libsarus/UserIdentity.hpp"
+
+namespace libsarus {
+
+/**
+ * Collects the bind mounts of a container and performs them as a batch.
+ *
+ * The mounts are deduplicated by destination (the last requested mount of a
+ * destination wins, as it is the one visible in the container) and ordered by
+ * depth of the destination, so that a mount is never shadowed by a mount of one
+ * of its parent directories. Sources and destinations are resolved and validated
+ * in one pass under the user identity, the mount points are created in one pass
+ * as root, and the mounts are performed in one pass under the user's filesystem
+ * identity.
+ *
+ * Where available (Linux >= 5.12), the mounts are performed with the new mount
+ * API: open_tree() clones the source, mount_setattr() applies the flags and the
+ * propagation to the detached tree, and move_mount() attaches it, instead of a
+ * bind mount followed by two remounts. The mount points are created and opened
+ * through a RootfsResolver, and the mounts are attached to the descriptors of the
+ * mount points, so that they can't be redirected by changes of the rootfs after
+ * the validation.
+ *
+ * A mount whose destination is inside the destination of another mount of the plan
+ * can only be validated once the latter is in place: such nested mounts are
+ * resolved and performed individually after the others.
+ */
+class MountPlan {
+public:
+    struct Entry {
+        boost::filesystem::path source;
+        boost::filesystem::path destination;
+        unsigned long flags = 0;
+        std::string origin;
+        boost::filesystem::path sourceReal;
+        boost::filesystem::path destinationReal;
+        bool isSourceDirectory = false;
+        bool isNested = false;
+    };
+
+public:
+    MountPlan(const boost::filesystem::path& rootfsDir, const UserIdentity& userIdentity, bool rootless=false);
+
+    void add(const Mount& mount, const std::string& origin);
+    void resolve();
+    void execute();
+    std::string dump() const;
+    const std::vector<Entry>& getEntries() const { return entries; }
+
+    static bool isNewMountApiAvailable();
+
+private:
+    void order();
+    RootfsResolver::Descriptor createMountPoint(const Entry& entry) const;
+    void performMount(const Entry& entry, const RootfsResolver::Descriptor& mountPoint) const;
+    bool performMountWithNewApi(const Entry& entry, const RootfsResolver::Descriptor& mountPoint) const;
+    void logAndRethrow(std::exception& error, const Entry& entry) const;
+
+private:
+    boost::filesystem::path rootfsDir;
+    UserIdentity userIdentity;
+    bool rootless;
+    std::unique_ptr<RootfsResolver> resolver;
+    std::vector<Entry> entries;
+    bool isResolved = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "RootfsResolver.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/utility/filesystem.hpp"
+#include "libsarus/utility/logging.hpp"
+
+// openat2() is called through syscall(), because the glibc wrapper
+// and the definitions of the headers are only available in recent versions
+#ifndef __NR_openat2
+#define __NR_openat2 437
+#endif
+#ifndef RESOLVE_NO_MAGICLINKS
+#define RESOLVE_NO_MAGICLINKS 0x02
+#endif
+#ifndef RESOLVE_NO_SYMLINKS
+#define RESOLVE_NO_SYMLINKS 0x04
+#endif
+#ifndef RESOLVE_BENEATH
+#define RESOLVE_BENEATH 0x08
+#endif
+#ifndef RESOLVE_IN_ROOT
+#define RESOLVE_IN_ROOT 0x10
+#endif
+
+namespace libsarus {
+
+namespace {
+
+// layout of struct open_how (linux/openat2.h)
+struct OpenHow {
+    std::uint64_t flags;
+    std::uint64_t mode;
+    std::uint64_t resolve;
+};
+
+// openat2() fails with EAGAIN if a rename or a mount raced with the resolution
+const int maxOpenat2Attempts = 8;
+
+int openat2(int directoryFd, const char* path, std::uint64_t flags, std::uint64_t resolve) {
+    auto how = OpenHow{};
+    how.flags = flags | O_PATH | O_CLOEXEC;
+    how.resolve = resolve;
+    int fd = -1;
+    for(int attempt = 0; attempt < maxOpenat2Attempts; ++attempt) {
+        fd = static_cast<int>(syscall(__NR_openat2, directoryFd, path, &how, sizeof(how)));
+        if(fd >= 0 || errno != EAGAIN) {
+            break;
+        }
+    }
+    return fd;
+}
+
+boost::filesystem::path getPathOfDescriptor(int fd) {
+    auto link = boost::format("/proc/self/fd/%d") % fd;
+    char buffer[PATH_MAX];
+    auto count = readlink(link.str().c_str(), buffer, PATH_MAX - 1);
+    if(count < 0) {
+        auto message = boost::format("Failed to read %s: %s") % link % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    buffer[count] = '\0';
+    return buffer;
+}
+
+}
+
+RootfsResolver::Descriptor::Descriptor(int fd)
+    : fd{fd}
+{}
+
+RootfsResolver::Descriptor::Descriptor(Descriptor&& rhs)
+    : fd{rhs.fd}
+{
+    rhs.fd = -1;
+}
+
+RootfsResolver::Descriptor& RootfsResolver::Descriptor::operator=(Descriptor&& rhs) {
+    if(this != &rhs) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        fd = rhs.fd;
+        rhs.fd = -1;
+    }
+    return *this;
+}
+
+RootfsResolver::Descriptor::~Descriptor() {
+    if(fd >= 0) {
+        close(fd);
+    }
+}
+
+RootfsResolver::RootfsResolver(const boost::filesystem::path& rootfsDir)
+    : rootfsDir{rootfsDir}
+{
+    if(!isOpenat2Available()) {
+        logMessage("openat2 not available: resolving paths within rootfs in user space", LogLevel::DEBUG);
+        return;
+    }
+    auto fd = Descriptor{::open(rootfsDir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC)};
+    if(!fd.isValid()) {
+        logMessage(boost::format("Failed to open rootfs %s (%s): resolving paths within rootfs in user space")
+            % rootfsDir % strerror(errno), LogLevel::DEBUG);
+        return;
+    }
+    try {
+        rootfsDirReal = getPathOfDescriptor(fd.get());
+    }
+    catch(Error& e) {
+        logMessage(boost::format("%s: resolving paths within rootfs in user space") % e.what(), LogLevel::DEBUG);
+        return;
+    }
+    rootfsFd = std::move(fd);
+}
+
+/**
+ * Returns the path, within the rootfs, of the object designated by 'path', with all the
+ * symlinks resolved. The components of the path which don't exist are appended as they are.
+ */
+boost::filesystem::path RootfsResolver::resolve(const boost::filesystem::path& path) {
+    if(!path.is_absolute()) {
+        auto message = boost::format("Failed to determine realpath within rootfs. %s is not an absolute path.") % path;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto it = memo.find(path.string());
+    if(it != memo.cend()) {
+        return it->second;
+    }
+
+    auto result = boost::filesystem::path{};
+    if(path == path.root_path()) {
+        result = "/";
+    }
+    else if(!isUsingOpenat2() || !resolveWithOpenat2(path, result)) {
+        auto parent = resolve(path.parent_path());
+        result = filesystem::appendPathsWithinRootfs(rootfsDir, parent, path.filename());
+    }
+
+    memo[path.string()] = result;
+    return result;
+}
+
+/**
+ * Returns false if the path doesn't exist (entirely) in the rootfs, in which case the caller
+ * has to resolve the parent directory and append the last component.
+ */
+bool RootfsResolver::resolveWithOpenat2(const boost::filesystem::path& path, boost::filesystem::path& result) {
+    auto fd = Descriptor{openat2(rootfsFd.get(), path.relative_path().c_str(), 0,
+                                 RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS)};
+    if(!fd.isValid()) {
+        if(errno == ELOOP) {
+            auto message = boost::format("Failed to resolve %s within rootfs %s: too many levels of"
+                                         " symbolic links or magic link in path") % path % rootfsDir;
+            SARUS_THROW_ERROR(message.str());
+        }
+        return false;
+    }
+    result = getPathWithinRootfs(fd);
+    return true;
+}
+
+/**
+ * Returns an O_PATH descriptor of the object designated by 'path' within the rootfs.
+ */
+RootfsResolver::Descriptor RootfsResolver::open(const boost::filesystem::path& path) {
+    auto fd = Descriptor{};
+    if(isUsingOpenat2()) {
+        fd = Descriptor{openat2(rootfsFd.get(), path.relative_path().c_str(), 0,
+                                RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS)};
+    }
+    else {
+        fd = Descriptor{::open((rootfsDir / resolve(path)).c_str(), O_PATH | O_CLOEXEC)};
+    }
+    if(!fd.isValid()) {
+        auto message = boost::format("Failed to open %s within rootfs %s: %s") % path % rootfsDir % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return fd;
+}
+
+/**
+ * Creates the directory designated by 'path' within the rootfs and its missing parents, and returns
+ * an O_PATH descriptor of the directory. With openat2, the directories are created one at a time,
+ * relative to the descriptor of their parent and without following symlinks, so that a concurrent
+ * modification of the rootfs can't redirect the creation out of the rootfs.
+ */
+RootfsResolver::Descriptor RootfsResolver::createFoldersIfNecessary(const boost::filesystem::path& path, uid_t uid, gid_t gid) {
+    auto resolved = resolve(path);
+    if(!isUsingOpenat2()) {
+        filesystem::createFoldersIfNecessary(rootfsDir / resolved, uid, gid);
+        return open(path);
+    }
+
+    auto current = openBeneath(rootfsFd, ".", O_DIRECTORY);
+    for(const auto& element : resolved) {
+        if(element == "/") {
+            continue;
+        }
+        auto name = element.string();
+        auto next = openBeneath(current, name, O_DIRECTORY);
+        if(!next.isValid()) {
+            logMessage(boost::format{"Creating directory %s"} % (rootfsDir / resolved), LogLevel::DEBUG);
+            // the directory might have been created concurrently by another process
+            if(mkdirat(current.get(), name.c_str(), 0777) != 0 && errno != EEXIST) {
+                auto message = boost::format("Failed to create directory %s: %s") % (rootfsDir / resolved) % strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+            next = openBeneath(current, name, O_DIRECTORY);
+            if(!next.isValid()) {
+                auto message = boost::format("Failed to create directory %s") % (rootfsDir / resolved);
+                SARUS_THROW_ERROR(message.str());
+            }
+            if(fchownat(next.get(), "", uid, gid, AT_EMPTY_PATH) != 0) {
+                auto message = boost::format("Failed to set ownership of %s: %s") % (rootfsDir / resolved) % strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+        }
+        current = std::move(next);
+    }
+    return current;
+}
+
+/**
+ * Creates the file designated by 'path' within the rootfs and its missing parent directories,
+ * and returns an O_PATH descriptor of the file.
+ */
+RootfsResolver::Descriptor RootfsResolver::createFileIfNecessary(const boost::filesystem::path& path, uid_t uid, gid_t gid) {
+    auto resolved = resolve(path);
+    if(!isUsingOpenat2()) {
+        filesystem::createFileIfNecessary(rootfsDir / resolved, uid, gid);
+        return open(path);
+    }
+
+    auto parent = createFoldersIfNecessary(resolved.parent_path(), uid, gid);
+    auto name = resolved.filename().string();
+    auto file = openBeneath(parent, name, 0);
+    if(file.isValid()) {
+        logMessage(boost::format{"File %s already exists"} % (rootfsDir / resolved), LogLevel::DEBUG);
+        return file;
+    }
+
+    logMessage(boost::format{"Creating file %s"} % (rootfsDir / resolved), LogLevel::DEBUG);
+    auto created = Descriptor{openat(parent.get(), name.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_NOFOLLOW | O_CLOEXEC, 0666)};
+    if(!created.isValid() && errno != EEXIST) {
+        auto message = boost::format("Failed to create file %s: %s") % (rootfsDir / resolved) % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    file = openBeneath(parent, name, 0);
+    if(!file.isValid()) {
+        auto message = boost::format("Failed to create file %s") % (rootfsDir / resolved);
+        SARUS_THROW_ERROR(message.str());
+    }
+    if(fchownat(file.get(), "", uid, gid, AT_EMPTY_PATH) != 0) {
+        auto message = boost::format("Failed to set ownership of %s: %s") % (rootfsDir / resolved) % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return file;
+}
+
+/**
+ * Opens 'name' in 'directory' without following any symlink. Returns an invalid descriptor
+ * if 'name' doesn't exist.
+ */
+RootfsResolver::Descriptor RootfsResolver::openBeneath(const Descriptor& directory, const std::string& name, int flags) const {
+    auto fd = Descriptor{openat2(directory.get(), name.c_str(), flags, RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS)};
+    if(!fd.isValid() && errno != ENOENT) {
+        auto message = boost::format("Failed to open %s within rootfs %s: %s") % name % rootfsDir % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return fd;
+}
+
+boost::filesystem::path RootfsResolver::getPathWithinRootfs(const Descriptor& descriptor) const {
+    auto path = getPathOfDescriptor(descriptor.get());
+    if(path == rootfsDirReal) {
+        return "/";
+    }
+    auto prefix = rootfsDirReal.string() + "/";
+    if(path.string().compare(0, prefix.size(), prefix) != 0) {
+        auto message = boost::format("Internal error: path %s resolved within rootfs %s is out of the rootfs")
+            % path % rootfsDir;
+        SARUS_THROW_ERROR(message.str());
+    }
+    return boost::filesystem::path{"/"} / path.string().substr(prefix.size());
+}
+
+/**
+ * The probe passes an invalid file descriptor, which fails with EBADF if the syscall
+ * exists, and with ENOSYS otherwise (or EPERM if it is filtered by seccomp).
+ */
+bool RootfsResolver::isOpenat2Available() {
+    static const bool isAvailable = [] {
+        auto how = OpenHow{};
+        how.flags = O_PATH | O_CLOEXEC;
+        auto fd = syscall(__NR_openat2, -1, "", &how, sizeof(how));
+        if(fd >= 0) {
+            close(static_cast<int>(fd));
+            return true;
+        }
+        return errno != ENOSYS && errno != EPERM;
+    }();
+    return isAvailable;
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef libsarus_RootfsResolver_hpp
+#define libsarus_RootfsResolver_hpp
+
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+
+#include <boost/filesystem.hpp>
+
+namespace libsarus {
+
+/**
+ * Resolves paths within a container's rootfs, i.e. as if the rootfs were the root
+ * directory: absolute symlinks are resolved relative to the rootfs and ".." never
+ * leads out of it.
+ *
+ * Where available (Linux >= 5.6), the paths are resolved by the kernel with openat2()
+ * and RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS, in one syscall per path. The resulting
+ * O_PATH descriptors can be used as targets of mounts and *at() syscalls, so that the
+ * object which was validated is also the one which is operated upon, even if the
+ * rootfs is modified in between. On older kernels, the resolver falls back to
+ * filesystem::appendPathsWithinRootfs.
+ *
+ * The resolved paths are memoized for the lifetime of the resolver. In fallback mode,
+ * paths are resolved parent first, so that the symlinks of the prefixes shared by many
+ * paths (e.g. /usr/lib64) are only looked up once.
+ */
+class RootfsResolver {
+public:
+    /**
+     * Owns a file descriptor, which is closed on destruction
+     */
+    class Descriptor {
+    public:
+        explicit Descriptor(int fd=-1);
+        Descriptor(Descriptor&& rhs);
+        Descriptor& operator=(Descriptor&& rhs);
+        ~Descriptor();
+        int get() const { return fd; }
+        bool isValid() const { return fd >= 0; }
+
+    private:
+        int fd;
+    };
+
+public:
+    explicit RootfsResolver(const boost::filesystem::path& rootfsDir);
+    RootfsResolver(const RootfsResolver&) = delete;
+    RootfsResolver& operator=(const RootfsResolver&) = delete;
+
+    const boost::filesystem::path& getRootfsDir() const { return rootfsDir; }
+    bool isUsingOpenat2() const { return rootfsFd.isValid(); }
+
+    boost::filesystem::path resolve(const boost::filesystem::path& path);
+    Descriptor open(const boost::filesystem::path& path);
+    Descriptor createFoldersIfNecessary(const boost::filesystem::path& path, uid_t uid=-1, gid_t gid=-1);
+    Descriptor createFileIfNecessary(const boost::filesystem::path& path, uid_t uid=-1, gid_t gid=-1);
+
+    static bool isOpenat2Available();
+
+private:
+    bool resolveWithOpenat2(const boost::filesystem::path& path, boost::filesystem::path& result);
+    Descriptor openBeneath(const Descriptor& directory, const std::string& name, int flags) const;
+    boost::filesystem::path getPathWithinRootfs(const Descriptor& descriptor) const;
+
+private:
+    boost::filesystem::path rootfsDir;
+    boost::filesystem::path rootfsDirReal;
+    Descriptor rootfsFd;
+    std::unordered_map<std::string, boost::filesystem::path> memo;
+};
+
+}
+
+#endif
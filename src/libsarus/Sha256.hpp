@@ -0,0 +1,56 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef libsarus_Sha256_hpp
+#define libsarus_Sha256_hpp
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+namespace libsarus {
+
+/**
+ * This class computes SHA-256 digests (FIPS 180-4) incrementally, so that
+ * large files and data streams can be hashed while they are being processed.
+ * After the call to finalize() the object cannot be updated anymore.
+ * HMAC-SHA256 (RFC 2104) is provided for the authentication of short messages.
+ */
+class Sha256 {
+public:
+    using Digest = std::array<std::uint8_t, 32>;
+
+public:
+    Sha256();
+    void update(const void* data, size_t size);
+    void update(const std::string& data);
+    Digest finalize();
+    std::string finalizeHex();
+
+    static std::string toHex(const Digest& digest);
+    static std::string hexDigestOfFile(const boost::filesystem::path& file);
+    static Digest hmac(const std::string& key, const std::string& message);
+
+private:
+    void processBlock(const std::uint8_t* block);
+
+private:
+    std::array<std::uint32_t, 8> state;
+    std::array<std::uint8_t, 64> buffer;
+    size_t bufferSize = 0;
+    std::uint64_t totalSize = 0;
+    bool isFinalized = false;
+};
+
+}
+
+#endif
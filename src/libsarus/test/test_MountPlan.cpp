@@ -0,0 +1,113 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+/**
+ *  @brief Tests for the batched execution of mounts
+ */
+
+#include <string>
+#include <sys/mount.h>
+
+#include "aux/filesystem.hpp"
+#include "aux/unitTestMain.hpp"
+#include "libsarus/MountPlan.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace libsarus {
+namespace test {
+
+TEST_GROUP(MountPlanTestGroup) {
+};
+
+TEST(MountPlanTestGroup, order_and_deduplicate) {
+    auto userIdentity = libsarus::UserIdentity{};
+    auto bundleDirRAII = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/test-bundle-dir")};
+    auto rootfsDir = bundleDirRAII.getPath() / "rootfs";
+    auto sourceDir = bundleDirRAII.getPath() / "source";
+    libsarus::filesystem::createFoldersIfNecessary(rootfsDir);
+    libsarus::filesystem::createFoldersIfNecessary(sourceDir);
+    libsarus::filesystem::createFoldersIfNecessary(bundleDirRAII.getPath() / "other-source");
+
+    auto plan = libsarus::MountPlan{rootfsDir, userIdentity};
+    plan.add(libsarus::Mount{sourceDir, "/a/b/c", 0, rootfsDir, userIdentity}, "custom");
+    plan.add(libsarus::Mount{sourceDir, "/d", MS_RDONLY, rootfsDir, userIdentity}, "custom");
+    plan.add(libsarus::Mount{sourceDir, "/a/b", 0, rootfsDir, userIdentity}, "custom");
+    plan.add(libsarus::Mount{bundleDirRAII.getPath() / "other-source", "/d/./", 0, rootfsDir, userIdentity}, "pmix");
+    plan.resolve();
+
+    // the last mount of /d wins, the shallower destinations come first
+    const auto& entries = plan.getEntries();
+    CHECK_EQUAL(entries.size(), 3);
+    CHECK_EQUAL(entries[0].destination.string(), std::string{"/d/./"});
+    CHECK_EQUAL(entries[0].origin, std::string{"pmix"});
+    CHECK_EQUAL(entries[1].destination.string(), std::string{"/a/b"});
+    CHECK_EQUAL(entries[2].destination.string(), std::string{"/a/b/c"});
+
+    // /a/b/c is inside /a/b: it is resolved when /a/b is mounted
+    CHECK(!entries[0].isNested);
+    CHECK(!entries[1].isNested);
+    CHECK(entries[2].isNested);
+    CHECK(entries[1].sourceReal == sourceDir);
+    CHECK(entries[1].destinationReal == rootfsDir / "a/b");
+    CHECK(entries[2].destinationReal.empty());
+
+    auto dump = plan.dump();
+    CHECK(dump.find("3 mounts") != std::string::npos);
+    CHECK(dump.find("/a/b/c (rw, nested)") != std::string::npos);
+
+    // mounts can't be added to a resolved plan
+    CHECK_THROWS(libsarus::Error, plan.add(libsarus::Mount{sourceDir, "/e", 0, rootfsDir, userIdentity}, "custom"));
+}
+
+TEST(MountPlanTestGroup, invalid_source) {
+    auto userIdentity = libsarus::UserIdentity{};
+    auto bundleDirRAII = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/test-bundle-dir")};
+    auto rootfsDir = bundleDirRAII.getPath() / "rootfs";
+    libsarus::filesystem::createFoldersIfNecessary(rootfsDir);
+
+    auto plan = libsarus::MountPlan{rootfsDir, userIdentity};
+    plan.add(libsarus::Mount{bundleDirRAII.getPath() / "missing", "/a", 0, rootfsDir, userIdentity}, "custom");
+    CHECK_THROWS(libsarus::Error, plan.resolve());
+}
+
+#ifdef ASROOT
+TEST(MountPlanTestGroup, execute) {
+#else
+IGNORE_TEST(MountPlanTestGroup, execute) {
+#endif
+    auto userIdentity = libsarus::UserIdentity{};
+    auto bundleDirRAII = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(boost::filesystem::absolute("test-bundle-dir"))};
+    auto rootfsDir = bundleDirRAII.getPath() / "rootfs";
+    auto sourceDir = bundleDirRAII.getPath() / "source";
+    auto sourceFile = bundleDirRAII.getPath() / "source-file";
+    libsarus::filesystem::createFoldersIfNecessary(rootfsDir);
+    aux::filesystem::createTestDirectoryTree(sourceDir.string());
+    libsarus::filesystem::writeTextFile("test data", sourceFile);
+
+    auto plan = libsarus::MountPlan{rootfsDir, userIdentity};
+    plan.add(libsarus::Mount{sourceFile, "/destination-file", 0, rootfsDir, userIdentity}, "custom");
+    plan.add(libsarus::Mount{sourceDir, "/destination", MS_RDONLY, rootfsDir, userIdentity}, "custom");
+    plan.execute();
+
+    CHECK(aux::filesystem::areDirectoriesEqual(sourceDir.string(), (rootfsDir / "destination").string(), 1));
+    CHECK(aux::filesystem::isSameBindMountedFile(sourceFile, rootfsDir / "destination-file"));
+    CHECK(!boost::filesystem::exists(sourceDir / "new-file"));
+    CHECK_THROWS(libsarus::Error, libsarus::filesystem::createFileIfNecessary(rootfsDir / "destination/new-file"));
+
+    // cleanup
+    CHECK(umount((rootfsDir / "destination").c_str()) == 0);
+    CHECK(umount((rootfsDir / "destination-file").c_str()) == 0);
+}
+
+}}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
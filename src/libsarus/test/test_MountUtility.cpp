@@ -160,6 +160,16 @@ TEST(MountUtilitiesTestGroup, loopMountSquashfs) {
     CHECK(boost::filesystem::exists(mountPoint / "file_in_squashfs_image"));
 
     CHECK(umount(mountPoint.string().c_str()) == 0);
+
+    // only image formats are mounted, and the arguments never reach a shell
+    CHECK_THROWS(libsarus::Error, libsarus::mount::loopMountImage(imageSquashfs, mountPoint, "ext4"));
+    CHECK_THROWS(libsarus::Error, libsarus::mount::loopMountImage(imageSquashfs, mountPoint, "squashfs; touch /tmp/x"));
+    auto fileWithSpaces = mountPoint.parent_path() / (mountPoint.filename().string() + " image;.squashfs");
+    libsarus::filesystem::copyFile(imageSquashfs, fileWithSpaces);
+    libsarus::mount::loopMountImage(fileWithSpaces, mountPoint, "squashfs");
+    CHECK(boost::filesystem::exists(mountPoint / "file_in_squashfs_image"));
+    CHECK(umount(mountPoint.string().c_str()) == 0);
+    boost::filesystem::remove(fileWithSpaces);
 }
 
 }}
@@ -0,0 +1,98 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <unistd.h>
+
+#include "aux/unitTestMain.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/RootfsResolver.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace libsarus {
+namespace test {
+
+TEST_GROUP(RootfsResolverTestGroup) {
+};
+
+TEST(RootfsResolverTestGroup, resolve) {
+    auto path = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-rootfs")};
+    const auto& rootfs = path.getPath();
+    libsarus::filesystem::createFoldersIfNecessary(rootfs / "dir0/dir1/dir2");
+    libsarus::filesystem::createFoldersIfNecessary(rootfs / "dirX");
+    CHECK_EQUAL(symlink("/dir0/dir1", (rootfs / "dirX/link_absolute").string().c_str()), 0);
+    CHECK_EQUAL(symlink("../../../dir0", (rootfs / "dirX/link_relative_that_spills").string().c_str()), 0);
+    CHECK_EQUAL(symlink("/missing/target", (rootfs / "dirX/link_dangling").string().c_str()), 0);
+
+    libsarus::RootfsResolver resolver{rootfs};
+    CHECK(resolver.resolve("/") == "/");
+    CHECK(resolver.resolve("/dir0/dir1/dir2") == "/dir0/dir1/dir2");
+    CHECK(resolver.resolve("/dirX/link_absolute/dir2") == "/dir0/dir1/dir2");
+    CHECK(resolver.resolve("/dirX/link_relative_that_spills/dir1") == "/dir0/dir1");
+    CHECK(resolver.resolve("/dir0/dir1/..") == "/dir0");
+
+    // non-existing components are appended as they are
+    CHECK(resolver.resolve("/dirX/link_absolute/new/dir") == "/dir0/dir1/new/dir");
+    CHECK(resolver.resolve("/dirX/link_dangling/file") == "/missing/target/file");
+
+    // memoized results
+    CHECK(resolver.resolve("/dirX/link_absolute/dir2") == "/dir0/dir1/dir2");
+
+    CHECK_THROWS(libsarus::Error, resolver.resolve("dir0"));
+}
+
+TEST(RootfsResolverTestGroup, symlink_loop) {
+    if(!libsarus::RootfsResolver::isOpenat2Available()) {
+        // the user-space fallback doesn't detect symlink loops
+        return;
+    }
+    auto path = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-rootfs")};
+    const auto& rootfs = path.getPath();
+    libsarus::filesystem::createFoldersIfNecessary(rootfs);
+    CHECK_EQUAL(symlink("/link1", (rootfs / "link0").string().c_str()), 0);
+    CHECK_EQUAL(symlink("/link0", (rootfs / "link1").string().c_str()), 0);
+
+    libsarus::RootfsResolver resolver{rootfs};
+    CHECK_THROWS(libsarus::Error, resolver.resolve("/link0/file"));
+}
+
+TEST(RootfsResolverTestGroup, create_and_open) {
+    auto path = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-rootfs")};
+    const auto& rootfs = path.getPath();
+    libsarus::filesystem::createFoldersIfNecessary(rootfs / "dir0/dir1");
+    CHECK_EQUAL(symlink("/dir0/dir1", (rootfs / "link").string().c_str()), 0);
+
+    libsarus::RootfsResolver resolver{rootfs};
+
+    // folders are created at the target of the symlinks
+    {
+        auto descriptor = resolver.createFoldersIfNecessary("/link/dir2/dir3", getuid(), getgid());
+        CHECK(descriptor.isValid());
+        CHECK(boost::filesystem::is_directory(rootfs / "dir0/dir1/dir2/dir3"));
+    }
+    // files too
+    {
+        auto descriptor = resolver.createFileIfNecessary("/link/dir4/file", getuid(), getgid());
+        CHECK(descriptor.isValid());
+        CHECK(boost::filesystem::is_regular_file(rootfs / "dir0/dir1/dir4/file"));
+    }
+    // existing objects are opened
+    {
+        auto descriptor = resolver.createFileIfNecessary("/dir0/dir1/dir4/file");
+        CHECK(descriptor.isValid());
+        CHECK(resolver.open("/link/dir4/file").isValid());
+    }
+
+    CHECK_THROWS(libsarus::Error, resolver.open("/link/missing"));
+}
+
+}}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
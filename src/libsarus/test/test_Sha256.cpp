@@ -0,0 +1,88 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "aux/unitTestMain.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace libsarus {
+namespace test {
+
+static std::string sha256(const std::string& data) {
+    auto sha = Sha256{};
+    sha.update(data);
+    return sha.finalizeHex();
+}
+
+TEST_GROUP(Sha256TestGroup) {
+};
+
+TEST(Sha256TestGroup, known_digests) {
+    CHECK_EQUAL(sha256(""),
+                std::string{"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"});
+    CHECK_EQUAL(sha256("abc"),
+                std::string{"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"});
+    // two-block message
+    CHECK_EQUAL(sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+                std::string{"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"});
+    CHECK_EQUAL(sha256(std::string(1000000, 'a')),
+                std::string{"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"});
+}
+
+TEST(Sha256TestGroup, incremental_updates) {
+    auto data = std::string{};
+    for(size_t i=0; i<1000; ++i) {
+        data += std::to_string(i);
+    }
+
+    // feed the data in chunks of varying size, crossing the block boundaries
+    auto sha = Sha256{};
+    auto offset = size_t{0};
+    auto chunkSize = size_t{1};
+    while(offset < data.size()) {
+        auto size = std::min(chunkSize, data.size() - offset);
+        sha.update(data.data() + offset, size);
+        offset += size;
+        chunkSize = (chunkSize * 7) % 131 + 1;
+    }
+    CHECK_EQUAL(sha.finalizeHex(), sha256(data));
+
+    // updates are not allowed after finalization
+    CHECK_THROWS(libsarus::Error, sha.update("more data"));
+}
+
+TEST(Sha256TestGroup, file_digest) {
+    auto file = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-sha256")};
+    auto data = std::string(3 * 1024 * 1024 + 17, 'x');
+    libsarus::filesystem::writeTextFile(data, file.getPath());
+    CHECK_EQUAL(Sha256::hexDigestOfFile(file.getPath()), sha256(data));
+
+    CHECK_THROWS(libsarus::Error, Sha256::hexDigestOfFile(file.getPath().string() + "-non-existent"));
+}
+
+TEST(Sha256TestGroup, hmac) {
+    // test cases 2 and 6 of RFC 4231
+    CHECK_EQUAL(Sha256::toHex(Sha256::hmac("Jefe", "what do ya want for nothing?")),
+                std::string{"5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"});
+    CHECK_EQUAL(Sha256::toHex(Sha256::hmac(std::string(131, '\xaa'),
+                                           "Test Using Larger Than Block-Size Key - Hash Key First")),
+                std::string{"60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"});
+}
+
+}}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
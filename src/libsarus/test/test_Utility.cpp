@@ -234,6 +234,32 @@ TEST(UtilityTestGroup, copyFile) {
     boost::filesystem::remove_all(testDir);
 }
 
+TEST(UtilityTestGroup, copyFileRange) {
+    auto testDirRAII = libsarus::PathRAII{ "./sarus-test-copyFileRange" };
+    const auto& testDir = testDirRAII.getPath();
+    libsarus::filesystem::createFoldersIfNecessary(testDir);
+
+    auto content = std::string{};
+    for(size_t i=0; i<300000; ++i) {
+        content.push_back(static_cast<char>(i % 251));
+    }
+    libsarus::filesystem::writeTextFile(content, testDir / "src");
+
+    // whole file
+    libsarus::filesystem::copyFileRange(testDir / "src", testDir / "dst", 0, content.size());
+    CHECK(libsarus::filesystem::readFile(testDir / "dst") == content);
+
+    // range of the file overwrites the existing destination
+    libsarus::filesystem::copyFileRange(testDir / "src", testDir / "dst", 12345, 100000);
+    CHECK(libsarus::filesystem::readFile(testDir / "dst") == content.substr(12345, 100000));
+
+    // range beyond the end of the file
+    CHECK_THROWS(libsarus::Error, libsarus::filesystem::copyFileRange(testDir / "src", testDir / "dst", 200000, 200000));
+
+    // non-existing source
+    CHECK_THROWS(libsarus::Error, libsarus::filesystem::copyFileRange(testDir / "non-existing", testDir / "dst", 0, 1));
+}
+
 TEST(UtilityTestGroup, copyFolder) {
     libsarus::filesystem::createFoldersIfNecessary("/tmp/src-folder/subfolder");
     libsarus::filesystem::createFileIfNecessary("/tmp/src-folder/file0");
@@ -280,6 +306,20 @@ TEST(UtilityTestGroup, countFilesInDirectory) {
     }
 }
 
+TEST(UtilityTestGroup, getDirectorySize) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/directory-size-test")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath() / "subdir");
+    CHECK_EQUAL(libsarus::filesystem::getDirectorySize(testDir.getPath()), 0);
+
+    libsarus::filesystem::writeTextFile("0123456789", testDir.getPath() / "file1");
+    libsarus::filesystem::writeTextFile("01234", testDir.getPath() / "subdir/file2");
+    boost::filesystem::create_symlink(testDir.getPath() / "file1", testDir.getPath() / "subdir/link");
+    CHECK_EQUAL(libsarus::filesystem::getDirectorySize(testDir.getPath()), 15);
+
+    // non-directory argument
+    CHECK_THROWS(libsarus::Error, libsarus::filesystem::getDirectorySize(testDir.getPath() / "file1"));
+}
+
 TEST(UtilityTestGroup, parseMap) {
     // empty list
     {
@@ -11,13 +11,19 @@
 #include "filesystem.hpp"
 
 #include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
+#include <boost/optional.hpp>
 
 #include "libsarus/Error.hpp"
+#include "libsarus/RootfsResolver.hpp"
 #include "libsarus/utility/logging.hpp"
 #include "libsarus/utility/string.hpp"
 
@@ -38,6 +44,32 @@ size_t getFileSize(const boost::filesystem::path& filename) {
     return st.st_size;
 }
 
+/**
+ * Returns the sum of the sizes of the regular files found within a directory.
+ * Symlinks are not followed.
+ */
+size_t getDirectorySize(const boost::filesystem::path& path) {
+    if (!boost::filesystem::is_directory(path)) {
+        auto message = boost::format("Failed to retrieve size of directory %s: path is not an existing directory.") % path;
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto size = size_t{0};
+    auto it = boost::filesystem::recursive_directory_iterator(path);
+    for(; it != boost::filesystem::recursive_directory_iterator(); ++it) {
+        struct stat st;
+        if(lstat(it->path().c_str(), &st) != 0) {
+            auto message = boost::format("Failed to retrieve size of directory %s. Stat of %s failed: %s")
+                % path % it->path() % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(S_ISREG(st.st_mode)) {
+            size += st.st_size;
+        }
+    }
+    return size;
+}
+
 std::tuple<uid_t, gid_t> getOwner(const boost::filesystem::path& path) {
     struct stat sb;
     if(stat(path.c_str(), &sb) != 0) {
@@ -123,6 +155,113 @@ void copyFile(const boost::filesystem::path& src, const boost::filesystem::path&
     setOwner(dst, uid, gid);
 }
 
+static ssize_t copyFileRangeSyscall(int in, loff_t* inOffset, int out, size_t count) {
+    #ifdef SYS_copy_file_range
+    return syscall(SYS_copy_file_range, in, inOffset, out, nullptr, count, 0u);
+    #else
+    errno = ENOSYS;
+    return -1;
+    #endif
+}
+
+/**
+ * Copies "length" bytes starting at "offset" of the source file into a new destination file.
+ * The copy is performed with copy_file_range(2), so that the data doesn't need to transit
+ * through user space and filesystems which support it can offload the copy. Falls back
+ * to sendfile(2) when copy_file_range is not available or not supported across the two
+ * filesystems, and to plain reads and writes as last resort.
+ */
+void copyFileRange(const boost::filesystem::path& src, const boost::filesystem::path& dst, size_t offset, size_t length) {
+    logMessage(boost::format{"Copying %d bytes at offset %d of %s -> %s"} % length % offset % src % dst, LogLevel::DEBUG);
+
+    auto in = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if(in < 0) {
+        auto message = boost::format("Failed to open %s: %s") % src % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto out = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(out < 0) {
+        auto message = boost::format("Failed to open %s: %s") % dst % strerror(errno);
+        close(in);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto isFallbackError = [](int error) {
+        return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP;
+    };
+
+    auto inOffset = static_cast<loff_t>(offset);
+    auto copied = size_t{0};
+    auto useCopyFileRange = true;
+    auto useSendfile = true;
+    auto error = boost::optional<std::string>{};
+
+    while(copied < length) {
+        auto count = std::min(length - copied, size_t{1} << 30);
+        auto ret = ssize_t{-1};
+
+        if(useCopyFileRange) {
+            ret = copyFileRangeSyscall(in, &inOffset, out, count);
+            if(ret < 0 && copied == 0 && isFallbackError(errno)) {
+                useCopyFileRange = false;
+                continue;
+            }
+        }
+        else if(useSendfile) {
+            auto sendfileOffset = static_cast<off_t>(inOffset);
+            ret = sendfile(out, in, &sendfileOffset, count);
+            if(ret < 0 && copied == 0 && isFallbackError(errno)) {
+                useSendfile = false;
+                continue;
+            }
+            inOffset = sendfileOffset;
+        }
+        else {
+            char buffer[1 << 16];
+            ret = pread(in, buffer, std::min(count, sizeof(buffer)), inOffset);
+            auto written = ssize_t{0};
+            while(ret > 0 && written < ret) {
+                auto w = write(out, buffer + written, ret - written);
+                if(w < 0 && errno == EINTR) {
+                    continue;
+                }
+                if(w < 0) {
+                    ret = -1;
+                    break;
+                }
+                written += w;
+            }
+            if(ret > 0) {
+                inOffset += ret;
+            }
+        }
+
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if(ret < 0) {
+            error = std::string{strerror(errno)};
+            break;
+        }
+        if(ret == 0) {
+            error = (boost::format("unexpected end of file after %d of %d bytes") % copied % length).str();
+            break;
+        }
+        copied += static_cast<size_t>(ret);
+    }
+
+    if(!error && fsync(out) != 0) {
+        error = std::string{strerror(errno)};
+    }
+    close(in);
+    close(out);
+
+    if(error) {
+        auto message = boost::format("Failed to copy %s to %s: %s") % src % dst % *error;
+        SARUS_THROW_ERROR(message.str());
+    }
+}
+
 void removeFile(const boost::filesystem::path& path) {
     if(boost::filesystem::exists(path)) {
         boost::filesystem::remove(path);
@@ -307,13 +446,12 @@ boost::filesystem::path appendPathsWithinRootfs( const boost::filesystem::path&
     return current;
 }
 
+/*
+    Resolves path within rootfs. See RootfsResolver, which should be used directly
+    to resolve many paths within the same rootfs.
+*/
 boost::filesystem::path realpathWithinRootfs(const boost::filesystem::path& rootfs, const boost::filesystem::path& path) {
-    if(!path.is_absolute()) {
-        auto message = boost::format("Failed to determine realpath within rootfs. %s is not an absolute path.") % path;
-        SARUS_THROW_ERROR(message.str());
-    }
-
-    return appendPathsWithinRootfs(rootfs, "/", path);
+    return RootfsResolver{rootfs}.resolve(path);
 }
 
 dev_t getDeviceID(const boost::filesystem::path& path) {
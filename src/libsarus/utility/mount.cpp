@@ -15,6 +15,8 @@
 #include "mount.hpp"
 
 #include <errno.h>
+#include <sstream>
+#include <unistd.h>
 
 #include <boost/format.hpp>
 
@@ -53,6 +55,13 @@ boost::filesystem::path getValidatedMountSource(const boost::filesystem::path& s
 
 boost::filesystem::path getValidatedMountDestination(const boost::filesystem::path& destination,
                                                      const boost::filesystem::path& rootfsDir) {
+    RootfsResolver resolver{rootfsDir};
+    return getValidatedMountDestination(destination, resolver);
+}
+
+boost::filesystem::path getValidatedMountDestination(const boost::filesystem::path& destination,
+                                                     RootfsResolver& resolver) {
+    const auto& rootfsDir = resolver.getRootfsDir();
     logMessage(boost::format("Validating mount destination: %s") % destination, LogLevel::DEBUG);
 
     if (destination.is_relative()) {
@@ -61,7 +70,7 @@ boost::filesystem::path getValidatedMountDestination(const boost::filesystem::pa
     if (rootfsDir.is_relative()) {
         SARUS_THROW_ERROR("Internal error: rootfsDir is not an absolute path");
     }
-    auto destinationReal = rootfsDir / filesystem::realpathWithinRootfs(rootfsDir, destination);
+    auto destinationReal = rootfsDir / resolver.resolve(destination);
 
     /* If the destination does not exist, check its parents */
     if (!boost::filesystem::exists(destinationReal)) {
@@ -261,37 +270,71 @@ void bindMount(const boost::filesystem::path& from, const boost::filesystem::pat
 
 
 void loopMountSquashfs(const boost::filesystem::path& image, const boost::filesystem::path& mountPoint) {
-    auto command = std::string{"mount"};
-    command += " -n";
-    command += " -o";
-    command += " loop,nosuid,nodev,ro";
-    command += " -t squashfs";
-    command += " " + image.string();
-    command += " " + mountPoint.string();
+    loopMountImage(image, mountPoint, "squashfs");
+}
 
-    logMessage(boost::format{"Performing loop mount: %s "} % command, LogLevel::DEBUG);
 
+/**
+ * The arguments are passed to mount(8) as separate argv entries, never through a shell,
+ * because the file and the filesystem type can come from the repository metadata.
+ */
+void loopMount(const boost::filesystem::path& file,
+               const boost::filesystem::path& mountPoint,
+               const std::string& filesystemType,
+               const std::string& options) {
+    auto args = CLIArguments{"mount", "-n", "-o", "loop," + options, "-t", filesystemType,
+                             "--", file.string(), mountPoint.string()};
+
+    logMessage(boost::format{"Performing loop mount: %s "} % args, LogLevel::DEBUG);
+
+    auto output = std::stringstream{};
+    auto redirectStderrToStdout = []() {
+        dup2(STDOUT_FILENO, STDERR_FILENO);
+    };
     try {
-        process::executeCommand(command);
+        auto status = process::forkExecWait(args, std::function<void()>{redirectStderrToStdout}, {}, &output);
+        if(status != 0) {
+            auto message = boost::format("Command %s exited with status %d. Output:\n%s") % args % status % output.str();
+            SARUS_THROW_ERROR(message.str());
+        }
     }
     catch(Error& e) {
-        auto message = boost::format("Failed to loop mount %s on %s") % image % mountPoint;
+        auto message = boost::format("Failed to loop mount %s on %s") % file % mountPoint;
         SARUS_RETHROW_ERROR(e, message.str());
     }
 }
 
+/**
+ * Mounts a container image. Only the read-only image formats supported by Sarus are
+ * accepted, so that no other filesystem type is ever mounted from a file written by users.
+ */
+void loopMountImage(const boost::filesystem::path& image,
+                    const boost::filesystem::path& mountPoint,
+                    const std::string& filesystemType) {
+    if(filesystemType != "squashfs" && filesystemType != "erofs") {
+        auto message = boost::format("Failed to loop mount %s: unsupported image format '%s'") % image % filesystemType;
+        SARUS_THROW_ERROR(message.str());
+    }
+    loopMount(image, mountPoint, filesystemType, "nosuid,nodev,ro");
+}
+
 
 void mountOverlayfs(const boost::filesystem::path& lowerDir,
                     const boost::filesystem::path& upperDir,
                     const boost::filesystem::path& workDir,
-                    const boost::filesystem::path& mountPoint) {
+                    const boost::filesystem::path& mountPoint,
+                    const std::string& extraOptions,
+                    unsigned long flags) {
     auto options = boost::format{"lowerdir=%s,upperdir=%s,workdir=%s"}
         % lowerDir.string()
         % upperDir.string()
         % workDir.string();
+    if(!extraOptions.empty()) {
+        options = boost::format{"%s,%s"} % options.str() % extraOptions;
+    }
     logMessage(boost::format{"Performing overlay mount to %s "} % mountPoint, LogLevel::DEBUG);
     logMessage(boost::format{"Overlay options: %s "} % options.str(), LogLevel::DEBUG);
-    if(::mount("overlay", mountPoint.c_str(), "overlay", MS_MGC_VAL, options.str().c_str()) != 0) {
+    if(::mount("overlay", mountPoint.c_str(), "overlay", MS_MGC_VAL | flags, options.str().c_str()) != 0) {
         auto message = boost::format("Failed to mount OverlayFS on %s (options: %s): %s")
             % mountPoint % options % strerror(errno);
         SARUS_THROW_ERROR(message.str());
@@ -20,6 +20,7 @@
 
 #include "libsarus/Logger.hpp"
 #include "libsarus/Mount.hpp"
+#include "libsarus/RootfsResolver.hpp"
 
 /**
  * Utility functions for mounting
@@ -31,6 +32,8 @@ namespace mount {
 boost::filesystem::path getValidatedMountSource(const boost::filesystem::path&);
 boost::filesystem::path getValidatedMountDestination(const boost::filesystem::path& destination,
                                                      const boost::filesystem::path& rootfsDir);
+boost::filesystem::path getValidatedMountDestination(const boost::filesystem::path& destination,
+                                                     RootfsResolver& resolver);
 bool isPathOnAllowedDevice(const boost::filesystem::path& path, const boost::filesystem::path& rootfsDir);
 dev_t getDevice(const boost::filesystem::path& path);
 void validatedBindMount(const boost::filesystem::path& source,
@@ -41,10 +44,19 @@ void validatedBindMount(const boost::filesystem::path& source,
                         const bool rootless=false);
 void bindMount(const boost::filesystem::path& from, const boost::filesystem::path& to, unsigned long flags=0);
 void loopMountSquashfs(const boost::filesystem::path& image, const boost::filesystem::path& mountPoint);
+void loopMount(const boost::filesystem::path& file,
+               const boost::filesystem::path& mountPoint,
+               const std::string& filesystemType,
+               const std::string& options);
+void loopMountImage(const boost::filesystem::path& image,
+                    const boost::filesystem::path& mountPoint,
+                    const std::string& filesystemType);
 void mountOverlayfs(const boost::filesystem::path& lowerDir,
                     const boost::filesystem::path& upperDir,
                     const boost::filesystem::path& workDir,
-                    const boost::filesystem::path& mountPoint);
+                    const boost::filesystem::path& mountPoint,
+                    const std::string& extraOptions="",
+                    unsigned long flags=0);
 
 }}
 
@@ -22,6 +22,7 @@
 #include "libsarus/Logger.hpp"
 #include "libsarus/Utility.hpp"
 #include "cli/CLI.hpp"
+#include "daemon/DaemonClient.hpp"
 #include "runtime/SecurityChecks.hpp"
 
 #include <sys/types.h>
@@ -48,9 +49,13 @@ int main(int argc, char* argv[]) {
 
         // Initialize Config object
         auto sarusInstallationPrefixDir = boost::filesystem::canonical("/proc/self/exe").parent_path().parent_path();
-        auto config = std::make_shared<sarus::common::Config>(sarusInstallationPrefixDir);
+        // the node daemon, if running, already validated the configuration and ran the security checks
+        auto config = std::make_shared<sarus::common::Config>();
+        if(!daemon::DaemonClient{}.loadConfiguration(*config, sarusInstallationPrefixDir)) {
+            config = std::make_shared<sarus::common::Config>(sarusInstallationPrefixDir);
+            runtime::SecurityChecks{config}.runSecurityChecks(sarusInstallationPrefixDir);
+        }
         config->program_start = program_start;
-        runtime::SecurityChecks{config}.runSecurityChecks(sarusInstallationPrefixDir);
         config->commandRun.hostEnvironment = libsarus::environment::parseVariables(environ);
 
 
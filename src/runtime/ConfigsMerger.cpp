@@ -10,6 +10,8 @@
 
 #include "ConfigsMerger.hpp"
 
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 
 #include "runtime/Utility.hpp"
@@ -265,6 +267,21 @@ libsarus::CLIArguments ConfigsMerger::getCommandToExecuteInContainer() const {
         result.push_back("/dev/init");
         result.push_back("--");
     }
+    // the task runner replaces the entrypoint and the command (see Runtime::setupTaskRunnerIfNecessary)
+    if(config->commandRun.taskListFile) {
+        auto intToString = [](int i) { return std::to_string(i); };
+        auto cpus = std::vector<std::string>(config->commandRun.cpuAffinity.size());
+        std::transform(config->commandRun.cpuAffinity.cbegin(), config->commandRun.cpuAffinity.cend(),
+                       cpus.begin(), intToString);
+        result += libsarus::CLIArguments{"/dev/task-runner",
+                                         "--cpus", boost::algorithm::join(cpus, ","),
+                                         "--retries", std::to_string(config->commandRun.taskRetries),
+                                         "/dev/task-list", "/dev/task-results"};
+        utility::logMessage(
+            boost::format("Successfully built command to execute in container: %s") % result,
+            libsarus::LogLevel::INFO);
+        return result;
+    }
     // then entrypoint (if any) (CLI entrypoint has priority over metadata/image entrypoint)
     if(config->commandRun.entrypoint) {
         result += *config->commandRun.entrypoint;
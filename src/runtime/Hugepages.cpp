@@ -0,0 +1,119 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "Hugepages.hpp"
+
+#include <cctype>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <boost/regex.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/Utility.hpp"
+
+
+namespace sarus {
+namespace runtime {
+
+Hugepages::Hugepages(const boost::filesystem::path& hugepagesDir, const boost::filesystem::path& cgroupDir) {
+    if(!boost::filesystem::is_directory(hugepagesDir)) {
+        utility::logMessage(boost::format("Hugepages not available: %s not found") % hugepagesDir,
+                            libsarus::LogLevel::DEBUG);
+        return;
+    }
+
+    try {
+        static const boost::regex re("^hugepages-([0-9]+)kB$");
+        for(const auto& entry : boost::filesystem::directory_iterator{hugepagesDir}) {
+            boost::smatch matches;
+            auto filename = entry.path().filename().string();
+            if(!boost::regex_match(filename, matches, re)) {
+                continue;
+            }
+            auto pages = boost::trim_copy(libsarus::filesystem::readFile(entry.path() / "nr_hugepages"));
+            numberOfPages[std::stoul(matches[1])] = std::stoul(pages);
+        }
+    }
+    catch(std::exception& e) {
+        auto message = boost::format("Failed to read hugepage pools from %s") % hugepagesDir;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+
+    // cgroup v2 lists the available controllers in the root of the hierarchy,
+    // cgroup v1 has one hierarchy per controller
+    if(boost::filesystem::exists(cgroupDir / "cgroup.controllers")) {
+        std::stringstream ss{libsarus::filesystem::readFile(cgroupDir / "cgroup.controllers")};
+        auto controller = std::string{};
+        while(ss >> controller) {
+            isHugetlbControllerAvailable |= controller == "hugetlb";
+        }
+    }
+    else {
+        isHugetlbControllerAvailable = boost::filesystem::is_directory(cgroupDir / "hugetlb");
+    }
+}
+
+/**
+ * Parses a page size such as "2MB", "1G" or "2048kB" and returns it in kB.
+ */
+std::size_t Hugepages::parseSize(const std::string& size) {
+    static const boost::regex re("^([0-9]+)([kKmMgG])[bB]?$");
+    boost::smatch matches;
+    if(!boost::regex_match(size, matches, re) || std::stoul(matches[1]) == 0) {
+        auto message = boost::format("Invalid hugepage size '%s'. Expected a size such as '2MB' or '1GB'") % size;
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto value = std::size_t{std::stoul(matches[1])};
+    switch(std::tolower(matches[2].str()[0])) {
+    case 'g':
+        return value * 1024 * 1024;
+    case 'm':
+        return value * 1024;
+    default:
+        return value;
+    }
+}
+
+/**
+ * Formats a page size in kB like the "pageSize" entries of the OCI bundle's config.json,
+ * e.g. "2MB" or "1GB".
+ */
+std::string Hugepages::formatSize(std::size_t sizeKB) {
+    if(sizeKB % (1024 * 1024) == 0) {
+        return std::to_string(sizeKB / (1024 * 1024)) + "GB";
+    }
+    else if(sizeKB % 1024 == 0) {
+        return std::to_string(sizeKB / 1024) + "MB";
+    }
+    return std::to_string(sizeKB) + "KB";
+}
+
+std::vector<std::size_t> Hugepages::getSizes() const {
+    auto sizes = std::vector<std::size_t>{};
+    for(const auto& pool : numberOfPages) {
+        sizes.push_back(pool.first);
+    }
+    return sizes;
+}
+
+std::size_t Hugepages::getNumberOfPages(std::size_t sizeKB) const {
+    auto pool = numberOfPages.find(sizeKB);
+    if(pool == numberOfPages.cend()) {
+        auto message = boost::format("Hugepages of size %s are not available on the host") % formatSize(sizeKB);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return pool->second;
+}
+
+}
+}
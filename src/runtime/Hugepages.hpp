@@ -0,0 +1,50 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_runtime_Hugepages_hpp
+#define sarus_runtime_Hugepages_hpp
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+
+namespace sarus {
+namespace runtime {
+
+/**
+ * Hugepage pools of the host, as exposed by the kernel in sysfs. The page sizes are
+ * expressed in kB, like in the names of the sysfs entries (e.g. hugepages-2048kB).
+ */
+class Hugepages {
+public:
+    Hugepages(const boost::filesystem::path& hugepagesDir = "/sys/kernel/mm/hugepages",
+              const boost::filesystem::path& cgroupDir = "/sys/fs/cgroup");
+
+    static std::size_t parseSize(const std::string&);
+    static std::string formatSize(std::size_t sizeKB);
+
+    std::vector<std::size_t> getSizes() const;
+    bool isSizeAvailable(std::size_t sizeKB) const { return numberOfPages.count(sizeKB) > 0; }
+    std::size_t getNumberOfPages(std::size_t sizeKB) const;
+    bool isCgroupControllerAvailable() const { return isHugetlbControllerAvailable; }
+
+private:
+    std::map<std::size_t, std::size_t> numberOfPages; // page size in kB -> pages of the pool
+    bool isHugetlbControllerAvailable = false;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "ImagePrefetcher.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unordered_set>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/fanotify.h>
+#include <sys/fsuid.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/Utility.hpp"
+
+// the filesystem marks were introduced in Linux 4.20
+#ifndef FAN_MARK_FILESYSTEM
+#define FAN_MARK_FILESYSTEM 0x00000100
+#endif
+
+
+namespace sarus {
+namespace runtime {
+
+const std::chrono::seconds ImagePrefetcher::defaultRecordingWindow = std::chrono::seconds{30};
+
+ImagePrefetcher::ImagePrefetcher(std::shared_ptr<const common::Config> config)
+    : config{std::move(config)}
+    , profileFile{this->config->getPrefetchProfileFileOfImage()}
+{}
+
+ImagePrefetcher::~ImagePrefetcher() {
+    isStopRequested = true;
+    if(worker.joinable()) {
+        worker.join();
+    }
+    if(imageFd >= 0) {
+        close(imageFd);
+    }
+}
+
+bool ImagePrefetcher::isRecording() const {
+    return config->commandRun.recordPrefetchProfile;
+}
+
+std::chrono::seconds ImagePrefetcher::getRecordingWindow() const {
+    if(config->json.HasMember("prefetchRecordingWindow")) {
+        return std::chrono::seconds{config->json["prefetchRecordingWindow"].GetUint()};
+    }
+    return defaultRecordingWindow;
+}
+
+/**
+ * Drops the image file from the page cache, so that after the mount the page cache
+ * contains exactly the ranges of the image read by the container.
+ */
+void ImagePrefetcher::prepareRecording(const boost::filesystem::path& imageFile) {
+    try {
+        imageFd = openImageFile(imageFile);
+    }
+    catch(const libsarus::Error& e) {
+        auto message = boost::format("Failed to prepare the recording of the prefetch profile: %s") % e.what();
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        return;
+    }
+
+    auto result = posix_fadvise(imageFd, 0, 0, POSIX_FADV_DONTNEED);
+    if(result != 0) {
+        auto message = boost::format("Failed to drop page cache of image file %s: %s."
+                                     " The prefetch profile might miss some ranges read at startup")
+                       % imageFile % strerror(result);
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+    }
+    utility::logMessage(boost::format("Dropped page cache of image file %s to record its prefetch profile") % imageFile,
+                        libsarus::LogLevel::INFO);
+}
+
+/**
+ * Starts collecting the files opened in the rootfs of the container. The mark is placed
+ * on the filesystem rather than on the mount, because the OCI runtime accesses the rootfs
+ * through its own copy of the mount.
+ */
+void ImagePrefetcher::startRecording(const boost::filesystem::path& rootfsDir, const boost::filesystem::path& imageRootDir) {
+    if(imageFd < 0) {
+        return;
+    }
+
+    auto fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+    if(fanotifyFd < 0) {
+        auto message = boost::format("Failed to initialize fanotify to record the prefetch profile: %s") % strerror(errno);
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        return;
+    }
+    if(fanotify_mark(fanotifyFd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FAN_OPEN, AT_FDCWD, rootfsDir.c_str()) != 0) {
+        auto message = boost::format("Failed to add fanotify mark on %s to record the prefetch profile: %s"
+                                     " (filesystem marks require Linux >= 4.20)")
+                       % rootfsDir % strerror(errno);
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        close(fanotifyFd);
+        return;
+    }
+
+    auto message = boost::format("Recording prefetch profile of image during the first %d seconds of the container")
+                   % getRecordingWindow().count();
+    utility::logMessage(message, libsarus::LogLevel::INFO);
+    worker = std::thread{&ImagePrefetcher::record, this, fanotifyFd, rootfsDir, imageRootDir};
+}
+
+void ImagePrefetcher::startReplay(const boost::filesystem::path& imageFile) {
+    auto rootIdentity = libsarus::UserIdentity{};
+    auto profile = PrefetchProfile{};
+    try {
+        // switch to user identity to make sure we can access files on root_squashed filesystems
+        libsarus::process::setFilesystemUid(config->userIdentity);
+        if(!boost::filesystem::exists(profileFile)) {
+            libsarus::process::setFilesystemUid(rootIdentity);
+            utility::logMessage(boost::format("No prefetch profile %s for image") % profileFile, libsarus::LogLevel::DEBUG);
+            return;
+        }
+        profile = PrefetchProfile::read(profileFile);
+        libsarus::process::setFilesystemUid(rootIdentity);
+        imageFd = openImageFile(imageFile);
+
+        if(!profile.matches(PrefetchProfile::computeFingerprint(imageFd))) {
+            auto message = boost::format("Skipping prefetch of image: profile %s was recorded for another version of the image."
+                                         " Hint: record it again with 'sarus run --record-prefetch-profile'") % profileFile;
+            utility::logMessage(message, libsarus::LogLevel::INFO);
+            return;
+        }
+    }
+    catch(const std::exception& e) {
+        libsarus::process::setFilesystemUid(rootIdentity);
+        auto message = boost::format("Failed to load prefetch profile, continuing without prefetch: %s") % e.what();
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        return;
+    }
+
+    auto message = boost::format("Prefetching %d bytes of image %s in %d ranges")
+                   % profile.getTotalSize() % imageFile % profile.getRanges().size();
+    utility::logMessage(message, libsarus::LogLevel::INFO);
+    worker = std::thread{&ImagePrefetcher::replay, this, std::move(profile)};
+}
+
+/**
+ * Stops the background work (if still running) and waits for it. To be called after the
+ * container exited: the recording of a profile ends early when the container is shorter
+ * than the recording window.
+ */
+void ImagePrefetcher::finish() {
+    isStopRequested = true;
+    if(worker.joinable()) {
+        worker.join();
+        utility::logMessage(workerMessage, workerMessageLevel, std::cout, std::cerr);
+    }
+    if(imageFd >= 0) {
+        close(imageFd);
+        imageFd = -1;
+    }
+}
+
+int ImagePrefetcher::openImageFile(const boost::filesystem::path& imageFile) const {
+    auto rootIdentity = libsarus::UserIdentity{};
+    // switch to user identity to make sure we can access files on root_squashed filesystems
+    libsarus::process::setFilesystemUid(config->userIdentity);
+    auto fd = open(imageFile.c_str(), O_RDONLY | O_CLOEXEC);
+    auto openErrno = errno;
+    libsarus::process::setFilesystemUid(rootIdentity);
+    if(fd < 0) {
+        auto message = boost::format("Failed to open image file %s: %s") % imageFile % strerror(openErrno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    return fd;
+}
+
+// Executed by the worker thread, which doesn't log: the outcome is logged by finish()
+void ImagePrefetcher::record(int fanotifyFd, boost::filesystem::path rootfsDir, boost::filesystem::path imageRootDir) {
+    try {
+        auto files = std::vector<boost::filesystem::path>{};
+        collectOpenedFiles(fanotifyFd, rootfsDir, imageRootDir, files);
+        close(fanotifyFd);
+        fanotifyFd = -1;
+
+        auto ranges = PrefetchProfile::getResidentRanges(imageFd);
+        auto profile = PrefetchProfile{PrefetchProfile::computeFingerprint(imageFd), files, ranges};
+        writeProfile(profile);
+
+        workerMessage = (boost::format("Recorded prefetch profile %s: %d files opened, %d bytes of image read in %d ranges")
+                         % profileFile % files.size() % profile.getTotalSize() % ranges.size()).str();
+        workerMessageLevel = libsarus::LogLevel::INFO;
+    }
+    catch(const std::exception& e) {
+        if(fanotifyFd >= 0) {
+            close(fanotifyFd);
+        }
+        workerMessage = (boost::format("Failed to record prefetch profile %s: %s") % profileFile % e.what()).str();
+        workerMessageLevel = libsarus::LogLevel::WARN;
+    }
+}
+
+void ImagePrefetcher::collectOpenedFiles(int fanotifyFd,
+                                         const boost::filesystem::path& rootfsDir,
+                                         const boost::filesystem::path& imageRootDir,
+                                         std::vector<boost::filesystem::path>& files) {
+    auto deadline = std::chrono::steady_clock::now() + getRecordingWindow();
+    auto rootfsPrefix = rootfsDir.string() + "/";
+    auto seenFiles = std::unordered_set<std::string>{};
+    alignas(struct fanotify_event_metadata) char buffer[64 * 1024];
+
+    while(!isStopRequested) {
+        auto now = std::chrono::steady_clock::now();
+        if(now >= deadline) {
+            break;
+        }
+        auto timeout = std::min(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now),
+                                std::chrono::milliseconds{100});
+        auto pollFd = pollfd{fanotifyFd, POLLIN, 0};
+        auto ready = poll(&pollFd, 1, static_cast<int>(timeout.count()));
+        if(ready < 0 && errno != EINTR) {
+            auto message = boost::format("Failed to poll fanotify events: %s") % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(ready <= 0) {
+            continue;
+        }
+
+        while(true) {
+            auto length = read(fanotifyFd, buffer, sizeof(buffer));
+            if(length < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                if(errno == EAGAIN) {
+                    break;
+                }
+                auto message = boost::format("Failed to read fanotify events: %s") % strerror(errno);
+                SARUS_THROW_ERROR(message.str());
+            }
+
+            auto* event = reinterpret_cast<struct fanotify_event_metadata*>(buffer);
+            for(; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+                if(event->vers != FANOTIFY_METADATA_VERSION) {
+                    SARUS_THROW_ERROR("Unsupported version of fanotify event metadata");
+                }
+                if(event->fd < 0) {
+                    continue;
+                }
+
+                // the opened files are identified through the file descriptors of the events
+                boost::system::error_code ec;
+                auto path = boost::filesystem::read_symlink("/proc/self/fd/" + std::to_string(event->fd), ec).string();
+                close(event->fd);
+                if(ec) {
+                    continue;
+                }
+                // the files opened in the mount namespace of the container are already relative to its rootfs
+                if(boost::starts_with(path, rootfsPrefix)) {
+                    path = path.substr(rootfsPrefix.size() - 1);
+                }
+                if(path.empty() || path[0] != '/' || !seenFiles.insert(path).second) {
+                    continue;
+                }
+                // skip the files which are not part of the image (e.g. created by the container)
+                if(!boost::filesystem::is_regular_file(boost::filesystem::symlink_status(imageRootDir / path, ec))) {
+                    continue;
+                }
+                files.push_back(path);
+            }
+        }
+    }
+}
+
+void ImagePrefetcher::writeProfile(const PrefetchProfile& profile) const {
+    // setfsuid() applies to the calling thread only, i.e. not to the main thread.
+    // The syscall is issued directly because libsarus::process::setFilesystemUid logs.
+    auto rootUid = geteuid();
+    setfsuid(config->userIdentity.uid);
+    try {
+        profile.write(profileFile);
+    }
+    catch(...) {
+        setfsuid(rootUid);
+        throw;
+    }
+    setfsuid(rootUid);
+}
+
+// Executed by the worker thread, which doesn't log: the outcome is logged by finish()
+void ImagePrefetcher::replay(PrefetchProfile profile) {
+    auto start = std::chrono::steady_clock::now();
+    auto prefetchedSize = std::uint64_t{0};
+    auto failedRanges = size_t{0};
+    for(const auto& range : profile.getRanges()) {
+        if(isStopRequested) {
+            break;
+        }
+        if(posix_fadvise(imageFd, range.offset, range.length, POSIX_FADV_WILLNEED) != 0) {
+            ++failedRanges;
+            continue;
+        }
+        prefetchedSize += range.length;
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    workerMessage = (boost::format("Issued prefetch of %d bytes of image in %.6f seconds (%d ranges failed)")
+                     % prefetchedSize % elapsed.count() % failedRanges).str();
+    workerMessageLevel = libsarus::LogLevel::INFO;
+}
+
+}
+}
@@ -0,0 +1,84 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_runtime_ImagePrefetcher_hpp
+#define sarus_runtime_ImagePrefetcher_hpp
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include "common/Config.hpp"
+#include "libsarus/LogLevel.hpp"
+#include "runtime/PrefetchProfile.hpp"
+
+
+namespace sarus {
+namespace runtime {
+
+/**
+ * Records and replays the startup I/O of the containers of an image.
+ *
+ * Record mode ("sarus run --record-prefetch-profile"): the page cache of the image
+ * file is dropped before the image is mounted, then a fanotify mark on the rootfs of
+ * the container collects the files opened during the startup window. At the end of
+ * the window, the ranges of the image file brought into the page cache by the
+ * container are written to the prefetch profile of the image.
+ *
+ * Replay mode (default): if the image has a matching prefetch profile, a background
+ * thread issues POSIX_FADV_WILLNEED for the ranges of the profile, so that the image
+ * file is read ahead in large requests while the rest of the bundle is set up and the
+ * container starts, instead of through the page faults of the container.
+ */
+class ImagePrefetcher {
+public:
+    static const std::chrono::seconds defaultRecordingWindow;
+
+public:
+    ImagePrefetcher(std::shared_ptr<const common::Config> config);
+    ~ImagePrefetcher();
+    ImagePrefetcher(const ImagePrefetcher&) = delete;
+    ImagePrefetcher& operator=(const ImagePrefetcher&) = delete;
+
+    bool isRecording() const;
+    std::chrono::seconds getRecordingWindow() const;
+    void prepareRecording(const boost::filesystem::path& imageFile);
+    void startRecording(const boost::filesystem::path& rootfsDir, const boost::filesystem::path& imageRootDir);
+    void startReplay(const boost::filesystem::path& imageFile);
+    void finish();
+
+private:
+    int openImageFile(const boost::filesystem::path& imageFile) const;
+    void record(int fanotifyFd, boost::filesystem::path rootfsDir, boost::filesystem::path imageRootDir);
+    void collectOpenedFiles(int fanotifyFd,
+                            const boost::filesystem::path& rootfsDir,
+                            const boost::filesystem::path& imageRootDir,
+                            std::vector<boost::filesystem::path>& files);
+    void writeProfile(const PrefetchProfile& profile) const;
+    void replay(PrefetchProfile profile);
+
+private:
+    std::shared_ptr<const common::Config> config;
+    boost::filesystem::path profileFile;
+    int imageFd = -1;
+    std::thread worker;
+    std::atomic<bool> isStopRequested{false};
+    std::string workerMessage;
+    libsarus::LogLevel workerMessageLevel = libsarus::LogLevel::INFO;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "NumaTopology.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <boost/regex.hpp>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/Utility.hpp"
+
+
+namespace sarus {
+namespace runtime {
+
+NumaTopology::NumaTopology(const boost::filesystem::path& nodesDir, const boost::filesystem::path& procStatusFile) {
+    if(!boost::filesystem::is_directory(nodesDir)) {
+        utility::logMessage(boost::format("NUMA topology not available: %s not found") % nodesDir,
+                            libsarus::LogLevel::DEBUG);
+        return;
+    }
+
+    try {
+        static const boost::regex re("^node([0-9]+)$");
+        for(const auto& entry : boost::filesystem::directory_iterator{nodesDir}) {
+            boost::smatch matches;
+            auto filename = entry.path().filename().string();
+            if(!boost::regex_match(filename, matches, re)) {
+                continue;
+            }
+            auto& node = nodes[std::stoi(matches[1])];
+            node.cpus = [&entry]() {
+                auto cpus = parseList(libsarus::filesystem::readFile(entry.path() / "cpulist"));
+                return std::set<int>(cpus.cbegin(), cpus.cend());
+            }();
+            if(boost::filesystem::exists(entry.path() / "distance")) {
+                std::stringstream ss{libsarus::filesystem::readFile(entry.path() / "distance")};
+                int distance;
+                while(ss >> distance) {
+                    node.distances.push_back(distance);
+                }
+            }
+        }
+
+        if(boost::filesystem::exists(nodesDir / "has_memory")) {
+            auto nodesWithMemory = parseList(libsarus::filesystem::readFile(nodesDir / "has_memory"));
+            for(auto& node : nodes) {
+                node.second.hasMemory = std::find(nodesWithMemory.cbegin(), nodesWithMemory.cend(), node.first)
+                                        != nodesWithMemory.cend();
+            }
+        }
+
+        // the memory nodes of the container must be a subset of the ones of the process,
+        // which may be restricted by the cpuset cgroup of the job
+        for(const auto& node : nodes) {
+            allowedMemoryNodes.insert(node.first);
+        }
+        if(boost::filesystem::exists(procStatusFile)) {
+            std::stringstream ss{libsarus::filesystem::readFile(procStatusFile)};
+            auto line = std::string{};
+            while(std::getline(ss, line)) {
+                if(boost::starts_with(line, "Mems_allowed_list:")) {
+                    auto allowed = parseList(line.substr(line.find(':') + 1));
+                    allowedMemoryNodes = std::set<int>(allowed.cbegin(), allowed.cend());
+                    break;
+                }
+            }
+        }
+    }
+    catch(std::exception& e) {
+        auto message = boost::format("Failed to read NUMA topology from %s") % nodesDir;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+NumaTopology::MemoryPolicy NumaTopology::parseMemoryPolicy(const std::string& value) {
+    if(value == "local") {
+        return MemoryPolicy::local;
+    }
+    else if(value == "interleave") {
+        return MemoryPolicy::interleave;
+    }
+    else if(value == "unset") {
+        return MemoryPolicy::unset;
+    }
+    auto message = boost::format("Invalid NUMA memory policy '%s'. Supported values: 'local', 'interleave', 'unset'")
+                   % value;
+    SARUS_THROW_ERROR(message.str());
+}
+
+/**
+ * Parses a list in the format used by the kernel for CPUs and NUMA nodes, e.g. "0-3,8,10-11".
+ */
+std::vector<int> NumaTopology::parseList(const std::string& list) {
+    auto result = std::vector<int>{};
+    auto trimmed = boost::trim_copy(list);
+    if(trimmed.empty()) {
+        return result;
+    }
+
+    auto ranges = std::vector<std::string>{};
+    boost::split(ranges, trimmed, boost::is_any_of(","));
+    for(const auto& range : ranges) {
+        static const boost::regex re("^([0-9]+)(-([0-9]+))?$");
+        boost::smatch matches;
+        if(!boost::regex_match(range, matches, re)) {
+            auto message = boost::format("Failed to parse list '%s'") % list;
+            SARUS_THROW_ERROR(message.str());
+        }
+        auto first = std::stoi(matches[1]);
+        auto last = matches[3].matched ? std::stoi(matches[3]) : first;
+        for(auto i=first; i<=last; ++i) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+std::string NumaTopology::makeList(const std::vector<int>& values) {
+    auto strings = std::vector<std::string>{};
+    for(auto value : values) {
+        strings.push_back(std::to_string(value));
+    }
+    return boost::join(strings, ",");
+}
+
+/**
+ * Returns the NUMA nodes with CPUs in 'cpus'. The nodes without memory (or whose memory
+ * the process is not allowed to use) are replaced by the nearest node with memory.
+ */
+std::vector<int> NumaTopology::getMemoryNodesLocalTo(const std::vector<int>& cpus) const {
+    auto result = std::set<int>{};
+    for(const auto& node : nodes) {
+        auto isLocal = std::any_of(cpus.cbegin(), cpus.cend(), [&node](int cpu) {
+            return node.second.cpus.count(cpu) > 0;
+        });
+        if(!isLocal) {
+            continue;
+        }
+        auto memoryNode = node.second.hasMemory && allowedMemoryNodes.count(node.first)
+                          ? node.first
+                          : getNearestNodeWithMemory(node.first);
+        if(memoryNode >= 0) {
+            result.insert(memoryNode);
+        }
+    }
+    return std::vector<int>(result.cbegin(), result.cend());
+}
+
+int NumaTopology::getNearestNodeWithMemory(int nodeID) const {
+    // the distances are listed in the order of the IDs of the nodes
+    const auto& distances = nodes.at(nodeID).distances;
+    auto nearest = -1;
+    auto nearestDistance = std::numeric_limits<int>::max();
+    auto position = size_t{0};
+    for(auto node = nodes.cbegin(); node != nodes.cend() && position < distances.size(); ++node, ++position) {
+        if(!node->second.hasMemory || allowedMemoryNodes.count(node->first) == 0) {
+            continue;
+        }
+        if(distances[position] < nearestDistance) {
+            nearest = node->first;
+            nearestDistance = distances[position];
+        }
+    }
+    return nearest;
+}
+
+}
+}
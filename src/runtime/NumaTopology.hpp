@@ -0,0 +1,62 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_runtime_NumaTopology_hpp
+#define sarus_runtime_NumaTopology_hpp
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+
+namespace sarus {
+namespace runtime {
+
+/**
+ * NUMA topology of the host, as exposed by the kernel in sysfs. Used to bind the memory
+ * of the container to the NUMA nodes local to its CPUs (cpuset.mems).
+ */
+class NumaTopology {
+public:
+    enum class MemoryPolicy { local, interleave, unset };
+
+public:
+    NumaTopology(const boost::filesystem::path& nodesDir = "/sys/devices/system/node",
+                 const boost::filesystem::path& procStatusFile = "/proc/self/status");
+
+    static MemoryPolicy parseMemoryPolicy(const std::string&);
+    static std::vector<int> parseList(const std::string&);
+    static std::string makeList(const std::vector<int>&);
+
+    bool isAvailable() const { return !nodes.empty(); }
+    std::vector<int> getMemoryNodesLocalTo(const std::vector<int>& cpus) const;
+
+private:
+    struct Node {
+        std::set<int> cpus;
+        std::vector<int> distances; // to all the nodes, in the order of their IDs
+        bool hasMemory = true;
+    };
+
+private:
+    int getNearestNodeWithMemory(int nodeID) const;
+
+private:
+    std::map<int, Node> nodes;
+    std::set<int> allowedMemoryNodes;
+};
+
+}
+}
+
+#endif
@@ -22,6 +22,7 @@
 #include "common/GroupDB.hpp"
 #include "common/ImageMetadata.hpp"
 #include "runtime/Utility.hpp"
+#include "runtime/Hugepages.hpp"
 #include "runtime/OCIHooksFactory.hpp"
 
 
@@ -150,7 +151,7 @@ rj::Value OCIBundleConfig::makeMemberRoot() const {
                     rj::Value{config->json["rootfsFolder"].GetString(), *allocator},
                     *allocator);
     root.AddMember( "readonly",
-                    rj::Value{false},
+                    rj::Value{config->commandRun.readOnlyRootfs},
                     *allocator);
     return root;
 }
@@ -298,6 +299,11 @@ rj::Value OCIBundleConfig::makeMemberLinux() const {
         auto cpus = boost::join(config->commandRun.cpuAffinity |intToString, ",");
         auto cpuAffinity = rj::Value{cpus.c_str(), *allocator};
         cpu.AddMember("cpus", cpuAffinity, *allocator);
+        // Likewise, bind the memory to the NUMA nodes local to the CPUs (see Runtime::setMemoryNodes)
+        if(!config->commandRun.memoryNodes.empty()) {
+            auto mems = boost::join(config->commandRun.memoryNodes |intToString, ",");
+            cpu.AddMember("mems", rj::Value{mems.c_str(), *allocator}, *allocator);
+        }
 
         // devices
         auto devices = rj::Value{rj::kArrayType};
@@ -316,10 +322,34 @@ rj::Value OCIBundleConfig::makeMemberLinux() const {
             devices.PushBack(deviceRule, *allocator);
         }
 
+        // hugepage limits (see Runtime::setHugepages)
+        auto hugepageLimits = rj::Value{rj::kArrayType};
+        for(const auto& limit : config->commandRun.hugepageLimits) {
+            auto pageSize = Hugepages::formatSize(limit.first);
+            auto hugepageLimit = rj::Value{rj::kObjectType};
+            hugepageLimit.AddMember("pageSize", rj::Value{pageSize.c_str(), *allocator}, *allocator);
+            hugepageLimit.AddMember("limit", rj::Value{static_cast<uint64_t>(limit.second)}, *allocator);
+            hugepageLimits.PushBack(hugepageLimit, *allocator);
+        }
+
         resources.AddMember("cpu", cpu, *allocator);
         resources.AddMember("devices", devices, *allocator);
+        if(!hugepageLimits.Empty()) {
+            resources.AddMember("hugepageLimits", hugepageLimits, *allocator);
+        }
         linuxV.AddMember("resources", resources, *allocator);
     }
+    // memory policy
+    if(!config->commandRun.memoryNodes.empty()
+       && config->json.HasMember("numaMemoryPolicy")
+       && config->json["numaMemoryPolicy"].GetString() == std::string{"interleave"}) {
+        auto intToString = boost::adaptors::transformed([](int i) { return std::to_string(i); });
+        auto nodes = boost::join(config->commandRun.memoryNodes |intToString, ",");
+        auto memoryPolicy = rj::Value{rj::kObjectType};
+        memoryPolicy.AddMember("mode", rj::Value{"MPOL_INTERLEAVE"}, *allocator);
+        memoryPolicy.AddMember("nodes", rj::Value{nodes.c_str(), *allocator}, *allocator);
+        linuxV.AddMember("memoryPolicy", memoryPolicy, *allocator);
+    }
     // namespaces
     {
         auto namespaces = rj::Value{rj::kArrayType};
@@ -410,8 +440,11 @@ rj::Value OCIBundleConfig::makeMemberHooks() const {
 
     auto hooksDir = boost::filesystem::path{ config->json["hooksDir"].GetString() };
     auto schemaFile = boost::filesystem::path{ config->json["prefixDir"].GetString() } / "etc/hook.schema.json";
+    auto hooks = config->validatedHooks.IsArray()
+        ? OCIHooksFactory{}.createHooks(config->validatedHooks)
+        : OCIHooksFactory{}.createHooks(hooksDir, schemaFile);
 
-    for(const auto& hook : OCIHooksFactory{}.createHooks(hooksDir, schemaFile)) {
+    for(const auto& hook : hooks) {
         if(hook.isActive(config)) {
             for(const auto& stage : hook.stages) {
                 if(!jsonHooks.HasMember(stage.c_str())) {
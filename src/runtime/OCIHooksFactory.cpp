@@ -53,11 +53,32 @@ std::vector<OCIHook> OCIHooksFactory::createHooks(const boost::filesystem::path&
     return hooks;
 }
 
+/**
+ * Creates the hooks from the JSON files already read and validated by the node daemon,
+ * in the form [{"file": ..., "json": ...}, ...].
+ */
+std::vector<OCIHook> OCIHooksFactory::createHooks(const rapidjson::Value& validatedHooks) const {
+    auto hooks = std::vector<OCIHook>{};
+    for(const auto& hook : validatedHooks.GetArray()) {
+        hooks.push_back(createHook(hook["file"].GetString(), hook["json"]));
+    }
+
+    utility::logMessage(boost::format{"Successfully created %d OCI hooks"} % hooks.size(),
+                        libsarus::LogLevel::INFO);
+
+    return hooks;
+}
+
 OCIHook OCIHooksFactory::createHook(const boost::filesystem::path& jsonFile,
                                     const boost::filesystem::path& schemaFile) const {
+    auto json = libsarus::json::readAndValidate(jsonFile, schemaFile);
+    return createHook(jsonFile, json);
+}
+
+OCIHook OCIHooksFactory::createHook(const boost::filesystem::path& jsonFile,
+                                    const rapidjson::Value& json) const {
     utility::logMessage(boost::format{"Creating OCI hook object from %s"} % jsonFile,
                         libsarus::LogLevel::INFO);
-    auto json = libsarus::json::readAndValidate(jsonFile, schemaFile);
     auto hook = OCIHook{};
 
     hook.jsonFile = jsonFile;
@@ -24,8 +24,11 @@ class OCIHooksFactory {
 public:
     std::vector<OCIHook> createHooks(const boost::filesystem::path& hooksDir,
                                      const boost::filesystem::path& schemaFile) const;
+    std::vector<OCIHook> createHooks(const rapidjson::Value& validatedHooks) const;
     OCIHook createHook(const boost::filesystem::path& jsonFile,
                        const boost::filesystem::path& schemaFile) const;
+    OCIHook createHook(const boost::filesystem::path& jsonFile,
+                       const rapidjson::Value& json) const;
     std::unique_ptr<OCIHook::Condition> createCondition(const std::string& name,
                                                         const rapidjson::Value& value) const;
 };
@@ -0,0 +1,194 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "PersistentContainer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+
+#include <boost/format.hpp>
+#include <boost/regex.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace runtime {
+
+PersistentContainer::PersistentContainer(const libsarus::UserIdentity& userIdentity, const std::string& name)
+    : userIdentity{userIdentity}
+    , name{name}
+    , stateDirectory{getStateDirectory(userIdentity)}
+{
+    validateName(name);
+}
+
+/**
+ * The name is used in the paths of the state files and is passed to the OCI runtime
+ * as a positional argument, hence the restricted character set.
+ */
+void PersistentContainer::validateName(const std::string& name) {
+    static const boost::regex re("^[a-zA-Z0-9][a-zA-Z0-9_.-]{0,127}$");
+    if(!boost::regex_match(name, re)) {
+        auto message = boost::format("Invalid container name '%s'. The name must start with a letter or a digit,"
+                                     " followed by at most 127 letters, digits, '_', '.' or '-'") % name;
+        SARUS_THROW_ERROR(message.str());
+    }
+}
+
+boost::filesystem::path PersistentContainer::getStateDirectory(const libsarus::UserIdentity& userIdentity) {
+    return boost::filesystem::path{"/run/sarus"} / std::to_string(userIdentity.uid);
+}
+
+/**
+ * Returns the state of the persistent containers of the user, sorted by name. The state
+ * of the containers whose supervisor doesn't exist anymore (e.g. because it was killed at
+ * the end of the job) is removed.
+ */
+std::vector<PersistentContainer::State> PersistentContainer::list(const libsarus::UserIdentity& userIdentity) {
+    auto states = std::vector<State>{};
+    auto stateDirectory = getStateDirectory(userIdentity);
+    if(!boost::filesystem::is_directory(stateDirectory)) {
+        return states;
+    }
+
+    for(const auto& entry : boost::filesystem::directory_iterator{stateDirectory}) {
+        if(entry.path().extension() != ".json") {
+            continue;
+        }
+        try {
+            auto container = PersistentContainer{userIdentity, entry.path().stem().string()};
+            auto state = container.readState();
+            if(container.isStale(state)) {
+                utility::logMessage(boost::format("Removing stale state of persistent container %s") % state.name,
+                                    libsarus::LogLevel::DEBUG);
+                container.removeState();
+                continue;
+            }
+            states.push_back(std::move(state));
+        }
+        catch(libsarus::Error& e) {
+            auto message = boost::format("Skipping invalid state file %s: %s") % entry.path() % e.what();
+            utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        }
+    }
+
+    std::sort(states.begin(), states.end(), [](const State& lhs, const State& rhs) {
+        return lhs.name < rhs.name;
+    });
+    return states;
+}
+
+boost::filesystem::path PersistentContainer::getStateFile() const {
+    return stateDirectory / (name + ".json");
+}
+
+boost::filesystem::path PersistentContainer::getActivityFile() const {
+    return stateDirectory / (name + ".activity");
+}
+
+boost::filesystem::path PersistentContainer::getLogFile() const {
+    return stateDirectory / (name + ".log");
+}
+
+bool PersistentContainer::exists() const {
+    if(!boost::filesystem::exists(getStateFile())) {
+        return false;
+    }
+    try {
+        return !isStale(readState());
+    }
+    catch(libsarus::Error&) {
+        return false;
+    }
+}
+
+void PersistentContainer::writeState(const State& state) const {
+    libsarus::filesystem::createFoldersIfNecessary(stateDirectory);
+
+    auto json = rj::Document{rj::kObjectType};
+    auto& allocator = json.GetAllocator();
+    json.AddMember("name", rj::Value{state.name.c_str(), allocator}, allocator);
+    json.AddMember("image", rj::Value{state.image.c_str(), allocator}, allocator);
+    json.AddMember("supervisorPid", rj::Value{static_cast<std::int64_t>(state.supervisorPid)}, allocator);
+    json.AddMember("creationTime", rj::Value{static_cast<std::int64_t>(state.creationTime)}, allocator);
+    json.AddMember("idleTimeout", rj::Value{static_cast<std::int64_t>(state.idleTimeout.count())}, allocator);
+    json.AddMember("slurmJobID", rj::Value{state.slurmJobID.c_str(), allocator}, allocator);
+    libsarus::json::write(json, getStateFile());
+
+    libsarus::filesystem::createFileIfNecessary(getActivityFile());
+}
+
+PersistentContainer::State PersistentContainer::readState() const {
+    auto state = State{};
+    try {
+        auto json = libsarus::json::read(getStateFile());
+        state.name = json["name"].GetString();
+        state.image = json["image"].GetString();
+        state.supervisorPid = static_cast<pid_t>(json["supervisorPid"].GetInt64());
+        state.creationTime = static_cast<std::time_t>(json["creationTime"].GetInt64());
+        state.idleTimeout = std::chrono::seconds{json["idleTimeout"].GetInt64()};
+        state.slurmJobID = json["slurmJobID"].GetString();
+    }
+    catch(std::exception& e) {
+        auto message = boost::format("Failed to read state of persistent container %s") % name;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+    return state;
+}
+
+/**
+ * The log is kept when the container failed to start, for "sarus run --detach" to report it.
+ */
+void PersistentContainer::removeState(bool isLogKept) const {
+    auto ec = boost::system::error_code{};
+    boost::filesystem::remove(getStateFile(), ec);
+    boost::filesystem::remove(getActivityFile(), ec);
+    if(!isLogKept) {
+        boost::filesystem::remove(getLogFile(), ec);
+    }
+}
+
+bool PersistentContainer::isStale(const State& state) const {
+    return kill(state.supervisorPid, 0) != 0 && errno == ESRCH;
+}
+
+libsarus::Flock PersistentContainer::lockActivity() const {
+    return libsarus::Flock{getActivityFile(), libsarus::Flock::Type::readLock};
+}
+
+void PersistentContainer::recordActivity() const {
+    boost::filesystem::last_write_time(getActivityFile(), std::time(nullptr));
+}
+
+/**
+ * The container is idle if no process is attached with "sarus exec" and the last
+ * attached process ended more than 'idleTimeout' ago.
+ */
+bool PersistentContainer::isIdle(const std::chrono::seconds& idleTimeout) const {
+    try {
+        auto lock = libsarus::Flock{getActivityFile(), libsarus::Flock::Type::writeLock, libsarus::milliseconds{0}};
+    }
+    catch(libsarus::Error&) {
+        return false;
+    }
+    auto lastActivity = boost::filesystem::last_write_time(getActivityFile());
+    return std::time(nullptr) - lastActivity >= idleTimeout.count();
+}
+
+}
+}
@@ -0,0 +1,87 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_runtime_PersistentContainer_hpp
+#define sarus_runtime_PersistentContainer_hpp
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/Flock.hpp"
+#include "libsarus/UserIdentity.hpp"
+
+
+namespace sarus {
+namespace runtime {
+
+/**
+ * Bookkeeping of a container started in the background with "sarus run --detach",
+ * to which new processes are attached with "sarus exec".
+ *
+ * The container is owned by a supervisor process, which keeps the mount namespace of
+ * the bundle alive, runs the OCI runtime and stops the container when it was idle for
+ * longer than its idle timeout. The supervisor stays in the process tree of the job
+ * which started it, so the container is also terminated with the job.
+ *
+ * The state of the container is stored in a root-owned directory, one JSON file per
+ * container. "sarus exec" holds a read lock on the activity file of the container
+ * while its process runs and updates the modification time of the file when it
+ * starts and ends: the container is idle when the supervisor can take a write lock
+ * on the file and the file wasn't modified within the idle timeout.
+ */
+class PersistentContainer {
+public:
+    struct State {
+        std::string name;
+        std::string image;
+        pid_t supervisorPid = 0;
+        std::time_t creationTime = 0;
+        std::chrono::seconds idleTimeout{0};
+        std::string slurmJobID;
+    };
+
+public:
+    PersistentContainer(const libsarus::UserIdentity& userIdentity, const std::string& name);
+
+    static void validateName(const std::string& name);
+    static boost::filesystem::path getStateDirectory(const libsarus::UserIdentity& userIdentity);
+    static std::vector<State> list(const libsarus::UserIdentity& userIdentity);
+
+    const std::string& getName() const { return name; }
+    boost::filesystem::path getLogFile() const;
+    bool exists() const;
+    void writeState(const State& state) const;
+    State readState() const;
+    void removeState(bool isLogKept=false) const;
+
+    libsarus::Flock lockActivity() const;
+    void recordActivity() const;
+    bool isIdle(const std::chrono::seconds& idleTimeout) const;
+
+private:
+    boost::filesystem::path getStateFile() const;
+    boost::filesystem::path getActivityFile() const;
+    bool isStale(const State& state) const;
+
+private:
+    libsarus::UserIdentity userIdentity;
+    std::string name;
+    boost::filesystem::path stateDirectory;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "PrefetchProfile.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+#include <rapidjson/document.h>
+
+#include "libsarus/Error.hpp"
+#include "libsarus/Sha256.hpp"
+#include "libsarus/Utility.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace runtime {
+
+// the head of the image contains the superblock of the filesystem
+static const size_t fingerprintHeadSize = 4096;
+
+PrefetchProfile::PrefetchProfile(const Fingerprint& fingerprint,
+                                 const std::vector<boost::filesystem::path>& files,
+                                 const std::vector<Range>& ranges)
+    : fingerprint(fingerprint)
+    , files(files)
+    , ranges(ranges)
+{}
+
+static bool isValidProfile(const rj::Value& json) {
+    if(!json.IsObject()
+       || !json.HasMember("imageSize") || !json["imageSize"].IsUint64()
+       || !json.HasMember("imageHeadDigest") || !json["imageHeadDigest"].IsString()
+       || !json.HasMember("files") || !json["files"].IsArray()
+       || !json.HasMember("ranges") || !json["ranges"].IsArray()) {
+        return false;
+    }
+    for(const auto& path : json["files"].GetArray()) {
+        if(!path.IsString()) {
+            return false;
+        }
+    }
+    for(const auto& range : json["ranges"].GetArray()) {
+        if(!range.IsArray() || range.Size() != 2 || !range[0].IsUint64() || !range[1].IsUint64()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PrefetchProfile PrefetchProfile::read(const boost::filesystem::path& file) {
+    try {
+        auto json = libsarus::json::read(file);
+        if(!isValidProfile(json)) {
+            SARUS_THROW_ERROR("Invalid JSON structure");
+        }
+
+        auto profile = PrefetchProfile{};
+        profile.fingerprint.imageSize = json["imageSize"].GetUint64();
+        profile.fingerprint.headDigest = json["imageHeadDigest"].GetString();
+        for(const auto& path : json["files"].GetArray()) {
+            profile.files.emplace_back(path.GetString());
+        }
+        for(const auto& range : json["ranges"].GetArray()) {
+            profile.ranges.push_back(Range{range[0].GetUint64(), range[1].GetUint64()});
+        }
+        return profile;
+    }
+    catch(const std::exception& e) {
+        auto message = boost::format("Failed to read prefetch profile %s") % file;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+/**
+ * Writes the profile to a temporary file which then replaces the profile atomically,
+ * so that concurrent containers never replay a partially written profile.
+ */
+void PrefetchProfile::write(const boost::filesystem::path& file) const {
+    auto json = rj::Document{rj::kObjectType};
+    auto& allocator = json.GetAllocator();
+    json.AddMember("imageSize", rj::Value{fingerprint.imageSize}, allocator);
+    json.AddMember("imageHeadDigest", rj::Value{fingerprint.headDigest.c_str(), allocator}, allocator);
+
+    auto filesJSON = rj::Value{rj::kArrayType};
+    for(const auto& path : files) {
+        filesJSON.PushBack(rj::Value{path.c_str(), allocator}, allocator);
+    }
+    json.AddMember("files", filesJSON, allocator);
+
+    auto rangesJSON = rj::Value{rj::kArrayType};
+    for(const auto& range : ranges) {
+        auto rangeJSON = rj::Value{rj::kArrayType};
+        rangeJSON.PushBack(rj::Value{range.offset}, allocator);
+        rangeJSON.PushBack(rj::Value{range.length}, allocator);
+        rangesJSON.PushBack(rangeJSON, allocator);
+    }
+    json.AddMember("ranges", rangesJSON, allocator);
+
+    auto tempFile = libsarus::filesystem::makeUniquePathWithRandomSuffix(file);
+    try {
+        libsarus::json::write(json, tempFile);
+        boost::filesystem::rename(tempFile, file);
+    }
+    catch(const std::exception& e) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(tempFile, ec);
+        auto message = boost::format("Failed to write prefetch profile %s") % file;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+}
+
+PrefetchProfile::Fingerprint PrefetchProfile::computeFingerprint(int imageFd) {
+    struct stat st;
+    if(fstat(imageFd, &st) != 0) {
+        auto message = boost::format("Failed to stat image file: %s") % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto head = std::vector<char>(fingerprintHeadSize);
+    auto headSize = pread(imageFd, head.data(), head.size(), 0);
+    if(headSize < 0) {
+        auto message = boost::format("Failed to read head of image file: %s") % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto sha256 = libsarus::Sha256{};
+    sha256.update(head.data(), headSize);
+    return Fingerprint{static_cast<std::uint64_t>(st.st_size), sha256.finalizeHex()};
+}
+
+/**
+ * Returns the byte ranges of the image file which are currently in the page cache.
+ * When the page cache of the file is dropped before the image is mounted, these are
+ * the ranges read through the loop device since the mount, including the pages of
+ * the files mapped in memory by the container (e.g. shared libraries), which are
+ * not visible as read operations.
+ */
+std::vector<PrefetchProfile::Range> PrefetchProfile::getResidentRanges(int imageFd) {
+    struct stat st;
+    if(fstat(imageFd, &st) != 0) {
+        auto message = boost::format("Failed to stat image file: %s") % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto fileSize = static_cast<std::uint64_t>(st.st_size);
+    if(fileSize == 0) {
+        return {};
+    }
+
+    auto* address = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, imageFd, 0);
+    if(address == MAP_FAILED) {
+        auto message = boost::format("Failed to map image file in memory: %s") % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto residency = std::vector<unsigned char>((fileSize + pageSize - 1) / pageSize);
+    auto result = mincore(address, fileSize, residency.data());
+    auto mincoreErrno = errno;
+    munmap(address, fileSize);
+    if(result != 0) {
+        auto message = boost::format("Failed to determine page cache residency of image file: %s") % strerror(mincoreErrno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    return makeRanges(residency, pageSize, fileSize);
+}
+
+/**
+ * Coalesces the resident pages of a mincore() residency vector into byte ranges.
+ */
+std::vector<PrefetchProfile::Range> PrefetchProfile::makeRanges(const std::vector<unsigned char>& residency,
+                                                                size_t pageSize,
+                                                                std::uint64_t fileSize) {
+    auto ranges = std::vector<Range>{};
+    for(size_t page = 0; page < residency.size(); ++page) {
+        if(!(residency[page] & 1)) {
+            continue;
+        }
+        auto offset = static_cast<std::uint64_t>(page) * pageSize;
+        auto length = std::min<std::uint64_t>(pageSize, fileSize - offset);
+        if(!ranges.empty() && ranges.back().offset + ranges.back().length == offset) {
+            ranges.back().length += length;
+        }
+        else {
+            ranges.push_back(Range{offset, length});
+        }
+    }
+    return ranges;
+}
+
+bool PrefetchProfile::matches(const Fingerprint& other) const {
+    return fingerprint.imageSize == other.imageSize && fingerprint.headDigest == other.headDigest;
+}
+
+std::uint64_t PrefetchProfile::getTotalSize() const {
+    return std::accumulate(ranges.cbegin(), ranges.cend(), std::uint64_t{0},
+                           [](std::uint64_t size, const Range& range) { return size + range.length; });
+}
+
+}
+}
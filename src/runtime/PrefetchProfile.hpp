@@ -0,0 +1,71 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_runtime_PrefetchProfile_hpp
+#define sarus_runtime_PrefetchProfile_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+
+namespace sarus {
+namespace runtime {
+
+/**
+ * Byte ranges of an image file read during the startup of a container, recorded
+ * from a previous run of the image, together with the files opened in the container
+ * in order of first access.
+ *
+ * The profile identifies the image file by size and by the digest of its head (which
+ * contains the superblock of the filesystem), so that a profile recorded for a previous
+ * version of the image, or for another image, is never replayed.
+ */
+class PrefetchProfile {
+public:
+    struct Range {
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    struct Fingerprint {
+        std::uint64_t imageSize;
+        std::string headDigest;
+    };
+
+public:
+    PrefetchProfile() = default;
+    PrefetchProfile(const Fingerprint& fingerprint,
+                    const std::vector<boost::filesystem::path>& files,
+                    const std::vector<Range>& ranges);
+    static PrefetchProfile read(const boost::filesystem::path& file);
+    void write(const boost::filesystem::path& file) const;
+
+    static Fingerprint computeFingerprint(int imageFd);
+    static std::vector<Range> getResidentRanges(int imageFd);
+    static std::vector<Range> makeRanges(const std::vector<unsigned char>& residency, size_t pageSize, std::uint64_t fileSize);
+
+    bool matches(const Fingerprint& fingerprint) const;
+    const std::vector<boost::filesystem::path>& getFiles() const { return files; }
+    const std::vector<Range>& getRanges() const { return ranges; }
+    std::uint64_t getTotalSize() const;
+
+private:
+    Fingerprint fingerprint{0, ""};
+    std::vector<boost::filesystem::path> files;
+    std::vector<Range> ranges;
+};
+
+}
+}
+
+#endif
@@ -11,16 +11,28 @@
 #include "Runtime.hpp"
 
 #include <type_traits>
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
+#include <ctime>
+#include <fcntl.h>
 #include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
 #include <sched.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
@@ -28,6 +40,9 @@
 #include "libsarus/Utility.hpp"
 #include "common/ImageReference.hpp"
 #include "libsarus/CLIArguments.hpp"
+#include "runtime/Hugepages.hpp"
+#include "runtime/NumaTopology.hpp"
+#include "runtime/PersistentContainer.hpp"
 #include "runtime/Utility.hpp"
 
 
@@ -40,26 +55,162 @@ Runtime::Runtime(std::shared_ptr<common::Config> config)
     , rootfsDir{ bundleDir / boost::filesystem::path{config->json["rootfsFolder"].GetString()} }
     , bundleConfig{config}
     , fdHandler{config}
+    , prefetcher{new ImagePrefetcher{config}}
+    , writableLayer{new WritableLayer{config, bundleDir}}
 {
     libsarus::environment::clearVariables();
 
     auto status = libsarus::filesystem::readFile("/proc/self/status");
     config->commandRun.cpuAffinity = libsarus::process::getCpuAffinity();
+    setMemoryNodes();
+    setHugepages();
+}
+
+/**
+ * Binds the memory of the container to the NUMA nodes local to its CPUs (i.e. to the affinity
+ * set by the workload manager), according to the policy configured by the administrator.
+ */
+void Runtime::setMemoryNodes() const {
+    auto policy = NumaTopology::MemoryPolicy::local;
+    if(config->json.HasMember("numaMemoryPolicy")) {
+        policy = NumaTopology::parseMemoryPolicy(config->json["numaMemoryPolicy"].GetString());
+    }
+    if(policy == NumaTopology::MemoryPolicy::unset) {
+        return;
+    }
+
+    try {
+        auto topology = NumaTopology{};
+        if(!topology.isAvailable()) {
+            return;
+        }
+        config->commandRun.memoryNodes = topology.getMemoryNodesLocalTo(config->commandRun.cpuAffinity);
+    }
+    catch(libsarus::Error& e) {
+        auto message = boost::format("Failed to determine the NUMA nodes local to the CPUs of the container,"
+                                     " the memory of the container is not bound: %s") % e.what();
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        return;
+    }
+    utility::logMessage(boost::format("Memory nodes of the container: %s")
+                        % NumaTopology::makeList(config->commandRun.memoryNodes),
+                        libsarus::LogLevel::DEBUG);
+}
+
+/**
+ * Resolves the hugepages of the container: the page sizes requested from the CLI or, if none,
+ * the default ones of the "hugepages" parameter of the configuration. The requests are validated
+ * against the hugepage pools of the host and against the sizes and the number of pages allowed by
+ * the administrator. The default sizes which are not available on the host are skipped, so that
+ * the same configuration can be deployed on nodes with different pools.
+ */
+void Runtime::setHugepages() const {
+    auto& hugepages = config->commandRun.hugepages;
+    auto isRequestedFromCLI = !hugepages.empty();
+    if(!isRequestedFromCLI) {
+        if(const auto* defaultSizes = rapidjson::Pointer("/hugepages/defaultSizes").Get(config->json)) {
+            for(const auto& size : defaultSizes->GetArray()) {
+                hugepages[Hugepages::parseSize(size.GetString())] = 0;
+            }
+        }
+    }
+    if(hugepages.empty()) {
+        return;
+    }
+
+    auto allowedSizes = boost::optional<std::vector<size_t>>{};
+    if(const auto* sizes = rapidjson::Pointer("/hugepages/allowedSizes").Get(config->json)) {
+        allowedSizes = std::vector<size_t>{};
+        for(const auto& size : sizes->GetArray()) {
+            allowedSizes->push_back(Hugepages::parseSize(size.GetString()));
+        }
+    }
+    auto maxPages = boost::optional<size_t>{};
+    if(const auto* value = rapidjson::Pointer("/hugepages/maxPages").Get(config->json)) {
+        maxPages = value->GetUint64();
+    }
+
+    auto host = Hugepages{};
+    for(auto it = hugepages.begin(); it != hugepages.end();) {
+        auto sizeKB = it->first;
+        auto size = Hugepages::formatSize(sizeKB);
+        auto hostPages = host.isSizeAvailable(sizeKB) ? host.getNumberOfPages(sizeKB) : 0;
+        if(hostPages == 0) {
+            if(!isRequestedFromCLI) {
+                utility::logMessage(boost::format("Skipping default hugepages of size %s: not available on the host")
+                                    % size, libsarus::LogLevel::DEBUG);
+                it = hugepages.erase(it);
+                continue;
+            }
+            auto available = std::vector<std::string>{};
+            for(auto hostSize : host.getSizes()) {
+                if(host.getNumberOfPages(hostSize) > 0) {
+                    available.push_back(Hugepages::formatSize(hostSize));
+                }
+            }
+            auto message = boost::format("Hugepages of size %s are not available on the host. Available sizes: %s")
+                % size % (available.empty() ? std::string{"none"} : boost::join(available, ", "));
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(allowedSizes && std::find(allowedSizes->cbegin(), allowedSizes->cend(), sizeKB) == allowedSizes->cend()) {
+            auto message = boost::format("Hugepages of size %s are not allowed by the configuration") % size;
+            SARUS_THROW_ERROR(message.str());
+        }
+
+        auto pages = it->second;
+        if(pages > hostPages) {
+            auto message = boost::format("Requested %d hugepages of size %s, but the host has %d")
+                % pages % size % hostPages;
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(maxPages && pages > *maxPages) {
+            auto message = boost::format("Requested %d hugepages of size %s, but the configuration allows at most %d"
+                                         " pages per container") % pages % size % *maxPages;
+            SARUS_THROW_ERROR(message.str());
+        }
+        if(pages == 0) {
+            pages = maxPages ? std::min(hostPages, *maxPages) : hostPages;
+        }
+
+        if(host.isCgroupControllerAvailable()) {
+            config->commandRun.hugepageLimits[sizeKB] = pages * sizeKB * 1024;
+        }
+        else if(it->second > 0) {
+            auto message = boost::format("Cannot limit the hugepages of size %s of the container: the hugetlb"
+                                         " cgroup controller is not available on the host") % size;
+            SARUS_THROW_ERROR(message.str());
+        }
+        else if(maxPages) {
+            auto message = boost::format("Not enforcing the maximum number of hugepages of size %s of the container:"
+                                         " the hugetlb cgroup controller is not available on the host") % size;
+            utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        }
+        utility::logMessage(boost::format("Hugepages of the container: size %s, up to %d pages") % size % pages,
+                            libsarus::LogLevel::DEBUG);
+        ++it;
+    }
 }
 
 void Runtime::setupOCIBundle() {
     utility::logMessage("Setting up OCI Bundle", libsarus::LogLevel::INFO);
 
+    // before the mount namespace is created, so that the mount of the daemon is visible in it
+    requestImageMountFromNodeDaemon();
     setupMountIsolation();
     setupRamFilesystem();
     mountImageIntoRootfs();
     setupDevFilesystem();
+    mountHugetlbfsIfNecessary();
+    if(config->commandRun.readOnlyRootfs) {
+        setupWritableMountsOfReadOnlyRootfs();
+    }
     copyEtcFilesIntoRootfs();
     mountInitProgramIntoRootfsIfNecessary();
-    performCustomMounts();
-    performExtraMounts();
-    performDeviceMounts();
-    remountRootfsWithNoSuid();
+    setupTaskRunnerIfNecessary();
+    performMounts();
+    if(!config->commandRun.readOnlyRootfs) {
+        remountRootfsWithNoSuid();
+    }
     fdHandler.preservePMIFdIfAny();
     fdHandler.applyChangesToFdsAndEnvVariablesAndBundleAnnotations();
     bundleConfig.generateConfigFile();
@@ -74,41 +225,48 @@ static std::string getContainerName(const common::Config::CommandRun& commandRun
     return "sarus-container-" + libsarus::string::generateRandom(16);
 }
 
-void Runtime::executeContainer() const {
+// Sets a parent-death signal in the forked process (i.e. the OCI runtime), in the attempt to gracefully
+// terminate the container and cleanup should the parent process receive a SIGKILL or die unexpectedly
+// in another way.
+static void setParentDeathSignal(pid_t parentPid) {
+    if(prctl(PR_SET_PDEATHSIG, SIGHUP) == -1) {
+        auto message = boost::format("Failed to set parent death signal in subprocess for OCI runtime");
+        SARUS_THROW_ERROR(message.str());
+    }
+    // check if the parent already exited before the prctl() call
+    if (getppid() != parentPid) {
+        auto message = boost::format("Sarus main process died immediately after forking subprocess for OCI runtime");
+        SARUS_THROW_ERROR(message.str());
+    }
+}
+
+libsarus::CLIArguments Runtime::makeOCIRuntimeArgs(const std::string& containerID) const {
+    auto runcPath = config->json["runcPath"].GetString();
+    auto extraFileDescriptors = std::to_string(fdHandler.getExtraFileDescriptors());
+    return libsarus::CLIArguments{runcPath,
+                                  "--root", "/run/runc/" + std::to_string(config->userIdentity.uid),
+                                  "run",
+                                  "--preserve-fds", extraFileDescriptors,
+                                  containerID};
+}
+
+void Runtime::executeContainer() {
     auto containerID = getContainerName(config->commandRun);
     utility::logMessage("Executing " + containerID, libsarus::LogLevel::INFO);
 
     // chdir to bundle
     libsarus::filesystem::changeDirectory(bundleDir);
 
-    // assemble runc args
-    auto runcPath = config->json["runcPath"].GetString();
-    auto extraFileDescriptors = std::to_string(fdHandler.getExtraFileDescriptors());
-    auto args = libsarus::CLIArguments{runcPath, 
-                                       "--root", "/run/runc/" + std::to_string(config->userIdentity.uid),
-                                       "run",
-                                       "--preserve-fds", extraFileDescriptors,
-                                       containerID};
-
-    // prepare a pre-exec function for the forked process (i.e. the OCI runtime)
-    // to set a parent-death signal, in the attempt to gracefully terminate the container
-    // and cleanup should the Sarus process receive a SIGKILL or die unexpectedly in another way.
-    auto setParentDeathSignal = [] (pid_t parentPid) {
-        if(prctl(PR_SET_PDEATHSIG, SIGHUP) == -1) {
-            auto message = boost::format("Failed to set parent death signal in subprocess for OCI runtime");
-            SARUS_THROW_ERROR(message.str());
-        }
-        // check if the parent already exited before the prctl() call
-        if (getppid() != parentPid) {
-            auto message = boost::format("Sarus main process died immediately after forking subprocess for OCI runtime");
-            SARUS_THROW_ERROR(message.str());
-        }
-    };
+    auto args = makeOCIRuntimeArgs(containerID);
 
     // execute runc
+    writableLayer->startMonitoring();
     auto status = libsarus::process::forkExecWait(args,
                                        std::function<void()>{std::bind(setParentDeathSignal, getpid())},
                                        std::function<void(pid_t)>{utility::setupSignalProxying});
+    prefetcher->finish();
+    writableLayer->finish();
+    collectTaskResultsIfNecessary();
     if(status != 0) {
         auto message = boost::format("%s exited with code %d") % args % status;
         utility::logMessage(message, libsarus::LogLevel::INFO);
@@ -118,6 +276,216 @@ void Runtime::executeContainer() const {
     utility::logMessage("Successfully executed " + containerID, libsarus::LogLevel::INFO);
 }
 
+/**
+ * Starts the container in the background ("sarus run --detach"). A supervisor process is forked,
+ * which inherits the mount namespace of the bundle, keeps it alive after this process exits and
+ * runs the OCI runtime (see PersistentContainer). This process returns once the container is
+ * running, printing the name of the container.
+ */
+void Runtime::executeContainerInBackground() {
+    auto containerID = getContainerName(config->commandRun);
+    auto container = PersistentContainer{config->userIdentity, containerID};
+    if(container.exists()) {
+        auto message = boost::format("A persistent container named %s already exists") % containerID;
+        SARUS_THROW_ERROR(message.str());
+    }
+    utility::logMessage("Executing " + containerID + " in the background", libsarus::LogLevel::INFO);
+
+    libsarus::filesystem::changeDirectory(bundleDir);
+
+    // the worker thread of the prefetcher doesn't survive the fork of the supervisor
+    prefetcher->finish();
+
+    int readinessPipe[2];
+    if(pipe2(readinessPipe, O_CLOEXEC) != 0) {
+        auto message = boost::format("Failed to create pipe to start container in the background: %s") % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    auto pid = fork();
+    if(pid == -1) {
+        auto message = boost::format("Failed to fork supervisor of container %s: %s") % containerID % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    if(pid == 0) {
+        close(readinessPipe[0]);
+        _exit(superviseContainer(container, readinessPipe[1]));
+    }
+
+    close(readinessPipe[1]);
+    char isReady = 0;
+    ssize_t count;
+    do {
+        count = read(readinessPipe[0], &isReady, 1);
+    } while(count < 0 && errno == EINTR);
+    close(readinessPipe[0]);
+
+    if(count != 1) {
+        int status;
+        waitpid(pid, &status, 0);
+        auto log = boost::filesystem::exists(container.getLogFile())
+            ? libsarus::filesystem::readFile(container.getLogFile()) : std::string{};
+        container.removeState();
+        auto message = boost::format("Failed to start container %s in the background:\n%s") % containerID % log;
+        utility::logMessage(message, libsarus::LogLevel::GENERAL, std::cout, std::cerr);
+        SARUS_THROW_ERROR(message.str(), libsarus::LogLevel::INFO);
+    }
+
+    // the supervisor owns the writable layer from now on
+    writableLayer->handOver();
+    std::cout << containerID << std::endl;
+    utility::logMessage("Successfully started " + containerID + " in the background", libsarus::LogLevel::INFO);
+}
+
+/**
+ * Executed by the supervisor process of a container started in the background. Runs the OCI
+ * runtime and, from a separate thread, reports through 'readinessFd' when the container is
+ * running and stops the container when it was idle for longer than its idle timeout. The
+ * output of the supervisor and of the container goes to the log file of the container.
+ * Returns the exit status of the OCI runtime.
+ */
+int Runtime::superviseContainer(const PersistentContainer& container, int readinessFd) {
+    const auto& containerID = container.getName();
+    try {
+        if(setsid() == -1) {
+            auto message = boost::format("Failed to create new session: %s") % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+
+        auto state = PersistentContainer::State{};
+        state.name = containerID;
+        state.image = config->imageReference.string();
+        state.supervisorPid = getpid();
+        state.creationTime = std::time(nullptr);
+        state.idleTimeout = config->commandRun.idleTimeout;
+        auto slurmJobID = config->commandRun.hostEnvironment.find("SLURM_JOB_ID");
+        if(slurmJobID != config->commandRun.hostEnvironment.cend()) {
+            state.slurmJobID = slurmJobID->second;
+        }
+        container.writeState(state);
+
+        auto logFd = open(container.getLogFile().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        auto nullFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if(logFd < 0 || nullFd < 0
+           || fchown(logFd, config->userIdentity.uid, config->userIdentity.gid) != 0
+           || dup2(nullFd, STDIN_FILENO) < 0 || dup2(logFd, STDOUT_FILENO) < 0 || dup2(logFd, STDERR_FILENO) < 0) {
+            auto message = boost::format("Failed to redirect output to %s: %s") % container.getLogFile() % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+        close(logFd);
+        close(nullFd);
+    }
+    catch(std::exception& e) {
+        utility::logMessage(e.what(), libsarus::LogLevel::ERROR, std::cout, std::cerr);
+        container.removeState(true);
+        return EXIT_FAILURE;
+    }
+
+    auto args = makeOCIRuntimeArgs(containerID);
+    std::atomic<bool> isStopRequested{false};
+    std::atomic<bool> isRunning{false};
+    std::thread watcher;
+    auto startWatcher = [&](pid_t ociRuntimePid) {
+        utility::setupSignalProxying(ociRuntimePid);
+        watcher = std::thread{[&, ociRuntimePid]() {
+            watchContainer(container, ociRuntimePid, readinessFd, isStopRequested, isRunning);
+        }};
+    };
+
+    auto status = EXIT_FAILURE;
+    try {
+        writableLayer->startMonitoring();
+        status = libsarus::process::forkExecWait(args,
+                                                 std::function<void()>{std::bind(setParentDeathSignal, getpid())},
+                                                 std::function<void(pid_t)>{startWatcher});
+    }
+    catch(std::exception& e) {
+        utility::logMessage(e.what(), libsarus::LogLevel::ERROR, std::cout, std::cerr);
+    }
+
+    isStopRequested = true;
+    if(watcher.joinable()) {
+        watcher.join();
+    }
+    close(readinessFd);
+    writableLayer->finish();
+    container.removeState(!isRunning);
+    auto message = boost::format("%s exited with code %d") % args % status;
+    utility::logMessage(message, libsarus::LogLevel::INFO);
+    return status;
+}
+
+/**
+ * Executed by the watcher thread of the supervisor, see superviseContainer().
+ */
+void Runtime::watchContainer(const PersistentContainer& container,
+                             pid_t ociRuntimePid,
+                             int readinessFd,
+                             const std::atomic<bool>& isStopRequested,
+                             std::atomic<bool>& isRunning) const {
+    const auto pollInterval = std::chrono::milliseconds{100};
+    const auto idleCheckInterval = std::chrono::seconds{1};
+    const auto stopGracePeriod = std::chrono::seconds{10};
+    const auto& containerID = container.getName();
+    auto runcPath = std::string{config->json["runcPath"].GetString()};
+    auto runcRoot = "/run/runc/" + std::to_string(config->userIdentity.uid);
+
+    // wait until the container is running
+    while(!isStopRequested) {
+        try {
+            std::stringstream output;
+            auto args = libsarus::CLIArguments{runcPath, "--root", runcRoot, "state", containerID};
+            if(libsarus::process::forkExecWait(args, {}, {}, &output) == 0
+               && libsarus::json::parse(output.str())["status"] == "running") {
+                isRunning = true;
+                char isReady = 1;
+                if(write(readinessFd, &isReady, 1) != 1) {
+                    utility::logMessage("Failed to notify that the container is running", libsarus::LogLevel::WARN);
+                }
+                break;
+            }
+        }
+        catch(std::exception&) {
+            // the container is not created yet
+        }
+        std::this_thread::sleep_for(pollInterval);
+    }
+
+    // stop the container when idle
+    auto idleTimeout = config->commandRun.idleTimeout;
+    auto lastCheck = std::chrono::steady_clock::now();
+    while(!isStopRequested && idleTimeout.count() > 0) {
+        std::this_thread::sleep_for(pollInterval);
+        if(std::chrono::steady_clock::now() - lastCheck < idleCheckInterval) {
+            continue;
+        }
+        lastCheck = std::chrono::steady_clock::now();
+        if(!container.isIdle(idleTimeout)) {
+            continue;
+        }
+
+        auto message = boost::format("Stopping container %s, idle for more than %d seconds") % containerID % idleTimeout.count();
+        utility::logMessage(message, libsarus::LogLevel::GENERAL);
+        // the OCI runtime forwards the signal to the process of the container
+        kill(ociRuntimePid, SIGTERM);
+        auto deadline = std::chrono::steady_clock::now() + stopGracePeriod;
+        while(!isStopRequested && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(pollInterval);
+        }
+        if(!isStopRequested) {
+            try {
+                auto args = libsarus::CLIArguments{runcPath, "--root", runcRoot, "kill", "--all", containerID, "SIGKILL"};
+                libsarus::process::forkExecWait(args);
+            }
+            catch(std::exception& e) {
+                utility::logMessage(e.what(), libsarus::LogLevel::WARN);
+            }
+        }
+        break;
+    }
+}
+
 void Runtime::setupMountIsolation() const {
     utility::logMessage("Setting up mount isolation", libsarus::LogLevel::INFO);
     if(unshare(CLONE_NEWNS) != 0) {
@@ -161,23 +529,92 @@ void Runtime::setupRamFilesystem() const {
     utility::logMessage("Successfully set up RAM filesystem", libsarus::LogLevel::INFO);
 }
 
-void Runtime::mountImageIntoRootfs() const {
+/**
+ * The image is mounted as the lower layer of an overlay whose upper layer is provided by
+ * the configured backend (see WritableLayer), so that the container can write anywhere
+ * in its rootfs.
+ * With a read-only rootfs ("sarus run --read-only") the image is mounted directly as the
+ * rootfs, which saves the overlay and the memory of its upper layer.
+ */
+void Runtime::mountImageIntoRootfs() {
     utility::logMessage("Mounting image into bundle's rootfs", libsarus::LogLevel::INFO);
 
-    auto lowerDir = bundleDir / "overlay/rootfs-lower";
-    auto upperDir = bundleDir / "overlay/rootfs-upper";
-    auto workDir = bundleDir / "overlay/rootfs-work";
     libsarus::filesystem::createFoldersIfNecessary(rootfsDir);
-    libsarus::filesystem::createFoldersIfNecessary(lowerDir);
-    libsarus::filesystem::createFoldersIfNecessary(upperDir, config->userIdentity.uid, config->userIdentity.gid);
-    libsarus::filesystem::createFoldersIfNecessary(workDir);
 
-    libsarus::mount::loopMountSquashfs(config->getImageFile(), lowerDir);
-    libsarus::mount::mountOverlayfs(lowerDir, upperDir, workDir, rootfsDir);
+    auto imageFile = getImageFile();
+    // the prefetch of the image proceeds in the background during the rest of the bundle setup
+    if(prefetcher->isRecording()) {
+        prefetcher->prepareRecording(imageFile);
+    }
+    else {
+        prefetcher->startReplay(imageFile);
+    }
+
+    if(config->commandRun.readOnlyRootfs) {
+        mountImage(imageFile, rootfsDir);
+        if(prefetcher->isRecording()) {
+            prefetcher->startRecording(rootfsDir, rootfsDir);
+        }
+    }
+    else {
+        auto lowerDir = bundleDir / "overlay/rootfs-lower";
+        libsarus::filesystem::createFoldersIfNecessary(lowerDir);
+        writableLayer->setup();
+        mountImage(imageFile, lowerDir);
+        libsarus::mount::mountOverlayfs(lowerDir,
+                                        writableLayer->getUpperDir(),
+                                        writableLayer->getWorkDir(),
+                                        rootfsDir,
+                                        writableLayer->getOverlayOptions());
+        if(prefetcher->isRecording()) {
+            prefetcher->startRecording(rootfsDir, lowerDir);
+        }
+    }
 
     utility::logMessage("Successfully mounted image into bundle's rootfs", libsarus::LogLevel::INFO);
 }
 
+boost::filesystem::path Runtime::getImageFile() const {
+    if(config->commandRun.nodeLocalImageFile) {
+        return *config->commandRun.nodeLocalImageFile;
+    }
+    else if(config->commandRun.imageFile) {
+        return *config->commandRun.imageFile;
+    }
+    return config->getImageFile();
+}
+
+void Runtime::requestImageMountFromNodeDaemon() {
+    nodeDaemonImageMount = daemon::DaemonClient{}.mountImage(getImageFile(), config->commandRun.imageFormat);
+}
+
+/**
+ * Bind mounts the image mounted by the node daemon, if available, otherwise loop mounts the
+ * image. The daemon could have unmounted the image in the meantime (e.g. after its idle timeout),
+ * hence the device of the bind mount is checked against the one of the mount of the daemon.
+ */
+void Runtime::mountImage(const boost::filesystem::path& imageFile, const boost::filesystem::path& mountPoint) const {
+    if(nodeDaemonImageMount) {
+        const auto& source = nodeDaemonImageMount->mountPoint;
+        if(mount(source.c_str(), mountPoint.c_str(), "bind", MS_BIND, NULL) == 0) {
+            struct stat st;
+            auto flags = MS_REMOUNT | MS_BIND | MS_RDONLY | MS_NOSUID | MS_NODEV;
+            if(mount(NULL, mountPoint.c_str(), NULL, flags, NULL) == 0
+               && stat(mountPoint.c_str(), &st) == 0
+               && st.st_dev == nodeDaemonImageMount->device) {
+                utility::logMessage(boost::format("Bind mounted image from node daemon's mount %s") % source,
+                                    libsarus::LogLevel::INFO);
+                return;
+            }
+            umount2(mountPoint.c_str(), MNT_DETACH);
+        }
+        auto message = boost::format("Failed to use node daemon's mount %s of image, loop mounting the image instead")
+            % source;
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+    }
+    libsarus::mount::loopMountImage(imageFile, mountPoint, config->commandRun.imageFormat);
+}
+
 void Runtime::setupDevFilesystem() const {
     utility::logMessage("Setting up /dev filesystem", libsarus::LogLevel::INFO);
 
@@ -196,6 +633,75 @@ void Runtime::setupDevFilesystem() const {
     utility::logMessage("Successfully set up /dev filesystem", libsarus::LogLevel::INFO);
 }
 
+/**
+ * One hugetlbfs per page size, in the /dev filesystem of the container, owned by the user.
+ * Libraries such as libhugetlbfs find the mount points through /proc/mounts.
+ */
+void Runtime::mountHugetlbfsIfNecessary() const {
+    for(const auto& hugepages : config->commandRun.hugepages) {
+        auto mountPoint = rootfsDir / ("dev/hugepages-" + Hugepages::formatSize(hugepages.first));
+        utility::logMessage(boost::format("Mounting hugetlbfs on %s") % mountPoint, libsarus::LogLevel::INFO);
+        libsarus::filesystem::createFoldersIfNecessary(mountPoint);
+        auto options = boost::format("pagesize=%dK,mode=700,uid=%d,gid=%d")
+            % hugepages.first % config->userIdentity.uid % config->userIdentity.gid;
+        if(mount("hugetlbfs", mountPoint.c_str(), "hugetlbfs", MS_NOSUID|MS_NODEV, options.str().c_str()) != 0) {
+            auto message = boost::format("Failed to mount hugetlbfs on %s: %s") % mountPoint % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+    }
+}
+
+/**
+ * A read-only rootfs still needs a few writable locations: /etc, where the runtime copies
+ * the host's network and user databases, and /tmp and /run, which many programs expect to
+ * be able to write. /etc is covered with a small overlay whose upper layer lives in the RAM
+ * filesystem of the bundle, /tmp and /run with RAM filesystems. Since the image cannot be
+ * modified, the mount points must already exist in the image.
+ */
+void Runtime::setupWritableMountsOfReadOnlyRootfs() const {
+    utility::logMessage("Setting up writable mounts of read-only rootfs", libsarus::LogLevel::INFO);
+
+    auto etcDir = rootfsDir / "etc";
+    if(!boost::filesystem::is_directory(etcDir)) {
+        auto message = boost::format("Failed to set up read-only rootfs: the image has no /etc directory");
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto etcUpperDir = bundleDir / "overlay/etc-upper";
+    auto etcWorkDir = bundleDir / "overlay/etc-work";
+    libsarus::filesystem::createFoldersIfNecessary(etcUpperDir);
+    libsarus::filesystem::createFoldersIfNecessary(etcWorkDir);
+    // the overlay replaces the rootfs mount for /etc: it must not honor setuid binaries and devices either
+    libsarus::mount::mountOverlayfs(etcDir, etcUpperDir, etcWorkDir, etcDir, "", MS_NOSUID|MS_NODEV);
+
+    const char* ramFilesystemType = config->json["ramFilesystemType"].GetString();
+    auto mountRamFilesystem = [&](const std::string& destination, const std::string& options) {
+        auto mountPoint = rootfsDir / destination;
+        if(!boost::filesystem::is_directory(mountPoint)) {
+            auto message = boost::format("Not mounting a writable %s filesystem on %s: the mount point"
+                                         " does not exist in the read-only image")
+                % ramFilesystemType % ("/" + destination);
+            utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+            return;
+        }
+        if(mount(NULL, mountPoint.c_str(), ramFilesystemType, MS_NOSUID|MS_NODEV, options.c_str()) != 0) {
+            auto message = boost::format("Failed to setup %s filesystem on %s: %s")
+                % ramFilesystemType
+                % mountPoint
+                % strerror(errno);
+            SARUS_THROW_ERROR(message.str());
+        }
+    };
+    // the memory of /tmp is capped like the writable layer it replaces, /run only holds small runtime files
+    const auto& sizeLimit = writableLayer->getSizeLimit();
+    auto tmpSize = sizeLimit ? std::to_string(*sizeLimit / 1024) + "k" : std::string{"25%"};
+    mountRamFilesystem("tmp", "mode=1777,size=" + tmpSize);
+    auto runOptions = boost::format("mode=755,size=65536k,uid=%d,gid=%d")
+        % config->userIdentity.uid % config->userIdentity.gid;
+    mountRamFilesystem("run", runOptions.str());
+
+    utility::logMessage("Successfully set up writable mounts of read-only rootfs", libsarus::LogLevel::INFO);
+}
+
 void Runtime::copyEtcFilesIntoRootfs() const {
     utility::logMessage("Copying /etc files into rootfs", libsarus::LogLevel::INFO);
     auto prefixDir = boost::filesystem::path{config->json["prefixDir"].GetString()};
@@ -234,33 +740,106 @@ void Runtime::mountInitProgramIntoRootfsIfNecessary() const {
     }
 }
 
+/**
+ * The task runner and a copy of the task list are placed into the /dev filesystem of the container,
+ * which is private to the container, together with the file where the runner writes the results.
+ * The task list is read with the identity of the user, as the file might not be accessible to root
+ * (e.g. on root_squashed filesystems) and the user shouldn't be able to read files through Sarus
+ * that they can't read themselves.
+ */
+void Runtime::setupTaskRunnerIfNecessary() const {
+    if(!config->commandRun.taskListFile) {
+        return;
+    }
+    utility::logMessage("Setting up task runner in rootfs", libsarus::LogLevel::INFO);
+
+    auto runnerPath = boost::filesystem::path{config->json["prefixDir"].GetString()} / "bin/task_runner";
+    if(!boost::filesystem::exists(runnerPath)) {
+        auto message = boost::format("Failed to set up task runner: %s not found") % runnerPath;
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto runnerDst = rootfsDir / "dev/task-runner";
+    libsarus::filesystem::createFileIfNecessary(runnerDst);
+    libsarus::mount::bindMount(runnerPath, runnerDst, MS_RDONLY);
+
+    auto rootIdentity = libsarus::UserIdentity{};
+    auto taskList = std::string{};
+    try {
+        libsarus::process::setFilesystemUid(config->userIdentity);
+        taskList = libsarus::filesystem::readFile(*config->commandRun.taskListFile);
+        libsarus::process::setFilesystemUid(rootIdentity);
+    }
+    catch(libsarus::Error& e) {
+        libsarus::process::setFilesystemUid(rootIdentity);
+        auto message = boost::format("Failed to read task list %s") % *config->commandRun.taskListFile;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+
+    const auto& uid = config->userIdentity.uid;
+    const auto& gid = config->userIdentity.gid;
+    libsarus::filesystem::writeTextFile(taskList, rootfsDir / "dev/task-list");
+    libsarus::filesystem::setOwner(rootfsDir / "dev/task-list", uid, gid);
+    libsarus::filesystem::createFileIfNecessary(rootfsDir / "dev/task-results", uid, gid);
+
+    utility::logMessage("Successfully set up task runner in rootfs", libsarus::LogLevel::INFO);
+}
+
+/**
+ * Copies the results written by the task runner within the container to the file requested
+ * by the user, with the identity of the user.
+ */
+void Runtime::collectTaskResultsIfNecessary() const {
+    if(!config->commandRun.taskListFile) {
+        return;
+    }
+
+    auto results = libsarus::filesystem::readFile(rootfsDir / "dev/task-results");
+    if(results.empty()) {
+        auto message = boost::format("The task runner didn't write any results, %s was not created")
+                       % config->commandRun.taskResultsFile;
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        return;
+    }
+
+    auto rootIdentity = libsarus::UserIdentity{};
+    try {
+        libsarus::process::setFilesystemUid(config->userIdentity);
+        libsarus::filesystem::writeTextFile(results, config->commandRun.taskResultsFile);
+        libsarus::process::setFilesystemUid(rootIdentity);
+    }
+    catch(libsarus::Error& e) {
+        libsarus::process::setFilesystemUid(rootIdentity);
+        auto message = boost::format("Failed to write results of the tasks: %s") % e.what();
+        utility::logMessage(message, libsarus::LogLevel::WARN, std::cout, std::cerr);
+        return;
+    }
+    utility::logMessage(boost::format("Wrote results of the tasks to %s") % config->commandRun.taskResultsFile,
+                        libsarus::LogLevel::INFO);
+}
+
 /**
  * "Custom mounts" are those defined by users through the CLI ("user mounts") and by the system
  * administrator through the configuration file ("site mounts"). They represent a mean of arbitrary
  * container customization.
  */
-void Runtime::performCustomMounts() const {
-    utility::logMessage("Performing custom mounts", libsarus::LogLevel::INFO);
+void Runtime::addCustomMounts(libsarus::MountPlan& plan) const {
     for(const auto& mount : config->commandRun.mounts) {
-        mount->performMount();
+        plan.add(*mount, "custom");
     }
-    utility::logMessage("Successfully performed custom mounts", libsarus::LogLevel::INFO);
 }
 
 /**
  * "Extra mounts" are feature-dependent mounts which may happen automatically (i.e. without direct control
  * by users or system administrators), but are not part of basic container setup.
  */
-void Runtime::performExtraMounts() const {
-    utility::logMessage("Performing extra mounts", libsarus::LogLevel::INFO);
+void Runtime::addExtraMounts(libsarus::MountPlan& plan) const {
     if (const rapidjson::Value* pmixSupport = rapidjson::Pointer("/enablePMIxv3Support").Get(config->json)) {
         if (pmixSupport->GetBool()) {
             for(const auto& mount : utility::generatePMIxMounts(config)) {
-                mount->performMount();
+                plan.add(*mount, "pmix");
             }
         }
     }
-    utility::logMessage("Successfully performed custom mounts", libsarus::LogLevel::INFO);
 }
 
 /**
@@ -272,12 +851,27 @@ void Runtime::performExtraMounts() const {
  * https://github.com/opencontainers/runtime-spec/blob/v1.0.2/config-linux.md#devices
  * We bind mount device files here to have more direct control, in a similar fashion to what is done for /dev.
  */
-void Runtime::performDeviceMounts() const {
-    utility::logMessage("Performing device mounts", libsarus::LogLevel::INFO);
+void Runtime::addDeviceMounts(libsarus::MountPlan& plan) const {
     for(const auto& mount : config->commandRun.deviceMounts) {
-        mount->performMount();
+        plan.add(*mount, "device");
     }
-    utility::logMessage("Successfully performed device mounts", libsarus::LogLevel::INFO);
+}
+
+/**
+ * The custom, extra and device mounts are collected into a single mount plan, which
+ * deduplicates and orders them by destination, and performs them as a batch
+ * (see libsarus::MountPlan). The plan is printed in the debug output.
+ */
+void Runtime::performMounts() const {
+    utility::logMessage("Performing custom, extra and device mounts", libsarus::LogLevel::INFO);
+    auto plan = libsarus::MountPlan{rootfsDir, config->userIdentity};
+    addCustomMounts(plan);
+    addExtraMounts(plan);
+    addDeviceMounts(plan);
+    plan.resolve();
+    utility::logMessage(plan.dump(), libsarus::LogLevel::DEBUG);
+    plan.execute();
+    utility::logMessage("Successfully performed custom, extra and device mounts", libsarus::LogLevel::INFO);
 }
 
 void Runtime::remountRootfsWithNoSuid() const {
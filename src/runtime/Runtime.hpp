@@ -11,11 +11,20 @@
 #ifndef sarus_runtime_Runtime_hpp
 #define sarus_runtime_Runtime_hpp
 
+#include <atomic>
 #include <memory>
+#include <string>
+#include <sys/types.h>
 
 #include "common/Config.hpp"
+#include "libsarus/CLIArguments.hpp"
+#include "libsarus/MountPlan.hpp"
+#include "daemon/DaemonClient.hpp"
 #include "runtime/OCIBundleConfig.hpp"
 #include "runtime/FileDescriptorHandler.hpp"
+#include "runtime/ImagePrefetcher.hpp"
+#include "runtime/PersistentContainer.hpp"
+#include "runtime/WritableLayer.hpp"
 
 
 namespace sarus {
@@ -25,18 +34,36 @@ class Runtime {
 public:
     Runtime(std::shared_ptr<common::Config>);
     void setupOCIBundle();
-    void executeContainer() const;
+    void executeContainer();
+    void executeContainerInBackground();
 
 private:
+    void setMemoryNodes() const;
+    void setHugepages() const;
+    libsarus::CLIArguments makeOCIRuntimeArgs(const std::string& containerID) const;
+    int superviseContainer(const PersistentContainer& container, int readinessFd);
+    void watchContainer(const PersistentContainer& container,
+                        pid_t ociRuntimePid,
+                        int readinessFd,
+                        const std::atomic<bool>& isStopRequested,
+                        std::atomic<bool>& isRunning) const;
     void setupMountIsolation() const;
     void setupRamFilesystem() const;
-    void mountImageIntoRootfs() const;
+    boost::filesystem::path getImageFile() const;
+    void requestImageMountFromNodeDaemon();
+    void mountImageIntoRootfs();
+    void mountImage(const boost::filesystem::path& imageFile, const boost::filesystem::path& mountPoint) const;
     void setupDevFilesystem() const;
+    void mountHugetlbfsIfNecessary() const;
+    void setupWritableMountsOfReadOnlyRootfs() const;
     void copyEtcFilesIntoRootfs() const;
     void mountInitProgramIntoRootfsIfNecessary() const;
-    void performCustomMounts() const;
-    void performExtraMounts() const;
-    void performDeviceMounts() const;
+    void setupTaskRunnerIfNecessary() const;
+    void collectTaskResultsIfNecessary() const;
+    void addCustomMounts(libsarus::MountPlan& plan) const;
+    void addExtraMounts(libsarus::MountPlan& plan) const;
+    void addDeviceMounts(libsarus::MountPlan& plan) const;
+    void performMounts() const;
     void remountRootfsWithNoSuid() const;
 
 private:
@@ -45,6 +72,9 @@ private:
     boost::filesystem::path rootfsDir;
     OCIBundleConfig bundleConfig;
     FileDescriptorHandler fdHandler;
+    std::unique_ptr<ImagePrefetcher> prefetcher; // on the heap: its worker thread refers to it
+    std::unique_ptr<WritableLayer> writableLayer; // on the heap: its worker thread refers to it
+    boost::optional<daemon::DaemonClient::ImageMount> nodeDaemonImageMount;
 };
 
 }
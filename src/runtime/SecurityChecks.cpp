@@ -10,6 +10,8 @@
 
 #include "SecurityChecks.hpp"
 
+#include <rapidjson/pointer.h>
+
 #include "libsarus/Utility.hpp"
 #include "runtime/Utility.hpp"
 #include "runtime/OCIHooksFactory.hpp"
@@ -58,6 +60,9 @@ void SecurityChecks::checkThatPathIsUntamperable(const boost::filesystem::path&
 void SecurityChecks::checkThatBinariesInSarusJsonAreUntamperable() const {
     checkThatPathIsUntamperable(config->json["initPath"].GetString());
     checkThatPathIsUntamperable(config->json["runcPath"].GetString());
+    if(const auto* mkfsExt4Path = rapidjson::Pointer("/writableLayer/mkfsExt4Path").Get(config->json)) {
+        checkThatPathIsUntamperable(mkfsExt4Path->GetString());
+    }
 }
 
 void SecurityChecks::checkThatPathIsRootOwned(const boost::filesystem::path& path) const {
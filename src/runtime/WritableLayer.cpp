@@ -0,0 +1,398 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "WritableLayer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/quota.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <rapidjson/pointer.h>
+
+#include "libsarus/CLIArguments.hpp"
+#include "libsarus/Error.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/Utility.hpp"
+
+#ifndef PRJQUOTA
+#define PRJQUOTA 2
+#endif
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace runtime {
+
+namespace {
+
+boost::optional<std::uint64_t> getUsedSpace(const boost::filesystem::path& path) {
+    struct statvfs sb;
+    if(statvfs(path.c_str(), &sb) != 0 || sb.f_blocks == 0) {
+        // ramfs doesn't account its usage
+        return {};
+    }
+    return std::uint64_t{sb.f_blocks - sb.f_bfree} * sb.f_frsize;
+}
+
+/**
+ * Returns the block device of the filesystem containing the path, as required by quotactl.
+ */
+boost::filesystem::path getBlockDevice(const boost::filesystem::path& path) {
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) {
+        auto message = boost::format("Failed to stat %s: %s") % path % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    auto device = (boost::format("%d:%d") % major(st.st_dev) % minor(st.st_dev)).str();
+
+    std::ifstream mountinfo{"/proc/self/mountinfo"};
+    auto line = std::string{};
+    while(std::getline(mountinfo, line)) {
+        // <id> <parent id> <major:minor> <root> <mount point> <options> [optional fields] - <type> <source> <options>
+        auto fields = std::vector<std::string>{};
+        boost::split(fields, line, boost::is_any_of(" "), boost::token_compress_on);
+        if(fields.size() < 3 || fields[2] != device) {
+            continue;
+        }
+        auto separator = std::find(fields.cbegin(), fields.cend(), "-");
+        if(std::distance(separator, fields.cend()) >= 3) {
+            return *std::next(separator, 2);
+        }
+    }
+    auto message = boost::format("Failed to find the block device of %s (device %s) in /proc/self/mountinfo")
+        % path % device;
+    SARUS_THROW_ERROR(message.str());
+}
+
+}
+
+const std::chrono::milliseconds WritableLayer::samplingInterval = std::chrono::milliseconds{1000};
+// project IDs of the containers' directories: base + PID of the Sarus process
+const std::uint32_t WritableLayer::quotaProjectIdBase = 1u << 30;
+
+WritableLayer::WritableLayer(std::shared_ptr<const common::Config> config, const boost::filesystem::path& bundleDir)
+    : config{std::move(config)}
+    , bundleDir{bundleDir}
+{
+    const auto* value = rj::Pointer("/writableLayer").Get(this->config->json);
+    if(!value) {
+        return;
+    }
+    backend = parseBackend((*value)["backend"].GetString());
+    if(value->HasMember("sizeMB")) {
+        sizeLimit = std::uint64_t{(*value)["sizeMB"].GetUint()} * 1024 * 1024;
+    }
+    if(value->HasMember("directory")) {
+        baseDirectory = boost::filesystem::path{(*value)["directory"].GetString()};
+    }
+    if(value->HasMember("volatile")) {
+        isVolatileOverlay = (*value)["volatile"].GetBool();
+    }
+
+    if(backend == Backend::ramFilesystem && sizeLimit) {
+        SARUS_THROW_ERROR("The ramFilesystem backend of the writable layer doesn't support a size limit"
+                          " (writableLayer.sizeMB). Use the tmpfs backend instead");
+    }
+    if((backend == Backend::directory || backend == Backend::loopFile) && !baseDirectory) {
+        auto message = boost::format("The %s backend of the writable layer requires the configuration"
+                                     " parameter writableLayer.directory") % getBackendName(backend);
+        SARUS_THROW_ERROR(message.str());
+    }
+    if(backend == Backend::loopFile && !sizeLimit) {
+        SARUS_THROW_ERROR("The loopFile backend of the writable layer requires the configuration"
+                          " parameter writableLayer.sizeMB");
+    }
+    if(backend == Backend::loopFile && !value->HasMember("mkfsExt4Path")) {
+        SARUS_THROW_ERROR("The loopFile backend of the writable layer requires the configuration"
+                          " parameter writableLayer.mkfsExt4Path");
+    }
+}
+
+WritableLayer::~WritableLayer() {
+    isStopRequested = true;
+    if(worker.joinable()) {
+        worker.join();
+    }
+    cleanup();
+}
+
+WritableLayer::Backend WritableLayer::parseBackend(const std::string& name) {
+    if(name == "ramFilesystem") {
+        return Backend::ramFilesystem;
+    }
+    else if(name == "tmpfs") {
+        return Backend::tmpfs;
+    }
+    else if(name == "directory") {
+        return Backend::directory;
+    }
+    else if(name == "loopFile") {
+        return Backend::loopFile;
+    }
+    auto message = boost::format("Invalid backend of the writable layer '%s'. Supported values:"
+                                 " 'ramFilesystem', 'tmpfs', 'directory', 'loopFile'") % name;
+    SARUS_THROW_ERROR(message.str());
+}
+
+std::string WritableLayer::getBackendName(Backend backend) {
+    switch(backend) {
+        case Backend::ramFilesystem: return "ramFilesystem";
+        case Backend::tmpfs: return "tmpfs";
+        case Backend::directory: return "directory";
+        case Backend::loopFile: return "loopFile";
+    }
+    SARUS_THROW_ERROR("Unexpected backend of the writable layer");
+}
+
+std::string WritableLayer::getOverlayOptions() const {
+    // the volatile option requires Linux >= 5.10
+    return isVolatileOverlay ? "volatile" : "";
+}
+
+void WritableLayer::setup() {
+    auto message = boost::format("Setting up writable layer (%s backend)") % getBackendName(backend);
+    utility::logMessage(message, libsarus::LogLevel::INFO);
+
+    switch(backend) {
+        case Backend::ramFilesystem:
+            upperDir = bundleDir / "overlay/rootfs-upper";
+            workDir = bundleDir / "overlay/rootfs-work";
+            break;
+        case Backend::tmpfs:
+            setupTmpfs();
+            break;
+        case Backend::directory:
+            setupDirectory();
+            break;
+        case Backend::loopFile:
+            setupLoopFile();
+            break;
+    }
+    libsarus::filesystem::createFoldersIfNecessary(upperDir, config->userIdentity.uid, config->userIdentity.gid);
+    libsarus::filesystem::createFoldersIfNecessary(workDir);
+    isSetUp = true;
+
+    utility::logMessage("Successfully set up writable layer", libsarus::LogLevel::INFO);
+}
+
+void WritableLayer::setupTmpfs() {
+    mountPoint = bundleDir / "overlay/rootfs-layer";
+    libsarus::filesystem::createFoldersIfNecessary(mountPoint);
+    auto options = std::string{"mode=755"};
+    if(sizeLimit) {
+        options += ",size=" + std::to_string(*sizeLimit / 1024) + "k";
+    }
+    if(mount(NULL, mountPoint.c_str(), "tmpfs", MS_NOSUID|MS_NODEV, options.c_str()) != 0) {
+        auto message = boost::format("Failed to setup tmpfs filesystem on %s (options: %s): %s")
+            % mountPoint % options % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    upperDir = mountPoint / "upper";
+    workDir = mountPoint / "work";
+}
+
+void WritableLayer::setupDirectory() {
+    auto name = boost::format("sarus-%d-%s") % config->userIdentity.uid % libsarus::string::generateRandom(16);
+    containerPath = *baseDirectory / name.str();
+    libsarus::filesystem::createFoldersIfNecessary(containerPath);
+    if(sizeLimit) {
+        setupProjectQuota();
+    }
+    upperDir = containerPath / "upper";
+    workDir = containerPath / "work";
+}
+
+void WritableLayer::setupLoopFile() {
+    auto name = boost::format("sarus-%d-%s.ext4") % config->userIdentity.uid % libsarus::string::generateRandom(16);
+    containerPath = *baseDirectory / name.str();
+    libsarus::filesystem::createFoldersIfNecessary(*baseDirectory);
+    libsarus::filesystem::createFileIfNecessary(containerPath);
+    boost::filesystem::resize_file(containerPath, *sizeLimit); // sparse: blocks are allocated on write
+
+    // no journal, because the layer is discarded when the container exits
+    auto mkfsExt4Path = rj::Pointer("/writableLayer/mkfsExt4Path").Get(config->json)->GetString();
+    auto args = libsarus::CLIArguments{mkfsExt4Path, "-q", "-F", "-m", "0", "-O", "^has_journal", containerPath.string()};
+    try {
+        libsarus::process::executeCommand(args.string());
+    }
+    catch(const libsarus::Error& e) {
+        auto message = boost::format("Failed to create ext4 filesystem of writable layer in %s") % containerPath;
+        SARUS_RETHROW_ERROR(e, message.str());
+    }
+
+    mountPoint = bundleDir / "overlay/rootfs-layer";
+    libsarus::filesystem::createFoldersIfNecessary(mountPoint);
+    libsarus::mount::loopMount(containerPath, mountPoint, "ext4", "nosuid,nodev");
+    upperDir = mountPoint / "upper";
+    workDir = mountPoint / "work";
+}
+
+/**
+ * Assigns a project ID to the container's directory, inherited by the files created
+ * in it, and sets the limit of the project's quota to the size of the layer.
+ */
+void WritableLayer::setupProjectQuota() {
+    auto device = getBlockDevice(containerPath);
+    quotaProjectId = quotaProjectIdBase + static_cast<std::uint32_t>(getpid());
+
+    auto fd = open(containerPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) {
+        auto message = boost::format("Failed to open %s: %s") % containerPath % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    struct fsxattr attributes;
+    auto result = ioctl(fd, FS_IOC_FSGETXATTR, &attributes);
+    if(result == 0) {
+        attributes.fsx_projid = quotaProjectId;
+        attributes.fsx_xflags |= FS_XFLAG_PROJINHERIT;
+        result = ioctl(fd, FS_IOC_FSSETXATTR, &attributes);
+    }
+    auto ioctlErrno = errno;
+    close(fd);
+    if(result != 0) {
+        auto message = boost::format("Failed to set project ID %d on %s: %s")
+            % quotaProjectId % containerPath % strerror(ioctlErrno);
+        SARUS_THROW_ERROR(message.str());
+    }
+
+    struct dqblk limits;
+    std::memset(&limits, 0, sizeof(limits));
+    limits.dqb_bhardlimit = (*sizeLimit + 1023) / 1024; // in blocks of 1 KiB
+    limits.dqb_valid = QIF_BLIMITS;
+    if(quotactl(QCMD(Q_SETQUOTA, PRJQUOTA), device.c_str(), quotaProjectId, reinterpret_cast<caddr_t>(&limits)) != 0) {
+        auto message = boost::format("Failed to set project quota of %s on %s: %s. The filesystem must support"
+                                     " project quotas (e.g. XFS, or ext4 mounted with the prjquota option)")
+            % containerPath % device % strerror(errno);
+        SARUS_THROW_ERROR(message.str());
+    }
+    quotaDevice = device;
+}
+
+boost::optional<std::uint64_t> WritableLayer::measureUsage() const {
+    switch(backend) {
+        case Backend::ramFilesystem:
+            return getUsedSpace(bundleDir);
+        case Backend::tmpfs:
+        case Backend::loopFile:
+            return getUsedSpace(mountPoint);
+        case Backend::directory: {
+            if(!quotaDevice) {
+                return {};
+            }
+            struct dqblk quota;
+            if(quotactl(QCMD(Q_GETQUOTA, PRJQUOTA), quotaDevice->c_str(), quotaProjectId, reinterpret_cast<caddr_t>(&quota)) != 0) {
+                return {};
+            }
+            return std::uint64_t{quota.dqb_curspace};
+        }
+    }
+    return {};
+}
+
+void WritableLayer::startMonitoring() {
+    if(!isSetUp) {
+        return;
+    }
+    auto usage = measureUsage();
+    if(!usage) {
+        return;
+    }
+    isUsageMeasurable = true;
+    peakUsage = *usage;
+    worker = std::thread{&WritableLayer::monitor, this};
+}
+
+// Executed by the worker thread, which doesn't log: the peak is reported by finish()
+void WritableLayer::monitor() {
+    auto step = std::chrono::milliseconds{100};
+    auto elapsed = std::chrono::milliseconds{0};
+    while(!isStopRequested) {
+        std::this_thread::sleep_for(step);
+        elapsed += step;
+        if(elapsed < samplingInterval) {
+            continue;
+        }
+        elapsed = std::chrono::milliseconds{0};
+        auto usage = measureUsage();
+        if(usage && *usage > peakUsage) {
+            peakUsage = *usage;
+        }
+    }
+}
+
+void WritableLayer::finish() {
+    isStopRequested = true;
+    if(worker.joinable()) {
+        worker.join();
+    }
+    if(isUsageMeasurable) {
+        auto usage = measureUsage();
+        if(usage && *usage > peakUsage) {
+            peakUsage = *usage;
+        }
+        auto message = boost::format("Peak usage of writable layer (%s backend): %.1f MiB")
+            % getBackendName(backend) % (double(peakUsage) / (1024*1024));
+        if(sizeLimit) {
+            message = boost::format("%s of %d MiB") % message.str() % (*sizeLimit / (1024*1024));
+        }
+        utility::logMessage(message, libsarus::LogLevel::INFO);
+    }
+    else if(isSetUp) {
+        auto message = boost::format("Peak usage of writable layer (%s backend) is not available")
+            % getBackendName(backend);
+        utility::logMessage(message, libsarus::LogLevel::DEBUG);
+    }
+    cleanup();
+}
+
+/**
+ * To be called when the container is owned by another process (the supervisor of a
+ * container started with "sarus run --detach"), which takes care of the cleanup.
+ */
+void WritableLayer::handOver() {
+    quotaDevice = boost::none;
+    containerPath.clear();
+}
+
+/**
+ * Removes the per-container directory or file from the node-local filesystem. The mounts
+ * are released together with the mount namespace of the Sarus process.
+ */
+void WritableLayer::cleanup() noexcept {
+    if(quotaDevice) {
+        struct dqblk limits;
+        std::memset(&limits, 0, sizeof(limits));
+        limits.dqb_valid = QIF_BLIMITS;
+        quotactl(QCMD(Q_SETQUOTA, PRJQUOTA), quotaDevice->c_str(), quotaProjectId, reinterpret_cast<caddr_t>(&limits));
+        quotaDevice = boost::none;
+    }
+    if(!containerPath.empty()) {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(containerPath, ec);
+        containerPath.clear();
+    }
+}
+
+}} // namespace
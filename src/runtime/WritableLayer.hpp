@@ -0,0 +1,109 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_runtime_WritableLayer_hpp
+#define sarus_runtime_WritableLayer_hpp
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "common/Config.hpp"
+
+
+namespace sarus {
+namespace runtime {
+
+/**
+ * Upper layer of the overlay stacked on top of the image, i.e. the storage of the
+ * writes of the container to its rootfs. The backend is set by the "writableLayer"
+ * parameter of the configuration:
+ *
+ * - ramFilesystem (default): directories in the RAM filesystem of the bundle.
+ * - tmpfs: a dedicated tmpfs, capped at the configured size.
+ * - directory: a per-container directory in a node-local filesystem, capped with
+ *   a project quota (XFS, or ext4 mounted with the prjquota option).
+ * - loopFile: a per-container ext4 filesystem in a sparse file of the configured
+ *   size, in a node-local directory.
+ *
+ * The overlay can be mounted with the "volatile" option, which skips the syncs of
+ * the upper layer: its contents are discarded when the container exits anyway.
+ * While the container runs, a background thread samples the usage of the layer,
+ * whose peak is reported by finish().
+ */
+class WritableLayer {
+public:
+    enum class Backend { ramFilesystem, tmpfs, directory, loopFile };
+
+    static const std::chrono::milliseconds samplingInterval;
+    static const std::uint32_t quotaProjectIdBase;
+
+public:
+    WritableLayer(std::shared_ptr<const common::Config> config, const boost::filesystem::path& bundleDir);
+    ~WritableLayer();
+    WritableLayer(const WritableLayer&) = delete;
+    WritableLayer& operator=(const WritableLayer&) = delete;
+
+    Backend getBackend() const { return backend; }
+    const boost::optional<std::uint64_t>& getSizeLimit() const { return sizeLimit; }
+    bool isVolatile() const { return isVolatileOverlay; }
+    std::string getOverlayOptions() const;
+    const boost::filesystem::path& getUpperDir() const { return upperDir; }
+    const boost::filesystem::path& getWorkDir() const { return workDir; }
+
+    void setup();
+    void startMonitoring();
+    void finish();
+    void handOver();
+
+    static Backend parseBackend(const std::string& name);
+    static std::string getBackendName(Backend backend);
+
+private:
+    void setupTmpfs();
+    void setupDirectory();
+    void setupLoopFile();
+    void setupProjectQuota();
+    boost::optional<std::uint64_t> measureUsage() const;
+    void monitor();
+    void cleanup() noexcept;
+
+private:
+    std::shared_ptr<const common::Config> config;
+    boost::filesystem::path bundleDir;
+    Backend backend = Backend::ramFilesystem;
+    boost::optional<std::uint64_t> sizeLimit;
+    boost::optional<boost::filesystem::path> baseDirectory;
+    bool isVolatileOverlay = false;
+
+    boost::filesystem::path upperDir;
+    boost::filesystem::path workDir;
+    boost::filesystem::path mountPoint;   // tmpfs and loopFile backends
+    boost::filesystem::path containerPath; // directory and loopFile backends
+    boost::optional<boost::filesystem::path> quotaDevice;
+    std::uint32_t quotaProjectId = 0;
+    bool isSetUp = false;
+
+    std::thread worker;
+    std::atomic<bool> isStopRequested{false};
+    std::atomic<std::uint64_t> peakUsage{0};
+    std::atomic<bool> isUsageMeasurable{false};
+};
+
+}
+}
+
+#endif
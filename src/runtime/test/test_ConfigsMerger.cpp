@@ -413,6 +413,20 @@ TEST(ConfigsMergerTestGroup, command_to_execute) {
         auto metadata = common::ImageMetadata{};
         CHECK((ConfigsMerger{config, metadata}.getCommandToExecuteInContainer() == libsarus::CLIArguments{"/dev/init", "--", "cmd-cli"}));
     }
+    // task runner overrides metadata entrypoint and cmd
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        auto& config = configRAII.config;
+        config->commandRun.taskListFile = boost::filesystem::path{"/tasks.txt"};
+        config->commandRun.taskRetries = 2;
+        config->commandRun.cpuAffinity = {0, 1, 3};
+        auto metadata = common::ImageMetadata{};
+        metadata.entry = libsarus::CLIArguments{"entry-metadata"};
+        metadata.cmd = libsarus::CLIArguments{"cmd-metadata"};
+        CHECK((ConfigsMerger{config, metadata}.getCommandToExecuteInContainer()
+               == libsarus::CLIArguments{"/dev/task-runner", "--cpus", "0,1,3", "--retries", "2",
+                                         "/dev/task-list", "/dev/task-results"}));
+    }
     // only CLI cmd
     {
         auto configRAII = test_utility::config::makeConfig();
@@ -0,0 +1,84 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/Hugepages.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+using namespace sarus;
+
+TEST_GROUP(HugepagesTestGroup) {
+    libsarus::PathRAII sysfs{libsarus::filesystem::makeUniquePathWithRandomSuffix(boost::filesystem::absolute("test-hugepages-sysfs"))};
+    boost::filesystem::path hugepagesDir = sysfs.getPath() / "hugepages";
+    boost::filesystem::path cgroupDir = sysfs.getPath() / "cgroup";
+
+    void addPool(const std::string& name, size_t pages) {
+        libsarus::filesystem::writeTextFile(std::to_string(pages) + "\n", hugepagesDir / name / "nr_hugepages");
+    }
+};
+
+TEST(HugepagesTestGroup, parseSize) {
+    CHECK_EQUAL(runtime::Hugepages::parseSize("2MB"), size_t{2048});
+    CHECK_EQUAL(runtime::Hugepages::parseSize("2M"), size_t{2048});
+    CHECK_EQUAL(runtime::Hugepages::parseSize("2048kB"), size_t{2048});
+    CHECK_EQUAL(runtime::Hugepages::parseSize("64KB"), size_t{64});
+    CHECK_EQUAL(runtime::Hugepages::parseSize("1GB"), size_t{1048576});
+    CHECK_EQUAL(runtime::Hugepages::parseSize("1g"), size_t{1048576});
+    CHECK_THROWS(libsarus::Error, runtime::Hugepages::parseSize(""));
+    CHECK_THROWS(libsarus::Error, runtime::Hugepages::parseSize("2"));
+    CHECK_THROWS(libsarus::Error, runtime::Hugepages::parseSize("0MB"));
+    CHECK_THROWS(libsarus::Error, runtime::Hugepages::parseSize("2TB"));
+    CHECK_THROWS(libsarus::Error, runtime::Hugepages::parseSize("MB"));
+}
+
+TEST(HugepagesTestGroup, formatSize) {
+    CHECK_EQUAL(runtime::Hugepages::formatSize(64), std::string{"64KB"});
+    CHECK_EQUAL(runtime::Hugepages::formatSize(2048), std::string{"2MB"});
+    CHECK_EQUAL(runtime::Hugepages::formatSize(1048576), std::string{"1GB"});
+}
+
+TEST(HugepagesTestGroup, no_hugepages) {
+    auto hugepages = runtime::Hugepages{hugepagesDir, cgroupDir};
+    CHECK(hugepages.getSizes().empty());
+    CHECK_FALSE(hugepages.isSizeAvailable(2048));
+    CHECK_FALSE(hugepages.isCgroupControllerAvailable());
+    CHECK_THROWS(libsarus::Error, hugepages.getNumberOfPages(2048));
+}
+
+TEST(HugepagesTestGroup, pools) {
+    addPool("hugepages-2048kB", 512);
+    addPool("hugepages-1048576kB", 0);
+    libsarus::filesystem::createFoldersIfNecessary(hugepagesDir / "unrelated");
+    auto hugepages = runtime::Hugepages{hugepagesDir, cgroupDir};
+    CHECK(hugepages.getSizes() == std::vector<size_t>({2048, 1048576}));
+    CHECK(hugepages.isSizeAvailable(2048));
+    CHECK(hugepages.isSizeAvailable(1048576));
+    CHECK_FALSE(hugepages.isSizeAvailable(64));
+    CHECK_EQUAL(hugepages.getNumberOfPages(2048), size_t{512});
+    CHECK_EQUAL(hugepages.getNumberOfPages(1048576), size_t{0});
+}
+
+TEST(HugepagesTestGroup, cgroup_controller) {
+    addPool("hugepages-2048kB", 16);
+    // cgroup v1
+    libsarus::filesystem::createFoldersIfNecessary(cgroupDir / "hugetlb");
+    CHECK(runtime::Hugepages(hugepagesDir, cgroupDir).isCgroupControllerAvailable());
+    // cgroup v2
+    libsarus::filesystem::writeTextFile("cpuset cpu io memory pids\n", cgroupDir / "cgroup.controllers");
+    CHECK_FALSE(runtime::Hugepages(hugepagesDir, cgroupDir).isCgroupControllerAvailable());
+    libsarus::filesystem::writeTextFile("cpuset cpu io memory hugetlb pids\n", cgroupDir / "cgroup.controllers");
+    CHECK(runtime::Hugepages(hugepagesDir, cgroupDir).isCgroupControllerAvailable());
+}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,104 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <boost/filesystem.hpp>
+
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/NumaTopology.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+using namespace sarus;
+
+TEST_GROUP(NumaTopologyTestGroup) {
+    libsarus::PathRAII sysfs{libsarus::filesystem::makeUniquePathWithRandomSuffix(boost::filesystem::absolute("test-numa-sysfs"))};
+    boost::filesystem::path nodesDir = sysfs.getPath() / "node";
+    boost::filesystem::path procStatusFile = sysfs.getPath() / "status";
+
+    void addNode(int id, const std::string& cpulist, const std::string& distance) {
+        auto nodeDir = nodesDir / ("node" + std::to_string(id));
+        libsarus::filesystem::writeTextFile(cpulist + "\n", nodeDir / "cpulist");
+        libsarus::filesystem::writeTextFile(distance + "\n", nodeDir / "distance");
+    }
+
+    void writeMemsAllowed(const std::string& list) {
+        libsarus::filesystem::writeTextFile("Name:\tsarus\nCpus_allowed_list:\t0-63\nMems_allowed_list:\t" + list + "\n",
+                                            procStatusFile);
+    }
+};
+
+TEST(NumaTopologyTestGroup, parseList) {
+    CHECK(runtime::NumaTopology::parseList("") == std::vector<int>{});
+    CHECK(runtime::NumaTopology::parseList("\n") == std::vector<int>{});
+    CHECK(runtime::NumaTopology::parseList("3\n") == std::vector<int>({3}));
+    CHECK(runtime::NumaTopology::parseList("0-2,8,10-11") == std::vector<int>({0, 1, 2, 8, 10, 11}));
+    CHECK_THROWS(libsarus::Error, runtime::NumaTopology::parseList("0-"));
+    CHECK_THROWS(libsarus::Error, runtime::NumaTopology::parseList("a"));
+    CHECK_EQUAL(runtime::NumaTopology::makeList({0, 2, 3}), std::string{"0,2,3"});
+}
+
+TEST(NumaTopologyTestGroup, parseMemoryPolicy) {
+    CHECK(runtime::NumaTopology::parseMemoryPolicy("local") == runtime::NumaTopology::MemoryPolicy::local);
+    CHECK(runtime::NumaTopology::parseMemoryPolicy("interleave") == runtime::NumaTopology::MemoryPolicy::interleave);
+    CHECK(runtime::NumaTopology::parseMemoryPolicy("unset") == runtime::NumaTopology::MemoryPolicy::unset);
+    CHECK_THROWS(libsarus::Error, runtime::NumaTopology::parseMemoryPolicy("bind"));
+}
+
+TEST(NumaTopologyTestGroup, no_topology) {
+    auto topology = runtime::NumaTopology{nodesDir, procStatusFile};
+    CHECK_FALSE(topology.isAvailable());
+}
+
+TEST(NumaTopologyTestGroup, two_sockets) {
+    addNode(0, "0-7,16-23", "10 21");
+    addNode(1, "8-15,24-31", "21 10");
+    writeMemsAllowed("0-1");
+    auto topology = runtime::NumaTopology{nodesDir, procStatusFile};
+    CHECK(topology.isAvailable());
+
+    // rank pinned to socket 1
+    CHECK(topology.getMemoryNodesLocalTo({8, 9, 24}) == std::vector<int>({1}));
+    // rank pinned to socket 0
+    CHECK(topology.getMemoryNodesLocalTo({0, 16}) == std::vector<int>({0}));
+    // rank spanning both sockets
+    CHECK(topology.getMemoryNodesLocalTo({7, 8}) == std::vector<int>({0, 1}));
+    // CPUs outside of the topology
+    CHECK(topology.getMemoryNodesLocalTo({64}) == std::vector<int>{});
+}
+
+TEST(NumaTopologyTestGroup, memory_less_nodes) {
+    // nodes 2 and 3 have CPUs but no memory, node 4 has memory but no CPUs
+    addNode(0, "0-3", "10 20 12 20 30");
+    addNode(1, "4-7", "20 10 20 12 30");
+    addNode(2, "8-11", "12 20 10 20 30");
+    addNode(3, "12-15", "20 12 20 10 30");
+    addNode(4, "", "30 30 30 30 10");
+    libsarus::filesystem::writeTextFile("0-1,4\n", nodesDir / "has_memory");
+    writeMemsAllowed("0-1,4");
+    auto topology = runtime::NumaTopology{nodesDir, procStatusFile};
+
+    CHECK(topology.getMemoryNodesLocalTo({8}) == std::vector<int>({0}));
+    CHECK(topology.getMemoryNodesLocalTo({12, 13}) == std::vector<int>({1}));
+    CHECK(topology.getMemoryNodesLocalTo({0, 12}) == std::vector<int>({0, 1}));
+}
+
+TEST(NumaTopologyTestGroup, allowed_memory_nodes) {
+    addNode(0, "0-7", "10 21");
+    addNode(1, "8-15", "21 10");
+    // the cpuset cgroup of the job only allows node 0
+    writeMemsAllowed("0");
+    auto topology = runtime::NumaTopology{nodesDir, procStatusFile};
+
+    CHECK(topology.getMemoryNodesLocalTo({0}) == std::vector<int>({0}));
+    CHECK(topology.getMemoryNodesLocalTo({8}) == std::vector<int>({0}));
+}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
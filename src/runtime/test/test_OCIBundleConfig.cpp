@@ -233,6 +233,90 @@ TEST(OCIBundleConfigTestGroup, OCIBundleConfig) {
     compareJsonObjects(actualJson, expectedJson);
 }
 
+TEST(OCIBundleConfigTestGroup, read_only_rootfs) {
+    // create test config
+    auto configRAII = test_utility::config::makeConfig();
+    auto& config = configRAII.config;
+    setupTestConfig(config);
+    config->commandRun.readOnlyRootfs = true;
+
+    auto bundleDir = createTestBundle(config);
+
+    // run
+    runtime::OCIBundleConfig{config}.generateConfigFile();
+
+    // check
+    auto actualJson = libsarus::json::read(bundleDir.getPath() / "config.json");
+    CHECK(actualJson["root"]["readonly"].GetBool());
+}
+
+TEST(OCIBundleConfigTestGroup, memory_nodes) {
+    // local
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        auto& config = configRAII.config;
+        setupTestConfig(config);
+        config->commandRun.memoryNodes = {1, 3};
+
+        auto bundleDir = createTestBundle(config);
+        runtime::OCIBundleConfig{config}.generateConfigFile();
+
+        auto actualJson = libsarus::json::read(bundleDir.getPath() / "config.json");
+        CHECK_EQUAL(actualJson["linux"]["resources"]["cpu"]["mems"].GetString(), std::string{"1,3"});
+        CHECK(!actualJson["linux"].HasMember("memoryPolicy"));
+    }
+    // interleave
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        auto& config = configRAII.config;
+        setupTestConfig(config);
+        config->json.AddMember("numaMemoryPolicy", rj::Value{"interleave"}, config->json.GetAllocator());
+        config->commandRun.memoryNodes = {0, 1};
+
+        auto bundleDir = createTestBundle(config);
+        runtime::OCIBundleConfig{config}.generateConfigFile();
+
+        auto actualJson = libsarus::json::read(bundleDir.getPath() / "config.json");
+        CHECK_EQUAL(actualJson["linux"]["resources"]["cpu"]["mems"].GetString(), std::string{"0,1"});
+        CHECK_EQUAL(actualJson["linux"]["memoryPolicy"]["mode"].GetString(), std::string{"MPOL_INTERLEAVE"});
+        CHECK_EQUAL(actualJson["linux"]["memoryPolicy"]["nodes"].GetString(), std::string{"0,1"});
+    }
+}
+
+TEST(OCIBundleConfigTestGroup, hugepage_limits) {
+    // no limits
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        auto& config = configRAII.config;
+        setupTestConfig(config);
+        config->commandRun.hugepages = {{2048, 0}};
+
+        auto bundleDir = createTestBundle(config);
+        runtime::OCIBundleConfig{config}.generateConfigFile();
+
+        auto actualJson = libsarus::json::read(bundleDir.getPath() / "config.json");
+        CHECK(!actualJson["linux"]["resources"].HasMember("hugepageLimits"));
+    }
+    // limits
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        auto& config = configRAII.config;
+        setupTestConfig(config);
+        config->commandRun.hugepageLimits = {{2048, 512*2048*1024UL}, {1048576, 4*1048576*1024UL}};
+
+        auto bundleDir = createTestBundle(config);
+        runtime::OCIBundleConfig{config}.generateConfigFile();
+
+        auto actualJson = libsarus::json::read(bundleDir.getPath() / "config.json");
+        const auto& limits = actualJson["linux"]["resources"]["hugepageLimits"];
+        CHECK_EQUAL(limits.Size(), 2u);
+        CHECK_EQUAL(limits[0]["pageSize"].GetString(), std::string{"2MB"});
+        CHECK_EQUAL(limits[0]["limit"].GetUint64(), uint64_t{1073741824});
+        CHECK_EQUAL(limits[1]["pageSize"].GetString(), std::string{"1GB"});
+        CHECK_EQUAL(limits[1]["limit"].GetUint64(), uint64_t{4294967296});
+    }
+}
+
 #ifdef ASROOT
 TEST (OCIBundleConfigTestGroup, allowed_devices)  {
 #else
@@ -0,0 +1,126 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <algorithm>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test_utility/config.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/PersistentContainer.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+using namespace sarus;
+
+TEST_GROUP(PersistentContainerTestGroup) {
+};
+
+TEST(PersistentContainerTestGroup, validate_name) {
+    runtime::PersistentContainer::validateName("container");
+    runtime::PersistentContainer::validateName("job-1234.step_0");
+    CHECK_THROWS(libsarus::Error, runtime::PersistentContainer::validateName(""));
+    CHECK_THROWS(libsarus::Error, runtime::PersistentContainer::validateName("-container"));
+    CHECK_THROWS(libsarus::Error, runtime::PersistentContainer::validateName("../container"));
+    CHECK_THROWS(libsarus::Error, runtime::PersistentContainer::validateName("a/b"));
+    CHECK_THROWS(libsarus::Error, runtime::PersistentContainer::validateName(std::string(129, 'a')));
+}
+
+#ifdef ASROOT
+TEST(PersistentContainerTestGroup, state) {
+#else
+IGNORE_TEST(PersistentContainerTestGroup, state) {
+#endif
+    auto configRAII = test_utility::config::makeConfig();
+    auto container = runtime::PersistentContainer{configRAII.config->userIdentity, "sarus-unittest-persistent"};
+    CHECK_FALSE(container.exists());
+
+    auto state = runtime::PersistentContainer::State{};
+    state.name = container.getName();
+    state.image = "docker.io/library/alpine:latest";
+    state.supervisorPid = getpid();
+    state.creationTime = 1700000000;
+    state.idleTimeout = std::chrono::seconds{60};
+    state.slurmJobID = "1234";
+    container.writeState(state);
+
+    CHECK(container.exists());
+    auto readState = container.readState();
+    CHECK_EQUAL(readState.name, state.name);
+    CHECK_EQUAL(readState.image, state.image);
+    CHECK_EQUAL(readState.supervisorPid, state.supervisorPid);
+    CHECK_EQUAL(readState.creationTime, state.creationTime);
+    CHECK(readState.idleTimeout == state.idleTimeout);
+    CHECK_EQUAL(readState.slurmJobID, state.slurmJobID);
+
+    auto states = runtime::PersistentContainer::list(configRAII.config->userIdentity);
+    auto it = std::find_if(states.cbegin(), states.cend(), [&state](const runtime::PersistentContainer::State& s) {
+        return s.name == state.name;
+    });
+    CHECK(it != states.cend());
+
+    container.removeState();
+    CHECK_FALSE(container.exists());
+}
+
+#ifdef ASROOT
+TEST(PersistentContainerTestGroup, stale_state) {
+#else
+IGNORE_TEST(PersistentContainerTestGroup, stale_state) {
+#endif
+    auto configRAII = test_utility::config::makeConfig();
+    auto container = runtime::PersistentContainer{configRAII.config->userIdentity, "sarus-unittest-stale"};
+
+    // the pid of a reaped child doesn't exist anymore
+    auto pid = fork();
+    if(pid == 0) {
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+
+    auto state = runtime::PersistentContainer::State{};
+    state.name = container.getName();
+    state.supervisorPid = pid;
+    container.writeState(state);
+
+    CHECK_FALSE(container.exists());
+    runtime::PersistentContainer::list(configRAII.config->userIdentity);
+    CHECK_FALSE(boost::filesystem::exists(
+        runtime::PersistentContainer::getStateDirectory(configRAII.config->userIdentity) / (state.name + ".json")));
+}
+
+#ifdef ASROOT
+TEST(PersistentContainerTestGroup, idleness) {
+#else
+IGNORE_TEST(PersistentContainerTestGroup, idleness) {
+#endif
+    auto configRAII = test_utility::config::makeConfig();
+    auto container = runtime::PersistentContainer{configRAII.config->userIdentity, "sarus-unittest-idle"};
+
+    auto state = runtime::PersistentContainer::State{};
+    state.name = container.getName();
+    state.supervisorPid = getpid();
+    container.writeState(state);
+
+    container.recordActivity();
+    CHECK_FALSE(container.isIdle(std::chrono::seconds{60}));
+    CHECK(container.isIdle(std::chrono::seconds{0}));
+
+    // an attached process keeps the container busy
+    {
+        auto lock = container.lockActivity();
+        CHECK_FALSE(container.isIdle(std::chrono::seconds{0}));
+    }
+    CHECK(container.isIdle(std::chrono::seconds{0}));
+
+    container.removeState();
+}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,79 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/PrefetchProfile.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+using namespace sarus;
+
+TEST_GROUP(PrefetchProfileTestGroup) {
+};
+
+TEST(PrefetchProfileTestGroup, make_ranges) {
+    auto residency = std::vector<unsigned char>{1, 1, 0, 1, 0, 0, 1, 1, 1};
+    auto ranges = runtime::PrefetchProfile::makeRanges(residency, 4096, 8 * 4096 + 100);
+    CHECK_EQUAL(ranges.size(), 3);
+    CHECK_EQUAL(ranges[0].offset, 0);
+    CHECK_EQUAL(ranges[0].length, 2 * 4096);
+    CHECK_EQUAL(ranges[1].offset, 3 * 4096);
+    CHECK_EQUAL(ranges[1].length, 4096);
+    // the last page is only partially covered by the file
+    CHECK_EQUAL(ranges[2].offset, 6 * 4096);
+    CHECK_EQUAL(ranges[2].length, 2 * 4096 + 100);
+
+    // only the least significant bit reports the residency of a page
+    CHECK(runtime::PrefetchProfile::makeRanges({0, 2, 0}, 4096, 3 * 4096).empty());
+}
+
+TEST(PrefetchProfileTestGroup, write_and_read) {
+    auto testDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-prefetch-profile")};
+    libsarus::filesystem::createFoldersIfNecessary(testDir.getPath());
+    auto imageFile = testDir.getPath() / "image.squashfs";
+    libsarus::filesystem::writeTextFile(std::string(3 * 4096 + 10, 'i'), imageFile);
+
+    auto fd = open(imageFile.c_str(), O_RDONLY);
+    auto fingerprint = runtime::PrefetchProfile::computeFingerprint(fd);
+    CHECK_EQUAL(fingerprint.imageSize, 3 * 4096 + 10);
+
+    // the image was just written: all of it is in the page cache
+    auto ranges = runtime::PrefetchProfile::getResidentRanges(fd);
+    CHECK_EQUAL(ranges.size(), 1);
+    CHECK_EQUAL(ranges[0].offset, 0);
+    CHECK_EQUAL(ranges[0].length, 3 * 4096 + 10);
+
+    auto profileFile = testDir.getPath() / "image.prefetch";
+    auto files = std::vector<boost::filesystem::path>{"/usr/bin/python3", "/usr/lib/libpython3.so"};
+    runtime::PrefetchProfile{fingerprint, files, ranges}.write(profileFile);
+
+    auto profile = runtime::PrefetchProfile::read(profileFile);
+    CHECK(profile.matches(fingerprint));
+    CHECK(profile.getFiles() == files);
+    CHECK_EQUAL(profile.getRanges().size(), 1);
+    CHECK_EQUAL(profile.getTotalSize(), 3 * 4096 + 10);
+
+    // the profile doesn't match other versions of the image
+    libsarus::filesystem::writeTextFile(std::string(3 * 4096 + 10, 'j'), imageFile);
+    CHECK_FALSE(profile.matches(runtime::PrefetchProfile::computeFingerprint(fd)));
+    libsarus::filesystem::writeTextFile(std::string(4096, 'i'), imageFile);
+    CHECK_FALSE(profile.matches(runtime::PrefetchProfile::computeFingerprint(fd)));
+    close(fd);
+
+    // invalid profile
+    libsarus::filesystem::writeTextFile("{\"files\": []}", profileFile);
+    CHECK_THROWS(libsarus::Error, runtime::PrefetchProfile::read(profileFile));
+}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,137 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <sys/mount.h>
+
+#include <rapidjson/document.h>
+
+#include "test_utility/config.hpp"
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+#include "runtime/WritableLayer.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+namespace rj = rapidjson;
+
+using namespace sarus;
+
+TEST_GROUP(WritableLayerTestGroup) {
+};
+
+static void setWritableLayerInConfig(common::Config& config,
+                                     const std::string& backend,
+                                     int sizeMB = 0,
+                                     const boost::filesystem::path& directory = {}) {
+    auto& allocator = config.json.GetAllocator();
+    auto value = rj::Value{rj::kObjectType};
+    value.AddMember("backend", rj::Value{backend.c_str(), allocator}, allocator);
+    if(sizeMB > 0) {
+        value.AddMember("sizeMB", rj::Value{sizeMB}, allocator);
+    }
+    if(!directory.empty()) {
+        value.AddMember("directory", rj::Value{directory.c_str(), allocator}, allocator);
+    }
+    config.json.AddMember("writableLayer", value, allocator);
+}
+
+TEST(WritableLayerTestGroup, parse_backend) {
+    CHECK(runtime::WritableLayer::parseBackend("ramFilesystem") == runtime::WritableLayer::Backend::ramFilesystem);
+    CHECK(runtime::WritableLayer::parseBackend("tmpfs") == runtime::WritableLayer::Backend::tmpfs);
+    CHECK(runtime::WritableLayer::parseBackend("directory") == runtime::WritableLayer::Backend::directory);
+    CHECK(runtime::WritableLayer::parseBackend("loopFile") == runtime::WritableLayer::Backend::loopFile);
+    CHECK_THROWS(libsarus::Error, runtime::WritableLayer::parseBackend("disk"));
+}
+
+TEST(WritableLayerTestGroup, configuration) {
+    // default
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        runtime::WritableLayer layer{configRAII.config, "/bundle"};
+        CHECK(layer.getBackend() == runtime::WritableLayer::Backend::ramFilesystem);
+        CHECK(!layer.getSizeLimit());
+        CHECK(!layer.isVolatile());
+        CHECK_EQUAL(layer.getOverlayOptions(), std::string{});
+    }
+    // tmpfs with size limit and volatile overlay
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        setWritableLayerInConfig(*configRAII.config, "tmpfs", 512);
+        configRAII.config->json["writableLayer"].AddMember("volatile", true, configRAII.config->json.GetAllocator());
+        runtime::WritableLayer layer{configRAII.config, "/bundle"};
+        CHECK(layer.getBackend() == runtime::WritableLayer::Backend::tmpfs);
+        CHECK_EQUAL(*layer.getSizeLimit(), 512ul * 1024 * 1024);
+        CHECK_EQUAL(layer.getOverlayOptions(), std::string{"volatile"});
+    }
+    // invalid combinations
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        setWritableLayerInConfig(*configRAII.config, "ramFilesystem", 512);
+        CHECK_THROWS(libsarus::Error, runtime::WritableLayer(configRAII.config, "/bundle"));
+    }
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        setWritableLayerInConfig(*configRAII.config, "directory");
+        CHECK_THROWS(libsarus::Error, runtime::WritableLayer(configRAII.config, "/bundle"));
+    }
+    {
+        auto configRAII = test_utility::config::makeConfig();
+        setWritableLayerInConfig(*configRAII.config, "loopFile", 0, "/tmp");
+        CHECK_THROWS(libsarus::Error, runtime::WritableLayer(configRAII.config, "/bundle"));
+    }
+    {
+        // missing mkfsExt4Path
+        auto configRAII = test_utility::config::makeConfig();
+        setWritableLayerInConfig(*configRAII.config, "loopFile", 512, "/tmp");
+        CHECK_THROWS(libsarus::Error, runtime::WritableLayer(configRAII.config, "/bundle"));
+    }
+}
+
+TEST(WritableLayerTestGroup, directory_backend) {
+    auto configRAII = test_utility::config::makeConfig();
+    auto baseDirectory = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-writable-layer")};
+    setWritableLayerInConfig(*configRAII.config, "directory", 0, baseDirectory.getPath());
+
+    runtime::WritableLayer layer{configRAII.config, "/bundle"};
+    layer.setup();
+    CHECK(boost::filesystem::is_directory(layer.getUpperDir()));
+    CHECK(boost::filesystem::is_directory(layer.getWorkDir()));
+    CHECK(layer.getUpperDir().parent_path().parent_path() == baseDirectory.getPath());
+    libsarus::filesystem::createFileIfNecessary(layer.getUpperDir() / "file");
+
+    // the per-container directory is removed when the container exits
+    layer.startMonitoring();
+    layer.finish();
+    CHECK(!boost::filesystem::exists(layer.getUpperDir().parent_path()));
+}
+
+#ifdef ASROOT
+TEST(WritableLayerTestGroup, tmpfs_backend) {
+#else
+IGNORE_TEST(WritableLayerTestGroup, tmpfs_backend) {
+#endif
+    auto configRAII = test_utility::config::makeConfig();
+    setWritableLayerInConfig(*configRAII.config, "tmpfs", 1);
+    auto bundleDir = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix("/tmp/sarus-test-bundle")};
+    libsarus::filesystem::createFoldersIfNecessary(bundleDir.getPath());
+
+    runtime::WritableLayer layer{configRAII.config, bundleDir.getPath()};
+    layer.setup();
+    layer.startMonitoring();
+
+    // the layer is capped at its size limit
+    CHECK(boost::filesystem::space(layer.getUpperDir()).capacity <= 1024 * 1024);
+    libsarus::filesystem::writeTextFile(std::string(512 * 1024, 'x'), layer.getUpperDir() / "file");
+    layer.finish();
+
+    CHECK_EQUAL(umount((bundleDir.getPath() / "overlay/rootfs-layer").c_str()), 0);
+}
+
+SARUS_UNITTEST_MAIN_FUNCTION();
@@ -0,0 +1,274 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "TaskRunner.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/prettywriter.h>
+
+
+extern char** environ;
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace task_runner {
+
+TaskRunner::TaskRunner(std::vector<Task> tasks, std::vector<int> cpus, std::size_t maxRetries)
+    : tasks(std::move(tasks))
+    , cpus(std::move(cpus))
+    , maxRetries{maxRetries}
+{
+    if(this->cpus.empty()) {
+        throw std::invalid_argument("no CPUs available to run the tasks");
+    }
+
+    results.resize(this->tasks.size());
+    for(std::size_t i=0; i<this->tasks.size(); ++i) {
+        results[i].index = this->tasks[i].index;
+        results[i].command = this->tasks[i].command;
+    }
+
+    // contiguous blocks of tasks, so that each worker starts from its own part of the list
+    auto numberOfWorkers = std::min(this->cpus.size(), std::max(this->tasks.size(), std::size_t{1}));
+    for(std::size_t i=0; i<numberOfWorkers; ++i) {
+        workers.emplace_back(new Worker{});
+        workers.back()->cpu = this->cpus[i];
+    }
+    for(std::size_t i=0; i<this->tasks.size(); ++i) {
+        workers[i * numberOfWorkers / this->tasks.size()]->queue.push_back(i);
+    }
+}
+
+/**
+ * One task per line. Empty lines and lines starting with '#' are skipped.
+ */
+std::vector<Task> TaskRunner::parseTaskList(std::istream& is) {
+    auto tasks = std::vector<Task>{};
+    auto line = std::string{};
+    while(std::getline(is, line)) {
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        auto begin = line.find_first_not_of(" \t");
+        if(begin == std::string::npos || line[begin] == '#') {
+            continue;
+        }
+        tasks.push_back(Task{tasks.size(), line.substr(begin)});
+    }
+    return tasks;
+}
+
+/**
+ * Parses a list of CPUs in the format of the "cpus" entry of the OCI bundle's config.json,
+ * e.g. "0,2,4-7".
+ */
+std::vector<int> TaskRunner::parseCpuList(const std::string& list) {
+    auto cpus = std::vector<int>{};
+    std::stringstream ss{list};
+    auto token = std::string{};
+    while(std::getline(ss, token, ',')) {
+        try {
+            auto separator = token.find('-');
+            std::size_t end;
+            auto first = std::stoi(token.substr(0, separator), &end);
+            auto last = first;
+            if(separator != std::string::npos) {
+                if(end != separator) {
+                    throw std::invalid_argument(token);
+                }
+                last = std::stoi(token.substr(separator+1), &end);
+                end += separator+1;
+            }
+            if(end != token.size() || first < 0 || last < first) {
+                throw std::invalid_argument(token);
+            }
+            for(auto cpu=first; cpu<=last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        catch(std::logic_error&) {
+            throw std::invalid_argument("invalid CPU list '" + list + "'");
+        }
+    }
+    return cpus;
+}
+
+void TaskRunner::writeResults(const std::vector<TaskResult>& results, std::ostream& os) {
+    auto json = rj::Document{rj::kObjectType};
+    auto& allocator = json.GetAllocator();
+    auto tasks = rj::Value{rj::kArrayType};
+    for(const auto& result : results) {
+        auto task = rj::Value{rj::kObjectType};
+        task.AddMember("index", rj::Value{static_cast<uint64_t>(result.index)}, allocator);
+        task.AddMember("command", rj::Value{result.command.c_str(), allocator}, allocator);
+        task.AddMember("exitCode", rj::Value{result.exitCode}, allocator);
+        task.AddMember("attempts", rj::Value{static_cast<uint64_t>(result.attempts)}, allocator);
+        task.AddMember("cpu", rj::Value{result.cpu}, allocator);
+        task.AddMember("wallTimeSeconds", rj::Value{result.wallTime}, allocator);
+        tasks.PushBack(task, allocator);
+    }
+    json.AddMember("tasks", tasks, allocator);
+
+    rj::OStreamWrapper osw{os};
+    rj::PrettyWriter<rj::OStreamWrapper> writer{osw};
+    json.Accept(writer);
+    os << std::endl;
+}
+
+std::vector<TaskResult> TaskRunner::run() {
+    auto threads = std::vector<std::thread>{};
+    for(std::size_t i=0; i<workers.size(); ++i) {
+        threads.emplace_back(&TaskRunner::work, this, i);
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
+/**
+ * Forwards the signal to the tasks being executed and doesn't start the other tasks.
+ * Only async-signal-safe operations are performed: this is called by the signal handler
+ * of the program.
+ */
+void TaskRunner::stop(int signal) {
+    stopSignal = signal;
+    isStopRequested = true;
+    for(const auto& worker : workers) {
+        auto pid = worker->taskPid.load();
+        if(pid > 0) {
+            kill(pid, signal);
+        }
+    }
+}
+
+void TaskRunner::work(std::size_t workerIndex) {
+    auto& worker = *workers[workerIndex];
+    auto taskIndex = std::size_t{};
+    while(!isStopRequested && (popOwnTask(worker, taskIndex) || stealTask(workerIndex, taskIndex))) {
+        executeTask(worker, taskIndex);
+    }
+}
+
+bool TaskRunner::popOwnTask(Worker& worker, std::size_t& taskIndex) {
+    std::lock_guard<std::mutex> lock{worker.mutex};
+    if(worker.queue.empty()) {
+        return false;
+    }
+    taskIndex = worker.queue.front();
+    worker.queue.pop_front();
+    return true;
+}
+
+/**
+ * Tasks are only removed from the queues, hence a worker whose steal attempt failed on
+ * all the queues has no more work to do.
+ */
+bool TaskRunner::stealTask(std::size_t thiefIndex, std::size_t& taskIndex) {
+    for(std::size_t i=1; i<workers.size(); ++i) {
+        auto& victim = *workers[(thiefIndex + i) % workers.size()];
+        std::lock_guard<std::mutex> lock{victim.mutex};
+        if(!victim.queue.empty()) {
+            taskIndex = victim.queue.back();
+            victim.queue.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskRunner::executeTask(Worker& worker, std::size_t taskIndex) {
+    // each task is executed by one worker only, hence its result is not shared
+    auto& result = results[taskIndex];
+    result.cpu = worker.cpu;
+    do {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            result.exitCode = executeProcess(worker, tasks[taskIndex]);
+        }
+        catch(std::exception& e) {
+            std::cerr << "task_runner: task " << tasks[taskIndex].index << ": " << e.what() << std::endl;
+            result.exitCode = -1;
+            ++result.attempts;
+            return;
+        }
+        result.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ++result.attempts;
+    } while(result.exitCode != 0 && result.attempts <= maxRetries && !isStopRequested);
+}
+
+int TaskRunner::executeProcess(Worker& worker, const Task& task) const {
+    // prepare everything before the fork: the child of a multi-threaded process
+    // may only call async-signal-safe functions
+    auto indexVariable = "SARUS_TASK_INDEX=" + std::to_string(task.index);
+    auto envp = std::vector<char*>{};
+    for(auto** variable = environ; *variable != nullptr; ++variable) {
+        if(std::strncmp(*variable, "SARUS_TASK_INDEX=", 17) != 0) {
+            envp.push_back(*variable);
+        }
+    }
+    envp.push_back(const_cast<char*>(indexVariable.c_str()));
+    envp.push_back(nullptr);
+    char shell[] = "/bin/sh";
+    char option[] = "-c";
+    char* argv[] = {shell, option, const_cast<char*>(task.command.c_str()), nullptr};
+    auto set = cpu_set_t{};
+    CPU_ZERO(&set);
+    CPU_SET(worker.cpu, &set);
+
+    auto pid = fork();
+    if(pid < 0) {
+        throw std::runtime_error(std::string{"failed to fork task process: "} + std::strerror(errno));
+    }
+    if(pid == 0) {
+        sched_setaffinity(0, sizeof(set), &set);
+        execve(argv[0], argv, envp.data());
+        _exit(127);
+    }
+
+    worker.taskPid = pid;
+    // a stop requested between the fork and the store above didn't see the pid:
+    // forward the signal here (the child might receive it twice, which is harmless)
+    if(isStopRequested) {
+        kill(pid, stopSignal.load());
+    }
+
+    int status;
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) {
+            worker.taskPid = 0;
+            throw std::runtime_error(std::string{"failed to wait for task process: "} + std::strerror(errno));
+        }
+    }
+    worker.taskPid = 0;
+    if(WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+}
+}
@@ -0,0 +1,96 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef sarus_task_runner_TaskRunner_hpp
+#define sarus_task_runner_TaskRunner_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+
+namespace sarus {
+namespace task_runner {
+
+struct Task {
+    std::size_t index;
+    std::string command;
+};
+
+struct TaskResult {
+    std::size_t index = 0;
+    std::string command;
+    int exitCode = -1;        // of the last attempt, 128+N if killed by signal N, -1 if not executed
+    std::size_t attempts = 0;
+    int cpu = -1;
+    double wallTime = 0.0;    // in seconds, of the last attempt
+};
+
+/**
+ * Executes a list of shell command lines ("tasks") inside a single container, as the
+ * program run by "sarus run --task-list".
+ *
+ * There is one worker thread per CPU. The tasks are initially split in contiguous blocks
+ * among the workers. Each worker executes the tasks of its own queue from the front, with
+ * its process pinned to the CPU of the worker, and steals from the back of the queues of
+ * the other workers when its own queue is empty, so that short and long tasks balance out
+ * without a central queue. A failed task is retried up to 'maxRetries' times on the same
+ * worker.
+ *
+ * The runner is executed within the image of the container, which generally has another
+ * C library than the host: it is linked statically and depends on the C++ standard
+ * library and on the (header-only) RapidJSON only.
+ */
+class TaskRunner {
+public:
+    TaskRunner(std::vector<Task> tasks, std::vector<int> cpus, std::size_t maxRetries);
+
+    static std::vector<Task> parseTaskList(std::istream&);
+    static std::vector<int> parseCpuList(const std::string&);
+    static void writeResults(const std::vector<TaskResult>&, std::ostream&);
+
+    std::vector<TaskResult> run();
+    void stop(int signal);
+
+private:
+    struct Worker {
+        int cpu;
+        std::mutex mutex;
+        std::deque<std::size_t> queue;
+        std::atomic<pid_t> taskPid{0};
+    };
+
+private:
+    void work(std::size_t workerIndex);
+    bool popOwnTask(Worker& worker, std::size_t& taskIndex);
+    bool stealTask(std::size_t thiefIndex, std::size_t& taskIndex);
+    void executeTask(Worker& worker, std::size_t taskIndex);
+    int executeProcess(Worker& worker, const Task& task) const;
+
+private:
+    std::vector<Task> tasks;
+    std::vector<int> cpus;
+    std::size_t maxRetries;
+    std::vector<std::unique_ptr<Worker>> workers; // on the heap: the mutexes can't be moved
+    std::vector<TaskResult> results;
+    std::atomic<int> stopSignal{0};
+    std::atomic<bool> isStopRequested{false};
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <getopt.h>
+
+#include "TaskRunner.hpp"
+
+
+using namespace sarus::task_runner;
+
+static TaskRunner* runner = nullptr;
+
+static void stopRunner(int signal) {
+    if(runner != nullptr) {
+        runner->stop(signal);
+    }
+}
+
+static void printUsage() {
+    std::cerr << "Usage: task_runner --cpus LIST [--retries N] TASK_LIST RESULTS_FILE" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    auto cpuList = std::string{};
+    auto maxRetries = std::size_t{0};
+
+    static const option options[] = {
+        {"cpus", required_argument, nullptr, 'c'},
+        {"retries", required_argument, nullptr, 'r'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int opt;
+    while((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch(opt) {
+        case 'c':
+            cpuList = optarg;
+            break;
+        case 'r':
+            maxRetries = std::strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    if(cpuList.empty() || argc - optind != 2) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::ifstream taskList{argv[optind]};
+        if(!taskList) {
+            throw std::runtime_error(std::string{"failed to open task list "} + argv[optind]);
+        }
+        auto tasks = TaskRunner::parseTaskList(taskList);
+        auto numberOfTasks = tasks.size();
+
+        TaskRunner taskRunner{std::move(tasks), TaskRunner::parseCpuList(cpuList), maxRetries};
+        runner = &taskRunner;
+        std::signal(SIGTERM, stopRunner);
+        std::signal(SIGINT, stopRunner);
+        std::signal(SIGHUP, stopRunner);
+
+        auto results = taskRunner.run();
+
+        std::signal(SIGTERM, SIG_DFL);
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGHUP, SIG_DFL);
+        runner = nullptr;
+
+        std::ofstream resultsFile{argv[optind+1], std::ios::trunc};
+        TaskRunner::writeResults(results, resultsFile);
+        if(!resultsFile) {
+            throw std::runtime_error(std::string{"failed to write results file "} + argv[optind+1]);
+        }
+
+        auto numberOfFailures = std::size_t{0};
+        for(const auto& result : results) {
+            numberOfFailures += result.exitCode != 0;
+        }
+        if(numberOfFailures > 0) {
+            std::cerr << "task_runner: " << numberOfFailures << " of " << numberOfTasks
+                      << " tasks failed or were not executed" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    catch(const std::exception& e) {
+        std::cerr << "task_runner: error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
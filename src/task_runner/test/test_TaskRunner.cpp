@@ -0,0 +1,142 @@
+/*
+ * Sarus
+ *
+ * Copyright (c) 2018-2023, ETH Zurich. All rights reserved.
+ *
+ * Please, refer to the LICENSE file in the root directory.
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include <rapidjson/document.h>
+
+#include "libsarus/PathRAII.hpp"
+#include "libsarus/Utility.hpp"
+#include "task_runner/TaskRunner.hpp"
+#include "test_utility/unittest_main_function.hpp"
+
+
+namespace rj = rapidjson;
+
+namespace sarus {
+namespace task_runner {
+namespace test {
+
+TEST_GROUP(TaskRunnerTestGroup) {
+};
+
+static std::vector<Task> makeTasks(const std::string& list) {
+    std::stringstream ss{list};
+    return TaskRunner::parseTaskList(ss);
+}
+
+TEST(TaskRunnerTestGroup, parseTaskList) {
+    auto tasks = makeTasks("echo 0\n"
+                           "\n"
+                           "# comment\n"
+                           "  echo 1 && echo 2\r\n"
+                           "\t\n"
+                           "echo 3");
+    CHECK_EQUAL(tasks.size(), 3);
+    CHECK_EQUAL(tasks[0].index, 0);
+    CHECK_EQUAL(tasks[0].command, std::string{"echo 0"});
+    CHECK_EQUAL(tasks[1].index, 1);
+    CHECK_EQUAL(tasks[1].command, std::string{"echo 1 && echo 2"});
+    CHECK_EQUAL(tasks[2].index, 2);
+    CHECK_EQUAL(tasks[2].command, std::string{"echo 3"});
+}
+
+TEST(TaskRunnerTestGroup, parseCpuList) {
+    CHECK(TaskRunner::parseCpuList("3") == std::vector<int>({3}));
+    CHECK(TaskRunner::parseCpuList("0,2,4-7") == std::vector<int>({0, 2, 4, 5, 6, 7}));
+    CHECK_THROWS(std::invalid_argument, TaskRunner::parseCpuList("a"));
+    CHECK_THROWS(std::invalid_argument, TaskRunner::parseCpuList("1-"));
+    CHECK_THROWS(std::invalid_argument, TaskRunner::parseCpuList("3-1"));
+    CHECK_THROWS(std::invalid_argument, TaskRunner::parseCpuList("1x"));
+    CHECK_THROWS(std::invalid_argument, TaskRunner(std::vector<Task>{}, std::vector<int>{}, 0));
+}
+
+TEST(TaskRunnerTestGroup, run) {
+    auto cpus = libsarus::process::getCpuAffinity();
+    auto tasks = makeTasks("true\n"
+                           "exit 3\n"
+                           "kill -9 $$\n"
+                           "test \"$SARUS_TASK_INDEX\" = 3\n");
+    for(std::size_t i=0; i<50; ++i) {
+        tasks.push_back(Task{tasks.size(), "true"});
+    }
+
+    auto results = TaskRunner{tasks, cpus, 0}.run();
+
+    CHECK_EQUAL(results.size(), tasks.size());
+    CHECK_EQUAL(results[0].exitCode, 0);
+    CHECK_EQUAL(results[1].exitCode, 3);
+    CHECK_EQUAL(results[2].exitCode, 128 + 9);
+    CHECK_EQUAL(results[3].exitCode, 0);
+    for(std::size_t i=0; i<results.size(); ++i) {
+        CHECK_EQUAL(results[i].index, i);
+        CHECK_EQUAL(results[i].command, tasks[i].command);
+        CHECK_EQUAL(results[i].attempts, 1);
+        CHECK(std::find(cpus.cbegin(), cpus.cend(), results[i].cpu) != cpus.cend());
+        CHECK(results[i].wallTime >= 0.0);
+    }
+}
+
+TEST(TaskRunnerTestGroup, pinning) {
+    auto cpus = libsarus::process::getCpuAffinity();
+    auto tasks = std::vector<Task>{};
+    for(std::size_t i=0; i<cpus.size(); ++i) {
+        tasks.push_back(Task{i, "grep -q '^Cpus_allowed_list:[[:space:]]*[0-9]*$' /proc/self/status"});
+    }
+
+    auto results = TaskRunner{tasks, cpus, 0}.run();
+
+    for(const auto& result : results) {
+        CHECK_EQUAL(result.exitCode, 0);
+    }
+}
+
+TEST(TaskRunnerTestGroup, retries) {
+    auto counterFile = libsarus::PathRAII{libsarus::filesystem::makeUniquePathWithRandomSuffix(boost::filesystem::absolute("test-task-runner-counter"))};
+    auto tasks = makeTasks("echo x >>" + counterFile.getPath().string() + "; test $(wc -l <" + counterFile.getPath().string() + ") -ge 3\n"
+                           "false\n");
+
+    auto results = TaskRunner{tasks, {libsarus::process::getCpuAffinity().front()}, 2}.run();
+
+    CHECK_EQUAL(results[0].exitCode, 0);
+    CHECK_EQUAL(results[0].attempts, 3);
+    CHECK_EQUAL(results[1].exitCode, 1);
+    CHECK_EQUAL(results[1].attempts, 3);
+}
+
+TEST(TaskRunnerTestGroup, writeResults) {
+    auto result = TaskResult{};
+    result.index = 7;
+    result.command = "echo \"7\"";
+    result.exitCode = 2;
+    result.attempts = 1;
+    result.cpu = 5;
+    result.wallTime = 0.25;
+
+    std::stringstream os;
+    TaskRunner::writeResults({result}, os);
+
+    auto json = rj::Document{};
+    json.Parse(os.str().c_str());
+    CHECK(!json.HasParseError());
+    const auto& task = json["tasks"][0];
+    CHECK_EQUAL(task["index"].GetUint64(), 7);
+    CHECK_EQUAL(task["command"].GetString(), std::string{"echo \"7\""});
+    CHECK_EQUAL(task["exitCode"].GetInt(), 2);
+    CHECK_EQUAL(task["attempts"].GetUint64(), 1);
+    CHECK_EQUAL(task["cpu"].GetInt(), 5);
+    DOUBLES_EQUAL(task["wallTimeSeconds"].GetDouble(), 0.25, 1e-9);
+}
+
+}}}
+
+SARUS_UNITTEST_MAIN_FUNCTION();